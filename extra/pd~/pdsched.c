@@ -21,6 +21,11 @@ outputs audio and messages. */
 
 #include "binarymsg.c"
 
+#ifdef __linux__
+#define PDSHM
+#include "pdshm.c"
+#endif
+
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
      || defined(__GNU__)
 void glob_watchdog(t_pd *dummy);
@@ -81,6 +86,125 @@ static int readbinmessage(t_binbuf *b)
     }
 }
 
+    /* send a message from the super-process to its receiver */
+static void sched_dispatch(int n, t_atom *ap)
+{
+    t_pd *whom = ap[0].a_w.w_symbol->s_thing;
+    if (!whom)
+        error("%s: no such object", ap[0].a_w.w_symbol->s_name);
+    else if (ap[1].a_type == A_SYMBOL)
+        typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
+    else pd_list(whom, 0, n-1, ap+1);
+}
+
+#ifdef PDSHM
+    /* shared memory transport (see pdshm.c).  "stdout" objects send us their
+    messages through "#pd_tilde_shm" and we put them in the ring. */
+static t_pdshm *sched_shm;
+
+static void sched_shm_anything(t_pd *dummy, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    if (!pdshm_putmessage(sched_shm, &sched_shm->s_toparent, s, argc, argv))
+        fprintf(stderr, "pd-extern: output buffer full\n");
+}
+
+static int sched_shm_run(int fd, t_binbuf *b, int chin, int chout)
+{
+    t_pdshm *s;
+    t_class *shm_class;
+    uint32_t size, seq = 0;
+    pid_t parent = getppid();
+    int nin, nout;
+    if ((s = (t_pdshm *)mmap(0, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0))
+        == MAP_FAILED)
+            goto fail;
+    size = (pdshm_load(&s->s_magic) == PDSHM_MAGIC ? s->s_size : 0);
+    munmap(s, sizeof(*s));
+    if (!size || (s = (t_pdshm *)mmap(0, size, PROT_READ|PROT_WRITE,
+        MAP_SHARED, fd, 0)) == MAP_FAILED)
+            goto fail;
+    close(fd);
+    sched_shm = s;
+    shm_class = class_new(gensym("pd~-shm"), 0, 0, sizeof(t_pd), CLASS_PD, 0);
+    class_addanything(shm_class, sched_shm_anything);
+    pd_bind(pd_new(shm_class), gensym("#pd_tilde_shm"));
+    nin = (chin < (int)s->s_ninsig ? chin : (int)s->s_ninsig);
+    nout = (chout < (int)s->s_noutsig ? chout : (int)s->s_noutsig);
+    while (1)
+    {
+        uint32_t slot = seq % s->s_nslots, nframes, onset, msgend;
+        t_pdshmslot *in = pdshm_slot(s, slot, 0), *out = pdshm_slot(s, slot, 1);
+        t_atom at;
+        while (pdshm_wait(&s->s_parentseq, &s->s_childwaiting, seq, 1000)
+            == seq)
+                if (pdshm_load(&s->s_quit) || getppid() != parent)
+                    goto done;
+        if (pdshm_load(&s->s_quit))
+            goto done;
+            /* messages that came before this block */
+        msgend = pdshm_load(&in->sl_msgend);
+        binbuf_clear(b);
+        while (pdshm_getatom(s, &s->s_tochild, msgend, &at))
+        {
+            if (at.a_type != A_SEMI)
+                binbuf_add(b, 1, &at);
+            else
+            {
+                if (binbuf_getnatom(b) > 1 &&
+                    binbuf_getvec(b)[0].a_type == A_SYMBOL)
+                        sched_dispatch(binbuf_getnatom(b), binbuf_getvec(b));
+                binbuf_clear(b);
+            }
+        }
+        nframes = in->sl_nframes;
+        if (nframes > s->s_maxframes)
+            nframes = s->s_maxframes;
+        for (onset = 0; onset < nframes; onset += DEFDACBLKSIZE)
+        {
+            int i, chan;
+            t_sample *fp;
+            for (chan = 0, fp = STUFF->st_soundin; chan < nin; chan++)
+            {
+                float *ip = pdshm_insig(s, slot, chan) + onset;
+                for (i = 0; i < DEFDACBLKSIZE; i++)
+                    *fp++ = *ip++;
+            }
+            for (; chan < chin; chan++)
+                for (i = 0; i < DEFDACBLKSIZE; i++)
+                    *fp++ = 0;
+            sched_tick();
+            resettmpbytes();
+            sys_pollgui();
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
+     || defined(__GNU__)
+            pollwatchdog();
+#endif
+            for (chan = 0, fp = STUFF->st_soundout; chan < nout; chan++)
+            {
+                float *op = pdshm_outsig(s, slot, chan) + onset;
+                for (i = 0; i < DEFDACBLKSIZE; i++)
+                    *op++ = *fp, *fp++ = 0;
+            }
+            for (; chan < chout; chan++)
+                for (i = 0; i < DEFDACBLKSIZE; i++)
+                    *fp++ = 0;
+        }
+        out->sl_nframes = nframes;
+        pdshm_store(&out->sl_msgend, s->s_toparent.r_head);
+        pdshm_post(&s->s_childseq, &s->s_parentwaiting);
+        seq++;
+    }
+done:
+    munmap(s, size);
+    return (0);
+fail:
+    fprintf(stderr, "pd-extern: can't map shared memory: %s\n",
+        strerror(errno));
+    return (1);
+}
+#endif /* PDSHM */
+
 int pd_extern_sched(char *flags)
 {
     int naudioindev, audioindev[MAXAUDIOINDEV], chindev[MAXAUDIOINDEV];
@@ -116,8 +240,19 @@ int pd_extern_sched(char *flags)
     }
     /* fprintf(stderr, "Pd plug-in scheduler called, chans %d %d, sr %d\n",
         chin, chout, (int)rate); */
+        /* pd~ exchanges audio 64 samples at a time, whatever the
+        super-process's block size */
+    sys_setschedblocksize(DEFDACBLKSIZE);
     sys_setchsr(chin, chout, rate);
     sys_audioapi = API_NONE;
+#ifdef PDSHM
+    if (flags && flags[0] == 's')
+    {
+        int ret = sched_shm_run(atoi(flags+1), b, chin, chout);
+        binbuf_free(b);
+        return (ret);
+    }
+#endif
     while (useascii ? readasciimessage(b) : readbinmessage(b) )
     {
         t_atom *ap = binbuf_getvec(b);
@@ -134,6 +269,7 @@ int pd_extern_sched(char *flags)
                 for (j = 0; j < DEFDACBLKSIZE; j++)
                     *fp++ = 0;
             sched_tick();
+            resettmpbytes();
             sys_pollgui();
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
      || defined(__GNU__)
@@ -156,14 +292,7 @@ int pd_extern_sched(char *flags)
             fflush(stdout);
         }
         else if (n > 1 && ap[0].a_type == A_SYMBOL)
-        {
-            t_pd *whom = ap[0].a_w.w_symbol->s_thing;
-            if (!whom)
-                error("%s: no such object", ap[0].a_w.w_symbol->s_name);
-            else if (ap[1].a_type == A_SYMBOL)
-                typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
-            else pd_list(whom, 0, n-1, ap+1);
-        }
+            sched_dispatch(n, ap);
     }
     binbuf_free(b);
     return (0);
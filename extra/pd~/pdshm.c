@@ -0,0 +1,228 @@
+/* Copyright 2008 Miller Puckette.  Berkeley license; see the
+file LICENSE.txt in this distribution. */
+
+/* Shared memory transport between pd~ and its sub-process, included by both
+pd~.c and pdsched.c (Linux only).  Instead of writing every sample through
+the pipes, pd~ makes a "memfd" holding a header, two message rings, and
+"nslots" audio slots, and passes its file descriptor to the sub-process as
+"-extraflags s<fd>".  Each side counts the blocks it has handed over
+(s_parentseq, s_childseq) and sleeps on the other's counter with a futex.
+
+Block number n goes through slot n % nslots.  The parent primes the
+sub-process with "fifo" silent blocks so that it runs that many blocks ahead,
+as with the pipes; nslots is fifo+1 so that neither side ever touches a slot
+the other is using.  Messages are written into the rings in the binary
+format of binarymsg.c.  Each slot records how far into the ring the messages
+belonging to that block go, so messages stay in order with the audio. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#define PDSHM_MAGIC 0x7064317e      /* "~1dp" */
+#define PDSHM_RINGSIZE 65536        /* bytes in each message ring */
+#define PDSHM_MAXFRAMES 1024        /* longest block; longer ones are split */
+#define PDSHM_SPIN 4000             /* polls before going to sleep */
+
+static int pdshm_nspin = -1;        /* PDSHM_SPIN, or 0 on one CPU */
+
+typedef struct _pdshmring
+{
+    uint32_t r_head;                /* number of bytes ever written */
+    uint32_t r_tail;                /* number of bytes ever read */
+} t_pdshmring;
+
+typedef struct _pdshmslot
+{
+    uint32_t sl_nframes;            /* frames in this block */
+    uint32_t sl_msgend;             /* ring position after its messages */
+} t_pdshmslot;
+
+typedef struct _pdshm
+{
+    uint32_t s_magic;
+    uint32_t s_size;                /* bytes in the whole mapping */
+    uint32_t s_ninsig;
+    uint32_t s_noutsig;
+    uint32_t s_maxframes;
+    uint32_t s_nslots;
+    uint32_t s_parentseq;           /* blocks the parent has handed over */
+    uint32_t s_childseq;            /* blocks the child has finished */
+    uint32_t s_parentwaiting;       /* nonzero if asleep on s_childseq */
+    uint32_t s_childwaiting;        /* nonzero if asleep on s_parentseq */
+    uint32_t s_quit;                /* parent wants the child to exit */
+    t_pdshmring s_tochild;
+    t_pdshmring s_toparent;
+} t_pdshm;
+
+    /* after the header come the two rings, then "nslots" input and output
+    slot headers, then the input and output samples for each slot */
+#define PDSHM_HEADERSIZE ((sizeof(t_pdshm) + 63) & ~63)
+
+static char *pdshm_ringbuf(t_pdshm *s, t_pdshmring *r)
+{
+    return ((char *)s + PDSHM_HEADERSIZE +
+        (r == &s->s_toparent ? PDSHM_RINGSIZE : 0));
+}
+
+static t_pdshmslot *pdshm_slot(t_pdshm *s, uint32_t slot, int out)
+{
+    return ((t_pdshmslot *)((char *)s + PDSHM_HEADERSIZE +
+        2 * PDSHM_RINGSIZE) + 2 * slot + out);
+}
+
+static float *pdshm_insig(t_pdshm *s, uint32_t slot, uint32_t chan)
+{
+    float *base = (float *)((char *)s + PDSHM_HEADERSIZE +
+        2 * PDSHM_RINGSIZE + 2 * s->s_nslots * sizeof(t_pdshmslot));
+    return (base + (slot * s->s_ninsig + chan) * s->s_maxframes);
+}
+
+static float *pdshm_outsig(t_pdshm *s, uint32_t slot, uint32_t chan)
+{
+    return (pdshm_insig(s, s->s_nslots, 0) +
+        (slot * s->s_noutsig + chan) * s->s_maxframes);
+}
+
+static uint32_t pdshm_load(uint32_t *p)
+{
+    return (__atomic_load_n(p, __ATOMIC_ACQUIRE));
+}
+
+static void pdshm_store(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+    /* bump a counter and wake the other side if it is asleep on it.  The
+    sequentially consistent store and load pair with the ones in
+    pdshm_wait() so that one side or the other always sees the change. */
+static void pdshm_post(uint32_t *seq, uint32_t *waiting)
+{
+    __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, seq, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+    /* wait up to "msec" milliseconds for "*seq" to differ from "old";
+    return its new value (which is "old" on timeout).  We poll for a while
+    first since the other side is usually about to answer, unless there's
+    only one CPU, in which case polling just keeps it from running. */
+static uint32_t pdshm_wait(uint32_t *seq, uint32_t *waiting, uint32_t old,
+    int msec)
+{
+    uint32_t now;
+    int i;
+    struct timespec ts;
+    if (pdshm_nspin < 0)
+        pdshm_nspin = (sysconf(_SC_NPROCESSORS_ONLN) > 1 ? PDSHM_SPIN : 0);
+    for (i = 0; i < pdshm_nspin; i++)
+    {
+        if ((now = pdshm_load(seq)) != old)
+            return (now);
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000;
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if ((now = __atomic_load_n(seq, __ATOMIC_SEQ_CST)) == old)
+    {
+        syscall(SYS_futex, seq, FUTEX_WAIT, old, &ts, 0, 0);
+        now = pdshm_load(seq);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+    return (now);
+}
+
+    /* append a message (selector, atoms, semicolon) to a ring.  It goes in
+    whole or not at all; returns 0 if the ring is too full. */
+static int pdshm_putmessage(t_pdshm *s, t_pdshmring *r, t_symbol *sel,
+    int argc, const t_atom *argv)
+{
+    char *buf = pdshm_ringbuf(s, r);
+    uint32_t head = r->r_head, tail = pdshm_load(&r->r_tail), pos = head;
+    int i;
+    const char *sp;
+#define PDSHM_PUT(c) \
+    { if (pos - tail >= PDSHM_RINGSIZE) return (0); \
+        buf[pos++ & (PDSHM_RINGSIZE-1)] = (c); }
+    PDSHM_PUT(A_PDSYMBOL);
+    for (sp = sel->s_name; *sp; sp++)
+        PDSHM_PUT(*sp);
+    PDSHM_PUT(0);
+    for (i = 0; i < argc; i++)
+    {
+        if (argv[i].a_type == A_FLOAT)
+        {
+            float f = argv[i].a_w.w_float;
+            unsigned char *fp = (unsigned char *)&f;
+            PDSHM_PUT(A_PDFLOAT);
+            for (sp = (char *)fp; sp < (char *)fp + sizeof(f); sp++)
+                PDSHM_PUT(*sp);
+        }
+        else if (argv[i].a_type == A_SYMBOL)
+        {
+            PDSHM_PUT(A_PDSYMBOL);
+            for (sp = argv[i].a_w.w_symbol->s_name; *sp; sp++)
+                PDSHM_PUT(*sp);
+            PDSHM_PUT(0);
+        }
+    }
+    PDSHM_PUT(A_PDSEMI);
+#undef PDSHM_PUT
+    pdshm_store(&r->r_head, pos);
+    return (1);
+}
+
+    /* read an atom from the ring, not going past "end"; 0 if none left */
+static int pdshm_getatom(t_pdshm *s, t_pdshmring *r, uint32_t end,
+    t_atom *ap)
+{
+    char *buf = pdshm_ringbuf(s, r), sbuf[MAXPDSTRING];
+    uint32_t pos = r->r_tail;
+    int fill;
+    float f;
+    while (pos != end)
+    {
+        switch (buf[pos++ & (PDSHM_RINGSIZE-1)])
+        {
+        case A_PDSEMI:
+            SETSEMI(ap);
+            goto done;
+        case A_PDFLOAT:
+            for (fill = 0; fill < (int)sizeof(f) && pos != end; fill++)
+                ((char *)&f)[fill] = buf[pos++ & (PDSHM_RINGSIZE-1)];
+            SETFLOAT(ap, f);
+            goto done;
+        case A_PDSYMBOL:
+            for (fill = 0; pos != end; fill++)
+            {
+                char c = buf[pos++ & (PDSHM_RINGSIZE-1)];
+                if (fill < MAXPDSTRING-1)
+                    sbuf[fill] = c;
+                if (!c)
+                    break;
+            }
+            sbuf[fill < MAXPDSTRING-1 ? fill : MAXPDSTRING-1] = 0;
+            SETSYMBOL(ap, gensym(sbuf));
+            goto done;
+        }
+    }
+    pdshm_store(&r->r_tail, pos);
+    return (0);
+done:
+    pdshm_store(&r->r_tail, pos);
+    return (1);
+}
@@ -126,6 +126,33 @@ static const char *pd_tilde_dllextent[] = {
 
 #include "binarymsg.c"
 
+#if defined(PD) && defined(__linux__)
+#define PDSHM
+#include "pdshm.c"
+
+    /* only the parent lays out the shared memory; the sub-process reads
+    the layout from the header */
+static uint32_t pdshm_size(int ninsig, int noutsig, int maxframes,
+    int nslots)
+{
+    return ((uint32_t)(PDSHM_HEADERSIZE + 2 * PDSHM_RINGSIZE +
+        2 * nslots * sizeof(t_pdshmslot) +
+            (size_t)nslots * (ninsig + noutsig) * maxframes * sizeof(float)));
+}
+
+static void pdshm_init(t_pdshm *s, uint32_t size, int ninsig, int noutsig,
+    int maxframes, int nslots)
+{
+    memset(s, 0, PDSHM_HEADERSIZE);
+    s->s_size = size;
+    s->s_ninsig = ninsig;
+    s->s_noutsig = noutsig;
+    s->s_maxframes = maxframes;
+    s->s_nslots = nslots;
+    __atomic_store_n(&s->s_magic, PDSHM_MAGIC, __ATOMIC_RELEASE);
+}
+#endif
+
 /* ------------------------ pd_tilde~ ----------------------------- */
 
 #define MSGBUFSIZE 65536
@@ -153,6 +180,10 @@ typedef struct _pd_tilde
     int x_noutsig;
     int x_fifo;
     int x_binary;
+    int x_useshm;               /* use shared memory instead of pipes */
+#ifdef PDSHM
+    t_pdshm *x_shm;             /* shared memory if running with it */
+#endif
     t_float x_sr;
     t_symbol *x_pddir;
     t_symbol *x_schedlibdir;
@@ -437,6 +468,13 @@ static void pd_tilde_close(t_pd_tilde *x)
 #endif
     FILE *infd = x->x_infd, *outfd = x->x_outfd;
     x->x_infd = x->x_outfd = 0;
+#ifdef PDSHM
+    if (x->x_shm)   /* ask the sub-process to quit */
+    {
+        pdshm_store(&x->x_shm->s_quit, 1);
+        pdshm_post(&x->x_shm->s_parentseq, &x->x_shm->s_childwaiting);
+    }
+#endif
     if (outfd)
         fclose(outfd);
     if (infd)
@@ -446,6 +484,13 @@ static void pd_tilde_close(t_pd_tilde *x)
         _cwait(&termstat, x->x_childpid, WAIT_CHILD);
 #else
         waitpid(x->x_childpid, 0, 0);
+#endif
+#ifdef PDSHM
+    if (x->x_shm)
+    {
+        munmap(x->x_shm, x->x_shm->s_size);
+        x->x_shm = 0;
+    }
 #endif
     binbuf_clear(x->x_binbuf);
     x->x_infd = x->x_outfd = 0;
@@ -527,12 +572,12 @@ static void pd_tilde_dostart(t_pd_tilde *x, const char *pddir,
     const char *schedlibdir, const char *patchdir_c, int argc, t_atom *argv,
     int ninsig, int noutsig, int fifo, t_float samplerate)
 {
-    int i, pid, pipe1[2], pipe2[2];
+    int i, pid, pipe1[2], pipe2[2], shmfd = -1;
     FILE *infd, *outfd;
     char cmdbuf[MAXPDSTRING], pdexecbuf[MAXPDSTRING], schedbuf[MAXPDSTRING],
         tmpbuf[MAXPDSTRING], patchdir[MAXPDSTRING];
     char *execargv[FIXEDARG+MAXARG+1], ninsigstr[20], noutsigstr[20],
-        sampleratestr[40];
+        sampleratestr[40], flagstr[20];
     const char**dllextent;
     struct stat statbuf;
     x->x_childpid = -1;
@@ -606,7 +651,8 @@ gotone:
     execargv[1] = "-schedlib";
     execargv[2] = schedbuf;
     execargv[3] = "-extraflags";
-    execargv[4] = (x->x_binary ? "b" : "a");
+    strcpy(flagstr, (x->x_binary ? "b" : "a"));
+    execargv[4] = flagstr;
     execargv[5] = "-path";
     execargv[6] = patchdir;
     execargv[7] = "-inchannels";
@@ -672,6 +718,30 @@ gotone:
         PDERROR "pd~: can't create pipe");
         goto fail2;
     }
+#ifdef PDSHM
+    if (x->x_useshm)
+    {
+            /* the sub-process runs "fifo" blocks ahead, so we give it
+            that many silent ones to begin with */
+        int nslots = (fifo > 0 ? fifo : 0) + 1;
+        uint32_t size = pdshm_size(ninsig, noutsig, PDSHM_MAXFRAMES, nslots);
+        t_pdshm *shm;
+        if ((shmfd = (int)syscall(SYS_memfd_create, "pd~", MFD_CLOEXEC)) < 0
+            || ftruncate(shmfd, size) < 0 ||
+            (shm = (t_pdshm *)mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                shmfd, 0)) == MAP_FAILED)
+        {
+            PDERROR "pd~: can't make shared memory: %s", strerror(errno));
+            goto fail3;
+        }
+        pdshm_init(shm, size, ninsig, noutsig, PDSHM_MAXFRAMES, nslots);
+        for (i = 0; i < nslots - 1; i++)
+            pdshm_slot(shm, i, 0)->sl_nframes = DEFDACBLKSIZE;
+        shm->s_parentseq = nslots - 1;
+        x->x_shm = shm;
+        sprintf(flagstr, "s%d", shmfd);
+    }
+#endif
 #ifdef _WIN32
     {
         int stdinwas = _dup(0), stdoutwas = _dup(1);
@@ -720,6 +790,8 @@ gotone:
             close(pipe1[1]);
         if (pipe2[0] >= 2)
             close(pipe2[0]);
+        if (shmfd >= 0)     /* let the sub-process have the shared memory */
+            fcntl(shmfd, F_SETFD, 0);
         execv(cmdbuf, execargv);
         _exit(1);
     }
@@ -730,6 +802,8 @@ gotone:
         /* done with fork/exec or spawn; parent continues here */
     close(pipe1[0]);
     close(pipe2[1]);
+    if (shmfd >= 0)
+        close(shmfd);
 #ifndef _WIN32      /* this was done in windows via the O_NOINHERIT flag */
     fcntl(pipe1[1],  F_SETFD, FD_CLOEXEC);
     fcntl(pipe2[0],  F_SETFD, FD_CLOEXEC);
@@ -737,23 +811,37 @@ gotone:
     outfd = fdopen(pipe1[1], "w");
     infd = fdopen(pipe2[0], "r");
     x->x_childpid = pid;
-    for (i = 0; i < fifo; i++)
-        if (x->x_binary)
+    binbuf_clear(x->x_binbuf);
+#ifdef PDSHM
+    if (!x->x_shm)
+#endif
     {
-        pd_tilde_putsemi(outfd);
-        pd_tilde_putfloat(0, outfd);
-        pd_tilde_putsemi(outfd);
-    }
-    else fprintf(outfd, "%s", ";\n0;\n");
+        for (i = 0; i < fifo; i++)
+            if (x->x_binary)
+        {
+            pd_tilde_putsemi(outfd);
+            pd_tilde_putfloat(0, outfd);
+            pd_tilde_putsemi(outfd);
+        }
+        else fprintf(outfd, "%s", ";\n0;\n");
 
-    fflush(outfd);
-    binbuf_clear(x->x_binbuf);
-    pd_tilde_readmessages(x, infd);
+        fflush(outfd);
+        pd_tilde_readmessages(x, infd);
+    }
     x->x_outfd = outfd;
     x->x_infd = infd;
     return;
 #ifndef _WIN32
 fail3:
+#ifdef PDSHM
+    if (x->x_shm)
+    {
+        munmap(x->x_shm, x->x_shm->s_size);
+        x->x_shm = 0;
+    }
+    if (shmfd >= 0)
+        close(shmfd);
+#endif
     close(pipe2[0]);
     close(pipe2[1]);
     if (x->x_childpid > 0)
@@ -789,12 +877,12 @@ void pd_empty(int infd)
 
 static int nperfed = 0;
 
-static void pd_tilde_doperf(t_pd_tilde *x)
+    /* exchange "n" (at most DEFDACBLKSIZE) samples starting at "onset" with
+    the sub-process through the pipes */
+static void pd_tilde_pipeperf(t_pd_tilde *x, int onset, int n)
 {
-    int n = x->x_blksize, i, j, nsigs, numbuffill = 0, c;
+    int i, j, nsigs, numbuffill = 0, c;
     char numbuf[80];
-    if (n > DEFDACBLKSIZE)
-        n = DEFDACBLKSIZE;
 #ifdef MAX
     critical_enter(0);
 #endif
@@ -807,7 +895,7 @@ static void pd_tilde_doperf(t_pd_tilde *x)
             pd_tilde_putfloat(0, x->x_outfd);
         else for (i = 0; i < x->x_ninsig; i++)
         {
-            t_pdsample *fp = x->x_insig[i];
+            t_pdsample *fp = x->x_insig[i] + onset;
             for (j = 0; j < n; j++)
                 pd_tilde_putfloat(*fp++, x->x_outfd);
             for (; j < DEFDACBLKSIZE; j++)
@@ -822,7 +910,7 @@ static void pd_tilde_doperf(t_pd_tilde *x)
             fprintf(x->x_outfd, "0\n");
         else for (i = 0; i < x->x_ninsig; i++)
         {
-            t_pdsample *fp = x->x_insig[i];
+            t_pdsample *fp = x->x_insig[i] + onset;
             for (j = 0; j < n; j++)
                 fprintf(x->x_outfd, "%g\n", *fp++);
             for (; j < DEFDACBLKSIZE; j++)
@@ -849,8 +937,8 @@ static void pd_tilde_doperf(t_pd_tilde *x)
                 break;
             else if (at.a_type == A_FLOAT)
             {
-                if (nsigs < x->x_noutsig)
-                    x->x_outsig[nsigs][j] = at.a_w.w_float;
+                if (nsigs < x->x_noutsig && j < n)
+                    x->x_outsig[nsigs][onset + j] = at.a_w.w_float;
                 if (++j >= DEFDACBLKSIZE)
                     j = 0, nsigs++;
             }
@@ -889,8 +977,8 @@ static void pd_tilde_doperf(t_pd_tilde *x)
                         if (sscanf(numbuf, "%lf", &z) < 1)
 #endif
                             continue;
-                        if (nsigs < x->x_noutsig)
-                            x->x_outsig[nsigs][j] = z;
+                        if (nsigs < x->x_noutsig && j < n)
+                            x->x_outsig[nsigs][onset + j] = z;
                         if (++j >= DEFDACBLKSIZE)
                             j = 0, nsigs++;
                     }
@@ -907,8 +995,8 @@ static void pd_tilde_doperf(t_pd_tilde *x)
         post("pd~: short audio signals (sigs %d, fragment %d)", nsigs, j);
     for (; nsigs < x->x_noutsig; nsigs++, j = 0)
     {
-        for (; j < x->x_blksize; j++)
-            x->x_outsig[nsigs][j] = 0;
+        for (; j < n; j++)
+            x->x_outsig[nsigs][onset + j] = 0;
     }
     if (!pd_tilde_readmessages(x, x->x_infd))
     {
@@ -927,8 +1015,108 @@ zeroit:
 #endif
     for (i = 0; i < x->x_noutsig; i++)
     {
-        for (j = 0; j < x->x_blksize; j++)
-            x->x_outsig[i][j] = 0;
+        for (j = 0; j < n; j++)
+            x->x_outsig[i][onset + j] = 0;
+    }
+}
+
+#ifdef PDSHM
+    /* wait for the sub-process to have finished "want" blocks; returns 0 if
+    it went away instead */
+static int pd_tilde_shmwait(t_pd_tilde *x, uint32_t want)
+{
+    t_pdshm *s = x->x_shm;
+    uint32_t now = pdshm_load(&s->s_childseq);
+    while ((int32_t)(now - want) < 0)
+    {
+        uint32_t was = now;
+        if ((now = pdshm_wait(&s->s_childseq, &s->s_parentwaiting, was,
+            1000)) == was && waitpid(x->x_childpid, 0, WNOHANG) != 0)
+        {
+            x->x_childpid = -1;
+            return (0);
+        }
+    }
+    return (1);
+}
+
+    /* exchange a block with the sub-process through shared memory, in
+    pieces of at most s_maxframes */
+static void pd_tilde_shmperf(t_pd_tilde *x)
+{
+    t_pdshm *s = x->x_shm;
+    int n = x->x_blksize, onset, chunk, i, j, gotmess = 0;
+    uint32_t fifo = s->s_nslots - 1;
+    for (onset = 0; onset < n; onset += chunk)
+    {
+        uint32_t seq = s->s_parentseq, slot = seq % s->s_nslots, nframes,
+            msgend;
+        t_pdshmslot *in = pdshm_slot(s, slot, 0), *out;
+        t_atom at;
+        chunk = (n - onset < (int)s->s_maxframes ? n - onset :
+            (int)s->s_maxframes);
+            /* the sub-process ticks DEFDACBLKSIZE samples at a time */
+        nframes = (chunk + DEFDACBLKSIZE - 1) / DEFDACBLKSIZE * DEFDACBLKSIZE;
+        for (i = 0; i < x->x_ninsig; i++)
+        {
+            float *fp = pdshm_insig(s, slot, i);
+            t_pdsample *ip = x->x_insig[i] + onset;
+            for (j = 0; j < chunk; j++)
+                fp[j] = ip[j];
+            for (; j < (int)nframes; j++)
+                fp[j] = 0;
+        }
+        in->sl_nframes = nframes;
+        in->sl_msgend = s->s_tochild.r_head;
+        pdshm_post(&s->s_parentseq, &s->s_childwaiting);
+        if (!pd_tilde_shmwait(x, seq + 1 - fifo))
+        {
+            PDERROR "pd~: subprocess exited");
+            pd_tilde_close(x);
+            for (i = 0; i < x->x_noutsig; i++)
+                for (j = onset; j < n; j++)
+                    x->x_outsig[i][j] = 0;
+            break;
+        }
+        out = pdshm_slot(s, (seq - fifo) % s->s_nslots, 1);
+        nframes = (out->sl_nframes < (uint32_t)chunk ?
+            out->sl_nframes : (uint32_t)chunk);
+        for (i = 0; i < x->x_noutsig; i++)
+        {
+            float *fp = pdshm_outsig(s, (seq - fifo) % s->s_nslots, i);
+            t_pdsample *op = x->x_outsig[i] + onset;
+            for (j = 0; j < (int)nframes; j++)
+                op[j] = fp[j];
+            for (; j < chunk; j++)
+                op[j] = 0;
+        }
+            /* messages the sub-process sent during that block */
+        msgend = pdshm_load(&out->sl_msgend);
+        while (pdshm_getatom(s, &s->s_toparent, msgend, &at))
+            binbuf_add(x->x_binbuf, 1, &at), gotmess = 1;
+    }
+    if (gotmess)
+        clock_delay(x->x_clock, 0);
+}
+#endif /* PDSHM */
+
+static void pd_tilde_doperf(t_pd_tilde *x)
+{
+    int onset, n;
+#ifdef PDSHM
+    if (x->x_shm)
+    {
+        pd_tilde_shmperf(x);
+        return;
+    }
+#endif
+        /* the sub-process takes DEFDACBLKSIZE samples at a time through the
+        pipes, so larger blocks go in several pieces */
+    for (onset = 0; onset < x->x_blksize; onset += n)
+    {
+        n = (x->x_blksize - onset < DEFDACBLKSIZE ?
+            x->x_blksize - onset : DEFDACBLKSIZE);
+        pd_tilde_pipeperf(x, onset, n);
     }
 }
 
@@ -1068,6 +1256,14 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
     char msgbuf[MAXPDSTRING];
     if (!x->x_outfd)
         return;
+#ifdef PDSHM
+    if (x->x_shm)
+    {
+        if (!pdshm_putmessage(x->x_shm, &x->x_shm->s_tochild, s, argc, argv))
+            pd_error(x, "pd~: message buffer full; dropping '%s'", s->s_name);
+        return;
+    }
+#endif
     if (x->x_binary)
     {
         pd_tilde_putsymbol(s, x->x_outfd);
@@ -1095,7 +1291,7 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
 static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_pd_tilde *x = (t_pd_tilde *)pd_new(pd_tilde_class);
-    int ninsig = 2, noutsig = 2, j, fifo = 5, binary = 1;
+    int ninsig = 2, noutsig = 2, j, fifo = 5, binary = 1, useshm = 0;
     t_float sr = sys_getsr();
     t_pdsample **g;
     t_symbol *pddir = sys_libdir,
@@ -1138,6 +1334,15 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
             binary = 0;
             argc--; argv++;
         }
+        else if (!strcmp(firstarg->s_name, "-shm"))
+        {
+#ifdef PDSHM
+            useshm = 1;
+#else
+            post("pd~: -shm not available on this platform; using pipes");
+#endif
+            argc--; argv++;
+        }
         else break;
     }
 
@@ -1146,7 +1351,7 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
         pd_error(x,
 "usage: pd~ [-sr #] [-ninsig #] [-noutsig #] [-fifo #] [-pddir <>]");
         post(
-"... [-scheddir <>]");
+"... [-scheddir <>] [-ascii] [-shm]");
     }
 
     x->x_clock = clock_new(x, (t_method)pd_tilde_tick);
@@ -1165,6 +1370,10 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
     x->x_canvas = canvas_getcurrent();
     x->x_binbuf = binbuf_new();
     x->x_binary = binary;
+    x->x_useshm = useshm;
+#ifdef PDSHM
+    x->x_shm = 0;
+#endif
     for (j = 1, g = x->x_insig; j < ninsig; j++, g++)
         inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_outlet1 = outlet_new(&x->x_obj, 0);
@@ -1422,6 +1631,7 @@ static void *pd_tilde_new(t_symbol *s, long ac, t_atom *av)
         x->x_binbuf = binbuf_new();
         x->x_clockisset = 0;
         x->x_binary = binary;
+        x->x_useshm = 0;
         x->x_sampbuf = 0;
     }
     return (x);
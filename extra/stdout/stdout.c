@@ -114,6 +114,13 @@ static void stdout_anything(t_stdout *x, t_symbol *s, int argc, t_atom *argv)
     }
     else if (x->x_mode == MODE_PDTILDE)
     {
+            /* pd~ may be using shared memory rather than stdout */
+        t_pd *shm = gensym("#pd_tilde_shm")->s_thing;
+        if (shm)
+        {
+            typedmess(shm, s, argc, argv);
+            return;
+        }
         pd_tilde_putsymbol(s, stdout);
         for (; argc--; argv++)
         {
@@ -9,6 +9,15 @@ to reset the value.
 */
 
 #include "m_pd.h"
+#include <string.h>
+
+    /* the routines used when the vector size is a multiple of 8: the "perf8"
+    routines below, or SIMD versions of them if the CPU has them (see the
+    end of this file.) */
+enum {ARITH_PLUS, ARITH_SCALARPLUS, ARITH_MINUS, ARITH_SCALARMINUS,
+    ARITH_TIMES, ARITH_SCALARTIMES, ARITH_OVER, ARITH_SCALAROVER,
+    ARITH_MAX, ARITH_SCALARMAX, ARITH_MIN, ARITH_SCALARMIN, ARITH_NKERNEL};
+static t_perfroutine arith_kernel[ARITH_NKERNEL];
 
 /* ----------------------------- plus ----------------------------- */
 static t_class *plus_class, *scalarplus_class;
@@ -110,7 +119,7 @@ void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n)
     if (n&7)
         dsp_add(plus_perform, 4, in1, in2, out, (t_int)n);
     else
-        dsp_add(plus_perf8, 4, in1, in2, out, (t_int)n);
+        dsp_add(arith_kernel[ARITH_PLUS], 4, in1, in2, out, (t_int)n);
 }
 
 static void plus_dsp(t_plus *x, t_signal **sp)
@@ -124,19 +133,19 @@ static void scalarplus_dsp(t_scalarplus *x, t_signal **sp)
         dsp_add(scalarplus_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalarplus_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALARPLUS], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void plus_setup(void)
 {
     plus_class = class_new(gensym("+~"), (t_newmethod)plus_new, 0,
-        sizeof(t_plus), 0, A_GIMME, 0);
+        sizeof(t_plus), CLASS_PARALLEL, A_GIMME, 0);
     class_addmethod(plus_class, (t_method)plus_dsp, gensym("dsp"), A_CANT, 0);
     CLASS_MAINSIGNALIN(plus_class, t_plus, x_f);
     class_sethelpsymbol(plus_class, gensym("sigbinops"));
     scalarplus_class = class_new(gensym("+~"), 0, 0,
-        sizeof(t_scalarplus), 0, 0);
+        sizeof(t_scalarplus), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalarplus_class, t_scalarplus, x_f);
     class_addmethod(scalarplus_class, (t_method)scalarplus_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -244,7 +253,7 @@ static void minus_dsp(t_minus *x, t_signal **sp)
         dsp_add(minus_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(minus_perf8, 4,
+        dsp_add(arith_kernel[ARITH_MINUS], 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -254,19 +263,19 @@ static void scalarminus_dsp(t_scalarminus *x, t_signal **sp)
         dsp_add(scalarminus_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalarminus_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALARMINUS], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void minus_setup(void)
 {
     minus_class = class_new(gensym("-~"), (t_newmethod)minus_new, 0,
-        sizeof(t_minus), 0, A_GIMME, 0);
+        sizeof(t_minus), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(minus_class, t_minus, x_f);
     class_addmethod(minus_class, (t_method)minus_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(minus_class, gensym("sigbinops"));
     scalarminus_class = class_new(gensym("-~"), 0, 0,
-        sizeof(t_scalarminus), 0, 0);
+        sizeof(t_scalarminus), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalarminus_class, t_scalarminus, x_f);
     class_addmethod(scalarminus_class, (t_method)scalarminus_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -375,7 +384,7 @@ static void times_dsp(t_times *x, t_signal **sp)
         dsp_add(times_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(times_perf8, 4,
+        dsp_add(arith_kernel[ARITH_TIMES], 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -385,19 +394,19 @@ static void scalartimes_dsp(t_scalartimes *x, t_signal **sp)
         dsp_add(scalartimes_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalartimes_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALARTIMES], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void times_setup(void)
 {
     times_class = class_new(gensym("*~"), (t_newmethod)times_new, 0,
-        sizeof(t_times), 0, A_GIMME, 0);
+        sizeof(t_times), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(times_class, t_times, x_f);
     class_addmethod(times_class, (t_method)times_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(times_class, gensym("sigbinops"));
     scalartimes_class = class_new(gensym("*~"), 0, 0,
-        sizeof(t_scalartimes), 0, 0);
+        sizeof(t_scalartimes), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalartimes_class, t_scalartimes, x_f);
     class_addmethod(scalartimes_class, (t_method)scalartimes_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -517,7 +526,7 @@ static void over_dsp(t_over *x, t_signal **sp)
         dsp_add(over_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(over_perf8, 4,
+        dsp_add(arith_kernel[ARITH_OVER], 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -527,19 +536,19 @@ static void scalarover_dsp(t_scalarover *x, t_signal **sp)
         dsp_add(scalarover_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalarover_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALAROVER], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void over_setup(void)
 {
     over_class = class_new(gensym("/~"), (t_newmethod)over_new, 0,
-        sizeof(t_over), 0, A_GIMME, 0);
+        sizeof(t_over), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(over_class, t_over, x_f);
     class_addmethod(over_class, (t_method)over_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(over_class, gensym("sigbinops"));
     scalarover_class = class_new(gensym("/~"), 0, 0,
-        sizeof(t_scalarover), 0, 0);
+        sizeof(t_scalarover), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalarover_class, t_scalarover, x_f);
     class_addmethod(scalarover_class, (t_method)scalarover_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -659,7 +668,7 @@ static void max_dsp(t_max *x, t_signal **sp)
         dsp_add(max_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(max_perf8, 4,
+        dsp_add(arith_kernel[ARITH_MAX], 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -669,19 +678,19 @@ static void scalarmax_dsp(t_scalarmax *x, t_signal **sp)
         dsp_add(scalarmax_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalarmax_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALARMAX], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void max_setup(void)
 {
     max_class = class_new(gensym("max~"), (t_newmethod)max_new, 0,
-        sizeof(t_max), 0, A_GIMME, 0);
+        sizeof(t_max), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(max_class, t_max, x_f);
     class_addmethod(max_class, (t_method)max_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(max_class, gensym("sigbinops"));
     scalarmax_class = class_new(gensym("max~"), 0, 0,
-        sizeof(t_scalarmax), 0, 0);
+        sizeof(t_scalarmax), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalarmax_class, t_scalarmax, x_f);
     class_addmethod(scalarmax_class, (t_method)scalarmax_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -801,7 +810,7 @@ static void min_dsp(t_min *x, t_signal **sp)
         dsp_add(min_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(min_perf8, 4,
+        dsp_add(arith_kernel[ARITH_MIN], 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -811,28 +820,319 @@ static void scalarmin_dsp(t_scalarmin *x, t_signal **sp)
         dsp_add(scalarmin_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
     else
-        dsp_add(scalarmin_perf8, 4, sp[0]->s_vec, &x->x_g,
+        dsp_add(arith_kernel[ARITH_SCALARMIN], 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void min_setup(void)
 {
     min_class = class_new(gensym("min~"), (t_newmethod)min_new, 0,
-        sizeof(t_min), 0, A_GIMME, 0);
+        sizeof(t_min), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(min_class, t_min, x_f);
     class_addmethod(min_class, (t_method)min_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(min_class, gensym("sigbinops"));
     scalarmin_class = class_new(gensym("min~"), 0, 0,
-        sizeof(t_scalarmin), 0, 0);
+        sizeof(t_scalarmin), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(scalarmin_class, t_scalarmin, x_f);
     class_addmethod(scalarmin_class, (t_method)scalarmin_dsp,
         gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(scalarmin_class, gensym("sigbinops"));
 }
 
+/* ----------------------- SIMD versions ---------------- */
+
+/* SIMD versions of the perf8 routines, for single-precision Pd only.  On x86
+we compile SSE2 and AVX versions (with gcc or clang) and pick one at run
+time according to the CPU; on 64-bit ARM we use NEON.  They compute exactly
+what the perf8 routines do, including for the "max~" and "min~" of NaNs, and
+like them take any vector size that's a multiple of 8.  The vectors needn't
+be aligned. */
+
+#if PD_FLOATSIZE == 32 && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define ARITH_SSE2
+#define ARITH_AVX
+#define ARITH_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#elif PD_FLOATSIZE == 32 && defined(_MSC_VER) && defined(_M_X64)
+#define ARITH_SSE2
+#define ARITH_TARGET(x)
+#include <emmintrin.h>
+#elif PD_FLOATSIZE == 32 && defined(__aarch64__)
+#define ARITH_NEON
+#include <arm_neon.h>
+#endif
+
+    /* make a signal-by-signal and a signal-by-scalar routine for an
+    operation "op" on "width" samples at a time, using the given types and
+    load and store functions.  If "recip" is set the scalar is replaced by
+    its reciprocal (or left zero) as in scalarover_perf8(). */
+#define ARITH_VV(name, target, vtype, width, load, store, op) \
+static target t_int *name(t_int *w) \
+{ \
+    t_sample *in1 = (t_sample *)(w[1]); \
+    t_sample *in2 = (t_sample *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int n = (int)(w[4]), i; \
+    for (; n; n -= 8, in1 += 8, in2 += 8, out += 8) \
+    { \
+        vtype f[8/width], g[8/width]; \
+        for (i = 0; i < 8/width; i++) \
+            f[i] = load(in1 + i * width), g[i] = load(in2 + i * width); \
+        for (i = 0; i < 8/width; i++) \
+            store(out + i * width, op(f[i], g[i])); \
+    } \
+    return (w+5); \
+}
+
+#define ARITH_VS(name, target, vtype, width, load, store, set1, op, recip) \
+static target t_int *name(t_int *w) \
+{ \
+    t_sample *in = (t_sample *)(w[1]); \
+    t_float g = *(t_float *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int n = (int)(w[4]), i; \
+    vtype gv; \
+    if (recip && g) g = 1.f / g; \
+    gv = set1(g); \
+    for (; n; n -= 8, in += 8, out += 8) \
+    { \
+        vtype f[8/width]; \
+        for (i = 0; i < 8/width; i++) \
+            f[i] = load(in + i * width); \
+        for (i = 0; i < 8/width; i++) \
+            store(out + i * width, op(f[i], gv)); \
+    } \
+    return (w+5); \
+}
+
+#define ARITH_ALL(isa, target, vtype, width, load, store, set1, \
+    add, sub, mul, over, max, min) \
+ARITH_VV(plus_##isa, target, vtype, width, load, store, add) \
+ARITH_VS(scalarplus_##isa, target, vtype, width, load, store, set1, add, 0) \
+ARITH_VV(minus_##isa, target, vtype, width, load, store, sub) \
+ARITH_VS(scalarminus_##isa, target, vtype, width, load, store, set1, sub, 0) \
+ARITH_VV(times_##isa, target, vtype, width, load, store, mul) \
+ARITH_VS(scalartimes_##isa, target, vtype, width, load, store, set1, mul, 0) \
+ARITH_VV(over_##isa, target, vtype, width, load, store, over) \
+ARITH_VS(scalarover_##isa, target, vtype, width, load, store, set1, mul, 1) \
+ARITH_VV(max_##isa, target, vtype, width, load, store, max) \
+ARITH_VS(scalarmax_##isa, target, vtype, width, load, store, set1, max, 0) \
+ARITH_VV(min_##isa, target, vtype, width, load, store, min) \
+ARITH_VS(scalarmin_##isa, target, vtype, width, load, store, set1, min, 0) \
+static t_perfroutine arith_##isa[ARITH_NKERNEL] = { \
+    plus_##isa, scalarplus_##isa, minus_##isa, scalarminus_##isa, \
+    times_##isa, scalartimes_##isa, over_##isa, scalarover_##isa, \
+    max_##isa, scalarmax_##isa, min_##isa, scalarmin_##isa};
+
+#ifdef ARITH_SSE2
+    /* (g ? f / g : 0); note the maxps and minps instructions already do
+    (f > g ? f : g) and (f < g ? f : g). */
+static ARITH_TARGET("sse2") __m128 arith_over_sse2(__m128 f, __m128 g)
+{
+    return (_mm_and_ps(_mm_cmpneq_ps(g, _mm_setzero_ps()), _mm_div_ps(f, g)));
+}
+ARITH_ALL(sse2, ARITH_TARGET("sse2"), __m128, 4, _mm_loadu_ps, _mm_storeu_ps,
+    _mm_set1_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, arith_over_sse2,
+    _mm_max_ps, _mm_min_ps)
+#endif
+
+#ifdef ARITH_AVX
+static ARITH_TARGET("avx") __m256 arith_over_avx(__m256 f, __m256 g)
+{
+    return (_mm256_and_ps(_mm256_cmp_ps(g, _mm256_setzero_ps(), _CMP_NEQ_UQ),
+        _mm256_div_ps(f, g)));
+}
+ARITH_ALL(avx, ARITH_TARGET("avx"), __m256, 8, _mm256_loadu_ps,
+    _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_sub_ps,
+    _mm256_mul_ps, arith_over_avx, _mm256_max_ps, _mm256_min_ps)
+#endif
+
+#ifdef ARITH_NEON
+    /* NEON's own max and min don't treat NaNs as the perf8 routines do */
+static float32x4_t arith_over_neon(float32x4_t f, float32x4_t g)
+{
+    return (vreinterpretq_f32_u32(vandq_u32(
+        vmvnq_u32(vceqq_f32(g, vdupq_n_f32(0))),
+            vreinterpretq_u32_f32(vdivq_f32(f, g)))));
+}
+static float32x4_t arith_max_neon(float32x4_t f, float32x4_t g)
+{
+    return (vbslq_f32(vcgtq_f32(f, g), f, g));
+}
+static float32x4_t arith_min_neon(float32x4_t f, float32x4_t g)
+{
+    return (vbslq_f32(vcltq_f32(f, g), f, g));
+}
+ARITH_ALL(neon, , float32x4_t, 4, vld1q_f32, vst1q_f32, vdupq_n_f32,
+    vaddq_f32, vsubq_f32, vmulq_f32, arith_over_neon,
+    arith_max_neon, arith_min_neon)
+#endif
+
+static t_perfroutine arith_perf8[ARITH_NKERNEL] = {
+    plus_perf8, scalarplus_perf8, minus_perf8, scalarminus_perf8,
+    times_perf8, scalartimes_perf8, over_perf8, scalarover_perf8,
+    max_perf8, scalarmax_perf8, min_perf8, scalarmin_perf8};
+
+static const char *arith_isa = "scalar";
+
+static void arith_choosekernels(void)
+{
+    t_perfroutine *kernels = arith_perf8;
+#ifdef ARITH_NEON
+    kernels = arith_neon, arith_isa = "NEON";
+#endif
+#ifdef ARITH_SSE2
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+        kernels = arith_avx, arith_isa = "AVX";
+    else if (__builtin_cpu_supports("sse2"))
+        kernels = arith_sse2, arith_isa = "SSE2";
+#else
+    kernels = arith_sse2, arith_isa = "SSE2";
+#endif
+#endif
+    memcpy(arith_kernel, kernels, sizeof(arith_kernel));
+}
+
+#ifdef PD_BENCHMARKS
+
+    /* pseudo-random inputs from -8 to 8, the second with some zeros to
+    divide by */
+static void binop_testsignal(t_sample *in1, t_sample *in2, int n)
+{
+    unsigned int seed = 1;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        seed = seed * 435898247 + 382842987;
+        in1[i] = (t_sample)((int)(seed >> 8) - 0x800000) / 0x100000;
+        seed = seed * 435898247 + 382842987;
+        in2[i] = ((seed >> 28) ? (t_sample)((int)(seed >> 8) - 0x800000) /
+            0x100000 : 0);
+    }
+}
+
+    /* check that the routines we're using give the same bits as the perf8
+    ones for every multiple of 8 up to 256 points, at every offset from an
+    aligned vector, with infinities and signed zeros mixed in, and with each
+    of those as the scalar argument.  With -ffast-math, as Pd is usually
+    compiled, which of two equal zeros or of a number and a NaN "max~" and
+    "min~" pass on depends on how the compiler orders the perf8 routines'
+    comparisons, so for those we take 0 and -0 as the same and leave NaNs
+    out. */
+int binop_selftest(void)
+{
+    int nscalar = 6, k, n, i, offset, nbad = 0;
+    t_sample *in1 = (t_sample *)getbytes(264 * sizeof(t_sample)),
+        *in2 = (t_sample *)getbytes(264 * sizeof(t_sample)),
+        *out1 = (t_sample *)getbytes(264 * sizeof(t_sample)),
+        *out2 = (t_sample *)getbytes(264 * sizeof(t_sample));
+    t_float g[6];
+    binop_testsignal(in1, in2, 264);
+        /* 0.7, -3, 0, -0, infinity and -infinity */
+    g[0] = 0.7, g[1] = -3, g[2] = 0, g[3] = -g[2];
+    g[4] = 1e30, g[4] *= g[4];
+    g[5] = -g[4];
+    for (i = 0; i < 264; i += 16)
+    {
+        in1[i] = g[4], in2[i+1] = g[4];
+        in1[i+2] = g[5], in2[i+3] = g[5];
+        in1[i+4] = g[3], in2[i+5] = g[3];
+    }
+    for (k = 0; k < ARITH_NKERNEL; k++)
+        for (n = 8; n <= 256; n += 8)
+            for (offset = 0; offset < 8; offset++)
+                for (i = 0; i < ((k & 1) ? nscalar : 1); i++)
+    {
+        t_int w[5];
+        w[1] = (t_int)(in1 + offset);
+        w[2] = (k & 1 ? (t_int)&g[i] : (t_int)(in2 + 8 - offset));
+        w[3] = (t_int)out1;
+        w[4] = n;
+        (*arith_perf8[k])(w);
+        w[3] = (t_int)(out2 + offset);
+        (*arith_kernel[k])(w);
+        if (memcmp(out1, out2 + offset, n * sizeof(t_sample)))
+        {
+            int j;
+            for (j = 0; j < n; j++)
+                if (memcmp(&out1[j], &out2[offset + j], sizeof(t_sample)) &&
+                    (k < ARITH_MAX || out1[j] != 0 || out2[offset + j] != 0))
+            {
+                nbad++;
+                break;
+            }
+        }
+    }
+    freebytes(in1, 264 * sizeof(t_sample));
+    freebytes(in2, 264 * sizeof(t_sample));
+    freebytes(out1, 264 * sizeof(t_sample));
+    freebytes(out2, 264 * sizeof(t_sample));
+    if (nbad)
+        pd_error(0, "binop self-test: %d results differ from perf8 (%s)",
+            nbad, arith_isa);
+    return (nbad);
+}
+
+    /* "pd binop-benchmark": time the perf8 routines against the ones we're
+    using, for vector sizes from 64 to 4096, and check they agree. */
+void glob_binopbenchmark(void *dummy)
+{
+    static const char *opnames[ARITH_NKERNEL / 2] =
+        {"+~", "-~", "*~", "/~", "max~", "min~"};
+    int k, n, j;
+    t_sample *in1 = (t_sample *)getbytes(4096 * sizeof(t_sample)),
+        *in2 = (t_sample *)getbytes(4096 * sizeof(t_sample)),
+        *out1 = (t_sample *)getbytes(4096 * sizeof(t_sample)),
+        *out2 = (t_sample *)getbytes(4096 * sizeof(t_sample));
+    t_float g = 0.7;
+    char buf[MAXPDSTRING];
+    binop_testsignal(in1, in2, 4096);
+    post("binop-benchmark: speedup of %s over perf8 routines", arith_isa);
+    strcpy(buf, "          ");
+    for (n = 64; n <= 4096; n *= 2)
+        sprintf(buf + strlen(buf), "%7d", n);
+    post("%s", buf);
+    for (k = 0; k < ARITH_NKERNEL; k++)
+    {
+        sprintf(buf, "%-5s%-5s", opnames[k/2], (k & 1 ? "scal" : "sig"));
+        for (n = 64; n <= 4096; n *= 2)
+        {
+            t_int w[5];
+            int reps = (1 << 22) / n;
+            double t1, t2, t3;
+            w[1] = (t_int)in1;
+            w[2] = (k & 1 ? (t_int)&g : (t_int)in2);
+            w[3] = (t_int)out1;
+            w[4] = n;
+            t1 = sys_getrealtime();
+            for (j = 0; j < reps; j++)
+                (*arith_perf8[k])(w);
+            w[3] = (t_int)out2;
+            t2 = sys_getrealtime();
+            for (j = 0; j < reps; j++)
+                (*arith_kernel[k])(w);
+            t3 = sys_getrealtime();
+            sprintf(buf + strlen(buf), "%7.2f",
+                (t3 > t2 ? (t2 - t1) / (t3 - t2) : 0));
+        }
+        post("%s", buf);
+    }
+    binop_selftest();
+    freebytes(in1, 4096 * sizeof(t_sample));
+    freebytes(in2, 4096 * sizeof(t_sample));
+    freebytes(out1, 4096 * sizeof(t_sample));
+    freebytes(out2, 4096 * sizeof(t_sample));
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* ----------------------- global setup routine ---------------- */
 void d_arithmetic_setup(void)
 {
+    arith_choosekernels();
     plus_setup();
     minus_setup();
     times_setup();
@@ -7,7 +7,8 @@
 /* LATER make tabread4 and tabread~ */
 
 #include "m_pd.h"
-
+#include "m_imp.h"
+#include "d_osc.h"
 
 /* ------------------------- tabwrite~ -------------------------- */
 
@@ -122,10 +123,11 @@ static void tabwrite_tilde_setup(void)
 {
     tabwrite_tilde_class = class_new(gensym("tabwrite~"),
         (t_newmethod)tabwrite_tilde_new, 0,
-        sizeof(t_tabwrite_tilde), 0, A_DEFSYM, 0);
+        sizeof(t_tabwrite_tilde), CLASS_PARALLEL, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabwrite_tilde_class, t_tabwrite_tilde, x_f);
     class_addmethod(tabwrite_tilde_class, (t_method)tabwrite_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabwrite_tilde_class, DSPGROUP_TAB, 1);
     class_addmethod(tabwrite_tilde_class, (t_method)tabwrite_tilde_set,
         gensym("set"), A_SYMBOL, 0);
     class_addmethod(tabwrite_tilde_class, (t_method)tabwrite_tilde_stop,
@@ -259,6 +261,7 @@ static void tabplay_tilde_setup(void)
         sizeof(t_tabplay_tilde), 0, A_DEFSYM, 0);
     class_addmethod(tabplay_tilde_class, (t_method)tabplay_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabplay_tilde_class, DSPGROUP_TAB, 0);
     class_addmethod(tabplay_tilde_class, (t_method)tabplay_tilde_stop,
         gensym("stop"), 0);
     class_addmethod(tabplay_tilde_class, (t_method)tabplay_tilde_set,
@@ -355,10 +358,11 @@ static void tabread_tilde_setup(void)
 {
     tabread_tilde_class = class_new(gensym("tabread~"),
         (t_newmethod)tabread_tilde_new, (t_method)tabread_tilde_free,
-        sizeof(t_tabread_tilde), 0, A_DEFSYM, 0);
+        sizeof(t_tabread_tilde), CLASS_PARALLEL, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabread_tilde_class, t_tabread_tilde, x_f);
     class_addmethod(tabread_tilde_class, (t_method)tabread_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabread_tilde_class, DSPGROUP_TAB, 0);
     class_addmethod(tabread_tilde_class, (t_method)tabread_tilde_set,
         gensym("set"), A_SYMBOL, 0);
 }
@@ -486,57 +490,17 @@ static void tabread4_tilde_setup(void)
 {
     tabread4_tilde_class = class_new(gensym("tabread4~"),
         (t_newmethod)tabread4_tilde_new, (t_method)tabread4_tilde_free,
-        sizeof(t_tabread4_tilde), 0, A_DEFSYM, 0);
+        sizeof(t_tabread4_tilde), CLASS_PARALLEL, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabread4_tilde_class, t_tabread4_tilde, x_f);
     class_addmethod(tabread4_tilde_class, (t_method)tabread4_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabread4_tilde_class, DSPGROUP_TAB, 0);
     class_addmethod(tabread4_tilde_class, (t_method)tabread4_tilde_set,
         gensym("set"), A_SYMBOL, 0);
 }
 
 /******************** tabosc4~ ***********************/
 
-/* this is all copied from d_osc.c... what include file could this go in? */
-#define UNITBIT32 1572864.  /* 3*2^19; bit 32 has place value 1 */
-
-#if defined(__FreeBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__) \
-    || defined(__OpenBSD__)
-#include <machine/endian.h>
-#endif
-
-#if defined(__linux__) || defined(__CYGWIN__) || defined(__GNU__) || \
-    defined(ANDROID)
-#include <endian.h>
-#endif
-
-#ifdef __MINGW32__
-#include <sys/param.h>
-#endif
-
-#ifdef _MSC_VER
-/* _MSVC lacks BYTE_ORDER and LITTLE_ENDIAN */
-#define LITTLE_ENDIAN 0x0001
-#define BYTE_ORDER LITTLE_ENDIAN
-#endif
-
-#if !defined(BYTE_ORDER) || !defined(LITTLE_ENDIAN)
-#error No byte order defined
-#endif
-
-#if BYTE_ORDER == LITTLE_ENDIAN
-# define HIOFFSET 1
-# define LOWOFFSET 0
-#else
-# define HIOFFSET 0    /* word offset to find MSB */
-# define LOWOFFSET 1    /* word offset to find LSB */
-#endif
-
-union tabfudge
-{
-    double tf_d;
-    int32_t tf_i[2];
-};
-
 static t_class *tabosc4_tilde_class;
 
 typedef struct _tabosc4_tilde
@@ -570,45 +534,13 @@ static t_int *tabosc4_tilde_perform(t_int *w)
     t_sample *in = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
-    int normhipart;
-    union tabfudge tf;
     t_float fnpoints = x->x_fnpoints;
-    int mask = fnpoints - 1;
-    t_float conv = fnpoints * x->x_conv;
-    t_word *tab = x->x_vec, *addr;
-    double dphase = fnpoints * x->x_phase + UNITBIT32;
-
-    if (!tab) goto zero;
-    tf.tf_d = UNITBIT32;
-    normhipart = tf.tf_i[HIOFFSET];
-
-#if 1
-    while (n--)
-    {
-        t_sample frac,  a,  b,  c,  d, cminusb;
-        tf.tf_d = dphase;
-        dphase += *in++ * conv;
-        addr = tab + (tf.tf_i[HIOFFSET] & mask);
-        tf.tf_i[HIOFFSET] = normhipart;
-        frac = tf.tf_d - UNITBIT32;
-        a = addr[0].w_float;
-        b = addr[1].w_float;
-        c = addr[2].w_float;
-        d = addr[3].w_float;
-        cminusb = c-b;
-        *out++ = b + frac * (
-            cminusb - 0.1666667f * (1.-frac) * (
-                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
-            )
-        );
-    }
-#endif
+    double phase = fnpoints * x->x_phase;
 
-    tf.tf_d = UNITBIT32 * fnpoints;
-    normhipart = tf.tf_i[HIOFFSET];
-    tf.tf_d = dphase + (UNITBIT32 * fnpoints - UNITBIT32);
-    tf.tf_i[HIOFFSET] = normhipart;
-    x->x_phase = (tf.tf_d - UNITBIT32 * fnpoints)  * x->x_finvnpoints;
+    if (!x->x_vec) goto zero;
+    (*osc_cubic64)(x->x_vec, fnpoints - 1, fnpoints * x->x_conv, &phase,
+        in, out, n);
+    x->x_phase = phase * x->x_finvnpoints;
     return (w+5);
  zero:
     while (n--) *out++ = 0;
@@ -666,10 +598,11 @@ static void tabosc4_tilde_setup(void)
 {
     tabosc4_tilde_class = class_new(gensym("tabosc4~"),
         (t_newmethod)tabosc4_tilde_new, 0,
-        sizeof(t_tabosc4_tilde), 0, A_DEFSYM, 0);
+        sizeof(t_tabosc4_tilde), CLASS_PARALLEL, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabosc4_tilde_class, t_tabosc4_tilde, x_f);
     class_addmethod(tabosc4_tilde_class, (t_method)tabosc4_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabosc4_tilde_class, DSPGROUP_TAB, 0);
     class_addmethod(tabosc4_tilde_class, (t_method)tabosc4_tilde_set,
         gensym("set"), A_SYMBOL, 0);
     class_addmethod(tabosc4_tilde_class, (t_method)tabosc4_tilde_ft1,
@@ -765,10 +698,11 @@ static void tabsend_dsp(t_tabsend *x, t_signal **sp)
 static void tabsend_setup(void)
 {
     tabsend_class = class_new(gensym("tabsend~"), (t_newmethod)tabsend_new,
-        0, sizeof(t_tabsend), 0, A_DEFSYM, 0);
+        0, sizeof(t_tabsend), CLASS_PARALLEL, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabsend_class, t_tabsend, x_f);
     class_addmethod(tabsend_class, (t_method)tabsend_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabsend_class, DSPGROUP_TAB, 1);
     class_addmethod(tabsend_class, (t_method)tabsend_set,
         gensym("set"), A_SYMBOL, 0);
 }
@@ -846,9 +780,10 @@ static void tabreceive_setup(void)
 {
     tabreceive_class = class_new(gensym("tabreceive~"),
         (t_newmethod)tabreceive_new, 0,
-        sizeof(t_tabreceive), 0, A_DEFSYM, 0);
+        sizeof(t_tabreceive), CLASS_PARALLEL, A_DEFSYM, 0);
     class_addmethod(tabreceive_class, (t_method)tabreceive_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(tabreceive_class, DSPGROUP_TAB, 0);
     class_addmethod(tabreceive_class, (t_method)tabreceive_set,
         gensym("set"), A_SYMBOL, 0);
 }
@@ -77,7 +77,7 @@ static void *sig_tilde_new(t_floatarg f)
 static void sig_tilde_setup(void)
 {
     sig_tilde_class = class_new(gensym("sig~"), (t_newmethod)sig_tilde_new, 0,
-        sizeof(t_sig), 0, A_DEFFLOAT, 0);
+        sizeof(t_sig), CLASS_PARALLEL, A_DEFFLOAT, 0);
     class_addfloat(sig_tilde_class, (t_method)sig_tilde_float);
     class_addmethod(sig_tilde_class, (t_method)sig_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -218,7 +218,7 @@ static void *line_tilde_new(void)
 static void line_tilde_setup(void)
 {
     line_tilde_class = class_new(gensym("line~"), line_tilde_new, 0,
-        sizeof(t_line), 0, 0);
+        sizeof(t_line), CLASS_PARALLEL, 0);
     class_addfloat(line_tilde_class, (t_method)line_tilde_float);
     class_addmethod(line_tilde_class, (t_method)line_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -228,7 +228,6 @@ static void line_tilde_setup(void)
 
 /* -------------------------- vline~ ------------------------------ */
 static t_class *vline_tilde_class;
-#include "s_stuff.h"    /* for DEFDACBLKSIZE; this should be in m_pd.h */
 typedef struct _vseg
 {
     double s_targettime;
@@ -266,7 +265,8 @@ static t_int *vline_tilde_perform(t_int *w)
     t_vseg *s = x->x_list;
     if (logicaltimenow != x->x_lastlogicaltime)
     {
-        int sampstotime = (n > DEFDACBLKSIZE ? n : DEFDACBLKSIZE);
+        int blksize = sys_getblksize(),
+            sampstotime = (n > blksize ? n : blksize);
         x->x_lastlogicaltime = logicaltimenow;
         x->x_nextblocktime = logicaltimenow - sampstotime * msecpersamp;
     }
@@ -412,7 +412,7 @@ static void *vline_tilde_new(void)
 static void vline_tilde_setup(void)
 {
     vline_tilde_class = class_new(gensym("vline~"), vline_tilde_new,
-        (t_method)vline_tilde_stop, sizeof(t_vline), 0, 0);
+        (t_method)vline_tilde_stop, sizeof(t_vline), CLASS_PARALLEL, 0);
     class_addfloat(vline_tilde_class, (t_method)vline_tilde_float);
     class_addmethod(vline_tilde_class, (t_method)vline_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -466,7 +466,7 @@ static void snapshot_tilde_set(t_snapshot *x, t_floatarg f)
 static void snapshot_tilde_setup(void)
 {
     snapshot_tilde_class = class_new(gensym("snapshot~"), snapshot_tilde_new, 0,
-        sizeof(t_snapshot), 0, 0);
+        sizeof(t_snapshot), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(snapshot_tilde_class, t_snapshot, x_f);
     class_addmethod(snapshot_tilde_class, (t_method)snapshot_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -554,7 +554,7 @@ static void vsnapshot_tilde_setup(void)
 {
     vsnapshot_tilde_class = class_new(gensym("vsnapshot~"),
         vsnapshot_tilde_new, (t_method)vsnapshot_tilde_ff,
-        sizeof(t_vsnapshot), 0, 0);
+        sizeof(t_vsnapshot), CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(vsnapshot_tilde_class, t_vsnapshot, x_f);
     class_addmethod(vsnapshot_tilde_class, (t_method)vsnapshot_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -6,6 +6,7 @@
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 
 /* ----------------------------- dac~ --------------------------- */
@@ -45,14 +46,15 @@ static void dac_dsp(t_dac *x, t_signal **sp)
 {
     t_int i, *ip;
     t_signal **sp2;
+    int n = sys_getblksize();
     for (i = x->x_n, ip = x->x_vec, sp2 = sp; i--; ip++, sp2++)
     {
         int ch = (int)(*ip - 1);
-        if ((*sp2)->s_n != DEFDACBLKSIZE)
+        if ((*sp2)->s_n != n)
             error("dac~: bad vector size");
         else if (ch >= 0 && ch < sys_get_outchannels())
-            dsp_add(plus_perform, 4, STUFF->st_soundout + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, STUFF->st_soundout + DEFDACBLKSIZE*ch, (t_int)DEFDACBLKSIZE);
+            dsp_add(plus_perform, 4, STUFF->st_soundout + n*ch,
+                (*sp2)->s_vec, STUFF->st_soundout + n*ch, (t_int)n);
     }
 }
 
@@ -72,9 +74,10 @@ static void dac_free(t_dac *x)
 static void dac_setup(void)
 {
     dac_class = class_new(gensym("dac~"), (t_newmethod)dac_new,
-        (t_method)dac_free, sizeof(t_dac), 0, A_GIMME, 0);
+        (t_method)dac_free, sizeof(t_dac), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(dac_class, t_dac, x_f);
     class_addmethod(dac_class, (t_method)dac_dsp, gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(dac_class, DSPGROUP_DAC, 1);
     class_addmethod(dac_class, (t_method)dac_set, gensym("set"), A_GIMME, 0);
     class_sethelpsymbol(dac_class, gensym("adc~_dac~"));
 }
@@ -160,15 +163,16 @@ static void adc_dsp(t_adc *x, t_signal **sp)
 {
     t_int i, *ip;
     t_signal **sp2;
+    int n = sys_getblksize();
     for (i = x->x_n, ip = x->x_vec, sp2 = sp; i--; ip++, sp2++)
     {
         int ch = (int)(*ip - 1);
-        if ((*sp2)->s_n != DEFDACBLKSIZE)
+        if ((*sp2)->s_n != n)
             error("adc~: bad vector size");
         else if (ch >= 0 && ch < sys_get_inchannels())
-            dsp_add_copy(STUFF->st_soundin + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, DEFDACBLKSIZE);
-        else dsp_add_zero((*sp2)->s_vec, DEFDACBLKSIZE);
+            dsp_add_copy(STUFF->st_soundin + n*ch,
+                (*sp2)->s_vec, n);
+        else dsp_add_zero((*sp2)->s_vec, n);
     }
 }
 
@@ -188,7 +192,7 @@ static void adc_free(t_adc *x)
 static void adc_setup(void)
 {
     adc_class = class_new(gensym("adc~"), (t_newmethod)adc_new,
-        (t_method)adc_free, sizeof(t_adc), 0, A_GIMME, 0);
+        (t_method)adc_free, sizeof(t_adc), CLASS_PARALLEL, A_GIMME, 0);
     class_addmethod(adc_class, (t_method)adc_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(adc_class, (t_method)adc_set, gensym("set"), A_GIMME, 0);
     class_sethelpsymbol(adc_class, gensym("adc~_dac~"));
@@ -3,6 +3,8 @@
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "m_pd.h"
+#include <math.h>
+#include <string.h>
 
 /* This file interfaces to one of the Mayer, Ooura, or fftw FFT packages
 to implement the "fft~", etc, Pd objects.  If using Mayer, also compile
@@ -15,6 +17,8 @@ linked in.  The configure script can be used to select which one.
 
 void mayer_init( void);
 void mayer_term( void);
+int mayer_setprecision(int bits);
+const char *mayer_name( void);
 
 static void fftclass_cleanup(t_class *c)
 {
@@ -356,7 +360,7 @@ static void sigframp_dsp(t_sigframp *x, t_signal **sp)
 static void sigframp_setup(void)
 {
     sigframp_class = class_new(gensym("framp~"), sigframp_new, 0,
-        sizeof(t_sigframp), 0, 0);
+        sizeof(t_sigframp), CLASS_PARALLEL, 0);
     class_setfreefn(sigframp_class, fftclass_cleanup);
     CLASS_MAINSIGNALIN(sigframp_class, t_sigframp, x_f);
     class_addmethod(sigframp_class, (t_method)sigframp_dsp,
@@ -364,6 +368,191 @@ static void sigframp_setup(void)
     mayer_init();
 }
 
+/* ------------------------ benchmarking ------------------------- */
+
+    /* "pd fft-precision 32" or "64": choose between the FFT package's
+    single and double precision routines if it has both. */
+void glob_fftprecision(void *dummy, t_floatarg f)
+{
+    if (!mayer_setprecision(f))
+        pd_error(0, "fft-precision: %d bits not available with this FFT",
+            (int)f);
+}
+
+#ifdef PD_BENCHMARKS
+
+#define FFTBENCH_MAXN 65536
+
+    /* time "reps" transforms of "n" points, copying the input in first each
+    time; returns microseconds per transform */
+static double fftbench_time(int which, int n, int reps,
+    const t_sample *from1, const t_sample *from2, t_sample *buf1,
+    t_sample *buf2)
+{
+    double starttime = sys_getrealtime();
+    int i;
+    for (i = 0; i < reps; i++)
+    {
+        memcpy(buf1, from1, n * sizeof(t_sample));
+        memcpy(buf2, from2, n * sizeof(t_sample));
+        switch (which)
+        {
+            case 0: mayer_fft(n, buf1, buf2); break;
+            case 1: mayer_ifft(n, buf1, buf2); break;
+            case 2: mayer_realfft(n, buf1); break;
+            case 3: mayer_realifft(n, buf1); break;
+        }
+    }
+    return (1e6 * (sys_getrealtime() - starttime) / reps);
+}
+
+    /* check that a complex exponential and then a cosine plus a sine come
+    out in the right bins, and that real transforms invert; return the
+    largest error relative to the size "n".  "in1" and "in2" are left holding
+    the exponential's real and imaginary parts. */
+static double fftbench_error(int n, t_sample *in1, t_sample *in2,
+    t_sample *buf1, t_sample *buf2)
+{
+    int j, k1 = 3, k2 = n/4 - 1;
+    double error = 0, x;
+    for (j = 0; j < n; j++)
+    {
+        in1[j] = cos(2 * 3.14159265358979 * k1 * j / n);
+        in2[j] = sin(2 * 3.14159265358979 * k1 * j / n);
+    }
+        /* exp(2 pi i k1 j / n) should give n in bin k1 */
+    memcpy(buf1, in1, n * sizeof(t_sample));
+    memcpy(buf2, in2, n * sizeof(t_sample));
+    mayer_fft(n, buf1, buf2);
+    for (j = 0; j < n; j++)
+    {
+        if ((x = fabs(buf1[j] - (j == k1 ? n : 0))) > error)
+            error = x;
+        if ((x = fabs(buf2[j])) > error)
+            error = x;
+    }
+        /* and the inverse should give it back, times n */
+    mayer_ifft(n, buf1, buf2);
+    for (j = 0; j < n; j++)
+    {
+        if ((x = fabs(buf1[j] - n * in1[j])) > error)
+            error = x;
+        if ((x = fabs(buf2[j] - n * in2[j])) > error)
+            error = x;
+    }
+        /* cos at k1 plus sin at k2, n/2 in bin k1 and n/2 in the
+        imaginary part of bin k2 (which is stored at n-k2) */
+    for (j = 0; j < n; j++)
+        buf2[j] = in1[j] + sin(2 * 3.14159265358979 * k2 * j / n);
+    memcpy(buf1, buf2, n * sizeof(t_sample));
+    mayer_realfft(n, buf1);
+    for (j = 0; j < n; j++)
+        if ((x = fabs(buf1[j] -
+            (j == k1 || j == n - k2 ? n/2 : 0))) > error)
+                error = x;
+    mayer_realifft(n, buf1);
+    for (j = 0; j < n; j++)
+        if ((x = fabs(buf1[j] - n * buf2[j])) > error)
+            error = x;
+    return (error / n);
+}
+
+    /* check each precision the FFT package offers at sizes from 16 to
+    65536 (the largest of which get their work space from the heap.) */
+#define FFTTEST_MAXERROR 1e-5
+
+int fft_selftest(void)
+{
+    static const int precisions[2] = {32, 64};
+    size_t size = FFTBENCH_MAXN * sizeof(t_sample);
+    t_sample *in1 = (t_sample *)getbytes(size), *in2 = (t_sample *)getbytes(size),
+        *buf1 = (t_sample *)getbytes(size), *buf2 = (t_sample *)getbytes(size);
+    int n, prec, was, wasprecision = 0, nbad = 0;
+    double error;
+    mayer_init();
+    for (prec = 0; prec < 2; prec++)
+    {
+        if (!(was = mayer_setprecision(precisions[prec])))
+            continue;
+        if (!wasprecision)
+            wasprecision = was;
+        for (n = 16; n <= FFTBENCH_MAXN; n *= 2)
+            if ((error = fftbench_error(n, in1, in2, buf1, buf2)) >
+                FFTTEST_MAXERROR)
+        {
+            pd_error(0, "fft self-test: %d points: error %g (%s)",
+                n, error, mayer_name());
+            nbad++;
+        }
+    }
+    mayer_term();
+    if (wasprecision)
+        mayer_setprecision(wasprecision);
+    freebytes(in1, size);
+    freebytes(in2, size);
+    freebytes(buf1, size);
+    freebytes(buf2, size);
+    return (nbad);
+}
+
+    /* "pd fft-benchmark": time fft~, ifft~, rfft~ and rifft~'s transforms
+    with each precision the FFT package offers, for sizes from 64 to 65536,
+    and print the error from fftbench_error().  To compare FFT packages,
+    run this in Pd compiled with each. */
+void glob_fftbenchmark(void *dummy)
+{
+    static const int precisions[2] = {32, 64};
+    size_t size = FFTBENCH_MAXN * sizeof(t_sample);
+    t_sample *in1 = (t_sample *)getbytes(size), *in2 = (t_sample *)getbytes(size),
+        *buf1 = (t_sample *)getbytes(size), *buf2 = (t_sample *)getbytes(size);
+    int i, k, n, prec, was, wasprecision = 0;
+    mayer_init();
+    for (prec = 0; prec < 2; prec++)
+    {
+        if (!(was = mayer_setprecision(precisions[prec])))
+            continue;
+        if (!wasprecision)
+            wasprecision = was;
+        post("fft-benchmark: %s", mayer_name());
+        post("       n    fft~   ifft~   rfft~  rifft~ (usec)   error");
+        for (n = 64; n <= FFTBENCH_MAXN; n *= 2)
+        {
+            int reps = (1 << 22) / (n * ilog2(n)) + 1;
+            double copytime, t[4], error, starttime;
+            char buf[MAXPDSTRING];
+            error = fftbench_error(n, in1, in2, buf1, buf2);
+                /* time copying the input to subtract it out */
+            starttime = sys_getrealtime();
+            for (i = 0; i < reps; i++)
+            {
+                memcpy(buf1, in1, n * sizeof(t_sample));
+                memcpy(buf2, in2, n * sizeof(t_sample));
+            }
+            copytime = 1e6 * (sys_getrealtime() - starttime) / reps;
+            for (k = 0; k < 4; k++)
+            {
+                fftbench_time(k, n, 1, in1, in2, buf1, buf2);   /* warm up */
+                t[k] = fftbench_time(k, n, reps, in1, in2, buf1, buf2)
+                    - copytime;
+            }
+            sprintf(buf, "%8d", n);
+            for (k = 0; k < 4; k++)
+                sprintf(buf + strlen(buf), "%8.2f", (t[k] > 0 ? t[k] : 0));
+            sprintf(buf + strlen(buf), "%16.2g", error);
+            post("%s", buf);
+        }
+    }
+    mayer_term();
+    if (wasprecision)
+        mayer_setprecision(wasprecision);
+    freebytes(in1, size);
+    freebytes(in2, size);
+    freebytes(buf1, size);
+    freebytes(buf2, size);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_fft_setup(void)
@@ -21,6 +21,9 @@ for another, more permissive-sounding copyright notice.  -MSP
 /* ---------- Pd interface to OOURA FFT; imitate Mayer API ---------- */
 #include "m_pd.h"
 #include "m_imp.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
 
 #ifdef _WIN32
 # include <malloc.h> /* MSVC or mingw on windows */
@@ -33,88 +36,473 @@ for another, more permissive-sounding copyright notice.  -MSP
 #define FFTFLT double
 void cdft(int, int, FFTFLT *, int *, FFTFLT *);
 void rdft(int, int, FFTFLT *, int *, FFTFLT *);
+void makewt(int nw, int *ip, FFTFLT *w);
+void makect(int nc, int *ip, FFTFLT *c);
 
 int ilog2(int n);
 
-static PERTHREAD int ooura_maxn;
-static PERTHREAD int *ooura_bitrev;
-static PERTHREAD int ooura_bitrevsize;
-static PERTHREAD FFTFLT *ooura_costab;
-static PERTHREAD FFTFLT *ooura_buffer;
+#define MAXLOGN 30
+
+    /* work space for a transform comes off the stack unless it's bigger
+    than this, in which case we use the heap */
+#define FFT_HUGE 65536
+#define FFT_ALLOCA(x, nbytes) ((x) = ((nbytes) <= FFT_HUGE ?  \
+        alloca(nbytes) : getbytes(nbytes)))
+#define FFT_FREEA(x, nbytes) ( \
+    ((nbytes) <= FFT_HUGE || (freebytes((x), (nbytes)), 0)))
+
+    /* Each FFT size gets its own "plan" the first time it's used: Ooura's
+    tables for the double-precision path, and for the native single-precision
+    path (below), the twiddle factors.  Plans are shared by all threads and
+    Pd instances, so they're made under fft_mutex and never written once
+    made; they're freed when the last mayer_init() is matched by
+    mayer_term(). */
+typedef struct _oouraplan
+{
+    int *o_bitrev;
+    int o_bitrevsize;
+    FFTFLT *o_costab;
+} t_oouraplan;
+
+static pthread_mutex_t fft_mutex = PTHREAD_MUTEX_INITIALIZER;
+static t_oouraplan *ooura_plans[MAXLOGN+1];
+
+static t_oouraplan *ooura_newplan(int logn)
+{
+    int n = (1 << logn);
+    t_oouraplan *x = (t_oouraplan *)t_getbytes(sizeof(*x));
+    if (!x)
+        return (0);
+    x->o_bitrevsize = sizeof(int) * (2 + (1 << (logn/2)));
+    x->o_bitrev = (int *)t_getbytes(x->o_bitrevsize);
+    x->o_costab = (FFTFLT *)t_getbytes(n * sizeof(FFTFLT)/2);
+    if (!x->o_bitrev || !x->o_costab)
+    {
+        if (x->o_bitrev)
+            t_freebytes(x->o_bitrev, x->o_bitrevsize);
+        if (x->o_costab)
+            t_freebytes(x->o_costab, n * sizeof(FFTFLT)/2);
+        t_freebytes(x, sizeof(*x));
+        return (0);
+    }
+        /* fill in the tables as rdft() and cdft() would on first use, so
+        that from now on they only read them */
+    makewt(n >> 2, x->o_bitrev, x->o_costab);
+    makect(n >> 2, x->o_bitrev, x->o_costab + (n >> 2));
+    return (x);
+}
 
-static int ooura_init( int n)
+    /* get the plan for Ooura's routines on "n" points (real ones for rdft,
+    or real and imaginary parts for cdft.) */
+static t_oouraplan *ooura_getplan(int n)
 {
-    n = (1 << ilog2(n));
-    if (n < 4)
+    t_oouraplan *x;
+    int logn = ilog2(n);
+    if (logn < 2 || logn > MAXLOGN)
         return (0);
-    if (n > ooura_maxn)
+    pthread_mutex_lock(&fft_mutex);
+    if (!(x = ooura_plans[logn]) && (x = ooura_newplan(logn)))
+        ooura_plans[logn] = x;
+    pthread_mutex_unlock(&fft_mutex);
+    if (!x)
+        error("out of memory allocating FFT tables");
+    return (x);
+}
+
+    /* called with fft_mutex locked */
+static void ooura_term( void)
+{
+    int i;
+    for (i = 0; i <= MAXLOGN; i++)
     {
-        if (n > ooura_maxn)    /* recheck in case it got set while we waited */
+        t_oouraplan *x = ooura_plans[i];
+        if (x)
         {
-            if (ooura_maxn)
-            {
-                t_freebytes(ooura_bitrev, ooura_bitrevsize);
-                t_freebytes(ooura_costab, ooura_maxn * sizeof(FFTFLT) / 2);
-                t_freebytes(ooura_buffer, ooura_maxn * sizeof(FFTFLT));
-            }
-            ooura_bitrevsize = sizeof(int) * (2 + (1 << (ilog2(n)/2)));
-            ooura_bitrev = (int *)t_getbytes(ooura_bitrevsize);
-            ooura_bitrev[0] = 0;
-            if (!ooura_bitrev)
-            {
-                error("out of memory allocating FFT buffer");
-                ooura_maxn = 0;
-                return (0);
-            }
-            ooura_costab = (FFTFLT *)t_getbytes(n * sizeof(FFTFLT)/2);
-            if (!ooura_costab)
-            {
-                error("out of memory allocating FFT buffer");
-                t_freebytes(ooura_bitrev, ooura_bitrevsize);
-                ooura_maxn = 0;
-                return (0);
-            }
-            ooura_buffer = (FFTFLT *)t_getbytes(n * sizeof(FFTFLT));
-            if (!ooura_buffer)
-            {
-                error("out of memory allocating FFT buffer");
-                t_freebytes(ooura_bitrev, ooura_bitrevsize);
-                t_freebytes(ooura_costab, n * sizeof(FFTFLT) / 2);
-                ooura_maxn = 0;
-                return (0);
-            }
-            ooura_maxn = n;
-            ooura_bitrev[0] = 0;
+            t_freebytes(x->o_bitrev, x->o_bitrevsize);
+            t_freebytes(x->o_costab, (1 << i) * sizeof(FFTFLT)/2);
+            t_freebytes(x, sizeof(*x));
+            ooura_plans[i] = 0;
         }
     }
-    return (1);
 }
 
-static void ooura_term( void)
+/* -------- native single-precision FFT -------- */
+
+/* A Stockham (self-sorting) radix-4 FFT, with a final radix-2 step when the
+size is an odd power of two, working on separate real and imaginary arrays
+as Pd keeps them so that no interleaving or conversion to double is needed.
+Each stage is computed four samples at a time with SSE or NEON.  Real FFTs
+are done as complex ones of half the size.  It's used for complex FFTs of 16
+or more points and real ones of 32 or more in single-precision Pd when
+"pd fft-precision" is 32; otherwise, and by default, we use Ooura's double
+precision routines, since the native FFT's output differs from theirs in the
+last bits. */
+
+#if PD_FLOATSIZE == 32 && (defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE__)))
+#define FFT_NATIVE
+#include <xmmintrin.h>
+typedef __m128 t_fftvec;
+#define FV_LOAD(p) _mm_loadu_ps(p)
+#define FV_STORE(p, v) _mm_storeu_ps(p, v)
+#define FV_SET1(f) _mm_set1_ps(f)
+#define FV_ADD(a, b) _mm_add_ps(a, b)
+#define FV_SUB(a, b) _mm_sub_ps(a, b)
+#define FV_MUL(a, b) _mm_mul_ps(a, b)
+#define FV_TRANSPOSE(a, b, c, d) _MM_TRANSPOSE4_PS(a, b, c, d)
+#define FFT_ISA "SSE"
+#elif PD_FLOATSIZE == 32 && defined(__aarch64__)
+#define FFT_NATIVE
+#include <arm_neon.h>
+typedef float32x4_t t_fftvec;
+#define FV_LOAD(p) vld1q_f32(p)
+#define FV_STORE(p, v) vst1q_f32(p, v)
+#define FV_SET1(f) vdupq_n_f32(f)
+#define FV_ADD(a, b) vaddq_f32(a, b)
+#define FV_SUB(a, b) vsubq_f32(a, b)
+#define FV_MUL(a, b) vmulq_f32(a, b)
+#define FV_TRANSPOSE(a, b, c, d) { \
+    float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d); \
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0])); \
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1])); \
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0])); \
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1])); }
+#define FFT_ISA "NEON"
+#endif
+
+    /* 32 to use the native FFT where we can, 64 to always use Ooura's */
+static int fft_precision = 64;
+
+#ifdef FFT_NATIVE
+
+#define FFT_MINLOGN 4   /* smallest complex FFT we do natively */
+
+typedef struct _fftplan
 {
-    if (!ooura_maxn)
-        return;
-    t_freebytes(ooura_bitrev, ooura_bitrevsize);
-    t_freebytes(ooura_costab, ooura_maxn * sizeof(FFTFLT)/2);
-    t_freebytes(ooura_buffer, ooura_maxn * sizeof(FFTFLT));
-    ooura_maxn = 0;
-    ooura_bitrev = 0;
-    ooura_bitrevsize = 0;
-    ooura_costab = 0;
+    int p_n;                    /* number of complex points */
+    size_t p_size;              /* bytes allocated for the arrays below */
+    float *p_wre, *p_wim;       /* exp(-2 pi i k / n) for k < 3n/4 */
+    float *p_w2re, *p_w2im;     /* the same for k = 2j, j < n/4 ... */
+    float *p_w3re, *p_w3im;     /* ... and k = 3j */
+    float *p_rwre, *p_rwim;     /* exp(-pi i k / n), k <= n/2, for rfft */
+} t_fftplan;
+
+static t_fftplan *fft_plans[MAXLOGN+1];
+
+static t_fftplan *fft_newplan(int n)
+{
+    t_fftplan *x;
+    float *fp;
+    int k;
+    if (!(x = (t_fftplan *)t_getbytes(sizeof(*x))))
+        return (0);
+    x->p_n = n;
+    x->p_size = (2 * (3*n/4) + 4 * (n/4) + 2 * (n/2 + 1)) * sizeof(float);
+    if (!(fp = (float *)t_getbytes(x->p_size)))
+    {
+        t_freebytes(x, sizeof(*x));
+        return (0);
+    }
+    x->p_wre = fp; fp += 3*n/4;
+    x->p_wim = fp; fp += 3*n/4;
+    x->p_w2re = fp; fp += n/4;
+    x->p_w2im = fp; fp += n/4;
+    x->p_w3re = fp; fp += n/4;
+    x->p_w3im = fp; fp += n/4;
+    x->p_rwre = fp; fp += n/2 + 1;
+    x->p_rwim = fp;
+    for (k = 0; k < 3*n/4; k++)
+    {
+        x->p_wre[k] = cos(2 * 3.14159265358979323846 * k / n);
+        x->p_wim[k] = -sin(2 * 3.14159265358979323846 * k / n);
+    }
+    for (k = 0; k < n/4; k++)
+    {
+        x->p_w2re[k] = x->p_wre[2*k];
+        x->p_w2im[k] = x->p_wim[2*k];
+        x->p_w3re[k] = x->p_wre[3*k];
+        x->p_w3im[k] = x->p_wim[3*k];
+    }
+    for (k = 0; k <= n/2; k++)
+    {
+        x->p_rwre[k] = cos(3.14159265358979323846 * k / n);
+        x->p_rwim[k] = -sin(3.14159265358979323846 * k / n);
+    }
+    return (x);
 }
 
+static t_fftplan *fft_getplan(int n)
+{
+    t_fftplan *x;
+    int logn = ilog2(n);
+    if (logn < FFT_MINLOGN || logn > MAXLOGN || n != (1 << logn))
+        return (0);
+    pthread_mutex_lock(&fft_mutex);
+    if (!(x = fft_plans[logn]) && (x = fft_newplan(n)))
+        fft_plans[logn] = x;
+    pthread_mutex_unlock(&fft_mutex);
+    if (!x)
+        error("out of memory allocating FFT tables");
+    return (x);
+}
+
+    /* called with fft_mutex locked */
+static void fft_term(void)
+{
+    int i;
+    for (i = 0; i <= MAXLOGN; i++)
+    {
+        t_fftplan *x = fft_plans[i];
+        if (x)
+        {
+            t_freebytes(x->p_wre, x->p_size);
+            t_freebytes(x, sizeof(*x));
+            fft_plans[i] = 0;
+        }
+    }
+}
+
+    /* the radix-4 butterfly: from a, b, c, d make a+b+c+d and, before
+    multiplying by the twiddle factors, a-jb-c+jd, a-b+c-d and a+jb-c-jd */
+#define FFT_BUTTERFLY \
+    t_fftvec apcr = FV_ADD(ar, cr), apci = FV_ADD(ai, ci); \
+    t_fftvec amcr = FV_SUB(ar, cr), amci = FV_SUB(ai, ci); \
+    t_fftvec bpdr = FV_ADD(br, dr), bpdi = FV_ADD(bi, di); \
+    t_fftvec bmdr = FV_SUB(br, dr), bmdi = FV_SUB(bi, di); \
+    t_fftvec t1r = FV_ADD(amcr, bmdi), t1i = FV_SUB(amci, bmdr); \
+    t_fftvec t2r = FV_SUB(apcr, bpdr), t2i = FV_SUB(apci, bpdi); \
+    t_fftvec t3r = FV_SUB(amcr, bmdi), t3i = FV_ADD(amci, bmdr); \
+    t_fftvec y0r = FV_ADD(apcr, bpdr), y0i = FV_ADD(apci, bpdi); \
+    t_fftvec y1r = FV_SUB(FV_MUL(w1r, t1r), FV_MUL(w1i, t1i)); \
+    t_fftvec y1i = FV_ADD(FV_MUL(w1r, t1i), FV_MUL(w1i, t1r)); \
+    t_fftvec y2r = FV_SUB(FV_MUL(w2r, t2r), FV_MUL(w2i, t2i)); \
+    t_fftvec y2i = FV_ADD(FV_MUL(w2r, t2i), FV_MUL(w2i, t2r)); \
+    t_fftvec y3r = FV_SUB(FV_MUL(w3r, t3r), FV_MUL(w3i, t3i)); \
+    t_fftvec y3i = FV_ADD(FV_MUL(w3r, t3i), FV_MUL(w3i, t3r));
+
+    /* the first stage, where the four outputs of each butterfly are
+    adjacent: do four butterflies at once and transpose the results. */
+static void fft_firststage(t_fftplan *x, const float *xr, const float *xi,
+    float *yr, float *yi)
+{
+    int m = x->p_n / 4, j;
+    for (j = 0; j < m; j += 4)
+    {
+        t_fftvec ar = FV_LOAD(xr + j), ai = FV_LOAD(xi + j);
+        t_fftvec br = FV_LOAD(xr + j + m), bi = FV_LOAD(xi + j + m);
+        t_fftvec cr = FV_LOAD(xr + j + 2*m), ci = FV_LOAD(xi + j + 2*m);
+        t_fftvec dr = FV_LOAD(xr + j + 3*m), di = FV_LOAD(xi + j + 3*m);
+        t_fftvec w1r = FV_LOAD(x->p_wre + j), w1i = FV_LOAD(x->p_wim + j);
+        t_fftvec w2r = FV_LOAD(x->p_w2re + j), w2i = FV_LOAD(x->p_w2im + j);
+        t_fftvec w3r = FV_LOAD(x->p_w3re + j), w3i = FV_LOAD(x->p_w3im + j);
+        FFT_BUTTERFLY
+        FV_TRANSPOSE(y0r, y1r, y2r, y3r);
+        FV_TRANSPOSE(y0i, y1i, y2i, y3i);
+        FV_STORE(yr + 4*j, y0r); FV_STORE(yr + 4*j + 4, y1r);
+        FV_STORE(yr + 4*j + 8, y2r); FV_STORE(yr + 4*j + 12, y3r);
+        FV_STORE(yi + 4*j, y0i); FV_STORE(yi + 4*j + 4, y1i);
+        FV_STORE(yi + 4*j + 8, y2i); FV_STORE(yi + 4*j + 12, y3i);
+    }
+}
+
+    /* a later stage, on "len"-point FFTs interleaved with stride "s" (at
+    least 4): each butterfly's twiddle factors apply to s adjacent points */
+static void fft_stage(t_fftplan *x, int len, int s, const float *xr,
+    const float *xi, float *yr, float *yi)
+{
+    int m = len / 4, step = x->p_n / len, j, q;
+    for (j = 0; j < m; j++)
+    {
+        t_fftvec w1r = FV_SET1(x->p_wre[j * step]);
+        t_fftvec w1i = FV_SET1(x->p_wim[j * step]);
+        t_fftvec w2r = FV_SET1(x->p_wre[2 * j * step]);
+        t_fftvec w2i = FV_SET1(x->p_wim[2 * j * step]);
+        t_fftvec w3r = FV_SET1(x->p_wre[3 * j * step]);
+        t_fftvec w3i = FV_SET1(x->p_wim[3 * j * step]);
+        const float *x0r = xr + s * j, *x0i = xi + s * j;
+        float *y0rp = yr + 4 * s * j, *y0ip = yi + 4 * s * j;
+        for (q = 0; q < s; q += 4)
+        {
+            t_fftvec ar = FV_LOAD(x0r + q), ai = FV_LOAD(x0i + q);
+            t_fftvec br = FV_LOAD(x0r + q + s*m), bi = FV_LOAD(x0i + q + s*m);
+            t_fftvec cr = FV_LOAD(x0r + q + 2*s*m),
+                ci = FV_LOAD(x0i + q + 2*s*m);
+            t_fftvec dr = FV_LOAD(x0r + q + 3*s*m),
+                di = FV_LOAD(x0i + q + 3*s*m);
+            FFT_BUTTERFLY
+            FV_STORE(y0rp + q, y0r); FV_STORE(y0ip + q, y0i);
+            FV_STORE(y0rp + q + s, y1r); FV_STORE(y0ip + q + s, y1i);
+            FV_STORE(y0rp + q + 2*s, y2r); FV_STORE(y0ip + q + 2*s, y2i);
+            FV_STORE(y0rp + q + 3*s, y3r); FV_STORE(y0ip + q + 3*s, y3i);
+        }
+    }
+}
+
+    /* the last stage if n is an odd power of 2; this one's in place. */
+static void fft_radix2(float *xr, float *xi, int s)
+{
+    int q;
+    for (q = 0; q < s; q += 4)
+    {
+        t_fftvec ar = FV_LOAD(xr + q), ai = FV_LOAD(xi + q);
+        t_fftvec br = FV_LOAD(xr + q + s), bi = FV_LOAD(xi + q + s);
+        FV_STORE(xr + q, FV_ADD(ar, br)); FV_STORE(xi + q, FV_ADD(ai, bi));
+        FV_STORE(xr + q + s, FV_SUB(ar, br));
+        FV_STORE(xi + q + s, FV_SUB(ai, bi));
+    }
+}
+
+    /* forward complex FFT, exp(-2 pi i j k / n), of the data in (xr, xi)
+    using (yr, yi) as work space.  Returns nonzero if the result ended up in
+    (yr, yi).  For the inverse FFT, exchange real and imaginary parts. */
+static int fft_complex(t_fftplan *x, float *xr, float *xi,
+    float *yr, float *yi)
+{
+    int len = x->p_n / 4, s = 4, iny = 1;
+    float *tr, *ti;
+    fft_firststage(x, xr, xi, yr, yi);
+    for (; len >= 4; len /= 4, s *= 4)
+    {
+        tr = xr, ti = xi;
+        xr = yr, xi = yi;
+        yr = tr, yi = ti;
+        fft_stage(x, len, s, xr, xi, yr, yi);
+        iny = !iny;
+    }
+        /* the data are now in (yr, yi), whichever arrays those are */
+    if (len == 2)
+        fft_radix2(yr, yi, s);
+    return (iny);
+}
+
+static void fft_copy(float *to, const float *from, int n)
+{
+    memcpy(to, from, n * sizeof(float));
+}
+
+    /* the complex FFT in place; "work" is 2n floats of work space */
+static void fft_docomplex(t_fftplan *x, t_sample *fz1, t_sample *fz2,
+    float *work, int inverse)
+{
+    float *are = work, *aim = work + x->p_n;
+    if (inverse)
+    {
+        if (fft_complex(x, fz2, fz1, aim, are))
+            fft_copy(fz1, are, x->p_n), fft_copy(fz2, aim, x->p_n);
+    }
+    else if (fft_complex(x, fz1, fz2, are, aim))
+        fft_copy(fz1, are, x->p_n), fft_copy(fz2, aim, x->p_n);
+}
+
+    /* real FFT of 2n points using a complex one of n.  The result is laid
+    out as Pd does: real parts 0 to n, then imaginary parts n-1 down to 1,
+    the latter with the sign reversed as in Ooura's rdft().  "work" is 4n floats
+of work space. */
+static void fft_dorealfft(t_fftplan *x, t_sample *fz, float *work)
+{
+    int n = x->p_n, k;
+    float *zr, *zi, *are = work, *aim = work + n, *bre = work + 2*n,
+        *bim = work + 3*n;
+    for (k = 0; k < n; k++)
+        are[k] = fz[2*k], aim[k] = fz[2*k+1];
+    if (fft_complex(x, are, aim, bre, bim))
+        zr = bre, zi = bim;
+    else zr = are, zi = aim;
+    fz[0] = zr[0] + zi[0];
+    fz[n] = zr[0] - zi[0];
+        /* from Z[k] and Z[n-k] get the even and odd parts' spectra,
+        e = (Z[k] + conj(Z[n-k]))/2 and o = (Z[k] - conj(Z[n-k]))/2i; then
+        X[k] = e + w^k o and X[n-k] = conj(e - w^k o). */
+    for (k = 1; k <= n/2; k++)
+    {
+        float er = 0.5f * (zr[k] + zr[n-k]), ei = 0.5f * (zi[k] - zi[n-k]);
+        float odr = 0.5f * (zi[k] + zi[n-k]), odi = 0.5f * (zr[n-k] - zr[k]);
+        float tr = x->p_rwre[k] * odr - x->p_rwim[k] * odi;
+        float ti = x->p_rwre[k] * odi + x->p_rwim[k] * odr;
+        fz[k] = er + tr;
+        fz[2*n-k] = -(ei + ti);
+        fz[n-k] = er - tr;
+        fz[n+k] = ei - ti;
+    }
+}
+
+    /* and the inverse, without normalization */
+static void fft_dorealifft(t_fftplan *x, t_sample *fz, float *work)
+{
+    int n = x->p_n, k;
+    float *zr, *zi, *are = work, *aim = work + n, *bre = work + 2*n,
+        *bim = work + 3*n;
+    are[0] = fz[0] + fz[n];
+    aim[0] = fz[0] - fz[n];
+        /* the reverse of the above, times 2:  Z[k] = (X[k] + conj(X[n-k]))
+        + i conj(w^k) (X[k] - conj(X[n-k])) */
+    for (k = 1; k <= n/2; k++)
+    {
+        float ar = fz[k], ai = -fz[2*n-k], br = fz[n-k], bi = -fz[n+k];
+        float sr = ar + br, si = ai - bi, dr = ar - br, di = ai + bi;
+        float tr = dr * x->p_rwre[k] + di * x->p_rwim[k];
+        float ti = di * x->p_rwre[k] - dr * x->p_rwim[k];
+        are[k] = sr - ti;
+        aim[k] = si + tr;
+        are[n-k] = sr + ti;
+        aim[n-k] = tr - si;
+    }
+    if (fft_complex(x, aim, are, bim, bre))
+        zr = bre, zi = bim;
+    else zr = are, zi = aim;
+    for (k = 0; k < n; k++)
+        fz[2*k] = zr[k], fz[2*k+1] = zi[k];
+}
+
+#endif /* FFT_NATIVE */
+
 /* -------- initialization and cleanup -------- */
-static PERTHREAD int mayer_refcount = 0;
+static int mayer_refcount = 0;  /* protected by fft_mutex */
 
 void mayer_init( void)
 {
+    pthread_mutex_lock(&fft_mutex);
     mayer_refcount++;
+    pthread_mutex_unlock(&fft_mutex);
 }
 
 void mayer_term( void)
 {
+    pthread_mutex_lock(&fft_mutex);
     if (--mayer_refcount == 0)  /* clean up */
+    {
         ooura_term();
+#ifdef FFT_NATIVE
+        fft_term();
+#endif
+    }
+    pthread_mutex_unlock(&fft_mutex);
+}
+
+    /* choose the native (32) or Ooura's double precision (64) routines;
+    return the previous choice, or 0 if we can't */
+int mayer_setprecision(int bits)
+{
+    int was = fft_precision;
+#ifdef FFT_NATIVE
+    if (bits == 32 || bits == 64)
+#else
+    if (bits == 64)
+#endif
+    {
+        fft_precision = bits;
+        return (was);
+    }
+    else return (0);
+}
+
+const char *mayer_name( void)
+{
+#ifdef FFT_NATIVE
+    if (fft_precision == 32)
+        return ("native, single precision (" FFT_ISA ")");
+#endif
+    return ("Ooura, double precision");
 }
 
 /* -------- public routines -------- */
@@ -127,23 +515,39 @@ EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
 {
     FFTFLT *buf, *fp3;
     int i;
+    size_t bufsize = 2 * n * sizeof(FFTFLT);
     t_sample *fp1, *fp2;
-    if (!ooura_init(2*n))
+    t_oouraplan *x;
+#ifdef FFT_NATIVE
+    t_fftplan *p;
+    if (fft_precision == 32 && (p = fft_getplan(n)))
+    {
+        float *work;
+        size_t worksize = 2 * n * sizeof(float);
+        if (FFT_ALLOCA(work, worksize))
+        {
+            fft_docomplex(p, fz1, fz2, work, (sgn > 0));
+            FFT_FREEA(work, worksize);
+        }
+        return;
+    }
+#endif
+    if (!(x = ooura_getplan(2*n)) || !FFT_ALLOCA(buf, bufsize))
         return;
-    buf = ooura_buffer;
     for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
     {
         fp3[0] = *fp1++;
         fp3[1] = *fp2++;
         fp3 += 2;
     }
-    cdft(2*n, sgn, buf, ooura_bitrev, ooura_costab);
+    cdft(2*n, sgn, buf, x->o_bitrev, x->o_costab);
     for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
     {
         *fp1++ = fp3[0];
         *fp2++ = fp3[1];
         fp3 += 2;
     }
+    FFT_FREEA(buf, bufsize);
 }
 
 EXTERN void mayer_fft(int n, t_sample *fz1, t_sample *fz2)
@@ -160,52 +564,87 @@ EXTERN void mayer_realfft(int n, t_sample *fz)
 {
     FFTFLT *buf, *fp3;
     int i, nover2 = n/2;
+    size_t bufsize = n * sizeof(FFTFLT);
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
+    t_oouraplan *x;
+#ifdef FFT_NATIVE
+    t_fftplan *p;
+    if (fft_precision == 32 && (p = fft_getplan(nover2)))
+    {
+        float *work;
+        size_t worksize = 2 * n * sizeof(float);
+        if (FFT_ALLOCA(work, worksize))
+        {
+            fft_dorealfft(p, fz, work);
+            FFT_FREEA(work, worksize);
+        }
+        return;
+    }
+#endif
+    if (!(x = ooura_getplan(n)) || !FFT_ALLOCA(buf, bufsize))
         return;
-    buf = ooura_buffer;
     for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
         buf[i] = fz[i];
-    rdft(n, 1, buf, ooura_bitrev, ooura_costab);
+    rdft(n, 1, buf, x->o_bitrev, x->o_costab);
     fz[0] = buf[0];
     fz[nover2] = buf[1];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
         i++, fp1++, fp2--, fp3 += 2)
             *fp1 = fp3[0], *fp2 = fp3[1];
+    FFT_FREEA(buf, bufsize);
 }
 
 EXTERN void mayer_realifft(int n, t_sample *fz)
 {
     FFTFLT *buf, *fp3;
     int i, nover2 = n/2;
+    size_t bufsize = n * sizeof(FFTFLT);
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
+    t_oouraplan *x;
+#ifdef FFT_NATIVE
+    t_fftplan *p;
+    if (fft_precision == 32 && (p = fft_getplan(nover2)))
+    {
+        float *work;
+        size_t worksize = 2 * n * sizeof(float);
+        if (FFT_ALLOCA(work, worksize))
+        {
+            fft_dorealifft(p, fz, work);
+            FFT_FREEA(work, worksize);
+        }
+        return;
+    }
+#endif
+    if (!(x = ooura_getplan(n)) || !FFT_ALLOCA(buf, bufsize))
         return;
-    buf = ooura_buffer;
     buf[0] = fz[0];
     buf[1] = fz[nover2];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
         i++, fp1++, fp2--, fp3 += 2)
             fp3[0] = *fp1, fp3[1] = *fp2;
-    rdft(n, -1, buf, ooura_bitrev, ooura_costab);
+    rdft(n, -1, buf, x->o_bitrev, x->o_costab);
     for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
         fz[i] = 2*buf[i];
+    FFT_FREEA(buf, bufsize);
 }
 
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
 {
-    FFTFLT *buf2 = (FFTFLT *)alloca(2 * npoints * sizeof(FFTFLT)), *bp2;
+    FFTFLT *buf2, *bp2;
+    size_t bufsize = 2 * npoints * sizeof(FFTFLT);
     t_float *fp;
     int i;
-    if (!ooura_init(2*npoints))
+    t_oouraplan *x;
+    if (!(x = ooura_getplan(2*npoints)) || !FFT_ALLOCA(buf2, bufsize))
         return;
     for (i = 0, bp2 = buf2, fp = buf; i < 2 * npoints; i++, bp2++, fp++)
         *bp2 = *fp;
-    cdft(2*npoints, (inverse ? 1 : -1), buf2, ooura_bitrev, ooura_costab);
+    cdft(2*npoints, (inverse ? 1 : -1), buf2, x->o_bitrev, x->o_costab);
     for (i = 0, bp2 = buf2, fp = buf; i < 2 * npoints; i++, bp2++, fp++)
         *fp = *bp2;
+    FFT_FREEA(buf2, bufsize);
 }
 
 /****************** end Pd-specific prologue ***********************/
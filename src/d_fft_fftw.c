@@ -167,6 +167,18 @@ void mayer_term(void)
 }
 
 
+    /* FFTW is only used in single precision; return 32 if that's what's
+    asked for, otherwise 0. */
+int mayer_setprecision(int bits)
+{
+    return (bits == 32 ? 32 : 0);
+}
+
+const char *mayer_name(void)
+{
+    return ("FFTW, single precision");
+}
+
 EXTERN void mayer_fht(t_sample *fz, int n)
 {
     post("FHT: not yet implemented");
@@ -130,7 +130,7 @@ static void sighip_clear(t_sighip *x, t_floatarg q)
 void sighip_setup(void)
 {
     sighip_class = class_new(gensym("hip~"), (t_newmethod)sighip_new, 0,
-        sizeof(t_sighip), 0, A_DEFFLOAT, 0);
+        sizeof(t_sighip), CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sighip_class, t_sighip, x_f);
     class_addmethod(sighip_class, (t_method)sighip_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -221,7 +221,7 @@ static void siglop_dsp(t_siglop *x, t_signal **sp)
 void siglop_setup(void)
 {
     siglop_class = class_new(gensym("lop~"), (t_newmethod)siglop_new, 0,
-        sizeof(t_siglop), 0, A_DEFFLOAT, 0);
+        sizeof(t_siglop), CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(siglop_class, t_siglop, x_f);
     class_addmethod(siglop_class, (t_method)siglop_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -356,7 +356,7 @@ static void sigbp_dsp(t_sigbp *x, t_signal **sp)
 void sigbp_setup(void)
 {
     sigbp_class = class_new(gensym("bp~"), (t_newmethod)sigbp_new, 0,
-        sizeof(t_sigbp), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+        sizeof(t_sigbp), CLASS_PARALLEL, A_DEFFLOAT, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigbp_class, t_sigbp, x_f);
     class_addmethod(sigbp_class, (t_method)sigbp_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -483,7 +483,7 @@ static void sigbiquad_dsp(t_sigbiquad *x, t_signal **sp)
 void sigbiquad_setup(void)
 {
     sigbiquad_class = class_new(gensym("biquad~"), (t_newmethod)sigbiquad_new,
-        0, sizeof(t_sigbiquad), 0, A_GIMME, 0);
+        0, sizeof(t_sigbiquad), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(sigbiquad_class, t_sigbiquad, x_f);
     class_addmethod(sigbiquad_class, (t_method)sigbiquad_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -561,7 +561,8 @@ static void sigsamphold_set(t_sigsamphold *x, t_float f)
 void sigsamphold_setup(void)
 {
     sigsamphold_class = class_new(gensym("samphold~"),
-        (t_newmethod)sigsamphold_new, 0, sizeof(t_sigsamphold), 0, 0);
+        (t_newmethod)sigsamphold_new, 0, sizeof(t_sigsamphold),
+            CLASS_PARALLEL, 0);
     CLASS_MAINSIGNALIN(sigsamphold_class, t_sigsamphold, x_f);
     class_addmethod(sigsamphold_class, (t_method)sigsamphold_set,
         gensym("set"), A_DEFFLOAT, 0);
@@ -634,7 +635,8 @@ static void sigrpole_set(t_sigrpole *x, t_float f)
 void sigrpole_setup(void)
 {
     sigrpole_class = class_new(gensym("rpole~"),
-        (t_newmethod)sigrpole_new, 0, sizeof(t_sigrpole), 0, A_DEFFLOAT, 0);
+        (t_newmethod)sigrpole_new, 0, sizeof(t_sigrpole), CLASS_PARALLEL,
+            A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigrpole_class, t_sigrpole, x_f);
     class_addmethod(sigrpole_class, (t_method)sigrpole_set,
         gensym("set"), A_DEFFLOAT, 0);
@@ -706,7 +708,8 @@ static void sigrzero_set(t_sigrzero *x, t_float f)
 void sigrzero_setup(void)
 {
     sigrzero_class = class_new(gensym("rzero~"),
-        (t_newmethod)sigrzero_new, 0, sizeof(t_sigrzero), 0, A_DEFFLOAT, 0);
+        (t_newmethod)sigrzero_new, 0, sizeof(t_sigrzero), CLASS_PARALLEL,
+            A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigrzero_class, t_sigrzero, x_f);
     class_addmethod(sigrzero_class, (t_method)sigrzero_set,
         gensym("set"), A_DEFFLOAT, 0);
@@ -779,7 +782,7 @@ void sigrzero_rev_setup(void)
 {
     sigrzero_rev_class = class_new(gensym("rzero_rev~"),
         (t_newmethod)sigrzero_rev_new, 0, sizeof(t_sigrzero_rev),
-        0, A_DEFFLOAT, 0);
+        CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigrzero_rev_class, t_sigrzero_rev, x_f);
     class_addmethod(sigrzero_rev_class, (t_method)sigrzero_rev_set,
         gensym("set"), A_DEFFLOAT, 0);
@@ -871,7 +874,7 @@ static void sigcpole_set(t_sigcpole *x, t_float re, t_float im)
 void sigcpole_setup(void)
 {
     sigcpole_class = class_new(gensym("cpole~"),
-        (t_newmethod)sigcpole_new, 0, sizeof(t_sigcpole), 0,
+        (t_newmethod)sigcpole_new, 0, sizeof(t_sigcpole), CLASS_PARALLEL,
             A_DEFFLOAT, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigcpole_class, t_sigcpole, x_f);
     class_addmethod(sigcpole_class, (t_method)sigcpole_set,
@@ -961,7 +964,7 @@ static void sigczero_set(t_sigczero *x, t_float re, t_float im)
 void sigczero_setup(void)
 {
     sigczero_class = class_new(gensym("czero~"),
-        (t_newmethod)sigczero_new, 0, sizeof(t_sigczero), 0,
+        (t_newmethod)sigczero_new, 0, sizeof(t_sigczero), CLASS_PARALLEL,
             A_DEFFLOAT, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigczero_class, t_sigczero, x_f);
     class_addmethod(sigczero_class, (t_method)sigczero_set,
@@ -1053,8 +1056,8 @@ static void sigczero_rev_set(t_sigczero_rev *x, t_float re, t_float im)
 void sigczero_rev_setup(void)
 {
     sigczero_rev_class = class_new(gensym("czero_rev~"),
-        (t_newmethod)sigczero_rev_new, 0, sizeof(t_sigczero_rev), 0,
-            A_DEFFLOAT, A_DEFFLOAT, 0);
+        (t_newmethod)sigczero_rev_new, 0, sizeof(t_sigczero_rev),
+            CLASS_PARALLEL, A_DEFFLOAT, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigczero_rev_class, t_sigczero_rev, x_f);
     class_addmethod(sigczero_rev_class, (t_method)sigczero_rev_set,
         gensym("set"), A_DEFFLOAT, A_DEFFLOAT, 0);
@@ -1163,7 +1166,7 @@ static void slop_tilde_dsp(t_slop_tilde *x, t_signal **sp)
 void slop_tilde_setup(void)
 {
     slop_tilde_class = class_new(gensym("slop~"), (t_newmethod)slop_tilde_new, 0,
-        sizeof(t_slop_tilde), 0, A_GIMME, 0);
+        sizeof(t_slop_tilde), CLASS_PARALLEL, A_GIMME, 0);
     CLASS_MAINSIGNALIN(slop_tilde_class, t_slop_tilde, x_f);
     class_addmethod(slop_tilde_class, (t_method)slop_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -5,9 +5,10 @@
 /*  send~, receive~, throw~, catch~ */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include <string.h>
 
-#define DEFSENDVS 64    /* LATER get send to get this from canvas */
+#define DEFSENDVS (sys_getblksize())  /* LATER get this from canvas */
 
 /* ----------------------------- send~ ----------------------------- */
 static t_class *sigsend_class;
@@ -63,11 +64,12 @@ static void sigsend_free(t_sigsend *x)
 static void sigsend_setup(void)
 {
     sigsend_class = class_new(gensym("send~"), (t_newmethod)sigsend_new,
-        (t_method)sigsend_free, sizeof(t_sigsend), 0, A_DEFSYM, 0);
+        (t_method)sigsend_free, sizeof(t_sigsend), CLASS_PARALLEL, A_DEFSYM, 0);
     class_addcreator((t_newmethod)sigsend_new, gensym("s~"), A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(sigsend_class, t_sigsend, x_f);
     class_addmethod(sigsend_class, (t_method)sigsend_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(sigsend_class, DSPGROUP_SEND, 1);
 }
 
 /* ----------------------------- receive~ ----------------------------- */
@@ -178,12 +180,13 @@ static void sigreceive_setup(void)
 {
     sigreceive_class = class_new(gensym("receive~"),
         (t_newmethod)sigreceive_new, 0,
-        sizeof(t_sigreceive), 0, A_DEFSYM, 0);
+        sizeof(t_sigreceive), CLASS_PARALLEL, A_DEFSYM, 0);
     class_addcreator((t_newmethod)sigreceive_new, gensym("r~"), A_DEFSYM, 0);
     class_addmethod(sigreceive_class, (t_method)sigreceive_set, gensym("set"),
         A_SYMBOL, 0);
     class_addmethod(sigreceive_class, (t_method)sigreceive_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(sigreceive_class, DSPGROUP_SEND, 0);
     class_sethelpsymbol(sigreceive_class, gensym("send~"));
 }
 
@@ -257,9 +260,11 @@ static void sigcatch_free(t_sigcatch *x)
 static void sigcatch_setup(void)
 {
     sigcatch_class = class_new(gensym("catch~"), (t_newmethod)sigcatch_new,
-        (t_method)sigcatch_free, sizeof(t_sigcatch), CLASS_NOINLET, A_DEFSYM, 0);
+        (t_method)sigcatch_free, sizeof(t_sigcatch),
+            CLASS_NOINLET | CLASS_PARALLEL, A_DEFSYM, 0);
     class_addmethod(sigcatch_class, (t_method)sigcatch_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(sigcatch_class, DSPGROUP_THROW, 0);
     class_sethelpsymbol(sigcatch_class, gensym("throw~"));
 }
 
@@ -337,12 +342,13 @@ static void sigthrow_dsp(t_sigthrow *x, t_signal **sp)
 static void sigthrow_setup(void)
 {
     sigthrow_class = class_new(gensym("throw~"), (t_newmethod)sigthrow_new, 0,
-        sizeof(t_sigthrow), 0, A_DEFSYM, 0);
+        sizeof(t_sigthrow), CLASS_PARALLEL, A_DEFSYM, 0);
     class_addmethod(sigthrow_class, (t_method)sigthrow_set, gensym("set"),
         A_SYMBOL, 0);
     CLASS_MAINSIGNALIN(sigthrow_class, t_sigthrow, x_f);
     class_addmethod(sigthrow_class, (t_method)sigthrow_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspgroup(sigthrow_class, DSPGROUP_THROW, 1);
 }
 
 /* ----------------------- global setup routine ---------------- */
@@ -7,48 +7,10 @@
 
 #include "m_pd.h"
 #include "math.h"
+#include <string.h>
+#include "d_osc.h"
 
 #define BIGFLOAT 1.0e+19
-#define UNITBIT32 1572864.  /* 3*2^19; bit 32 has place value 1 */
-
-
-#if defined(__FreeBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__) \
-    || defined(__OpenBSD__)
-#include <machine/endian.h>
-#endif
-
-#if defined(__linux__) || defined(__CYGWIN__) || defined(__GNU__) || \
-    defined(ANDROID)
-#include <endian.h>
-#endif
-
-#ifdef __MINGW32__
-#include <sys/param.h>
-#endif
-
-#ifdef _MSC_VER
-/* _MSVC lacks BYTE_ORDER and LITTLE_ENDIAN */
-#define LITTLE_ENDIAN 0x0001
-#define BYTE_ORDER LITTLE_ENDIAN
-#endif
-
-#if !defined(BYTE_ORDER) || !defined(LITTLE_ENDIAN)
-#error No byte order defined
-#endif
-
-#if BYTE_ORDER == LITTLE_ENDIAN
-# define HIOFFSET 1
-# define LOWOFFSET 0
-#else
-# define HIOFFSET 0    /* word offset to find MSB */
-# define LOWOFFSET 1    /* word offset to find LSB */
-#endif
-
-union tabfudge
-{
-    double tf_d;
-    int32_t tf_i[2];
-};
 
 /* -------------------------- phasor~ ------------------------------ */
 static t_class *phasor_class;
@@ -115,7 +77,7 @@ static void phasor_ft1(t_phasor *x, t_float f)
 static void phasor_setup(void)
 {
     phasor_class = class_new(gensym("phasor~"), (t_newmethod)phasor_new, 0,
-        sizeof(t_phasor), 0, A_DEFFLOAT, 0);
+        sizeof(t_phasor), CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(phasor_class, t_phasor, x_f);
     class_addmethod(phasor_class, (t_method)phasor_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -125,32 +87,14 @@ static void phasor_setup(void)
 
 #endif  /* Hoeldrich version */
 
-/* ------------------------ cos~ ----------------------------- */
-
-float *cos_table;
-
-static t_class *cos_class;
-
-typedef struct _cos
-{
-    t_object x_obj;
-    t_float x_f;			// scalar frequency
-} t_cos;
+/* ------------------------ table lookup ----------------------------- */
 
-static void *cos_new(t_floatarg f)
+    /* The plain C lookup routines; see d_osc.h.  They're hand-unrolled so
+    that the union isn't written and read back in the same step. */
+static void osc_linear32_c(const float *tab, int mask, t_float conv,
+    const t_sample *in, t_sample *out, int n)
 {
-    t_cos *x = (t_cos *)pd_new(cos_class);
-    outlet_new(&x->x_obj, gensym("signal"));
-    x->x_f = f;
-    return (x);
-}
-
-static t_int *cos_perform(t_int *w)
-{
-    t_sample *in = (t_sample *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-    float *tab = cos_table, *addr;
+    const float *addr;
     t_float f1, f2, frac;
     double dphase;
     int normhipart;
@@ -162,9 +106,9 @@ static t_int *cos_perform(t_int *w)
 #if 0           /* this is the readable version of the code. */
     while (n--)
     {
-        dphase = (double)(*in++ * (float)(COSTABSIZE)) + UNITBIT32;
+        dphase = (double)(*in++ * conv) + UNITBIT32;
         tf.tf_d = dphase;
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
         tf.tf_i[HIOFFSET] = normhipart;
         frac = tf.tf_d - UNITBIT32;
         f1 = addr[0];
@@ -173,18 +117,18 @@ static t_int *cos_perform(t_int *w)
     }
 #endif
 #if 1           /* this is the same, unwrapped by hand. */
-        dphase = (double)(*in++ * (float)(COSTABSIZE)) + UNITBIT32;
+        dphase = (double)(*in++ * conv) + UNITBIT32;
         tf.tf_d = dphase;
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
         tf.tf_i[HIOFFSET] = normhipart;
     while (--n)
     {
-        dphase = (double)(*in++ * (float)(COSTABSIZE)) + UNITBIT32;
+        dphase = (double)(*in++ * conv) + UNITBIT32;
             frac = tf.tf_d - UNITBIT32;
         tf.tf_d = dphase;
             f1 = addr[0];
             f2 = addr[1];
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
             *out++ = f1 + frac * (f2 - f1);
         tf.tf_i[HIOFFSET] = normhipart;
     }
@@ -193,6 +137,130 @@ static t_int *cos_perform(t_int *w)
             f2 = addr[1];
             *out++ = f1 + frac * (f2 - f1);
 #endif
+}
+
+    /* wrap a phase (plus UNITBIT32) back into [0, fnpoints) */
+static double osc_wrap(double dphase, double fnpoints)
+{
+    int normhipart;
+    union tabfudge tf;
+    tf.tf_d = UNITBIT32 * fnpoints;
+    normhipart = tf.tf_i[HIOFFSET];
+    tf.tf_d = dphase + (UNITBIT32 * fnpoints - UNITBIT32);
+    tf.tf_i[HIOFFSET] = normhipart;
+    return (tf.tf_d - UNITBIT32 * fnpoints);
+}
+
+static void osc_linear64_c(const float *tab, int mask, t_float conv,
+    double *phase, const t_sample *in, t_sample *out, int n)
+{
+    const float *addr;
+    t_float f1, f2, frac;
+    double dphase = *phase + UNITBIT32;
+    int normhipart;
+    union tabfudge tf;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+#if 0
+    while (n--)
+    {
+        tf.tf_d = dphase;
+        dphase += *in++ * conv;
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        f1 = addr[0];
+        f2 = addr[1];
+        *out++ = f1 + frac * (f2 - f1);
+    }
+#endif
+#if 1
+        tf.tf_d = dphase;
+        dphase += *in++ * conv;
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+    while (--n)
+    {
+        tf.tf_d = dphase;
+            f1 = addr[0];
+        dphase += *in++ * conv;
+            f2 = addr[1];
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
+        tf.tf_i[HIOFFSET] = normhipart;
+            *out++ = f1 + frac * (f2 - f1);
+        frac = tf.tf_d - UNITBIT32;
+    }
+            f1 = addr[0];
+            f2 = addr[1];
+            *out++ = f1 + frac * (f2 - f1);
+#endif
+    *phase = osc_wrap(dphase, mask + 1);
+}
+
+static void osc_cubic64_c(const t_word *tab, int mask, t_float conv,
+    double *phase, const t_sample *in, t_sample *out, int n)
+{
+    const t_word *addr;
+    double dphase = *phase + UNITBIT32;
+    int normhipart;
+    union tabfudge tf;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    while (n--)
+    {
+        t_sample frac,  a,  b,  c,  d, cminusb;
+        tf.tf_d = dphase;
+        dphase += *in++ * conv;
+        addr = tab + (tf.tf_i[HIOFFSET] & mask);
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        a = addr[0].w_float;
+        b = addr[1].w_float;
+        c = addr[2].w_float;
+        d = addr[3].w_float;
+        cminusb = c-b;
+        *out++ = b + frac * (
+            cminusb - 0.1666667f * (1.-frac) * (
+                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+            )
+        );
+    }
+    *phase = osc_wrap(dphase, mask + 1);
+}
+
+t_osclinear32 osc_linear32 = osc_linear32_c;
+t_osclinear64 osc_linear64 = osc_linear64_c;
+t_osccubic64 osc_cubic64 = osc_cubic64_c;
+
+/* ------------------------ cos~ ----------------------------- */
+
+float *cos_table;
+
+static t_class *cos_class;
+
+typedef struct _cos
+{
+    t_object x_obj;
+    t_float x_f;			// scalar frequency
+} t_cos;
+
+static void *cos_new(t_floatarg f)
+{
+    t_cos *x = (t_cos *)pd_new(cos_class);
+    outlet_new(&x->x_obj, gensym("signal"));
+    x->x_f = f;
+    return (x);
+}
+
+static t_int *cos_perform(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    (*osc_linear32)(cos_table, COSTABSIZE-1, COSTABSIZE, in, out, n);
     return (w+4);
 }
 
@@ -230,7 +298,7 @@ static void cos_cleanup(t_class *c)
 static void cos_setup(void)
 {
     cos_class = class_new(gensym("cos~"), (t_newmethod)cos_new, 0,
-        sizeof(t_cos), 0, A_DEFFLOAT, 0);
+        sizeof(t_cos), CLASS_PARALLEL, A_DEFFLOAT, 0);
     class_setfreefn(cos_class, cos_cleanup);
     CLASS_MAINSIGNALIN(cos_class, t_cos, x_f);
     class_addmethod(cos_class, (t_method)cos_dsp, gensym("dsp"), A_CANT, 0);
@@ -266,55 +334,8 @@ static t_int *osc_perform(t_int *w)
     t_sample *in = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
-    float *tab = cos_table, *addr;
-    t_float f1, f2, frac;
-    double dphase = x->x_phase + UNITBIT32;
-    int normhipart;
-    union tabfudge tf;
-    float conv = x->x_conv;
-
-    tf.tf_d = UNITBIT32;
-    normhipart = tf.tf_i[HIOFFSET];
-#if 0
-    while (n--)
-    {
-        tf.tf_d = dphase;
-        dphase += *in++ * conv;
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
-        tf.tf_i[HIOFFSET] = normhipart;
-        frac = tf.tf_d - UNITBIT32;
-        f1 = addr[0];
-        f2 = addr[1];
-        *out++ = f1 + frac * (f2 - f1);
-    }
-#endif
-#if 1
-        tf.tf_d = dphase;
-        dphase += *in++ * conv;
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
-        tf.tf_i[HIOFFSET] = normhipart;
-        frac = tf.tf_d - UNITBIT32;
-    while (--n)
-    {
-        tf.tf_d = dphase;
-            f1 = addr[0];
-        dphase += *in++ * conv;
-            f2 = addr[1];
-        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
-        tf.tf_i[HIOFFSET] = normhipart;
-            *out++ = f1 + frac * (f2 - f1);
-        frac = tf.tf_d - UNITBIT32;
-    }
-            f1 = addr[0];
-            f2 = addr[1];
-            *out++ = f1 + frac * (f2 - f1);
-#endif
-
-    tf.tf_d = UNITBIT32 * COSTABSIZE;
-    normhipart = tf.tf_i[HIOFFSET];
-    tf.tf_d = dphase + (UNITBIT32 * COSTABSIZE - UNITBIT32);
-    tf.tf_i[HIOFFSET] = normhipart;
-    x->x_phase = tf.tf_d - UNITBIT32 * COSTABSIZE;
+    (*osc_linear64)(cos_table, COSTABSIZE-1, x->x_conv, &x->x_phase,
+        in, out, n);
     return (w+5);
 }
 
@@ -332,7 +353,7 @@ static void osc_ft1(t_osc *x, t_float f)
 static void osc_setup(void)
 {
     osc_class = class_new(gensym("osc~"), (t_newmethod)osc_new, 0,
-        sizeof(t_osc), 0, A_DEFFLOAT, 0);
+        sizeof(t_osc), CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(osc_class, t_osc, x_f);
     class_addmethod(osc_class, (t_method)osc_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(osc_class, (t_method)osc_ft1, gensym("ft1"), A_FLOAT, 0);
@@ -458,7 +479,7 @@ static
 void sigvcf_setup(void)
 {
     sigvcf_class = class_new(gensym("vcf~"), (t_newmethod)sigvcf_new, 0,
-        sizeof(t_sigvcf), 0, A_DEFFLOAT, 0);
+        sizeof(t_sigvcf), CLASS_PARALLEL, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigvcf_class, t_sigvcf, x_f);
     class_addmethod(sigvcf_class, (t_method)sigvcf_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -516,16 +537,381 @@ static void noise_float(t_noise *x, t_float f)
 static void noise_setup(void)
 {
     noise_class = class_new(gensym("noise~"), (t_newmethod)noise_new, 0,
-        sizeof(t_noise), 0, A_DEFFLOAT, 0);
+        sizeof(t_noise), CLASS_PARALLEL, A_DEFFLOAT, 0);
     class_addmethod(noise_class, (t_method)noise_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(noise_class, (t_method)noise_float,
         gensym("seed"), A_FLOAT, 0);
 }
 
+/* ------------------- SIMD table lookup ----------------------- */
+
+/* AVX2 versions of the lookup routines, for single-precision Pd on x86 with
+gcc or clang, chosen at run time if the CPU has AVX2.  They use the gather
+instructions to read the table.  The "64" ones add up the phase increments
+four at a time and then do the tabfudge trick on all four phases at once;
+this rounds the phase differently (by a few times 2^-32 points) so a sample
+may come out differently in the last bit.  They otherwise compute what the C
+routines do, in the same precision (FMA is left out for this reason.) */
+
+#if PD_FLOATSIZE == 32 && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define OSC_AVX2
+#define OSC_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+
+static OSC_TARGET void osc_linear32_avx2(const float *tab, int mask,
+    t_float conv, const t_sample *in, t_sample *out, int n)
+{
+        /* past 2^30 the phase has no fraction left; clip it so as not to
+        overflow the conversion to integer */
+    __m256 vconv = _mm256_set1_ps(conv), lo = _mm256_set1_ps(-1073741824.f),
+        hi = _mm256_set1_ps(1073741824.f);
+    __m256i vmask = _mm256_set1_epi32(mask);
+    int i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 phase = _mm256_min_ps(_mm256_max_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(in + i), vconv), lo), hi);
+        __m256 whole = _mm256_floor_ps(phase);
+        __m256 frac = _mm256_sub_ps(phase, whole);
+        __m256i index = _mm256_and_si256(_mm256_cvttps_epi32(whole), vmask);
+        __m256 f1 = _mm256_i32gather_ps(tab, index, 4);
+        __m256 f2 = _mm256_i32gather_ps(tab + 1, index, 4);
+        _mm256_storeu_ps(out + i,
+            _mm256_add_ps(f1, _mm256_mul_ps(frac, _mm256_sub_ps(f2, f1))));
+    }
+    if (i < n)
+        osc_linear32_c(tab, mask, conv, in + i, out + i, n - i);
+}
+
+    /* the state for four phases at a time.  x86 is little-endian so the
+    high word of each double is the odd-numbered 32-bit word. */
+typedef struct _oscphase4
+{
+    __m256d p_phase;    /* phase plus UNITBIT32 for the next four samples */
+    __m128 p_conv;
+    __m256d p_lowword;  /* mask for low words */
+    __m256d p_normhi;   /* high word of UNITBIT32 */
+    __m256d p_unit;
+    __m128i p_mask;
+} t_oscphase4;
+
+static OSC_TARGET void oscphase4_init(t_oscphase4 *p, double phase,
+    t_float conv, int mask)
+{
+    union tabfudge tf;
+    tf.tf_d = UNITBIT32;
+    p->p_phase = _mm256_set1_pd(phase + UNITBIT32);
+    p->p_conv = _mm_set1_ps(conv);
+    p->p_lowword = _mm256_castsi256_pd(_mm256_set1_epi64x(0xffffffffLL));
+    p->p_normhi = _mm256_castsi256_pd(
+        _mm256_set1_epi64x((long long)tf.tf_i[HIOFFSET] << 32));
+    p->p_unit = _mm256_set1_pd(UNITBIT32);
+    p->p_mask = _mm_set1_epi32(mask);
+}
+
+    /* step four samples: get the four table indices and fractional parts
+    and advance the phase */
+static OSC_TARGET void oscphase4_step(t_oscphase4 *p, const t_sample *in,
+    __m128i *index, __m128 *frac)
+{
+    __m256d zero = _mm256_setzero_pd(), incr, sum, phase;
+    incr = _mm256_cvtps_pd(_mm_mul_ps(_mm_loadu_ps(in), p->p_conv));
+        /* sums of the increments before each sample: 0, a, a+b, a+b+c */
+    sum = _mm256_blend_pd(
+        _mm256_permute4x64_pd(incr, _MM_SHUFFLE(2, 1, 0, 0)), zero, 1);
+    sum = _mm256_add_pd(sum, _mm256_blend_pd(
+        _mm256_permute4x64_pd(sum, _MM_SHUFFLE(2, 1, 0, 0)), zero, 1));
+    sum = _mm256_add_pd(sum, _mm256_blend_pd(
+        _mm256_permute4x64_pd(sum, _MM_SHUFFLE(1, 0, 0, 0)), zero, 3));
+    phase = _mm256_add_pd(p->p_phase, sum);
+    p->p_phase = _mm256_add_pd(p->p_phase, _mm256_permute4x64_pd(
+        _mm256_add_pd(sum, incr), _MM_SHUFFLE(3, 3, 3, 3)));
+    *index = _mm_and_si128(_mm256_castsi256_si128(
+        _mm256_permutevar8x32_epi32(_mm256_castpd_si256(phase),
+            _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7))), p->p_mask);
+    *frac = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_or_pd(
+        _mm256_and_pd(phase, p->p_lowword), p->p_normhi), p->p_unit));
+}
+
+    /* the phase (without UNITBIT32) for the next sample */
+static OSC_TARGET double oscphase4_get(t_oscphase4 *p)
+{
+    return (_mm256_cvtsd_f64(p->p_phase) - UNITBIT32);
+}
+
+static OSC_TARGET void osc_linear64_avx2(const float *tab, int mask,
+    t_float conv, double *phase, const t_sample *in, t_sample *out, int n)
+{
+    t_oscphase4 p;
+    int i;
+    oscphase4_init(&p, *phase, conv, mask);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i index;
+        __m128 frac, f1, f2;
+        oscphase4_step(&p, in + i, &index, &frac);
+        f1 = _mm_i32gather_ps(tab, index, 4);
+        f2 = _mm_i32gather_ps(tab + 1, index, 4);
+        _mm_storeu_ps(out + i,
+            _mm_add_ps(f1, _mm_mul_ps(frac, _mm_sub_ps(f2, f1))));
+    }
+    *phase = oscphase4_get(&p);
+    if (i < n)
+        osc_linear64_c(tab, mask, conv, phase, in + i, out + i, n - i);
+    else *phase = osc_wrap(*phase + UNITBIT32, mask + 1);
+}
+
+static OSC_TARGET void osc_cubic64_avx2(const t_word *tab, int mask,
+    t_float conv, double *phase, const t_sample *in, t_sample *out, int n)
+{
+    t_oscphase4 p;
+    __m128 three = _mm_set1_ps(3.0f), two = _mm_set1_ps(2.0f);
+    __m256d one = _mm256_set1_pd(1.), sixth = _mm256_set1_pd(0.1666667f);
+    int i;
+    oscphase4_init(&p, *phase, conv, mask);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i index;
+        __m128 frac, a, b, c, d, cminusb, poly;
+        __m256d dfrac, dpoly;
+        oscphase4_step(&p, in + i, &index, &frac);
+        a = _mm_i32gather_ps(&tab[0].w_float, index, sizeof(t_word));
+        b = _mm_i32gather_ps(&tab[1].w_float, index, sizeof(t_word));
+        c = _mm_i32gather_ps(&tab[2].w_float, index, sizeof(t_word));
+        d = _mm_i32gather_ps(&tab[3].w_float, index, sizeof(t_word));
+        cminusb = _mm_sub_ps(c, b);
+            /* (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b) */
+        poly = _mm_add_ps(
+            _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(d, a),
+                _mm_mul_ps(three, cminusb)), frac),
+            _mm_sub_ps(_mm_add_ps(d, _mm_mul_ps(two, a)),
+                _mm_mul_ps(three, b)));
+            /* and the rest in double precision as in the C version */
+        dfrac = _mm256_cvtps_pd(frac);
+        dpoly = _mm256_mul_pd(_mm256_mul_pd(sixth,
+            _mm256_sub_pd(one, dfrac)), _mm256_cvtps_pd(poly));
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_add_pd(
+            _mm256_cvtps_pd(b), _mm256_mul_pd(dfrac,
+                _mm256_sub_pd(_mm256_cvtps_pd(cminusb), dpoly)))));
+    }
+    *phase = oscphase4_get(&p);
+    if (i < n)
+        osc_cubic64_c(tab, mask, conv, phase, in + i, out + i, n - i);
+    else *phase = osc_wrap(*phase + UNITBIT32, mask + 1);
+}
+
+#endif /* OSC_AVX2 */
+
+static const char *osc_isa = "C";
+
+static void osc_choosekernels(void)
+{
+#ifdef OSC_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        osc_linear32 = osc_linear32_avx2;
+        osc_linear64 = osc_linear64_avx2;
+        osc_cubic64 = osc_cubic64_avx2;
+        osc_isa = "AVX2";
+    }
+#endif
+}
+
+#ifdef PD_BENCHMARKS
+
+    /* "pd osc-benchmark": time the plain C lookup routines against the ones
+    we're using, as cos~, osc~ and tabosc4~ use them, for vector sizes from
+    64 to 4096.  Then run each at 997 Hz and print its THD+N (the power of its
+    difference from a perfect cosine, relative to the cosine's) and the
+    largest difference between the two versions. */
+#define OSCBENCH_N 4096
+#define OSCBENCH_SR 44100.
+#define OSCBENCH_FREQ 997.
+#define OSCBENCH_TABSIZE 512
+
+static void oscbench_run(int k, int plain, const t_word *wtab,
+    const t_sample *in, t_sample *out, int n)
+{
+    double phase = 0;
+    if (k == 0)
+        (*(plain ? osc_linear32_c : osc_linear32))(cos_table,
+            COSTABSIZE-1, COSTABSIZE, in, out, n);
+    else if (k == 1)
+        (*(plain ? osc_linear64_c : osc_linear64))(cos_table,
+            COSTABSIZE-1, COSTABSIZE / OSCBENCH_SR, &phase, in, out, n);
+    else (*(plain ? osc_cubic64_c : osc_cubic64))(wtab,
+            OSCBENCH_TABSIZE-1, OSCBENCH_TABSIZE / OSCBENCH_SR, &phase,
+                in, out, n);
+}
+
+static double oscbench_thd(const t_sample *out, int n)
+{
+    double signal = 0, error = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        double f = cos(2 * 3.14159265358979 * OSCBENCH_FREQ * i / OSCBENCH_SR);
+        signal += f * f;
+        error += (out[i] - f) * (out[i] - f);
+    }
+    return (error > 0 ? 10 * log10(error / signal) : -999);
+}
+
+    /* check that the lookup routines we're using agree with the C ones to
+    within OSCTEST_MAXDIFF, for phases and frequencies in and out of range
+    (including negative ones), and that they carry the phase over from one
+    call to the next the same way.  The calls are of every size from 1 to
+    OSCTEST_MAXCHUNK so that every remainder after the vector loop is
+    covered. */
+#define OSCTEST_MAXDIFF 1e-5
+#define OSCTEST_MAXCHUNK 40
+
+int osc_selftest(void)
+{
+    t_sample *in = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample)),
+        *out1 = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample)),
+        *out2 = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample));
+    t_word *wtab = (t_word *)getbytes((OSCBENCH_TABSIZE + 3) * sizeof(t_word));
+    int i, k, nbad = 0;
+    for (i = 0; i < OSCBENCH_TABSIZE + 3; i++)
+        wtab[i].w_float = cos(2 * 3.14159265358979 * (i - 1) /
+            OSCBENCH_TABSIZE);
+    for (k = 0; k < 3; k++)
+    {
+        double phase1 = 0.25, phase2 = 0.25, maxdiff = 0;
+        int onset, n;
+        for (i = 0; i < OSCBENCH_N; i++)
+        {
+                /* cos~ gets phases from -3 to 5; osc~ and tabosc4~ get
+                frequencies sweeping from -30000 to 30000 */
+            if (k == 0)
+                in[i] = -3 + 8. * i / OSCBENCH_N;
+            else in[i] = -30000 + 60000. * i / OSCBENCH_N;
+        }
+        for (onset = 0, n = 1; onset < OSCBENCH_N;
+            onset += n, n = n % OSCTEST_MAXCHUNK + 1)
+        {
+            if (n > OSCBENCH_N - onset)
+                n = OSCBENCH_N - onset;
+            if (k == 0)
+            {
+                osc_linear32_c(cos_table, COSTABSIZE-1, COSTABSIZE,
+                    in + onset, out1 + onset, n);
+                (*osc_linear32)(cos_table, COSTABSIZE-1, COSTABSIZE,
+                    in + onset, out2 + onset, n);
+            }
+            else if (k == 1)
+            {
+                osc_linear64_c(cos_table, COSTABSIZE-1,
+                    COSTABSIZE / OSCBENCH_SR, &phase1, in + onset,
+                        out1 + onset, n);
+                (*osc_linear64)(cos_table, COSTABSIZE-1,
+                    COSTABSIZE / OSCBENCH_SR, &phase2, in + onset,
+                        out2 + onset, n);
+            }
+            else
+            {
+                osc_cubic64_c(wtab, OSCBENCH_TABSIZE-1,
+                    OSCBENCH_TABSIZE / OSCBENCH_SR, &phase1, in + onset,
+                        out1 + onset, n);
+                (*osc_cubic64)(wtab, OSCBENCH_TABSIZE-1,
+                    OSCBENCH_TABSIZE / OSCBENCH_SR, &phase2, in + onset,
+                        out2 + onset, n);
+            }
+        }
+        for (i = 0; i < OSCBENCH_N; i++)
+            if (fabs(out1[i] - out2[i]) > maxdiff)
+                maxdiff = fabs(out1[i] - out2[i]);
+        if (maxdiff > OSCTEST_MAXDIFF || fabs(phase1 - phase2) > 1e-9)
+        {
+            pd_error(0, "osc self-test: routine %d differs by %g, "
+                "phase by %g (%s)", k, maxdiff, phase1 - phase2, osc_isa);
+            nbad++;
+        }
+    }
+    freebytes(in, OSCBENCH_N * sizeof(t_sample));
+    freebytes(out1, OSCBENCH_N * sizeof(t_sample));
+    freebytes(out2, OSCBENCH_N * sizeof(t_sample));
+    freebytes(wtab, (OSCBENCH_TABSIZE + 3) * sizeof(t_word));
+    return (nbad);
+}
+
+void glob_oscbenchmark(void *dummy)
+{
+    static const char *names[3] = {"cos~", "osc~", "tabosc4~"};
+    t_sample *ramp = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample)),
+        *freq = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample)),
+        *out1 = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample)),
+        *out2 = (t_sample *)getbytes(OSCBENCH_N * sizeof(t_sample));
+    t_word *wtab = (t_word *)getbytes((OSCBENCH_TABSIZE + 3) * sizeof(t_word));
+    char buf[MAXPDSTRING];
+    int i, j, k, n;
+    for (i = 0; i < OSCBENCH_N; i++)
+    {
+        double cycles = OSCBENCH_FREQ * i / OSCBENCH_SR;
+        ramp[i] = cycles - floor(cycles);
+        freq[i] = OSCBENCH_FREQ;
+    }
+    for (i = 0; i < OSCBENCH_TABSIZE + 3; i++)
+        wtab[i].w_float = cos(2 * 3.14159265358979 * (i - 1) /
+            OSCBENCH_TABSIZE);
+    post("osc-benchmark: speedup of %s over C lookup routines", osc_isa);
+    strcpy(buf, "          ");
+    for (n = 64; n <= OSCBENCH_N; n *= 2)
+        sprintf(buf + strlen(buf), "%7d", n);
+    post("%s", buf);
+    for (k = 0; k < 3; k++)
+    {
+        const t_sample *in = (k ? freq : ramp);
+        sprintf(buf, "%-10s", names[k]);
+        for (n = 64; n <= OSCBENCH_N; n *= 2)
+        {
+            int reps = (1 << 21) / n;
+            double t1, t2, t3;
+            t1 = sys_getrealtime();
+            for (j = 0; j < reps; j++)
+                oscbench_run(k, 1, wtab, in, out1, n);
+            t2 = sys_getrealtime();
+            for (j = 0; j < reps; j++)
+                oscbench_run(k, 0, wtab, in, out2, n);
+            t3 = sys_getrealtime();
+            sprintf(buf + strlen(buf), "%7.2f",
+                (t3 > t2 ? (t2 - t1) / (t3 - t2) : 0));
+        }
+        post("%s", buf);
+    }
+    post("osc-benchmark: THD+N (dB) of C and %s routines, largest difference",
+        osc_isa);
+    for (k = 0; k < 3; k++)
+    {
+        const t_sample *in = (k ? freq : ramp);
+        double maxdiff = 0;
+        oscbench_run(k, 1, wtab, in, out1, OSCBENCH_N);
+        oscbench_run(k, 0, wtab, in, out2, OSCBENCH_N);
+        for (i = 0; i < OSCBENCH_N; i++)
+            if (fabs(out1[i] - out2[i]) > maxdiff)
+                maxdiff = fabs(out1[i] - out2[i]);
+        post("%-10s%8.1f%8.1f%12g", names[k],
+            oscbench_thd(out1, OSCBENCH_N), oscbench_thd(out2, OSCBENCH_N),
+                maxdiff);
+    }
+    osc_selftest();
+    freebytes(ramp, OSCBENCH_N * sizeof(t_sample));
+    freebytes(freq, OSCBENCH_N * sizeof(t_sample));
+    freebytes(out1, OSCBENCH_N * sizeof(t_sample));
+    freebytes(out2, OSCBENCH_N * sizeof(t_sample));
+    freebytes(wtab, (OSCBENCH_TABSIZE + 3) * sizeof(t_word));
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* ----------------------- global setup routine ---------------- */
 void d_osc_setup(void)
 {
+    osc_choosekernels();
     phasor_setup();
     cos_setup();
     osc_setup();
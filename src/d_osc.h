@@ -0,0 +1,69 @@
+/* Copyright (c) 1997-1999 Miller Puckette.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* table lookup oscillators: the "tabfudge" trick, and the lookup routines
+shared by cos~ and osc~ (in d_osc.c) and tabosc4~ (in d_array.c). */
+
+#pragma once
+
+#include "m_pd.h"
+
+#define UNITBIT32 1572864.  /* 3*2^19; bit 32 has place value 1 */
+
+#if defined(__FreeBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__) \
+    || defined(__OpenBSD__)
+#include <machine/endian.h>
+#endif
+
+#if defined(__linux__) || defined(__CYGWIN__) || defined(__GNU__) || \
+    defined(ANDROID)
+#include <endian.h>
+#endif
+
+#ifdef __MINGW32__
+#include <sys/param.h>
+#endif
+
+#ifdef _MSC_VER
+/* _MSVC lacks BYTE_ORDER and LITTLE_ENDIAN */
+#define LITTLE_ENDIAN 0x0001
+#define BYTE_ORDER LITTLE_ENDIAN
+#endif
+
+#if !defined(BYTE_ORDER) || !defined(LITTLE_ENDIAN)
+#error No byte order defined
+#endif
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+# define HIOFFSET 1
+# define LOWOFFSET 0
+#else
+# define HIOFFSET 0    /* word offset to find MSB */
+# define LOWOFFSET 1    /* word offset to find LSB */
+#endif
+
+union tabfudge
+{
+    double tf_d;
+    int32_t tf_i[2];
+};
+
+    /* The lookup routines read a table whose size (in points) is a power of
+    two, "mask" being one less.  Phases are in points.  The "32" routines take
+    the phase from the input, times "conv", in single precision; the "64"
+    ones accumulate "conv" times the input into "*phase" in double precision,
+    and wrap it back to [0, size) at the end.  Linear interpolation reads one
+    point past the last; 4-point interpolation reads points i to i+3 to
+    interpolate between i+1 and i+2, so its table has three extra points. */
+typedef void (*t_osclinear32)(const float *tab, int mask, t_float conv,
+    const t_sample *in, t_sample *out, int n);
+typedef void (*t_osclinear64)(const float *tab, int mask, t_float conv,
+    double *phase, const t_sample *in, t_sample *out, int n);
+typedef void (*t_osccubic64)(const t_word *tab, int mask, t_float conv,
+    double *phase, const t_sample *in, t_sample *out, int n);
+
+    /* these point to SIMD versions if the CPU has them */
+extern t_osclinear32 osc_linear32;
+extern t_osclinear64 osc_linear64;
+extern t_osccubic64 osc_cubic64;
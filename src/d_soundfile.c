@@ -12,6 +12,7 @@ thread so that they can be used in real time.  The readsf~ and writesf~
 objects use Posix-like threads. */
 
 #include "d_soundfile.h"
+#include "s_stuff.h"
 #ifdef _WIN32
 #include <io.h>
 #endif
@@ -19,6 +20,10 @@ objects use Posix-like threads. */
 #include <stdio.h>
 #include <pthread.h>
 #include <math.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 /* Supported sample formats: LPCM (16 or 24 bit int) & 32 bit float */
 
@@ -431,72 +436,412 @@ int open_soundfile_via_canvas(t_canvas *canvas, const char *filename,
     return sf_fd;
 }
 
+/* ----- sample format conversion ----- */
+
+/* Converting between the soundfile's interleaved sample frames and Pd's
+floating-point vectors is done by "kernels" chosen from a table by sample
+format (2, 3 or 4 bytes, little or big endian) and channel count (mono,
+stereo, or anything else).  An input kernel takes "nframes" frames, "stride"
+bytes apart, and writes the first "nchannels" channels to the vectors,
+whose elements are "skip" t_floats apart -- 1 for signals, or the size of a
+t_word for arrays.  An output kernel does the opposite for all the channels
+in the frame.  The mono and stereo kernels are the generic ones specialized
+so that the compiler can unroll them; for 16-bit and floating-point samples
+we also have SSE2 versions which compute exactly the same thing. */
+
+typedef void (*t_sfxferin)(const unsigned char *buf, int stride,
+    int nchannels, t_float **vecs, int skip, size_t nframes);
+typedef void (*t_sfxferout)(t_float **vecs, int skip, unsigned char *buf,
+    int stride, int nchannels, size_t nframes, t_float normalfactor);
+
+    /* make the generic, mono and stereo input kernels for samples of
+    "bytes" bytes, given an expression converting the sample at "sp" */
+#define SF_XFERIN(name, bytes, expr) \
+static void name##_n(const unsigned char *buf, int stride, int nchannels, \
+    t_float **vecs, int skip, size_t nframes) \
+{ \
+    int i; \
+    size_t j; \
+    for (i = 0; i < nchannels; i++) \
+    { \
+        const unsigned char *sp = buf + i * bytes; \
+        t_float *fp = vecs[i]; \
+        for (j = 0; j < nframes; j++, sp += stride, fp += skip) \
+            *fp = (expr); \
+    } \
+} \
+static void name##_1(const unsigned char *buf, int stride, int nchannels, \
+    t_float **vecs, int skip, size_t nframes) \
+{ \
+    name##_n(buf, bytes, 1, vecs, skip, nframes); \
+} \
+static void name##_2(const unsigned char *buf, int stride, int nchannels, \
+    t_float **vecs, int skip, size_t nframes) \
+{ \
+    name##_n(buf, 2 * bytes, 2, vecs, skip, nframes); \
+}
+
+static t_float sf_getfloat(uint32_t ui)
+{
+    t_floatuint alias;
+    alias.ui = ui;
+    return ((t_float)alias.f);
+}
+
+SF_XFERIN(sf_in16le, 2, SCALE * ((sp[1] << 24) | (sp[0] << 16)))
+SF_XFERIN(sf_in16be, 2, SCALE * ((sp[0] << 24) | (sp[1] << 16)))
+SF_XFERIN(sf_in24le, 3, SCALE * ((sp[2] << 24) | (sp[1] << 16) | (sp[0] << 8)))
+SF_XFERIN(sf_in24be, 3, SCALE * ((sp[0] << 24) | (sp[1] << 16) | (sp[2] << 8)))
+SF_XFERIN(sf_in32le, 4, sf_getfloat(((uint32_t)sp[3] << 24) |
+    (sp[2] << 16) | (sp[1] << 8) | sp[0]))
+SF_XFERIN(sf_in32be, 4, sf_getfloat(((uint32_t)sp[0] << 24) |
+    (sp[1] << 16) | (sp[2] << 8) | sp[3]))
+
+    /* make the generic, mono and stereo output kernels.  "convert" is a
+    statement that stores the sample "f" (already multiplied by
+    "normalfactor") at "sp". */
+#define SF_XFEROUT(name, bytes, convert) \
+static void name##_n(t_float **vecs, int skip, unsigned char *buf, \
+    int stride, int nchannels, size_t nframes, t_float normalfactor) \
+{ \
+    int i; \
+    size_t j; \
+    for (i = 0; i < nchannels; i++) \
+    { \
+        unsigned char *sp = buf + i * bytes; \
+        const t_float *fp = vecs[i]; \
+        for (j = 0; j < nframes; j++, sp += stride, fp += skip) \
+        { \
+            t_float f = *fp * normalfactor; \
+            convert; \
+        } \
+    } \
+} \
+static void name##_1(t_float **vecs, int skip, unsigned char *buf, \
+    int stride, int nchannels, size_t nframes, t_float normalfactor) \
+{ \
+    name##_n(vecs, skip, buf, bytes, 1, nframes, normalfactor); \
+} \
+static void name##_2(t_float **vecs, int skip, unsigned char *buf, \
+    int stride, int nchannels, size_t nframes, t_float normalfactor) \
+{ \
+    name##_n(vecs, skip, buf, 2 * bytes, 2, nframes, normalfactor); \
+}
+
+    /* the integer formats round down and clip to the symmetric range */
+static int sf_getint(t_float f, int max)
+{
+    int xx = (max + 1.) + f;
+    xx -= (max + 1);
+    if (xx < -max)
+        xx = -max;
+    if (xx > max)
+        xx = max;
+    return (xx);
+}
+
+static uint32_t sf_getbits(t_float f)
+{
+    t_floatuint alias;
+    alias.f = f;
+    return (alias.ui);
+}
+
+SF_XFEROUT(sf_out16le, 2, {int xx = sf_getint(f * 32768., 32767);
+    sp[1] = (xx >> 8); sp[0] = xx;})
+SF_XFEROUT(sf_out16be, 2, {int xx = sf_getint(f * 32768., 32767);
+    sp[0] = (xx >> 8); sp[1] = xx;})
+SF_XFEROUT(sf_out24le, 3, {int xx = sf_getint(f * 8388608., 8388607);
+    sp[2] = (xx >> 16); sp[1] = (xx >> 8); sp[0] = xx;})
+SF_XFEROUT(sf_out24be, 3, {int xx = sf_getint(f * 8388608., 8388607);
+    sp[0] = (xx >> 16); sp[1] = (xx >> 8); sp[2] = xx;})
+SF_XFEROUT(sf_out32le, 4, {uint32_t ui = sf_getbits(f);
+    sp[3] = (ui >> 24); sp[2] = (ui >> 16); sp[1] = (ui >> 8); sp[0] = ui;})
+SF_XFEROUT(sf_out32be, 4, {uint32_t ui = sf_getbits(f);
+    sp[0] = (ui >> 24); sp[1] = (ui >> 16); sp[2] = (ui >> 8); sp[3] = ui;})
+
+#if PD_FLOATSIZE == 32 && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define SF_SSE2
+#define SF_TARGET __attribute__((target("sse2")))
+#include <emmintrin.h>
+#elif PD_FLOATSIZE == 32 && defined(_MSC_VER) && defined(_M_X64)
+#define SF_SSE2
+#define SF_TARGET
+#include <emmintrin.h>
+#endif
+
+#ifdef SF_SSE2
+
+    /* byte swapping for big-endian files */
+static SF_TARGET __m128i sf_swap16(__m128i v)
+{
+    return (_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+}
+
+static SF_TARGET __m128i sf_swap32(__m128i v)
+{
+    v = _mm_shufflelo_epi16(v, 0xb1);
+    return (sf_swap16(_mm_shufflehi_epi16(v, 0xb1)));
+}
+
+    /* load or store 4 floats "skip" apart.  "skip" is 1 or 2; storing
+    into array elements leaves the rest of each t_word alone. */
+static SF_TARGET __m128 sf_load(const t_float *fp, int skip)
+{
+    if (skip == 1)
+        return (_mm_loadu_ps(fp));
+    else return (_mm_shuffle_ps(_mm_loadu_ps(fp), _mm_loadu_ps(fp + 4),
+        _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static SF_TARGET void sf_store(t_float *fp, int skip, __m128 v)
+{
+    if (skip == 1)
+        _mm_storeu_ps(fp, v);
+    else
+    {
+        _mm_store_ss(fp, v);
+        _mm_store_ss(fp + 2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+        _mm_store_ss(fp + 4, _mm_movehl_ps(v, v));
+        _mm_store_ss(fp + 6, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+}
+
+    /* float to 16 bits, rounding down and clipping as sf_getint() does */
+static SF_TARGET __m128i sf_to16(__m128 f, __m128 gain)
+{
+    __m128 x = _mm_mul_ps(_mm_mul_ps(f, gain), _mm_set1_ps(32768.f));
+    __m128i xx;
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-32767.f)),
+        _mm_set1_ps(32767.f));
+    xx = _mm_cvttps_epi32(x);
+        /* truncation rounded negative numbers up; fix them */
+    return (_mm_add_epi32(xx,
+        _mm_castps_si128(_mm_cmplt_ps(x, _mm_cvtepi32_ps(xx)))));
+}
+
+    /* make the SSE2 input and output kernels for 16-bit samples and
+    floats in either byte order.  They handle 8 frames (mono) or 4 frames
+    (stereo) at a time and leave the rest to the generic kernels. */
+#define SF_SSE2KERNELS(end, swap16, swap32) \
+static SF_TARGET void sf_in16##end##_1_sse2(const unsigned char *buf, \
+    int stride, int nchannels, t_float **vecs, int skip, size_t nframes) \
+{ \
+    __m128 scale = _mm_set1_ps((float)SCALE); \
+    __m128i zero = _mm_setzero_si128(); \
+    t_float *fp = vecs[0]; \
+    size_t j; \
+    for (j = 0; j + 8 <= nframes; j += 8, buf += 16, fp += 8 * skip) \
+    { \
+        __m128i v = swap16(_mm_loadu_si128((const __m128i *)buf)); \
+        sf_store(fp, skip, _mm_mul_ps(scale, \
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(zero, v)))); \
+        sf_store(fp + 4 * skip, skip, _mm_mul_ps(scale, \
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(zero, v)))); \
+    } \
+    sf_in16##end##_n(buf, 2, 1, &fp, skip, nframes - j); \
+} \
+static SF_TARGET void sf_in16##end##_2_sse2(const unsigned char *buf, \
+    int stride, int nchannels, t_float **vecs, int skip, size_t nframes) \
+{ \
+    __m128 scale = _mm_set1_ps((float)SCALE); \
+    __m128i mask = _mm_set1_epi32((int)0xffff0000); \
+    t_float *fp[2]; \
+    size_t j; \
+    fp[0] = vecs[0], fp[1] = vecs[1]; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 16, \
+        fp[0] += 4 * skip, fp[1] += 4 * skip) \
+    { \
+        __m128i v = swap16(_mm_loadu_si128((const __m128i *)buf)); \
+        sf_store(fp[0], skip, _mm_mul_ps(scale, \
+            _mm_cvtepi32_ps(_mm_slli_epi32(v, 16)))); \
+        sf_store(fp[1], skip, _mm_mul_ps(scale, \
+            _mm_cvtepi32_ps(_mm_and_si128(v, mask)))); \
+    } \
+    sf_in16##end##_n(buf, 4, 2, fp, skip, nframes - j); \
+} \
+static SF_TARGET void sf_in32##end##_1_sse2(const unsigned char *buf, \
+    int stride, int nchannels, t_float **vecs, int skip, size_t nframes) \
+{ \
+    t_float *fp = vecs[0]; \
+    size_t j; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 16, fp += 4 * skip) \
+        sf_store(fp, skip, _mm_castsi128_ps( \
+            swap32(_mm_loadu_si128((const __m128i *)buf)))); \
+    sf_in32##end##_n(buf, 4, 1, &fp, skip, nframes - j); \
+} \
+static SF_TARGET void sf_in32##end##_2_sse2(const unsigned char *buf, \
+    int stride, int nchannels, t_float **vecs, int skip, size_t nframes) \
+{ \
+    t_float *fp[2]; \
+    size_t j; \
+    fp[0] = vecs[0], fp[1] = vecs[1]; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 32, \
+        fp[0] += 4 * skip, fp[1] += 4 * skip) \
+    { \
+        __m128 a = _mm_castsi128_ps( \
+            swap32(_mm_loadu_si128((const __m128i *)buf))); \
+        __m128 b = _mm_castsi128_ps( \
+            swap32(_mm_loadu_si128((const __m128i *)(buf + 16)))); \
+        sf_store(fp[0], skip, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))); \
+        sf_store(fp[1], skip, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))); \
+    } \
+    sf_in32##end##_n(buf, 8, 2, fp, skip, nframes - j); \
+} \
+static SF_TARGET void sf_out16##end##_1_sse2(t_float **vecs, int skip, \
+    unsigned char *buf, int stride, int nchannels, size_t nframes, \
+    t_float normalfactor) \
+{ \
+    __m128 gain = _mm_set1_ps(normalfactor); \
+    t_float *fp = vecs[0]; \
+    size_t j; \
+    for (j = 0; j + 8 <= nframes; j += 8, buf += 16, fp += 8 * skip) \
+        _mm_storeu_si128((__m128i *)buf, swap16(_mm_packs_epi32( \
+            sf_to16(sf_load(fp, skip), gain), \
+            sf_to16(sf_load(fp + 4 * skip, skip), gain)))); \
+    sf_out16##end##_n(&fp, skip, buf, 2, 1, nframes - j, normalfactor); \
+} \
+static SF_TARGET void sf_out16##end##_2_sse2(t_float **vecs, int skip, \
+    unsigned char *buf, int stride, int nchannels, size_t nframes, \
+    t_float normalfactor) \
+{ \
+    __m128 gain = _mm_set1_ps(normalfactor); \
+    t_float *fp[2]; \
+    size_t j; \
+    fp[0] = vecs[0], fp[1] = vecs[1]; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 16, \
+        fp[0] += 4 * skip, fp[1] += 4 * skip) \
+    { \
+        __m128i l = sf_to16(sf_load(fp[0], skip), gain), \
+            r = sf_to16(sf_load(fp[1], skip), gain); \
+        _mm_storeu_si128((__m128i *)buf, swap16(_mm_packs_epi32( \
+            _mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)))); \
+    } \
+    sf_out16##end##_n(fp, skip, buf, 4, 2, nframes - j, normalfactor); \
+} \
+static SF_TARGET void sf_out32##end##_1_sse2(t_float **vecs, int skip, \
+    unsigned char *buf, int stride, int nchannels, size_t nframes, \
+    t_float normalfactor) \
+{ \
+    __m128 gain = _mm_set1_ps(normalfactor); \
+    t_float *fp = vecs[0]; \
+    size_t j; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 16, fp += 4 * skip) \
+        _mm_storeu_si128((__m128i *)buf, swap32(_mm_castps_si128( \
+            _mm_mul_ps(sf_load(fp, skip), gain)))); \
+    sf_out32##end##_n(&fp, skip, buf, 4, 1, nframes - j, normalfactor); \
+} \
+static SF_TARGET void sf_out32##end##_2_sse2(t_float **vecs, int skip, \
+    unsigned char *buf, int stride, int nchannels, size_t nframes, \
+    t_float normalfactor) \
+{ \
+    __m128 gain = _mm_set1_ps(normalfactor); \
+    t_float *fp[2]; \
+    size_t j; \
+    fp[0] = vecs[0], fp[1] = vecs[1]; \
+    for (j = 0; j + 4 <= nframes; j += 4, buf += 32, \
+        fp[0] += 4 * skip, fp[1] += 4 * skip) \
+    { \
+        __m128 l = _mm_mul_ps(sf_load(fp[0], skip), gain), \
+            r = _mm_mul_ps(sf_load(fp[1], skip), gain); \
+        _mm_storeu_si128((__m128i *)buf, \
+            swap32(_mm_castps_si128(_mm_unpacklo_ps(l, r)))); \
+        _mm_storeu_si128((__m128i *)(buf + 16), \
+            swap32(_mm_castps_si128(_mm_unpackhi_ps(l, r)))); \
+    } \
+    sf_out32##end##_n(fp, skip, buf, 8, 2, nframes - j, normalfactor); \
+}
+
+#define SF_NOSWAP(v) (v)
+SF_SSE2KERNELS(le, SF_NOSWAP, SF_NOSWAP)
+SF_SSE2KERNELS(be, sf_swap16, sf_swap32)
+
+#define SF_KERNELS(fmt) {fmt##_n, fmt##_1_sse2, fmt##_2_sse2}
+
+#endif /* SF_SSE2 */
+
+    /* indexed by sample format (see sf_format()) and then by number of
+    channels, or 0 for any number.  The "_c" tables have the plain C
+    kernels, for comparison in "pd soundfile-benchmark". */
+#define SF_CKERNELS(fmt) {fmt##_n, fmt##_1, fmt##_2}
+
+static const t_sfxferin sf_xferin_c[6][3] = {
+    SF_CKERNELS(sf_in16le), SF_CKERNELS(sf_in16be),
+    SF_CKERNELS(sf_in24le), SF_CKERNELS(sf_in24be),
+    SF_CKERNELS(sf_in32le), SF_CKERNELS(sf_in32be)
+};
+
+static const t_sfxferout sf_xferout_c[6][3] = {
+    SF_CKERNELS(sf_out16le), SF_CKERNELS(sf_out16be),
+    SF_CKERNELS(sf_out24le), SF_CKERNELS(sf_out24be),
+    SF_CKERNELS(sf_out32le), SF_CKERNELS(sf_out32be)
+};
+
+#ifdef SF_SSE2
+static const t_sfxferin sf_xferin_sse2[6][3] = {
+    SF_KERNELS(sf_in16le), SF_KERNELS(sf_in16be),
+    SF_CKERNELS(sf_in24le), SF_CKERNELS(sf_in24be),
+    SF_KERNELS(sf_in32le), SF_KERNELS(sf_in32be)
+};
+
+static const t_sfxferout sf_xferout_sse2[6][3] = {
+    SF_KERNELS(sf_out16le), SF_KERNELS(sf_out16be),
+        /* the stereo 24-bit one comes out slower than the generic one */
+    {sf_out24le_n, sf_out24le_1, sf_out24le_n},
+    {sf_out24be_n, sf_out24be_1, sf_out24be_n},
+    SF_KERNELS(sf_out32le), SF_KERNELS(sf_out32be)
+};
+#endif
+
+    /* the tables in use, chosen by sf_choosekernels() */
+static const t_sfxferin (*sf_xferin)[3] = sf_xferin_c;
+static const t_sfxferout (*sf_xferout)[3] = sf_xferout_c;
+static const char *sf_isa = "C";
+
+static void sf_choosekernels(void)
+{
+#ifdef SF_SSE2
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse2"))
+        return;
+#endif
+    sf_xferin = sf_xferin_sse2;
+    sf_xferout = sf_xferout_sse2;
+    sf_isa = "SSE2";
+#endif
+}
+
+    /* table row for a soundfile's sample format, or -1 if unsupported */
+static int sf_format(const t_soundfile *sf)
+{
+    if (sf->sf_bytespersample < 2 || sf->sf_bytespersample > 4)
+        return (-1);
+    return ((sf->sf_bytespersample - 2) * 2 + (sf->sf_bigendian != 0));
+}
+
+    /* the kernel for converting "nchannels" of the file's channels */
+static int sf_channels(const t_soundfile *sf, int nchannels)
+{
+    return (nchannels == sf->sf_nchannels && nchannels <= 2 ? nchannels : 0);
+}
+
+    /* t_floats from one array element to the next */
+#define SF_WORDSKIP ((int)(sizeof(t_word) / sizeof(t_float)))
+
 static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
     t_sample **vecs, size_t framesread, unsigned char *buf, size_t nframes)
 {
-    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i;
+    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs),
+        format = sf_format(sf), i;
     size_t j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
-    {
-        if (sf->sf_bytespersample == 2)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (sf->sf_bytespersample == 3)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
-                                       (sp2[2] << 8));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[2] << 24) | (sp2[1] << 16) |
-                                       (sp2[0] << 8));
-            }
-        }
-        else if (sf->sf_bytespersample == 4)
-        {
-            t_floatuint alias;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
-                                (sp2[2] << 8)  |  sp2[3]);
-                    *fp = (t_sample)alias.f;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
-                                (sp2[1] << 8)  |  sp2[0]);
-                    *fp = (t_sample)alias.f;
-                }
-            }
-        }
-    }
+    t_sample *fp, *fpvec[MAXSFCHANS];
+    for (i = 0; i < nchannels; i++)
+        fpvec[i] = vecs[i] + framesread;
+    if (format >= 0 && nchannels > 0)
+        (*sf_xferin[format][sf_channels(sf, nchannels)])(buf,
+            sf->sf_bytesperframe, nchannels, fpvec, 1, nframes);
         /* zero out other outputs */
     for (i = sf->sf_nchannels; i < nvecs; i++)
         for (j = nframes, fp = vecs[i]; j--;)
@@ -506,69 +851,16 @@ static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
 static void soundfile_xferin_words(const t_soundfile *sf, int nvecs,
     t_word **vecs, size_t framesread, unsigned char *buf, size_t nframes)
 {
-    unsigned char *sp, *sp2;
-    t_word *wp;
-    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i;
+    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs),
+        format = sf_format(sf), i;
     size_t j;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
-    {
-        if (sf->sf_bytespersample == 2)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (sf->sf_bytespersample == 3)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
-                                               (sp2[2] << 8));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[2] << 24) | (sp2[1] << 16) |
-                                               (sp2[0] << 8));
-            }
-        }
-        else if (sf->sf_bytespersample == 4)
-        {
-            t_floatuint alias;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
-                                (sp2[2] << 8)  |  sp2[3]);
-                    wp->w_float = (t_float)alias.f;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
-                                (sp2[1] << 8)  |  sp2[0]);
-                    wp->w_float = (t_float)alias.f;
-                }
-            }
-        }
-    }
+    t_word *wp;
+    t_float *fpvec[MAXSFCHANS];
+    for (i = 0; i < nchannels; i++)
+        fpvec[i] = &vecs[i][framesread].w_float;
+    if (format >= 0 && nchannels > 0)
+        (*sf_xferin[format][sf_channels(sf, nchannels)])(buf,
+            sf->sf_bytesperframe, nchannels, fpvec, SF_WORDSKIP, nframes);
         /* zero out other outputs */
     for (i = sf->sf_nchannels; i < nvecs; i++)
         for (j = nframes, wp = vecs[i]; j--;)
@@ -789,218 +1081,176 @@ static void soundfile_xferout_sample(const t_soundfile *sf,
     t_sample **vecs, unsigned char *buf, size_t nframes, size_t onsetframes,
     t_sample normalfactor)
 {
-    int i;
-    size_t j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    for (i = 0, sp = buf; i < sf->sf_nchannels; i++,
-        sp += sf->sf_bytespersample)
-    {
-        if (sf->sf_bytespersample == 2)
-        {
-            t_sample ff = normalfactor * 32768.;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[0] = (xx >> 8);
-                    sp2[1] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
-        }
-        else if (sf->sf_bytespersample == 3)
-        {
-            t_sample ff = normalfactor * 8388608.;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[0] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[2] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[2] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
-        }
-        else if (sf->sf_bytespersample == 4)
-        {
-            t_floatuint f2;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    f2.f = *fp * normalfactor;
-                    sp2[0] = (f2.ui >> 24); sp2[1] = (f2.ui >> 16);
-                    sp2[2] = (f2.ui >> 8);  sp2[3] = f2.ui;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    f2.f = *fp * normalfactor;
-                    sp2[3] = (f2.ui >> 24); sp2[2] = (f2.ui >> 16);
-                    sp2[1] = (f2.ui >> 8);  sp2[0] = f2.ui;
-                }
-            }
-        }
-    }
+    int format = sf_format(sf), i;
+    t_sample *fpvec[MAXSFCHANS];
+    if (format < 0)
+        return;
+    for (i = 0; i < sf->sf_nchannels; i++)
+        fpvec[i] = vecs[i] + onsetframes;
+    (*sf_xferout[format][sf_channels(sf, sf->sf_nchannels)])(fpvec, 1,
+        buf, sf->sf_bytesperframe, sf->sf_nchannels, nframes, normalfactor);
 }
 
 static void soundfile_xferout_words(const t_soundfile *sf, t_word **vecs,
     unsigned char *buf, size_t nframes, size_t onsetframes,
     t_sample normalfactor)
 {
-    int i;
-    size_t j;
-    unsigned char *sp, *sp2;
-    t_word *wp;
-    for (i = 0, sp = buf; i < sf->sf_nchannels;
-         i++, sp += sf->sf_bytespersample)
+    int format = sf_format(sf), i;
+    t_float *fpvec[MAXSFCHANS];
+    if (format < 0)
+        return;
+    for (i = 0; i < sf->sf_nchannels; i++)
+        fpvec[i] = &vecs[i][onsetframes].w_float;
+    (*sf_xferout[format][sf_channels(sf, sf->sf_nchannels)])(fpvec,
+        SF_WORDSKIP, buf, sf->sf_bytesperframe, sf->sf_nchannels, nframes,
+        normalfactor);
+}
+
+#ifdef PD_BENCHMARKS
+
+#define SFBENCHFRAMES 4093  /* not a multiple of 8, to test the leftovers */
+#define SFSENTINEL ((t_float)12345)
+
+    /* fill two channels of SFBENCHFRAMES t_words with random samples */
+static void sf_benchsignal(t_float **vecs)
+{
+    int size = SFBENCHFRAMES * SF_WORDSKIP, i, j;
+    unsigned int seed = 1;
+    for (i = 0; i < 2; i++)
+        for (j = 0; j < size; j++)
     {
-        if (sf->sf_bytespersample == 2)
-        {
-            t_sample ff = normalfactor * 32768.;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    int xx = 32768. + (wp->w_float * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[0] = (xx >> 8);
-                    sp2[1] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    int xx = 32768. + (wp->w_float * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
-        }
-        else if (sf->sf_bytespersample == 3)
+        seed = seed * 435898247 + 382842987;
+        vecs[i][j] = (t_float)((int)(seed >> 8) - 0x800000) / 0x555555;
+    }
+}
+
+    /* check that the conversion kernels we use for mono and stereo agree
+    with the generic ones, in both directions and for each sample format,
+    for signals and arrays; and that when reading into arrays they leave
+    the rest of each t_word alone. */
+int soundfile_selftest(void)
+{
+    int size = SFBENCHFRAMES * SF_WORDSKIP, format, nchannels, skip,
+        i, j, nbad = 0;
+    t_float *src[2], *dst1[2], *dst2[2];
+    unsigned char *file1 = (unsigned char *)getbytes(SFBENCHFRAMES * 8),
+        *file2 = (unsigned char *)getbytes(SFBENCHFRAMES * 8);
+    for (i = 0; i < 2; i++)
+    {
+        src[i] = (t_float *)getbytes(size * sizeof(t_float));
+        dst1[i] = (t_float *)getbytes(size * sizeof(t_float));
+        dst2[i] = (t_float *)getbytes(size * sizeof(t_float));
+    }
+    sf_benchsignal(src);
+    for (format = 0; format < 6; format++)
+        for (skip = 1; skip <= SF_WORDSKIP; skip++)
+            for (nchannels = 1; nchannels <= 2; nchannels++)
+    {
+        int stride = nchannels * (format / 2 + 2);
+        (*sf_xferout_c[format][0])(src, skip, file1, stride,
+            nchannels, SFBENCHFRAMES, 0.7);
+        (*sf_xferout[format][nchannels])(src, skip, file2, stride,
+            nchannels, SFBENCHFRAMES, 0.7);
+        if (memcmp(file1, file2, SFBENCHFRAMES * stride))
+            nbad++;
+        for (i = 0; i < nchannels; i++)
+            for (j = 0; j < size; j++)
+                dst2[i][j] = SFSENTINEL;
+        (*sf_xferin_c[format][0])(file1, stride, nchannels, dst1,
+            skip, SFBENCHFRAMES);
+        (*sf_xferin[format][nchannels])(file1, stride, nchannels,
+            dst2, skip, SFBENCHFRAMES);
+        for (i = 0; i < nchannels; i++)
+            for (j = 0; j < SFBENCHFRAMES * skip; j++)
+                if (j % skip ? dst2[i][j] != SFSENTINEL :
+                    dst1[i][j] != dst2[i][j])
         {
-            t_sample ff = normalfactor * 8388608.;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    int xx = 8388608. + (wp->w_float * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[0] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[2] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    int xx = 8388608. + (wp->w_float * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[2] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
+            nbad++;
+            i = nchannels;
+            break;
         }
-        else if (sf->sf_bytespersample == 4)
+    }
+    for (i = 0; i < 2; i++)
+    {
+        freebytes(src[i], size * sizeof(t_float));
+        freebytes(dst1[i], size * sizeof(t_float));
+        freebytes(dst2[i], size * sizeof(t_float));
+    }
+    freebytes(file1, SFBENCHFRAMES * 8);
+    freebytes(file2, SFBENCHFRAMES * 8);
+    if (nbad)
+        pd_error(0, "soundfile self-test: %d conversions differ (%s)",
+            nbad, sf_isa);
+    return (nbad);
+}
+
+    /* "pd soundfile-benchmark": time the conversion kernels we use for
+    mono and stereo against the generic ones, in both directions and for
+    each sample format. */
+void glob_soundfilebenchmark(void *dummy)
+{
+    static const char *formatnames[6] = {"16-bit LE", "16-bit BE",
+        "24-bit LE", "24-bit BE", "float LE", "float BE"};
+    int size = SFBENCHFRAMES * SF_WORDSKIP, format, nchannels, i, j;
+    t_float *src[2], *dst[2];
+    unsigned char *file = (unsigned char *)getbytes(SFBENCHFRAMES * 8);
+    char buf[MAXPDSTRING];
+    for (i = 0; i < 2; i++)
+    {
+        src[i] = (t_float *)getbytes(size * sizeof(t_float));
+        dst[i] = (t_float *)getbytes(size * sizeof(t_float));
+    }
+    sf_benchsignal(src);
+    post("soundfile-benchmark: speedup over generic conversion (%s)",
+        sf_isa);
+    post("              in mono  in stereo  out mono out stereo");
+    for (format = 0; format < 6; format++)
+    {
+        int bytes = format / 2 + 2;
+        sprintf(buf, "%-12s", formatnames[format]);
+        for (i = 0; i < 2; i++)
         {
-            t_floatuint f2;
-            if (sf->sf_bigendian)
+            int reps = 1000;
+            double t1, t2, t3;
+            for (nchannels = 1; nchannels <= 2; nchannels++)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
+                int stride = nchannels * bytes;
+                t1 = sys_getrealtime();
+                for (j = 0; j < reps; j++)
                 {
-                    f2.f = wp->w_float * normalfactor;
-                    sp2[0] = (f2.ui >> 24); sp2[1] = (f2.ui >> 16);
-                    sp2[2] = (f2.ui >> 8);  sp2[3] = f2.ui;
+                    if (i)
+                        (*sf_xferout_c[format][0])(src, 1, file, stride,
+                            nchannels, SFBENCHFRAMES, 1);
+                    else (*sf_xferin_c[format][0])(file, stride,
+                        nchannels, dst, 1, SFBENCHFRAMES);
                 }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onsetframes;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
+                t2 = sys_getrealtime();
+                for (j = 0; j < reps; j++)
                 {
-                    f2.f = wp->w_float * normalfactor;
-                    sp2[3] = (f2.ui >> 24); sp2[2] = (f2.ui >> 16);
-                    sp2[1] = (f2.ui >> 8);  sp2[0] = f2.ui;
+                    if (i)
+                        (*sf_xferout[format][nchannels])(src, 1, file,
+                            stride, nchannels, SFBENCHFRAMES, 1);
+                    else (*sf_xferin[format][nchannels])(file, stride,
+                        nchannels, dst, 1, SFBENCHFRAMES);
                 }
+                t3 = sys_getrealtime();
+                sprintf(buf + strlen(buf), "%10.2f",
+                    (t3 > t2 ? (t2 - t1) / (t3 - t2) : 0));
             }
         }
+        post("%s", buf);
     }
+    soundfile_selftest();
+    for (i = 0; i < 2; i++)
+    {
+        freebytes(src[i], size * sizeof(t_float));
+        freebytes(dst[i], size * sizeof(t_float));
+    }
+    freebytes(file, SFBENCHFRAMES * 8);
 }
 
+#endif /* PD_BENCHMARKS */
+
 /* ----- soundfiler - reads and writes soundfiles to/from "garrays" ----- */
 
 #define SAMPBUFSIZE 1024
@@ -1110,13 +1360,102 @@ done:
            -caf
            -next
            -ascii
+           -mmap ... map the file and convert it on several threads; if
+               the file is truncated meanwhile, Pd gets a SIGBUS
     */
 
+#ifndef _WIN32
+
+    /* below this many bytes it isn't worth starting threads */
+#define SFMMAPCHUNK (4 * 1024 * 1024)
+#define SFMMAPMAXTHREADS 8
+
+typedef struct _sfmmapjob
+{
+    const t_soundfile *j_sf;
+    int j_nvecs;
+    t_word **j_vecs;
+    unsigned char *j_buf;       /* first frame to convert */
+    size_t j_onset;             /* and its index in the arrays */
+    size_t j_nframes;
+} t_sfmmapjob;
+
+static void *soundfiler_mmapjob(void *z)
+{
+    t_sfmmapjob *j = (t_sfmmapjob *)z;
+    soundfile_xferin_words(j->j_sf, j->j_nvecs, j->j_vecs, j->j_onset,
+        j->j_buf, j->j_nframes);
+    return (0);
+}
+
+    /** read "nframes" frames starting at the fd's current position by
+    mapping the file and converting pieces of it in parallel.  Returns
+    the number of frames read, or -1 if the file couldn't be mapped, in
+    which case the caller falls back to reading it. */
+static ssize_t soundfiler_readmmap(const t_soundfile *sf, int nvecs,
+    t_word **vecs, size_t nframes)
+{
+    pthread_t threads[SFMMAPMAXTHREADS];
+    t_sfmmapjob jobs[SFMMAPMAXTHREADS];
+    off_t onset = lseek(sf->sf_fd, 0, SEEK_CUR), filesize, mapstart;
+    size_t mapsize, nbytes, perjob, done;
+    long pagesize = sysconf(_SC_PAGESIZE), ncpu;
+    int njobs, i;
+    unsigned char *map;
+    if (onset < 0 || (filesize = lseek(sf->sf_fd, 0, SEEK_END)) < 0)
+        return (-1);
+    lseek(sf->sf_fd, onset, SEEK_SET);
+    if (filesize - onset < (off_t)(nframes * sf->sf_bytesperframe))
+        nframes = (filesize - onset) / sf->sf_bytesperframe;
+    if (!nframes)
+        return (0);
+    nbytes = nframes * sf->sf_bytesperframe;
+    mapstart = onset - (onset % (pagesize > 0 ? pagesize : 4096));
+    mapsize = nbytes + (onset - mapstart);
+    if ((map = (unsigned char *)mmap(0, mapsize, PROT_READ, MAP_SHARED,
+        sf->sf_fd, mapstart)) == MAP_FAILED)
+            return (-1);
+#ifdef MADV_SEQUENTIAL
+    madvise(map, mapsize, MADV_SEQUENTIAL);
+#endif
+        /* one job per SFMMAPCHUNK bytes, no more than we have processors */
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    njobs = (int)(nbytes / SFMMAPCHUNK) + 1;
+    if (njobs > ncpu)
+        njobs = (ncpu > 1 ? ncpu : 1);
+    if (njobs > SFMMAPMAXTHREADS)
+        njobs = SFMMAPMAXTHREADS;
+    perjob = (nframes + njobs - 1) / njobs;
+    for (i = 0, done = 0; i < njobs; i++, done += perjob)
+    {
+        jobs[i].j_sf = sf;
+        jobs[i].j_nvecs = nvecs;
+        jobs[i].j_vecs = vecs;
+        jobs[i].j_buf = map + (onset - mapstart) +
+            done * sf->sf_bytesperframe;
+        jobs[i].j_onset = done;
+        jobs[i].j_nframes = (nframes - done < perjob ? nframes - done : perjob);
+    }
+        /* the calling thread does the first piece itself */
+    for (i = 1; i < njobs; i++)
+        if (pthread_create(&threads[i], 0, soundfiler_mmapjob, &jobs[i]))
+            soundfiler_mmapjob(&jobs[i]), jobs[i].j_nframes = 0;
+    soundfiler_mmapjob(&jobs[0]);
+    for (i = 1; i < njobs; i++)
+        if (jobs[i].j_nframes)
+            pthread_join(threads[i], 0);
+    munmap(map, mapsize);
+    return (nframes);
+}
+
+#endif /* _WIN32 */
+
 static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
     t_soundfile sf = {0};
-    int fd = -1, resize = 0, ascii = 0, i;
+    int fd = -1, resize = 0, ascii = 0, usemmap = 0, i;
+    double starttime = 0;
     size_t skipframes = 0, finalsize = 0, maxsize = SFMAXFRAMES,
            framesread = 0, bufframes, j;
     ssize_t nframes, framesinfile;
@@ -1180,6 +1519,11 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             resize = 1;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "mmap"))
+        {
+            usemmap = 1;
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "maxsize"))
         {
             if (argc < 2 || argv[1].a_type != A_FLOAT ||
@@ -1307,17 +1651,36 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     }
 
         /* read */
-    bufframes = SAMPBUFSIZE / sf.sf_bytesperframe;
-    for (framesread = 0; framesread < finalsize;)
+    starttime = sys_getrealtime();
+#ifndef _WIN32
+        /* channels past the last array are dropped and arrays past the
+        last channel are zeroed below, so only convert the ones we need */
+    if (usemmap && (nframes = soundfiler_readmmap(&sf,
+        (argc < sf.sf_nchannels ? argc : sf.sf_nchannels), vecs,
+            finalsize)) >= 0)
+                framesread = nframes;
+    else
+#endif
+    {
+        bufframes = SAMPBUFSIZE / sf.sf_bytesperframe;
+        for (framesread = 0; framesread < finalsize;)
+        {
+            size_t thisread = finalsize - framesread;
+            thisread = (thisread > bufframes ? bufframes : thisread);
+            nframes = read(sf.sf_fd, sampbuf,
+                thisread * sf.sf_bytesperframe) / sf.sf_bytesperframe;
+            if (nframes <= 0) break;
+            soundfile_xferin_words(&sf, argc, vecs, framesread,
+                (unsigned char *)sampbuf, nframes);
+            framesread += nframes;
+        }
+    }
+    if (usemmap)
     {
-        size_t thisread = finalsize - framesread;
-        thisread = (thisread > bufframes ? bufframes : thisread);
-        nframes = read(sf.sf_fd, sampbuf,
-            thisread * sf.sf_bytesperframe) / sf.sf_bytesperframe;
-        if (nframes <= 0) break;
-        soundfile_xferin_words(&sf, argc, vecs, framesread,
-            (unsigned char *)sampbuf, nframes);
-        framesread += nframes;
+        double elapsed = sys_getrealtime() - starttime;
+        double mbytes = (double)framesread * sf.sf_bytesperframe / 1048576.;
+        logpost(x, 3, "soundfiler read: %s: %.1f MB in %.3f sec (%.1f MB/s)",
+            filename, mbytes, elapsed, (elapsed > 0 ? mbytes / elapsed : 0));
     }
 
         /* zero out remaining elements of vectors */
@@ -1343,7 +1706,8 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     goto done;
 usage:
     pd_error(x, "usage: read [flags] filename [tablename]...");
-    post("flags: -skip <n> -resize -maxsize <n> %s -ascii ...", sf_typeargs);
+    post("flags: -skip <n> -resize -maxsize <n> %s -ascii -mmap ...",
+        sf_typeargs);
     post("-raw <headerbytes> <channels> <bytespersample> "
          "<endian (b, l, or n)>");
 done:
@@ -1633,6 +1997,16 @@ typedef struct _readsf
 #ifdef PDINSTANCE
     t_pdinstance *x_pd_this;  /**< pointer to the owner pd instance */
 #endif
+        /* bookkeeping for the shared disk-I/O service */
+    struct _sfio *x_sfio;     /**< the instance's I/O service */
+    struct _readsf *x_ionext; /**< next stream known to the I/O service */
+    int x_iowaiting;          /**< true while queued for a disk slot */
+    int x_ioslot;             /**< true while holding one */
+    double x_ioslack;         /**< fraction of the fifo left before a stall */
+    int x_nunderrun;          /**< number of DSP ticks that waited on disk */
+    int x_nio;                /**< number of reads or writes serviced */
+    double x_iotime;          /**< total service time in seconds */
+    double x_iomax;           /**< worst service time in seconds */
 } t_readsf;
 
 /* ----- the child thread which performs file I/O ----- */
@@ -1660,6 +2034,160 @@ static void readsf_fakewait(pthread_mutex_t *b)
 #define sfread_cond_signal(a)
 #endif
 
+/* ----- the disk-I/O service shared by a Pd instance's readsf~ and writesf~ ---
+
+Child threads don't read from the disk whenever they like; each read first
+asks for one of SFIOSLOTS disk "slots", saying how much of its fifo is left
+before the DSP thread would have to wait for it (its "slack").  When more
+children want the disk than there are slots, the one with the least slack
+goes first, so that many streams don't seek each other to death while the
+one about to underrun waits its turn.  Only reads of regular files take a
+slot: writes land in the system's cache and pipes and devices don't seek, so
+holding those up would only make them later.  Each Pd instance has its own
+slots, made when its first readsf~ or writesf~ is.  The service also counts
+how often each stream made the DSP thread wait and how long its requests
+took, for "pd soundfile-stats". */
+
+#define SFIOSLOTS 2
+
+typedef struct _sfio
+{
+    pthread_mutex_t s_mutex;
+    pthread_cond_t s_cond;
+    int s_nbusy;                /* slots currently in use */
+    t_readsf *s_list;           /* the instance's readsf~ and writesf~ */
+} t_sfio;
+
+static void sfio_add(t_readsf *x)
+{
+    t_sfio *io = STUFF->st_sfio;
+    if (!io)
+    {
+        io = STUFF->st_sfio = (t_sfio *)getbytes(sizeof(*io));
+        pthread_mutex_init(&io->s_mutex, 0);
+        pthread_cond_init(&io->s_cond, 0);
+    }
+    x->x_sfio = io;
+    pthread_mutex_lock(&io->s_mutex);
+    x->x_ionext = io->s_list;
+    io->s_list = x;
+    pthread_mutex_unlock(&io->s_mutex);
+}
+
+    /* called once the child thread has exited */
+static void sfio_remove(t_readsf *x)
+{
+    t_sfio *io = x->x_sfio;
+    t_readsf **xp;
+    int empty;
+    pthread_mutex_lock(&io->s_mutex);
+    for (xp = &io->s_list; *xp; xp = &(*xp)->x_ionext)
+        if (*xp == x)
+    {
+        *xp = x->x_ionext;
+        break;
+    }
+    empty = !io->s_list;
+    pthread_mutex_unlock(&io->s_mutex);
+    if (empty)
+    {
+        pthread_cond_destroy(&io->s_cond);
+        pthread_mutex_destroy(&io->s_mutex);
+        freebytes(io, sizeof(*io));
+        STUFF->st_sfio = 0;
+    }
+}
+
+    /** wait for a free disk slot if the file is on a disk.  Called from the
+    child thread without x_mutex held; returns the time the request was
+    made. */
+static double sfio_acquire(t_readsf *x, int fd, double slack)
+{
+    t_sfio *io = x->x_sfio;
+    double starttime = sys_getrealtime();
+    struct stat statbuf;
+    t_readsf *y;
+    if (fstat(fd, &statbuf) < 0 || (statbuf.st_mode & S_IFMT) != S_IFREG)
+        return (starttime);
+    pthread_mutex_lock(&io->s_mutex);
+    x->x_iowaiting = 1;
+    x->x_ioslack = slack;
+    while (1)
+    {
+        if (io->s_nbusy < SFIOSLOTS)
+        {
+            for (y = io->s_list; y; y = y->x_ionext)
+                if (y->x_iowaiting && y->x_ioslack < slack)
+                    break;
+            if (!y)
+                break;
+        }
+        pthread_cond_wait(&io->s_cond, &io->s_mutex);
+    }
+    x->x_iowaiting = 0;
+    x->x_ioslot = 1;
+    io->s_nbusy++;
+    pthread_mutex_unlock(&io->s_mutex);
+    return starttime;
+}
+
+    /** give back the slot if we had one, and account for the time the
+    request took */
+static void sfio_release(t_readsf *x, double starttime)
+{
+    t_sfio *io = x->x_sfio;
+    double elapsed = sys_getrealtime() - starttime;
+    pthread_mutex_lock(&io->s_mutex);
+    if (x->x_ioslot)
+    {
+        io->s_nbusy--;
+        x->x_ioslot = 0;
+        pthread_cond_broadcast(&io->s_cond);
+    }
+    x->x_nio++;
+    x->x_iotime += elapsed;
+    if (elapsed > x->x_iomax)
+        x->x_iomax = elapsed;
+    pthread_mutex_unlock(&io->s_mutex);
+}
+
+static t_class *writesf_class;
+
+    /* "pd soundfile-stats": report how well the disk keeps up with each
+    stream in this Pd instance. */
+void glob_soundfilestats(void *dummy)
+{
+    t_sfio *io = STUFF->st_sfio;
+    t_readsf *x;
+    int nstream = 0;
+    if (!io)
+    {
+        post("soundfile-stats: no streams");
+        return;
+    }
+    pthread_mutex_lock(&io->s_mutex);
+    for (x = io->s_list; x; x = x->x_ionext)
+        nstream++;
+    post("soundfile-stats: %d stream(s), %d disk slot(s)",
+        nstream, SFIOSLOTS);
+    for (x = io->s_list; x; x = x->x_ionext)
+    {
+        int nunderrun;
+        pthread_mutex_lock(&x->x_mutex);
+        nunderrun = x->x_nunderrun;
+        pthread_mutex_unlock(&x->x_mutex);
+        post("%s %s: %d %s, mean %.3f msec, worst %.3f msec, %d underrun(s)",
+            (pd_class(&x->x_obj.ob_pd) == writesf_class ?
+                "writesf~" : "readsf~"),
+            (x->x_filename ? x->x_filename : "(no file)"),
+            x->x_nio, (pd_class(&x->x_obj.ob_pd) == writesf_class ?
+                "writes" : "reads"),
+            (x->x_nio ? 1000. * x->x_iotime / x->x_nio : 0),
+            1000. * x->x_iomax, nunderrun);
+    }
+    pthread_mutex_unlock(&io->s_mutex);
+}
+
 static void *readsf_child_main(void *zz)
 {
     t_readsf *x = zz;
@@ -1676,6 +2204,7 @@ static void *readsf_child_main(void *zz)
     {
         int fifohead;
         char *buf;
+        double slack, starttime;
 #ifdef DEBUG_SOUNDFILE_THREADS
         fprintf(stderr, "readsf~: 0\n");
 #endif
@@ -1838,8 +2367,12 @@ static void *readsf_child_main(void *zz)
 #endif
                 buf = x->x_buf;
                 fifohead = x->x_fifohead;
+                slack = (double)(fifohead - x->x_fifotail +
+                    (fifohead < x->x_fifotail ? fifosize : 0)) / fifosize;
                 pthread_mutex_unlock(&x->x_mutex);
+                starttime = sfio_acquire(x, sf.sf_fd, slack);
                 bytesread = read(sf.sf_fd, buf + fifohead, wantbytes);
+                sfio_release(x, starttime);
                 pthread_mutex_lock(&x->x_mutex);
                 if (x->x_requestcode != REQUEST_BUSY)
                     break;
@@ -1986,6 +2519,7 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_pd_this = pd_this;
 #endif
     pthread_create(&x->x_childthread, 0, readsf_child_main, x);
+    sfio_add(x);
     return x;
 }
 
@@ -2007,6 +2541,9 @@ static t_int *readsf_perform(t_int *w)
         int wantbytes;
         pthread_mutex_lock(&x->x_mutex);
         wantbytes = vecsize * sf.sf_bytesperframe;
+        if (!x->x_eof && x->x_fifohead >= x->x_fifotail &&
+                x->x_fifohead < x->x_fifotail + wantbytes-1)
+            x->x_nunderrun++;
         while (!x->x_eof && x->x_fifohead >= x->x_fifotail &&
                 x->x_fifohead < x->x_fifotail + wantbytes-1)
         {
@@ -2204,6 +2741,7 @@ static void readsf_free(t_readsf *x)
     pthread_mutex_unlock(&x->x_mutex);
     if (pthread_join(x->x_childthread, &threadrtn))
         pd_error(x, "readsf_free: join failed");
+    sfio_remove(x);
 
     pthread_cond_destroy(&x->x_requestcondition);
     pthread_cond_destroy(&x->x_answercondition);
@@ -2229,7 +2767,6 @@ static void readsf_setup(void)
 
 /* ------------------------- writesf ------------------------- */
 
-static t_class *writesf_class;
 
 typedef t_readsf t_writesf; /* just re-use the structure */
 
@@ -2343,6 +2880,7 @@ static void *writesf_child_main(void *zz)
             {
                 int fifosize = x->x_fifosize, fifotail;
                 char *buf = x->x_buf;
+                double starttime;
 #ifdef DEBUG_SOUNDFILE_THREADS
                 fprintf(stderr, "writesf~: 77\n");
 #endif
@@ -2382,7 +2920,9 @@ static void *writesf_child_main(void *zz)
                 fifotail = x->x_fifotail;
                 soundfile_copy(&sf, &x->x_sf);
                 pthread_mutex_unlock(&x->x_mutex);
+                starttime = sys_getrealtime();
                 byteswritten = write(sf.sf_fd, buf + fifotail, writebytes);
+                sfio_release(x, starttime);
                 pthread_mutex_lock(&x->x_mutex);
                 if (x->x_requestcode != REQUEST_BUSY &&
                     x->x_requestcode != REQUEST_CLOSE)
@@ -2510,6 +3050,7 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_pd_this = pd_this;
 #endif
     pthread_create(&x->x_childthread, 0, writesf_child_main, x);
+    sfio_add(x);
     return x;
 }
 
@@ -2528,7 +3069,9 @@ static t_int *writesf_perform(t_int *w)
         roominfifo = x->x_fifotail - x->x_fifohead;
         if (roominfifo <= 0)
             roominfifo += x->x_fifosize;
-        while (!x->x_eof && roominfifo < wantbytes + 1)
+        if (!x->x_eof && (size_t)roominfifo < wantbytes + 1)
+            x->x_nunderrun++;
+        while (!x->x_eof && (size_t)roominfifo < wantbytes + 1)
         {
             fprintf(stderr, "writesf waiting for disk write..\n");
             fprintf(stderr, "(head %d, tail %d, room %d, want %ld)\n",
@@ -2692,6 +3235,7 @@ static void writesf_free(t_writesf *x)
     pthread_mutex_unlock(&x->x_mutex);
     if (pthread_join(x->x_childthread, &threadrtn))
         pd_error(x, "writesf_free: join failed");
+    sfio_remove(x);
 #ifdef DEBUG_SOUNDFILE_THREADS
     fprintf(stderr, "writesf~: ... done\n");
 #endif
@@ -2721,6 +3265,7 @@ static void writesf_setup(void)
 
 void d_soundfile_setup(void)
 {
+    sf_choosekernels();
     soundfile_type_setup();
     soundfiler_setup();
     readsf_setup();
@@ -13,8 +13,13 @@
 
 #include "m_pd.h"
 #include "m_imp.h"
+#include "s_stuff.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
 
 extern t_class *vinlet_class, *voutlet_class, *canvas_class, *text_class;
 
@@ -35,15 +40,42 @@ struct _instanceugen
 {
     t_int *u_dspchain;         /* DSP chain */
     int u_dspchainsize;        /* number of elements in DSP chain */
+    int u_dspchainalloc;       /* number of elements allocated */
     t_signal *u_signals;       /* list of signals used by DSP chain */
     int u_sortno;              /* number of DSP sortings so far */
+    int u_nugen;               /* number of ugens in the last sort */
+    double u_sortstart;        /* real time the last sort started */
+    double u_sorttime;         /* and how long it took, in seconds */
         /* list of signals which can be reused, sorted by buffer size */
     t_signal *u_freelist[MAXLOGSIG+1];
         /* list of reusable "borrowed" signals (which don't own sample buffers) */
     t_signal *u_freeborrowed;
+        /* signals left over from the previous sort, used before making new
+        ones and freed if still unused when the sort is done */
+    t_signal *u_sparelist[MAXLOGSIG+1];
+    t_signal *u_spareborrowed;
     int u_phase;
     int u_loud;
     struct _dspcontext *u_context;
+        /* multi-threaded DSP - see "parallel DSP" below */
+    int u_nthreads;             /* number of threads to run DSP on */
+    struct _dspthreads *u_threads;  /* worker threads if u_nthreads > 1 */
+    int u_parallel;             /* true if the current sort is partitioned */
+    int u_task;                 /* task we're adding DSP code for, or -1 */
+    int u_ntask;                /* number of tasks found so far */
+    int u_tasksize;             /* allocated size of per-task arrays */
+    int *u_taskflags;           /* shared state touched by each task */
+    t_signal **u_taskfree;      /* free lists of each task while sorting */
+    int u_writers;              /* shared state written by anyone */
+    int u_segonset;             /* chain onset of current segment */
+    struct _dspsegment *u_seg;  /* chain segments in chain order */
+    int u_nseg;
+    int u_segsize;
+    int *u_jobhead;             /* first segment of each parallel job */
+    int u_njob;
+    int u_serialhead;           /* first segment to run after the jobs */
+    struct _dspfork *u_fork;    /* fork we're adding branches to, if any */
+    struct _dspfork *u_forklist;    /* all forks in the chain */
 };
 
 #define THIS (pd_this->pd_ugen)
@@ -52,12 +84,19 @@ void d_ugen_newpdinstance(void)
 {
     THIS = getbytes(sizeof(*THIS));
     THIS->u_dspchain = 0;
-    THIS->u_dspchainsize = 0;
+    THIS->u_dspchainsize = THIS->u_dspchainalloc = 0;
     THIS->u_signals = 0;
+    THIS->u_nthreads = 1;
+    THIS->u_threads = 0;
+    THIS->u_task = -1;
 }
 
+static void dspthreads_free(struct _dspthreads *x);
+
 void d_ugen_freepdinstance(void)
 {
+    if (THIS->u_threads)
+        dspthreads_free(THIS->u_threads);
     freebytes(THIS, sizeof(*THIS));
 }
 
@@ -305,7 +344,8 @@ static void block_dsp(t_block *x, t_signal **sp)
 void block_tilde_setup(void)
 {
     block_class = class_new(gensym("block~"), (t_newmethod)block_new, 0,
-            sizeof(t_block), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+            sizeof(t_block), CLASS_PARALLEL, A_DEFFLOAT, A_DEFFLOAT,
+                A_DEFFLOAT, 0);
     class_addcreator((t_newmethod)switch_new, gensym("switch~"),
         A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
     class_addmethod(block_class, (t_method)block_set, gensym("set"),
@@ -322,13 +362,30 @@ static t_int dsp_done(t_int *w)
     return (0);
 }
 
+    /* make room for n more elements on the chain.  The chain grows
+    geometrically so that building it is linear in its size. */
+static void dsp_growchain(int n)
+{
+    int newsize = THIS->u_dspchainsize + n;
+    if (newsize > THIS->u_dspchainalloc)
+    {
+        int newalloc = 2 * THIS->u_dspchainalloc;
+        if (newalloc < newsize)
+            newalloc = newsize;
+        if (newalloc < 64)
+            newalloc = 64;
+        THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
+            THIS->u_dspchainalloc * sizeof (t_int), newalloc * sizeof (t_int));
+        THIS->u_dspchainalloc = newalloc;
+    }
+}
+
 void dsp_add(t_perfroutine f, int n, ...)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
     va_list ap;
 
-    THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
-        THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+    dsp_growchain(n+1);
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
     if (THIS->u_loud)
         post("add to chain: %lx",
@@ -351,8 +408,7 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
 
-    THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
-        THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+    dsp_growchain(n+1);
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
     for (i = 0; i < n; i++)
         THIS->u_dspchain[THIS->u_dspchainsize + i] = vec[i];
@@ -360,16 +416,224 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
     THIS->u_dspchainsize = newsize;
 }
 
+/* ------------------ parallel DSP ----------------------- */
+
+/* If "pd dsp-threads" is set to more than one, the top level of each root
+canvas is partitioned into "tasks" - sets of unit generators connected to
+each other by signal connections - when the DSP chain is built.  Each piece
+of the chain is tagged with the task that added it, and tasks that can't
+share a thread with others (because they touch state outside their own
+objects, or their class doesn't declare CLASS_PARALLEL, see ugen_nonlocal()
+below) are demoted to run serially.  At each tick, the parallel tasks are
+grouped into "jobs" and run by a pool of worker threads (and by the calling
+thread).  When all are done, the serial part of the chain runs in its
+original order.  Unit generators with no signal
+outputs, such as dac~, are always serial, so the summing into the output
+buffers happens in the same order as it would on one thread, and the result
+is bit-identical to the single-threaded chain. */
+
+typedef struct _dspsegment
+{
+    int sg_onset;           /* first element in the DSP chain */
+    int sg_end;             /* and one past the last one */
+    int sg_task;            /* task that added it, or -1 if serial */
+    int sg_next;            /* next segment in the same job, or -1 */
+} t_dspsegment;
+
+typedef void (*t_dspjobfn)(void *owner, int job);
+
+typedef struct _dspthreads
+{
+    int dt_nthreads;            /* number of worker threads */
+    pthread_t *dt_threads;
+    pthread_mutex_t dt_mutex;
+    pthread_cond_t dt_startcond;    /* signaled when jobs are posted */
+    pthread_cond_t dt_donecond;     /* signaled when last job finishes */
+    t_pdinstance *dt_instance;
+    int dt_generation;          /* incremented for each batch of jobs */
+    int dt_quit;
+    int dt_running;             /* true while a batch is running */
+    t_dspjobfn dt_fn;
+    void *dt_owner;
+    int dt_njob;                /* number of jobs in current batch */
+    int dt_nextjob;             /* next job for anyone to take */
+    int dt_nleft;               /* number of jobs not yet finished */
+} t_dspthreads;
+
+static void *dspthreads_main(void *z)
+{
+    t_dspthreads *x = (t_dspthreads *)z;
+    int generation = 0;
+#ifdef PDINSTANCE
+    pd_setinstance(x->dt_instance);
+#endif
+    pthread_mutex_lock(&x->dt_mutex);
+    while (1)
+    {
+        while (!x->dt_quit && x->dt_generation == generation)
+            pthread_cond_wait(&x->dt_startcond, &x->dt_mutex);
+        if (x->dt_quit)
+            break;
+        generation = x->dt_generation;
+        while (x->dt_nextjob < x->dt_njob)
+        {
+            int job = x->dt_nextjob++;
+            pthread_mutex_unlock(&x->dt_mutex);
+            (*x->dt_fn)(x->dt_owner, job);
+            pthread_mutex_lock(&x->dt_mutex);
+            if (!--x->dt_nleft)
+                pthread_cond_signal(&x->dt_donecond);
+        }
+    }
+    pthread_mutex_unlock(&x->dt_mutex);
+    return (0);
+}
+
+static t_dspthreads *dspthreads_new(int nthreads)
+{
+    t_dspthreads *x = (t_dspthreads *)getbytes(sizeof(*x));
+    int i;
+    x->dt_threads = (pthread_t *)getbytes(nthreads * sizeof(pthread_t));
+    x->dt_instance = pd_this;
+    pthread_mutex_init(&x->dt_mutex, 0);
+    pthread_cond_init(&x->dt_startcond, 0);
+    pthread_cond_init(&x->dt_donecond, 0);
+    for (i = 0; i < nthreads; i++)
+    {
+        if (pthread_create(&x->dt_threads[i], 0, dspthreads_main, x))
+        {
+            error("dsp-threads: couldn't create thread %d", i + 1);
+            break;
+        }
+        x->dt_nthreads++;
+    }
+    return (x);
+}
+
+static void dspthreads_free(t_dspthreads *x)
+{
+    int i;
+    pthread_mutex_lock(&x->dt_mutex);
+    x->dt_quit = 1;
+    pthread_cond_broadcast(&x->dt_startcond);
+    pthread_mutex_unlock(&x->dt_mutex);
+    for (i = 0; i < x->dt_nthreads; i++)
+        pthread_join(x->dt_threads[i], 0);
+    pthread_cond_destroy(&x->dt_donecond);
+    pthread_cond_destroy(&x->dt_startcond);
+    pthread_mutex_destroy(&x->dt_mutex);
+    freebytes(x->dt_threads, x->dt_nthreads * sizeof(pthread_t));
+    freebytes(x, sizeof(*x));
+}
+
+    /* run "njob" jobs on the worker threads, helping out from this thread,
+    and return when all of them are finished.  If there are no workers, or
+    we're already inside a job (so that they're all busy) run them here. */
+void dsp_runjobs(t_dspjobfn fn, void *owner, int njob)
+{
+    t_dspthreads *x = THIS->u_threads;
+    int job;
+    if (!x || !x->dt_nthreads || njob < 2)
+        goto serial;
+    pthread_mutex_lock(&x->dt_mutex);
+    if (x->dt_running)
+    {
+        pthread_mutex_unlock(&x->dt_mutex);
+        goto serial;
+    }
+    x->dt_fn = fn;
+    x->dt_owner = owner;
+    x->dt_njob = x->dt_nleft = njob;
+    x->dt_nextjob = 0;
+    x->dt_running = 1;
+    x->dt_generation++;
+    pthread_cond_broadcast(&x->dt_startcond);
+    while (x->dt_nextjob < x->dt_njob)
+    {
+        job = x->dt_nextjob++;
+        pthread_mutex_unlock(&x->dt_mutex);
+        (*fn)(owner, job);
+        pthread_mutex_lock(&x->dt_mutex);
+        x->dt_nleft--;
+    }
+    while (x->dt_nleft)
+        pthread_cond_wait(&x->dt_donecond, &x->dt_mutex);
+    x->dt_running = 0;
+    pthread_mutex_unlock(&x->dt_mutex);
+    return;
+serial:
+    for (job = 0; job < njob; job++)
+        (*fn)(owner, job);
+}
+
+static void dsp_runsegment(t_int *chain, t_dspsegment *sg)
+{
+    t_int *ip = chain + sg->sg_onset, *end = chain + sg->sg_end;
+    while (ip && ip != end)
+        ip = (*(t_perfroutine)(*ip))(ip);
+}
+
+static void dsp_runjob(void *owner, int job)
+{
+    t_instanceugen *x = (t_instanceugen *)owner;
+    int i;
+    for (i = x->u_jobhead[job]; i >= 0; i = x->u_seg[i].sg_next)
+        dsp_runsegment(x->u_dspchain, &x->u_seg[i]);
+}
+
 void dsp_tick(void)
 {
     if (THIS->u_dspchain)
     {
         t_int *ip;
-        for (ip = THIS->u_dspchain; ip; ) ip = (*(t_perfroutine)(*ip))(ip);
+        if (THIS->u_njob)
+        {
+            int i;
+            dsp_runjobs(dsp_runjob, THIS, THIS->u_njob);
+            for (i = THIS->u_serialhead; i >= 0; i = THIS->u_seg[i].sg_next)
+                dsp_runsegment(THIS->u_dspchain, &THIS->u_seg[i]);
+        }
+        else for (ip = THIS->u_dspchain; ip; )
+            ip = (*(t_perfroutine)(*ip))(ip);
         THIS->u_phase++;
     }
 }
 
+    /* "pd dsp-threads <n>": run DSP on n threads from the next DSP sort on. */
+void glob_dspthreads(void *dummy, t_floatarg f)
+{
+    int nthreads = (f < 1 ? 1 : (f > 64 ? 64 : (int)f));
+    int dspstate;
+    if (nthreads == THIS->u_nthreads)
+        return;
+    dspstate = canvas_suspend_dsp();
+    if (THIS->u_threads)
+        dspthreads_free(THIS->u_threads), THIS->u_threads = 0;
+    if (nthreads > 1)
+        THIS->u_threads = dspthreads_new(nthreads - 1);
+    THIS->u_nthreads = nthreads;
+    canvas_resume_dsp(dspstate);
+}
+
+    /* "pd dsp-stats": report on the size of the DSP chain and the time it
+    took to build it. */
+void glob_dspstats(void *dummy)
+{
+    int nsig = 0;
+    t_signal *sig;
+    if (!THIS->u_dspchain)
+    {
+        post("DSP: off");
+        return;
+    }
+    for (sig = THIS->u_signals; sig; sig = sig->s_nextused)
+        nsig++;
+    post("DSP: %d ugens, %d signals, chain %d elements (%d allocated)",
+        THIS->u_nugen, nsig, THIS->u_dspchainsize, THIS->u_dspchainalloc);
+    post("DSP: sort %d took %.3f msec", THIS->u_sortno,
+        1000. * THIS->u_sorttime);
+}
+
 /* ---------------- signals ---------------------------- */
 
 int ilog2(int n)
@@ -398,8 +662,61 @@ static void signal_cleanup(void)
         t_freebytes(sig, sizeof *sig);
     }
     for (i = 0; i <= MAXLOGSIG; i++)
-        THIS->u_freelist[i] = 0;
-    THIS->u_freeborrowed = 0;
+        THIS->u_freelist[i] = THIS->u_sparelist[i] = 0;
+    THIS->u_freeborrowed = THIS->u_spareborrowed = 0;
+}
+
+    /* call this when re-sorting with DSP running: instead of freeing the
+    signals from the last sort, put them aside to use again. */
+static void signal_spare(void)
+{
+    t_signal *sig;
+    int i;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_freelist[i] = THIS->u_sparelist[i] = 0;
+    THIS->u_freeborrowed = THIS->u_spareborrowed = 0;
+    for (sig = THIS->u_signals; sig; sig = sig->s_nextused)
+    {
+        if (sig->s_isborrowed)
+        {
+            sig->s_vec = 0;
+            sig->s_nextfree = THIS->u_spareborrowed;
+            THIS->u_spareborrowed = sig;
+        }
+        else
+        {
+            int logn = ilog2(sig->s_vecsize);
+            sig->s_nextfree = THIS->u_sparelist[logn];
+            THIS->u_sparelist[logn] = sig;
+        }
+    }
+}
+
+    /* free whatever spare signals the new sort didn't need.  These are
+    marked with a size of -1 and then weeded out of the list of all signals. */
+static void signal_freespare(void)
+{
+    t_signal **sigp = &THIS->u_signals, *sig;
+    int i;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        for (sig = THIS->u_sparelist[i]; sig; sig = sig->s_nextfree)
+            sig->s_n = -1;
+    for (sig = THIS->u_spareborrowed; sig; sig = sig->s_nextfree)
+        sig->s_n = -1;
+    while ((sig = *sigp))
+    {
+        if (sig->s_n == -1)
+        {
+            *sigp = sig->s_nextused;
+            if (!sig->s_isborrowed)
+                t_freebytes(sig->s_vec, sig->s_vecsize * sizeof (*sig->s_vec));
+            t_freebytes(sig, sizeof *sig);
+        }
+        else sigp = &sig->s_nextused;
+    }
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_sparelist[i] = 0;
+    THIS->u_spareborrowed = 0;
 }
 
     /* mark the signal "reusable." */
@@ -456,7 +773,7 @@ void signal_makereusable(t_signal *sig)
 static t_signal *signal_new(int n, t_float sr)
 {
     int logn, vecsize = 0;
-    t_signal *ret, **whichlist;
+    t_signal *ret, **whichlist, **sparelist;
     logn = ilog2(n);
     if (n)
     {
@@ -465,13 +782,25 @@ static t_signal *signal_new(int n, t_float sr)
         if (logn > MAXLOGSIG)
             bug("signal buffer too large");
         whichlist = THIS->u_freelist + logn;
+        sparelist = THIS->u_sparelist + logn;
     }
     else
+    {
         whichlist = &THIS->u_freeborrowed;
+        sparelist = &THIS->u_spareborrowed;
+    }
 
-        /* first try to reclaim one from the free list */
+        /* first try to reclaim one from the free list, then from the
+        signals left over from the last sort.  Those still hold whatever
+        the old chain left in them, so clear them as if they were new. */
     if ((ret = *whichlist))
         *whichlist = ret->s_nextfree;
+    else if ((ret = *sparelist))
+    {
+        *sparelist = ret->s_nextfree;
+        if (n)
+            memset(ret->s_vec, 0, vecsize * sizeof(*ret->s_vec));
+    }
     else
     {
             /* LATER figure out what to do for out-of-space here! */
@@ -533,6 +862,7 @@ typedef struct _ugenbox
     struct _ugenbox *u_next;
     t_object *u_obj;
     int u_done;
+    int u_task;             /* parallel task if partitioned, or -1 */
 } t_ugenbox;
 
 typedef struct _siginlet
@@ -557,6 +887,32 @@ typedef struct _sigoutlet
     t_sigoutconnect *o_connections;
 } t_sigoutlet;
 
+    /* The graph of ugens and connections in a canvas is kept from one sort to
+    the next.  When the canvas is sorted again, the ugens and connections it
+    reports are checked against the ones recorded here; if they're the same
+    the old graph is reused, and otherwise it's rebuilt from the first
+    difference on. */
+typedef struct _ugenconnect
+{
+    t_ugenbox *c_from;
+    int c_outno;
+    t_ugenbox *c_to;
+    int c_inno;
+} t_ugenconnect;
+
+struct _ugengraph
+{
+    t_ugenbox **g_ugens;        /* ugens in the order they were added */
+    int g_nugen;
+    int g_ugensize;
+    t_ugenconnect *g_connect;   /* connections in the order they were made */
+    int g_nconnect;
+    int g_connectsize;
+    int g_busy;                 /* true while being sorted */
+};
+
+#define t_ugengraph struct _ugengraph
+
 
 struct _dspcontext
 {
@@ -571,6 +927,14 @@ struct _dspcontext
     char dc_toplevel;       /* true if "iosigs" is invalid. */
     char dc_reblock;        /* true if we have to reblock inlets/outlets */
     char dc_switched;       /* true if we're switched */
+    char dc_partitioned;    /* true if ugens are tagged with tasks */
+    struct _ugenbox **dc_hash;  /* ugens hashed by object for ugen_connect */
+    int dc_hashsize;        /* size of hash table, power of two, or zero */
+    int dc_nugen;           /* number of ugens in ugenlist */
+    t_ugengraph *dc_graph;  /* graph kept for the canvas, if any */
+    char dc_matching;       /* true while ugens match those in dc_graph */
+    int dc_nmatch;          /* how many ugens matched so far */
+    int dc_ncmatch;         /* how many connections matched so far */
 };
 
 #define t_dspcontext struct _dspcontext
@@ -582,28 +946,466 @@ t_signal *signal_newfromcontext(int borrowed)
         THIS->u_context->dc_srate));
 }
 
+/* ------------------ partitioning for parallel DSP ----------------- */
+
+#define UGEN_SERIAL 32      /* always serial, above the DSPGROUP_* bits */
+
+    /* find out what state outside itself an object's DSP code touches.
+    Classes have to say they can run on another thread (CLASS_PARALLEL) and
+    which shared state they use (class_setdspgroup()); all others, including
+    externs that don't know about this, are always serial. */
+static int ugen_nonlocal(t_object *obj, int *writes)
+{
+    t_class *c = pd_class(&obj->ob_pd);
+    *writes = c->c_dspwrites;
+    return (c->c_parallel ? c->c_dspgroup : (c->c_dspgroup | UGEN_SERIAL));
+}
+
+    /* close the current segment of the DSP chain, if it's nonempty */
+static void ugen_closesegment(void)
+{
+    int end = THIS->u_dspchainsize - 1;
+    t_dspsegment *sg;
+    if (end == THIS->u_segonset)
+        return;
+    if (THIS->u_nseg == THIS->u_segsize)
+    {
+        int newsize = (THIS->u_segsize ? 2 * THIS->u_segsize : 64);
+        THIS->u_seg = (t_dspsegment *)resizebytes(THIS->u_seg,
+            THIS->u_segsize * sizeof(*THIS->u_seg),
+                newsize * sizeof(*THIS->u_seg));
+        THIS->u_segsize = newsize;
+    }
+    sg = &THIS->u_seg[THIS->u_nseg++];
+    sg->sg_onset = THIS->u_segonset;
+    sg->sg_end = end;
+    sg->sg_task = THIS->u_task;
+    sg->sg_next = -1;
+    THIS->u_segonset = end;
+}
+
+    /* switch to adding DSP code for another task.  Each task (and the
+    serial part, in slot 0) keeps its own signal free lists so that no
+    buffer is ever shared between two tasks that might run at once. */
+static void ugen_settask(int task)
+{
+    t_signal **fp;
+    if (task == THIS->u_task)
+        return;
+    ugen_closesegment();
+    fp = THIS->u_taskfree + (THIS->u_task + 1) * (MAXLOGSIG+2);
+    memcpy(fp, THIS->u_freelist, (MAXLOGSIG+1) * sizeof(*fp));
+    fp[MAXLOGSIG+1] = THIS->u_freeborrowed;
+    fp = THIS->u_taskfree + (task + 1) * (MAXLOGSIG+2);
+    memcpy(THIS->u_freelist, fp, (MAXLOGSIG+1) * sizeof(*fp));
+    THIS->u_freeborrowed = fp[MAXLOGSIG+1];
+    THIS->u_task = task;
+}
+
+static void ugen_growtasks(int ntask)
+{
+    int oldsize = THIS->u_tasksize, newsize = (oldsize ? oldsize : 16);
+    if (ntask <= oldsize)
+        return;
+    while (newsize < ntask)
+        newsize *= 2;
+    THIS->u_taskflags = (int *)resizebytes(THIS->u_taskflags,
+        oldsize * sizeof(int), newsize * sizeof(int));
+    THIS->u_taskfree = (t_signal **)resizebytes(THIS->u_taskfree,
+        (oldsize + 1) * (MAXLOGSIG+2) * sizeof(t_signal *),
+            (newsize + 1) * (MAXLOGSIG+2) * sizeof(t_signal *));
+    THIS->u_tasksize = newsize;
+}
+
+static int ugen_findroot(int *root, int i)
+{
+    while (root[i] != i)
+        i = root[i] = root[root[i]];
+    return (i);
+}
+
+    /* split the top level of a root canvas into tasks: connected groups of
+    ugens, not counting connections into ugens without signal outputs,
+    which are always serial and which we call "sinks". */
+static void ugen_partition(t_dspcontext *dc)
+{
+    t_ugenbox *u;
+    t_sigoutlet *uout;
+    t_sigoutconnect *oc;
+    int i, nbox = 0, ntask = 0, *root, *id, writes;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        u->u_task = nbox++;
+    root = (int *)getbytes(2 * nbox * sizeof(int));
+    id = root + nbox;
+    for (i = 0; i < nbox; i++)
+        root[i] = i, id[i] = -1;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        for (uout = u->u_out, i = u->u_nout; i--; uout++)
+            for (oc = uout->o_connections; oc; oc = oc->oc_next)
+                if (oc->oc_who->u_nout)
+                    root[ugen_findroot(root, u->u_task)] =
+                        ugen_findroot(root, oc->oc_who->u_task);
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        int r = ugen_findroot(root, u->u_task);
+        if (u->u_nout && id[r] < 0)
+            id[r] = THIS->u_ntask + ntask++;
+    }
+    ugen_growtasks(THIS->u_ntask + ntask);
+    for (i = THIS->u_ntask; i < THIS->u_ntask + ntask; i++)
+    {
+        THIS->u_taskflags[i] = 0;
+        memset(THIS->u_taskfree + (i + 1) * (MAXLOGSIG+2), 0,
+            (MAXLOGSIG+2) * sizeof(t_signal *));
+    }
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        if (u->u_nout)
+        {
+            u->u_task = id[ugen_findroot(root, u->u_task)];
+            THIS->u_taskflags[u->u_task] |= ugen_nonlocal(u->u_obj, &writes);
+        }
+        else u->u_task = -1;
+    }
+    THIS->u_ntask += ntask;
+    freebytes(root, 2 * nbox * sizeof(int));
+    dc->dc_partitioned = 1;
+}
+
+/* ------------------ forked DSP chains ----------------------- */
+
+/* An object such as "clone -p" can add the DSP code for several identical
+branches (the copies of a clone) between dsp_fork() and dsp_forkjoin(),
+calling dsp_forkbranch() after each one.  The fork puts a routine on the
+chain that runs the branches as jobs on the worker threads, FORKGROUP
+branches per job, and then skips over their code.  Each job sums the
+outputs of its branches into its own partial sum, and the partial sums are
+added into the outputs when all jobs are done.  Branches that are switched
+off by a switch~ (and not reblocked) are skipped altogether.  If any branch
+touches shared state, or if there are no worker threads, the jobs are run
+one after the other on this thread, so the result is the same either way. */
+
+#define FORKGROUP 4
+
+typedef struct _forkbranch
+{
+    int b_onset;            /* DSP code for this branch */
+    int b_end;
+    t_block *b_switch;      /* switch~ that can turn it off, if any */
+    t_sample **b_outvec;    /* its output vectors */
+} t_forkbranch;
+
+struct _dspfork
+{
+    struct _dspfork *f_next;    /* next in list of all forks */
+    struct _dspfork *f_parent;  /* fork we're nested in while sorting */
+    t_dspcontext *f_context;    /* context the fork was made in */
+    int f_nbranch;
+    int f_curbranch;            /* branch being added while sorting */
+    t_forkbranch *f_branch;
+    int f_nout;
+    int f_n;                    /* vector size */
+    t_sample **f_outvec;        /* output vectors */
+    int f_njob;
+    t_sample *f_partial;        /* partial sums, f_nout * f_n per job */
+    int *f_gotpartial;          /* true if the job's branches contributed */
+    int f_onset;                /* where fork_perform is in the chain */
+    int f_skip;                 /* distance to code after the branches */
+    int f_flags;                /* shared state touched by any branch */
+    int f_parallel;             /* true if jobs can run in parallel */
+    t_signal *f_freelist[MAXLOGSIG+1];  /* free lists before the fork */
+    t_signal *f_freeborrowed;
+};
+
+#define t_dspfork struct _dspfork
+
+static void fork_runjob(void *owner, int job)
+{
+    t_dspfork *f = (t_dspfork *)owner;
+    int n = f->f_n, nout = f->f_nout, b, i, k, got = 0;
+    int last = (job + 1) * FORKGROUP;
+    t_sample *partial = f->f_partial + job * nout * n;
+    if (last > f->f_nbranch)
+        last = f->f_nbranch;
+    for (b = job * FORKGROUP; b < last; b++)
+    {
+        t_forkbranch *br = &f->f_branch[b];
+        t_dspsegment sg;
+        if (br->b_switch && !br->b_switch->x_switchon &&
+            !br->b_switch->x_reblock)
+                continue;
+        sg.sg_onset = br->b_onset;
+        sg.sg_end = br->b_end;
+        dsp_runsegment(THIS->u_dspchain, &sg);
+        for (i = 0; i < nout; i++)
+        {
+            t_sample *in = br->b_outvec[i], *out = partial + i * n;
+            if (got)
+                for (k = 0; k < n; k++)
+                    out[k] += in[k];
+            else for (k = 0; k < n; k++)
+                out[k] = in[k];
+        }
+        got = 1;
+    }
+    f->f_gotpartial[job] = got;
+}
+
+static t_int *fork_perform(t_int *w)
+{
+    t_dspfork *f = (t_dspfork *)(w[1]);
+    int n = f->f_n, i, j, k;
+    if (f->f_parallel)
+        dsp_runjobs(fork_runjob, f, f->f_njob);
+    else for (j = 0; j < f->f_njob; j++)
+        fork_runjob(f, j);
+    for (i = 0; i < f->f_nout; i++)
+    {
+        t_sample *out = f->f_outvec[i];
+        int got = 0;
+        for (j = 0; j < f->f_njob; j++)
+        {
+            t_sample *in = f->f_partial + (j * f->f_nout + i) * n;
+            if (!f->f_gotpartial[j])
+                continue;
+            if (got)
+                for (k = 0; k < n; k++)
+                    out[k] += in[k];
+            else for (k = 0; k < n; k++)
+                out[k] = in[k];
+            got = 1;
+        }
+        if (!got)
+            for (k = 0; k < n; k++)
+                out[k] = 0;
+    }
+    return (w + f->f_skip);
+}
+
+    /* start a fork with "nbranch" branches, each of which will supply "nout"
+    signals to be summed into "outsigs".  The branches get fresh signal free
+    lists so that they never share a buffer. */
+t_dspfork *dsp_fork(int nbranch, int nout, t_signal **outsigs)
+{
+    t_dspfork *f = (t_dspfork *)getbytes(sizeof(*f));
+    int i;
+    f->f_next = THIS->u_forklist;
+    THIS->u_forklist = f;
+    f->f_parent = THIS->u_fork;
+    THIS->u_fork = f;
+    f->f_context = THIS->u_context;
+    f->f_nbranch = nbranch;
+    f->f_branch = (t_forkbranch *)getbytes(nbranch * sizeof(*f->f_branch));
+    for (i = 0; i < nbranch; i++)
+        f->f_branch[i].b_outvec =
+            (t_sample **)getbytes(nout * sizeof(t_sample *));
+    f->f_nout = nout;
+    f->f_n = (nout ? outsigs[0]->s_n : 0);
+    f->f_outvec = (t_sample **)getbytes(nout * sizeof(t_sample *));
+    for (i = 0; i < nout; i++)
+        f->f_outvec[i] = outsigs[i]->s_vec;
+    f->f_njob = (nbranch + FORKGROUP - 1) / FORKGROUP;
+    f->f_partial = (t_sample *)getbytes(
+        f->f_njob * nout * f->f_n * sizeof(t_sample));
+    f->f_gotpartial = (int *)getbytes(f->f_njob * sizeof(int));
+    f->f_onset = THIS->u_dspchainsize - 1;
+    dsp_add(fork_perform, 1, f);
+    f->f_branch[0].b_onset = THIS->u_dspchainsize - 1;
+    memcpy(f->f_freelist, THIS->u_freelist, sizeof(f->f_freelist));
+    f->f_freeborrowed = THIS->u_freeborrowed;
+    memset(THIS->u_freelist, 0, sizeof(THIS->u_freelist));
+    THIS->u_freeborrowed = 0;
+    return (f);
+}
+
+    /* call after adding each branch's code, with its output signals.
+    Anything freed in the branch is dropped so the next branch can't use it. */
+void dsp_forkbranch(t_dspfork *f, t_signal **outsigs)
+{
+    t_forkbranch *br = &f->f_branch[f->f_curbranch];
+    int i;
+    br->b_end = THIS->u_dspchainsize - 1;
+    for (i = 0; i < f->f_nout; i++)
+        br->b_outvec[i] = outsigs[i]->s_vec;
+    if (++f->f_curbranch < f->f_nbranch)
+        f->f_branch[f->f_curbranch].b_onset = br->b_end;
+    memset(THIS->u_freelist, 0, sizeof(THIS->u_freelist));
+    THIS->u_freeborrowed = 0;
+}
+
+    /* finish the fork and go back to the free lists we had before it */
+void dsp_forkjoin(t_dspfork *f)
+{
+    f->f_skip = (THIS->u_dspchainsize - 1) - f->f_onset;
+    memcpy(THIS->u_freelist, f->f_freelist, sizeof(f->f_freelist));
+    THIS->u_freeborrowed = f->f_freeborrowed;
+    THIS->u_fork = f->f_parent;
+    if (f->f_parent)
+        f->f_parent->f_flags |= f->f_flags;
+}
+
+static void ugen_freeforks(void)
+{
+    t_dspfork *f;
+    int i;
+    while ((f = THIS->u_forklist))
+    {
+        THIS->u_forklist = f->f_next;
+        for (i = 0; i < f->f_nbranch; i++)
+            freebytes(f->f_branch[i].b_outvec,
+                f->f_nout * sizeof(t_sample *));
+        freebytes(f->f_branch, f->f_nbranch * sizeof(*f->f_branch));
+        freebytes(f->f_outvec, f->f_nout * sizeof(t_sample *));
+        freebytes(f->f_partial,
+            f->f_njob * f->f_nout * f->f_n * sizeof(t_sample));
+        freebytes(f->f_gotpartial, f->f_njob * sizeof(int));
+        freebytes(f, sizeof(*f));
+    }
+    THIS->u_fork = 0;
+}
+
+    /* called when all root canvases are added to the chain.  Decide which
+    tasks and forks can run in parallel and group tasks into jobs, largest
+    first. */
+void ugen_done_chain(void)
+{
+    int i, j, npar = 0, *cost, *order, *jobof, *jobcost, *last;
+    t_dspfork *f;
+    signal_freespare();
+    THIS->u_sorttime = sys_getrealtime() - THIS->u_sortstart;
+    for (f = THIS->u_forklist; f; f = f->f_next)
+        f->f_parallel = (THIS->u_threads && !(f->f_flags & UGEN_SERIAL) &&
+            !(f->f_flags & THIS->u_writers));
+    if (!THIS->u_parallel)
+        return;
+    ugen_settask(-1);
+    ugen_closesegment();
+    cost = (int *)getbytes(4 * THIS->u_ntask * sizeof(int) + 1);
+    order = cost + THIS->u_ntask;
+    jobof = order + THIS->u_ntask;
+    jobcost = jobof + THIS->u_ntask;
+    for (i = 0; i < THIS->u_nseg; i++)
+        if (THIS->u_seg[i].sg_task >= 0)
+            cost[THIS->u_seg[i].sg_task] +=
+                THIS->u_seg[i].sg_end - THIS->u_seg[i].sg_onset;
+    for (i = 0; i < THIS->u_ntask; i++)
+    {
+        int flags = THIS->u_taskflags[i];
+        if (!(flags & UGEN_SERIAL) && !(flags & THIS->u_writers))
+        {
+                /* insertion sort by decreasing cost */
+            for (j = npar; j > 0 && cost[order[j-1]] < cost[i]; j--)
+                order[j] = order[j-1];
+            order[j] = i;
+            npar++;
+        }
+        jobof[i] = -1;
+    }
+    if (npar > 1)
+    {
+        THIS->u_njob = (npar < 4 * THIS->u_nthreads ?
+            npar : 4 * THIS->u_nthreads);
+        memset(jobcost, 0, THIS->u_njob * sizeof(int));
+        for (i = 0; i < npar; i++)
+        {
+            int best = 0;
+            for (j = 1; j < THIS->u_njob; j++)
+                if (jobcost[j] < jobcost[best])
+                    best = j;
+            jobof[order[i]] = best;
+            jobcost[best] += cost[order[i]];
+        }
+            /* link the segments of each job (and the serial ones) */
+        THIS->u_jobhead = (int *)getbytes((THIS->u_njob + 1) * sizeof(int));
+        last = (int *)getbytes((THIS->u_njob + 1) * sizeof(int));
+        for (j = 0; j <= THIS->u_njob; j++)
+            THIS->u_jobhead[j] = last[j] = -1;
+        for (i = 0; i < THIS->u_nseg; i++)
+        {
+            int task = THIS->u_seg[i].sg_task;
+            j = (task >= 0 && jobof[task] >= 0 ? jobof[task] : THIS->u_njob);
+            if (last[j] >= 0)
+                THIS->u_seg[last[j]].sg_next = i;
+            else THIS->u_jobhead[j] = i;
+            last[j] = i;
+        }
+        THIS->u_serialhead = THIS->u_jobhead[THIS->u_njob];
+        freebytes(last, (THIS->u_njob + 1) * sizeof(int));
+    }
+    if (sys_verbose)
+        post("DSP: %d tasks, %d parallel, %d jobs on %d threads",
+            THIS->u_ntask, npar, THIS->u_njob, THIS->u_nthreads);
+    freebytes(cost, 4 * THIS->u_ntask * sizeof(int) + 1);
+}
+
+static void ugen_freeparallel(void)
+{
+    if (THIS->u_seg)
+        freebytes(THIS->u_seg, THIS->u_segsize * sizeof(*THIS->u_seg));
+    if (THIS->u_jobhead)
+        freebytes(THIS->u_jobhead, (THIS->u_njob + 1) * sizeof(int));
+    if (THIS->u_taskflags)
+        freebytes(THIS->u_taskflags, THIS->u_tasksize * sizeof(int));
+    if (THIS->u_taskfree)
+        freebytes(THIS->u_taskfree,
+            (THIS->u_tasksize + 1) * (MAXLOGSIG+2) * sizeof(t_signal *));
+    THIS->u_seg = 0;
+    THIS->u_nseg = THIS->u_segsize = THIS->u_segonset = 0;
+    THIS->u_jobhead = 0;
+    THIS->u_njob = 0;
+    THIS->u_serialhead = -1;
+    THIS->u_taskflags = 0;
+    THIS->u_taskfree = 0;
+    THIS->u_ntask = THIS->u_tasksize = 0;
+    THIS->u_task = -1;
+    THIS->u_writers = 0;
+    THIS->u_parallel = 0;
+}
+
 void ugen_stop(void)
 {
     if (THIS->u_dspchain)
     {
         freebytes(THIS->u_dspchain,
-            THIS->u_dspchainsize * sizeof (t_int));
+            THIS->u_dspchainalloc * sizeof (t_int));
         THIS->u_dspchain = 0;
+        THIS->u_dspchainsize = THIS->u_dspchainalloc = 0;
     }
+    ugen_freeparallel();
+    ugen_freeforks();
     signal_cleanup();
 
 }
 
+    /* start a new sort.  If DSP was already running, we keep the chain's
+    memory and the old signals to reuse, so that re-sorting a running patch
+    allocates (and zeroes) as little as possible. */
 void ugen_start(void)
 {
-    ugen_stop();
+    if (THIS->u_dspchain)
+    {
+        ugen_freeparallel();
+        ugen_freeforks();
+        signal_spare();
+    }
+    else ugen_stop();
     THIS->u_sortno++;
-    THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
+    THIS->u_sortstart = sys_getrealtime();
+    THIS->u_nugen = 0;
+    THIS->u_dspchainsize = 0;
+    dsp_growchain(1);
     THIS->u_dspchain[0] = (t_int)dsp_done;
     THIS->u_dspchainsize = 1;
     if (THIS->u_context) bug("ugen_start");
+    if (THIS->u_nthreads > 1 && THIS->u_threads)
+    {
+        THIS->u_parallel = 1;
+        ugen_growtasks(1);
+        memset(THIS->u_taskfree, 0, (MAXLOGSIG+2) * sizeof(t_signal *));
+    }
 }
 
+
 int ugen_getsortno(void)
 {
     return (THIS->u_sortno);
@@ -637,7 +1439,7 @@ void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv)
 
     /* start building the graph for a canvas */
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
-    int ninlets, int noutlets)
+    int ninlets, int noutlets, t_ugengraph **graphp)
 {
     t_dspcontext *dc = (t_dspcontext *)getbytes(sizeof(*dc));
 
@@ -649,6 +1451,22 @@ t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
         ninlets = noutlets = 0;
 
     dc->dc_ugenlist = 0;
+    dc->dc_hash = 0;
+    dc->dc_hashsize = dc->dc_nugen = 0;
+    dc->dc_graph = 0;
+    dc->dc_matching = 0;
+    dc->dc_nmatch = dc->dc_ncmatch = 0;
+    if (graphp)
+    {
+        if (!*graphp)
+            *graphp = (t_ugengraph *)getbytes(sizeof(t_ugengraph));
+        if (!(*graphp)->g_busy)
+        {
+            dc->dc_graph = *graphp;
+            dc->dc_graph->g_busy = 1;
+            dc->dc_matching = 1;
+        }
+    }
     dc->dc_toplevel = toplevel;
     dc->dc_iosigs = sp;
     dc->dc_ninlets = ninlets;
@@ -658,16 +1476,146 @@ t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
     return (dc);
 }
 
+    /* hash table to find a ugen from its object in ugen_connect() without
+    searching the whole list, which was quadratic in the size of the patch.
+    It's made at the first connection after boxes are added. */
+static void ugen_freehash(t_dspcontext *dc)
+{
+    freebytes(dc->dc_hash, dc->dc_hashsize * sizeof(*dc->dc_hash));
+    dc->dc_hash = 0;
+    dc->dc_hashsize = 0;
+}
+
+static void ugen_makehash(t_dspcontext *dc)
+{
+    t_ugenbox *u;
+    int size = 16, i;
+    while (size < 2 * dc->dc_nugen)
+        size *= 2;
+    dc->dc_hash = (t_ugenbox **)getbytes(size * sizeof(*dc->dc_hash));
+    dc->dc_hashsize = size;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        for (i = pd_ptrhash(u->u_obj, size); dc->dc_hash[i];
+            i = (i + 1) & (size - 1))
+                ;
+        dc->dc_hash[i] = u;
+    }
+}
+
+static t_ugenbox *ugen_find(t_dspcontext *dc, t_object *obj)
+{
+    int i;
+    if (!dc->dc_hash)
+        ugen_makehash(dc);
+    for (i = pd_ptrhash(obj, dc->dc_hashsize); dc->dc_hash[i];
+        i = (i + 1) & (dc->dc_hashsize - 1))
+            if (dc->dc_hash[i]->u_obj == obj)
+                return (dc->dc_hash[i]);
+    return (0);
+}
+
+static void ugen_freeconnections(t_ugenbox *u)
+{
+    t_sigoutlet *uout;
+    t_siginlet *uin;
+    t_sigoutconnect *oc, *oc2;
+    int n;
+    for (uout = u->u_out, n = u->u_nout; n--; uout++)
+    {
+        for (oc = uout->o_connections; oc; oc = oc2)
+        {
+            oc2 = oc->oc_next;
+            freebytes(oc, sizeof *oc);
+        }
+        uout->o_connections = 0;
+        uout->o_nconnect = 0;
+    }
+    for (uin = u->u_in, n = u->u_nin; n--; uin++)
+        uin->i_nconnect = 0;
+}
+
+static void ugen_freebox(t_ugenbox *u)
+{
+    ugen_freeconnections(u);
+    freebytes(u->u_out, u->u_nout * sizeof (*u->u_out));
+    freebytes(u->u_in, u->u_nin * sizeof(*u->u_in));
+    freebytes(u, sizeof *u);
+}
+
+static void ugen_doconnect(t_ugenbox *u1, int sigoutno, t_ugenbox *u2,
+    int siginno)
+{
+    t_sigoutlet *uout = u1->u_out + sigoutno;
+    t_siginlet *uin = u2->u_in + siginno;
+    t_sigoutconnect *oc;
+
+        /* add a new connection to the outlet's list */
+    oc = (t_sigoutconnect *)getbytes(sizeof *oc);
+    oc->oc_next = uout->o_connections;
+    uout->o_connections = oc;
+    oc->oc_who = u2;
+    oc->oc_inno = siginno;
+        /* update inlet and outlet counts  */
+    uout->o_nconnect++;
+    uin->i_nconnect++;
+}
+
+    /* free a kept graph - called when its canvas is freed */
+void ugen_freegraph(t_ugengraph *g)
+{
+    int i;
+    if (!g)
+        return;
+    for (i = 0; i < g->g_nugen; i++)
+        ugen_freebox(g->g_ugens[i]);
+    freebytes(g->g_ugens, g->g_ugensize * sizeof(*g->g_ugens));
+    freebytes(g->g_connect, g->g_connectsize * sizeof(*g->g_connect));
+    freebytes(g, sizeof(*g));
+}
+
+    /* the canvas has reported something different from the kept graph.
+    Throw away the ugens that haven't been matched yet and all connections,
+    then remake the connections that did match.  From here on the graph is
+    built from scratch (and recorded again). */
+static void ugen_unmatch(t_dspcontext *dc)
+{
+    t_ugengraph *g = dc->dc_graph;
+    int i;
+    for (i = 0; i < g->g_nugen; i++)
+        ugen_freeconnections(g->g_ugens[i]);
+    for (i = dc->dc_nmatch; i < g->g_nugen; i++)
+        ugen_freebox(g->g_ugens[i]);
+    g->g_nugen = dc->dc_nmatch;
+    for (i = 0; i < dc->dc_ncmatch; i++)
+        ugen_doconnect(g->g_connect[i].c_from, g->g_connect[i].c_outno,
+            g->g_connect[i].c_to, g->g_connect[i].c_inno);
+    g->g_nconnect = dc->dc_ncmatch;
+    dc->dc_matching = 0;
+}
+
     /* first the canvas calls this to create all the boxes... */
 void ugen_add(t_dspcontext *dc, t_object *obj)
 {
-    t_ugenbox *x = (t_ugenbox *)getbytes(sizeof *x);
+    t_ugenbox *x;
     int i;
     t_sigoutlet *uout;
     t_siginlet *uin;
+    t_ugengraph *g = dc->dc_graph;
 
-    x->u_next = dc->dc_ugenlist;
-    dc->dc_ugenlist = x;
+    if (dc->dc_matching)
+    {
+        if (dc->dc_nmatch < g->g_nugen &&
+            (x = g->g_ugens[dc->dc_nmatch])->u_obj == obj &&
+                x->u_nin == obj_nsiginlets(obj) &&
+                    x->u_nout == obj_nsigoutlets(obj))
+        {
+            dc->dc_nmatch++;
+            goto gotit;
+        }
+        ugen_unmatch(dc);
+    }
+    x = (t_ugenbox *)getbytes(sizeof *x);
     x->u_obj = obj;
     x->u_nin = obj_nsiginlets(obj);
     x->u_in = getbytes(x->u_nin * sizeof (*x->u_in));
@@ -677,6 +1625,36 @@ void ugen_add(t_dspcontext *dc, t_object *obj)
     x->u_out = getbytes(x->u_nout * sizeof (*x->u_out));
     for (uout = x->u_out, i = x->u_nout; i--; uout++)
         uout->o_connections = 0, uout->o_nconnect = 0;
+    if (g)
+    {
+        if (g->g_nugen == g->g_ugensize)
+        {
+            int newsize = (g->g_ugensize ? 2 * g->g_ugensize : 16);
+            g->g_ugens = (t_ugenbox **)resizebytes(g->g_ugens,
+                g->g_ugensize * sizeof(*g->g_ugens),
+                    newsize * sizeof(*g->g_ugens));
+            g->g_ugensize = newsize;
+        }
+        g->g_ugens[g->g_nugen++] = x;
+        dc->dc_nmatch = g->g_nugen;
+    }
+gotit:
+    x->u_next = dc->dc_ugenlist;
+    dc->dc_ugenlist = x;
+    dc->dc_nugen++;
+    THIS->u_nugen++;
+    if (dc->dc_hash)
+        ugen_freehash(dc);
+    x->u_task = -1;
+    if (THIS->u_threads)
+    {
+        int writes, flags = ugen_nonlocal(obj, &writes);
+        THIS->u_writers |= writes;
+        if (THIS->u_task >= 0)
+            THIS->u_taskflags[THIS->u_task] |= flags;
+        if (THIS->u_fork)
+            THIS->u_fork->f_flags |= flags;
+    }
 }
 
     /* and then this to make all the connections. */
@@ -684,17 +1662,27 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
     int inno)
 {
     t_ugenbox *u1, *u2;
-    t_sigoutlet *uout;
-    t_siginlet *uin;
-    t_sigoutconnect *oc;
+    t_ugengraph *g = dc->dc_graph;
     int sigoutno = obj_sigoutletindex(x1, outno);
     int siginno = obj_siginletindex(x2, inno);
     if (THIS->u_loud)
         post("%s -> %s: %d->%d",
             class_getname(x1->ob_pd),
                 class_getname(x2->ob_pd), outno, inno);
-    for (u1 = dc->dc_ugenlist; u1 && u1->u_obj != x1; u1 = u1->u_next);
-    for (u2 = dc->dc_ugenlist; u2 && u2->u_obj != x2; u2 = u2->u_next);
+    if (dc->dc_matching)
+    {
+        t_ugenconnect *c = g->g_connect + dc->dc_ncmatch;
+        if (dc->dc_nmatch == g->g_nugen && dc->dc_ncmatch < g->g_nconnect &&
+            c->c_from->u_obj == x1 && c->c_outno == sigoutno &&
+                c->c_to->u_obj == x2 && c->c_inno == siginno)
+        {
+            dc->dc_ncmatch++;
+            return;
+        }
+        ugen_unmatch(dc);
+    }
+    u1 = ugen_find(dc, x1);
+    u2 = ugen_find(dc, x2);
     if (!u1 || !u2 || siginno < 0 || !u2->u_nin)
     {
         if (!u1)
@@ -713,18 +1701,25 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
             class_getname(x2->ob_pd), sigoutno, siginno, u1->u_nout,
                 u2->u_nin);
     }
-    uout = u1->u_out + sigoutno;
-    uin = u2->u_in + siginno;
-
-        /* add a new connection to the outlet's list */
-    oc = (t_sigoutconnect *)getbytes(sizeof *oc);
-    oc->oc_next = uout->o_connections;
-    uout->o_connections = oc;
-    oc->oc_who = u2;
-    oc->oc_inno = siginno;
-        /* update inlet and outlet counts  */
-    uout->o_nconnect++;
-    uin->i_nconnect++;
+    ugen_doconnect(u1, sigoutno, u2, siginno);
+    if (g)
+    {
+        t_ugenconnect *c;
+        if (g->g_nconnect == g->g_connectsize)
+        {
+            int newsize = (g->g_connectsize ? 2 * g->g_connectsize : 16);
+            g->g_connect = (t_ugenconnect *)resizebytes(g->g_connect,
+                g->g_connectsize * sizeof(*g->g_connect),
+                    newsize * sizeof(*g->g_connect));
+            g->g_connectsize = newsize;
+        }
+        c = g->g_connect + g->g_nconnect++;
+        c->c_from = u1;
+        c->c_outno = sigoutno;
+        c->c_to = u2;
+        c->c_inno = siginno;
+        dc->dc_ncmatch = g->g_nconnect;
+    }
 }
 
     /* get the index of a ugenbox or -1 if it's not on the list */
@@ -763,8 +1758,15 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
     t_signal **insig, **outsig, **sig, *s1, *s2, *s3;
     t_ugenbox *u2;
 
+        /* in a partitioned graph, sinks are run after everything else, so
+        they must hold on to their inputs to keep other tasks from reusing
+        them in the meantime. */
+    int pinsigs = (dc->dc_partitioned && u->u_task < 0);
+
     if (THIS->u_loud) post("doit %s %d %d", class_getname(class), nofreesigs,
         nonewsigs);
+    if (dc->dc_partitioned)
+        ugen_settask(u->u_task);
     for (i = 0, uin = u->u_in; i < u->u_nin; i++, uin++)
     {
         if (!uin->i_nconnect)
@@ -793,7 +1795,7 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
             signal around to send to objects connected to them.  In this
             case we increment the reference count; the corresponding decrement
             is in sig_makereusable(). */
-        if (nofreesigs)
+        if (nofreesigs || pinsigs)
             (*sig)->s_refcount++;
         else if (!newrefcount)
             signal_makereusable(*sig);
@@ -852,11 +1854,17 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         {
             u2 = oc->oc_who;
             uin = &u2->u_in[oc->oc_inno];
+            if (dc->dc_partitioned)
+                ugen_settask(u2->u_task);
                 /* if there's already someone here, sum the two */
             if ((s2 = uin->i_signal))
             {
-                s1->s_refcount--;
-                s2->s_refcount--;
+                    /* as above, sums into sinks keep their inputs */
+                if (!(dc->dc_partitioned && u2->u_task < 0))
+                {
+                    s1->s_refcount--;
+                    s2->s_refcount--;
+                }
                 if (!signal_compatible(s1, s2))
                 {
                     pd_error(u->u_obj, "%s: incompatible signal inputs",
@@ -891,17 +1899,17 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
 }
 
     /* once the DSP graph is built, we call this routine to sort it.
-    This routine also deletes the graph; later we might want to leave the
-    graph around, in case the user is editing the DSP network, to save having
-    to recreate it all the time.  But not today.  */
+    This routine also deletes the graph, unless the canvas asked to keep it
+    (see ugen_start_graph()) in which case the next sort can reuse it if the
+    canvas hasn't changed. */
 
 void ugen_done_graph(t_dspcontext *dc)
 {
     t_ugenbox *u;
     t_sigoutlet *uout;
     t_siginlet *uin;
-    t_sigoutconnect *oc, *oc2;
-    int i, n;
+    t_sigoutconnect *oc;
+    int i;
     t_block *blk;
     t_dspcontext *parent_context = dc->dc_parentcontext;
     t_float parent_srate;
@@ -913,6 +1921,13 @@ void ugen_done_graph(t_dspcontext *dc)
     int chainafterall;      /* and after signal outlet epilog */
     int reblock = 0, switched;
     int downsample = 1, upsample = 1;
+
+        /* if the canvas reported fewer ugens or connections than last time,
+        the kept graph has some extra ones to get rid of */
+    if (dc->dc_matching && (dc->dc_nmatch != dc->dc_graph->g_nugen ||
+        dc->dc_ncmatch != dc->dc_graph->g_nconnect))
+            ugen_unmatch(dc);
+
     /* debugging printout */
 
     if (THIS->u_loud)
@@ -999,6 +2014,9 @@ void ugen_done_graph(t_dspcontext *dc)
     }
     dc->dc_reblock = reblock;
     dc->dc_switched = switched;
+        /* partition root canvases for parallel DSP unless they're blocked */
+    if (THIS->u_parallel && !parent_context && !blk)
+        ugen_partition(dc);
     dc->dc_srate = srate;
     dc->dc_vecsize = vecsize;
     dc->dc_calcsize = calcsize;
@@ -1082,6 +2100,8 @@ void ugen_done_graph(t_dspcontext *dc)
         ugen_doit(dc, u);
     next: ;
     }
+    if (dc->dc_partitioned)
+        ugen_settask(-1);
 
         /* check for a DSP loop, which is evidenced here by the presence
         of ugens not yet scheduled. */
@@ -1136,6 +2156,11 @@ void ugen_done_graph(t_dspcontext *dc)
         blk->x_blocklength = chainblockend - chainblockbegin;
         blk->x_epiloglength = chainafterall - chainblockend;
         blk->x_reblock = reblock;
+            /* if this is a branch of a fork, the fork can skip it when off */
+        if (switched && THIS->u_fork &&
+            parent_context == THIS->u_fork->f_context)
+                THIS->u_fork->f_branch[THIS->u_fork->f_curbranch].b_switch =
+                    blk;
     }
 
     if (THIS->u_loud)
@@ -1147,27 +2172,17 @@ void ugen_done_graph(t_dspcontext *dc)
                     post("chain %lx", *ip);
         post("... ugen_done_graph done.");
     }
-        /* now delete everything. */
-    while (dc->dc_ugenlist)
+        /* now delete everything, except for the graph if the canvas
+        keeps it for next time. */
+    if (dc->dc_hash)
+        ugen_freehash(dc);
+    if (dc->dc_graph)
+        dc->dc_graph->g_busy = 0;
+    else while (dc->dc_ugenlist)
     {
-        for (uout = dc->dc_ugenlist->u_out, n = dc->dc_ugenlist->u_nout;
-            n--; uout++)
-        {
-            oc = uout->o_connections;
-            while (oc)
-            {
-                oc2 = oc->oc_next;
-                freebytes(oc, sizeof *oc);
-                oc = oc2;
-            }
-        }
-        freebytes(dc->dc_ugenlist->u_out, dc->dc_ugenlist->u_nout *
-            sizeof (*dc->dc_ugenlist->u_out));
-        freebytes(dc->dc_ugenlist->u_in, dc->dc_ugenlist->u_nin *
-            sizeof(*dc->dc_ugenlist->u_in));
         u = dc->dc_ugenlist;
         dc->dc_ugenlist = u->u_next;
-        freebytes(u, sizeof *u);
+        ugen_freebox(u);
     }
     if (THIS->u_context == dc)
         THIS->u_context = dc->dc_parentcontext;
@@ -1225,6 +2240,245 @@ static void samplerate_tilde_setup(void)
     class_addbang(samplerate_tilde_class, samplerate_tilde_bang);
 }
 
+#ifdef PD_BENCHMARKS
+
+t_canvas *sched_newtestpatch(const char *text);
+int sched_rendertestpatch(const char *text, int nsamples, t_sample *record);
+void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
+
+    /* how many jobs a patch's DSP chain is split into */
+static int dspthreads_countjobs(const char *text)
+{
+    int dspstate = canvas_suspend_dsp(), njob = -1;
+    t_canvas *x = sched_newtestpatch(text);
+    if (x)
+    {
+        ugen_start();
+        canvas_dodsp(x, 1, 0);
+        ugen_done_chain();
+        njob = THIS->u_njob;
+        ugen_stop();
+        pd_free((t_pd *)x);
+    }
+    canvas_resume_dsp(dspstate);
+    return (njob);
+}
+
+#define DSPTEST_NCHAIN 8
+#define DSPTEST_NFILTER 200
+#define DSPTEST_TEXTSIZE 262144
+
+    /* make a patch with DSPTEST_NCHAIN independent chains of filters to
+    the dac~, long enough that the jobs overlap in time; a chain in a
+    subpatch; two chains sharing a signal; and a delread4~ that's sorted
+    after its delwrite~, so it has to stay serial to get the same block */
+static char *dspthreads_testpatch(void)
+{
+    char *text = (char *)getbytes(DSPTEST_TEXTSIZE),
+        *conn = (char *)getbytes(DSPTEST_TEXTSIZE / 2), *cp = conn;
+    int i, j, n = 1;
+    sprintf(text, "#N canvas 0 0 450 300 12;\n#X obj 10 500 dac~;\n");
+    for (i = 0; i < DSPTEST_NCHAIN; i++)
+    {
+        sprintf(text + strlen(text), "#X obj %d 10 osc~ %d;\n",
+            10 + 60 * i, 100 + 37 * i);
+        for (j = 0; j < DSPTEST_NFILTER; j++)
+        {
+            sprintf(text + strlen(text), "#X obj %d %d %s;\n", 10 + 60 * i,
+                30 + 15 * j, (j & 1 ? "hip~ 20" : "lop~ 3000"));
+            cp += sprintf(cp, "#X connect %d 0 %d 0;\n", n + j, n + j + 1);
+        }
+        sprintf(text + strlen(text), "#X obj %d 450 *~ 0.05;\n", 10 + 60 * i);
+        cp += sprintf(cp, "#X connect %d 0 %d 0;\n#X connect %d 0 0 %d;\n",
+            n + DSPTEST_NFILTER, n + DSPTEST_NFILTER + 1,
+                n + DSPTEST_NFILTER + 1, i & 1);
+        n += DSPTEST_NFILTER + 2;
+    }
+    strcat(text,
+        "#X obj 500 10 phasor~ 77;\n"
+        "#X obj 500 40 lop~ 1000;\n"
+        "#X obj 560 10 osc~ 333;\n"
+        "#X obj 560 40 vcf~ 4;\n"
+        "#N canvas 0 0 450 300 sub 0;\n"
+        "#X obj 10 10 osc~ 500;\n"
+        "#X obj 10 40 lop~ 2000;\n"
+        "#X obj 10 70 outlet~;\n"
+        "#X connect 0 0 1 0;\n"
+        "#X connect 1 0 2 0;\n"
+        "#X restore 620 10 pd sub;\n"
+        "#X obj 620 40 delwrite~ \\$0-d 100;\n"
+        "#X obj 680 40 *~ 0;\n"
+        "#X obj 680 70 delread4~ \\$0-d;\n");
+    cp += sprintf(cp, "#X connect %d 0 %d 0;\n#X connect %d 0 0 0;\n"
+        "#X connect %d 0 %d 0;\n#X connect %d 0 %d 1;\n#X connect %d 0 0 1;\n",
+            n, n + 1, n + 1, n + 2, n + 3, n, n + 3, n + 3);
+    cp += sprintf(cp, "#X connect %d 0 %d 0;\n#X connect %d 0 %d 0;\n"
+        "#X connect %d 0 0 0;\n#X connect %d 0 0 1;\n#X connect %d 0 %d 0;\n",
+            n + 4, n + 6, n + 6, n + 7, n + 7, n + 4, n + 4, n + 5);
+    strcat(text, conn);
+    freebytes(conn, DSPTEST_TEXTSIZE / 2);
+    return (text);
+}
+
+    /* render "patch" on one thread into "ref", which must not be silent,
+    and then on 2 and 4 threads, checking that not a bit of it changes and,
+    if "countjobs" is set, that the patch really gets split up */
+static int dspthreads_compare(const char *test, const char *patch,
+    int nsamples, t_sample *ref, int countjobs)
+{
+    static const int nthreads[2] = {2, 4};
+    int oldnthreads = THIS->u_nthreads, i, j, njob, nbad = 0;
+    t_sample *out = (t_sample *)getbytes(2 * nsamples * sizeof(t_sample));
+    glob_dspthreads(0, 1);
+    if (!sched_rendertestpatch(patch, nsamples, ref))
+    {
+        nbad++;
+        goto done;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        for (j = 0; j < nsamples && ref[i * nsamples + j] == 0; j++)
+            ;
+        if (j == nsamples)
+        {
+            pd_error(0, "%s self-test: silent output", test);
+            nbad++;
+            goto done;
+        }
+    }
+    for (i = 0; i < 2; i++)
+    {
+        int ndiff = 0;
+        glob_dspthreads(0, nthreads[i]);
+        if (countjobs && (njob = dspthreads_countjobs(patch)) < 2)
+        {
+            pd_error(0, "%s self-test: %d threads: %d jobs",
+                test, nthreads[i], njob);
+            nbad++;
+        }
+        if (!sched_rendertestpatch(patch, nsamples, out))
+        {
+            nbad++;
+            break;
+        }
+        for (j = 0; j < 2 * nsamples; j++)
+            if (memcmp(&out[j], &ref[j], sizeof(t_sample)))
+                ndiff++;
+        if (ndiff)
+        {
+            pd_error(0, "%s self-test: %d threads: %d of %d "
+                "samples differ", test, nthreads[i], ndiff, 2 * nsamples);
+            nbad++;
+        }
+    }
+done:
+    glob_dspthreads(0, oldnthreads);
+    freebytes(out, 2 * nsamples * sizeof(t_sample));
+    return (nbad);
+}
+
+    /* check that running DSP on several threads puts out the same bits as
+    running it on one, and that the patch above really gets split up */
+int dspthreads_selftest(void)
+{
+    int nsamples = 32768, nbad;
+    char *patch = dspthreads_testpatch();
+    t_sample *ref = (t_sample *)getbytes(2 * nsamples * sizeof(t_sample));
+    nbad = dspthreads_compare("dsp-threads", patch, nsamples, ref, 1);
+    freebytes(patch, DSPTEST_TEXTSIZE);
+    freebytes(ref, 2 * nsamples * sizeof(t_sample));
+    return (nbad);
+}
+
+    /* the copies for the "clone -p" self-test: a filtered oscillator at a
+    frequency depending on the copy's number, times the input, with every
+    third copy switched off */
+static const char dspfork_testabs[] =
+    "#N canvas 0 0 450 300 12;\n"
+    "#X obj 10 10 loadbang;\n"
+    "#X obj 10 40 f \\$1;\n"
+    "#X obj 10 70 mod 3;\n"
+    "#X obj 10 100 switch~;\n"
+    "#X obj 100 70 * 37;\n"
+    "#X obj 100 100 osc~;\n"
+    "#X obj 100 130 lop~ 3000;\n"
+    "#X obj 200 100 inlet~;\n"
+    "#X obj 100 160 *~;\n"
+    "#X obj 100 190 outlet~;\n"
+    "#X connect 0 0 1 0;\n"
+    "#X connect 1 0 2 0;\n"
+    "#X connect 2 0 3 0;\n"
+    "#X connect 1 0 4 0;\n"
+    "#X connect 4 0 5 0;\n"
+    "#X connect 5 0 6 0;\n"
+    "#X connect 6 0 8 0;\n"
+    "#X connect 7 0 8 1;\n"
+    "#X connect 8 0 9 0;\n";
+
+#define DSPFORK_NCOPY 18    /* five jobs, the last one partly filled */
+#define DSPFORK_MAXDIFF 1e-4
+
+    /* check that "clone -p", with some of its copies switched off, puts out
+    the same bits on any number of threads, and about the same as a plain
+    clone of the same copies (which sums them in another order) */
+int dspfork_selftest(void)
+{
+    int nsamples = 16384, i, nbad = 0;
+    char absname[MAXPDSTRING], patch[3 * MAXPDSTRING];
+    const char *dir = getenv("TMPDIR");
+    t_sample *ref = (t_sample *)getbytes(2 * nsamples * sizeof(t_sample));
+    t_binbuf *b = binbuf_new();
+    double maxdiff = 0;
+#ifdef _WIN32
+    if (!dir)
+        dir = getenv("TEMP");
+#endif
+    if (!dir)
+        dir = "/tmp";
+    snprintf(absname, MAXPDSTRING, "%s/pd-self-test-clone", dir);
+    binbuf_text(b, dspfork_testabs, strlen(dspfork_testabs));
+    if (binbuf_write(b, "pd-self-test-clone.pd", dir, 0))
+    {
+        pd_error(0, "clone self-test: couldn't write %s.pd", absname);
+        binbuf_free(b);
+        freebytes(ref, 2 * nsamples * sizeof(t_sample));
+        return (1);
+    }
+    binbuf_free(b);
+        /* the parallel clone goes to the left channel and a plain one to
+        the right */
+    snprintf(patch, sizeof(patch),
+        "#N canvas 0 0 450 300 12;\n"
+        "#X obj 10 10 phasor~ 3;\n"
+        "#X obj 10 40 clone -s 1 -p %d %s;\n"
+        "#X obj 200 40 clone -s 1 %d %s;\n"
+        "#X obj 10 70 dac~;\n"
+        "#X connect 0 0 1 0;\n"
+        "#X connect 0 0 2 0;\n"
+        "#X connect 1 0 3 0;\n"
+        "#X connect 2 0 3 1;\n",
+            DSPFORK_NCOPY, absname, DSPFORK_NCOPY, absname);
+    nbad = dspthreads_compare("clone", patch, nsamples, ref, 0);
+    for (i = 0; !nbad && i < nsamples; i++)
+    {
+        double diff = fabs(ref[i] - ref[nsamples + i]);
+        if (!(diff <= maxdiff))
+            maxdiff = diff;
+    }
+    if (!(maxdiff <= DSPFORK_MAXDIFF))
+    {
+        pd_error(0, "clone self-test: -p differs from plain clone by %g",
+            maxdiff);
+        nbad++;
+    }
+    strcat(absname, ".pd");
+    remove(absname);
+    freebytes(ref, 2 * nsamples * sizeof(t_sample));
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* -------------------- setup routine -------------------------- */
 
 void d_ugen_setup(void)
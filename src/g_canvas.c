@@ -33,8 +33,11 @@ struct _canvasenvironment
 typedef struct _canvas_private
 {
     t_undo undo;
+    struct _ugengraph *ugengraph;   /* DSP graph kept between sorts */
 } t_canvas_private;
 
+void ugen_freegraph(struct _ugengraph *g);
+
 #define GLIST_DEFCANVASWIDTH 450
 #define GLIST_DEFCANVASHEIGHT 300
 
@@ -801,7 +804,9 @@ void canvas_free(t_canvas *x)
         freebytes(x->gl_env, sizeof(*x->gl_env));
     }
     canvas_undo_free(x);
+    ugen_freegraph(private->ugengraph);
     freebytes(private, sizeof(*private));
+    x->gl_privatedata = 0;
     canvas_resume_dsp(dspstate);
     freebytes(x->gl_xlabel, x->gl_nxlabels * sizeof(*(x->gl_xlabel)));
     freebytes(x->gl_ylabel, x->gl_nylabels * sizeof(*(x->gl_ylabel)));
@@ -1196,12 +1201,15 @@ t_undo* canvas_undo_get(t_canvas *x)
 
 EXTERN_STRUCT _dspcontext;
 #define t_dspcontext struct _dspcontext
+EXTERN_STRUCT _ugengraph;
+#define t_ugengraph struct _ugengraph
 
 void ugen_start(void);
 void ugen_stop(void);
+void ugen_done_chain(void);
 
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
-    int ninlets, int noutlets);
+    int ninlets, int noutlets, t_ugengraph **graphp);
 void ugen_add(t_dspcontext *dc, t_object *x);
 void ugen_connect(t_dspcontext *dc, t_object *x1, int outno,
     t_object *x2, int inno);
@@ -1219,13 +1227,16 @@ void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp)
     t_object *ob;
     t_symbol *dspsym = gensym("dsp");
     t_dspcontext *dc;
+    t_canvas_private *private = x->gl_privatedata;
 
         /* create a new "DSP graph" object to use in sorting this canvas.
-        If we aren't toplevel, there are already other dspcontexts around. */
+        If we aren't toplevel, there are already other dspcontexts around.
+        The graph itself is kept in the canvas so that it needn't be
+        rebuilt if the canvas hasn't changed since the last sort. */
 
     dc = ugen_start_graph(toplevel, sp,
         obj_nsiginlets(&x->gl_obj),
-        obj_nsigoutlets(&x->gl_obj));
+        obj_nsigoutlets(&x->gl_obj), (private ? &private->ugengraph : 0));
 
         /* find all the "dsp" boxes and add them to the graph */
 
@@ -1260,6 +1271,7 @@ static void canvas_start_dsp(void)
 
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
         canvas_dodsp(x, 1, 0);
+    ugen_done_chain();
 
     canvas_dspstate = THISGUI->i_dspstate = 1;
     if (gensym("pd-dsp-started")->s_thing)
@@ -1893,7 +1905,8 @@ void g_canvas_setup(void)
         /* we prevent the user from typing "canvas" in an object box
         by sending 0 for a creator function. */
     canvas_class = class_new(gensym("canvas"), 0,
-        (t_method)canvas_free, sizeof(t_canvas), CLASS_NOINLET, 0);
+        (t_method)canvas_free, sizeof(t_canvas),
+            CLASS_NOINLET | CLASS_PARALLEL, 0);
             /* here is the real creator function, invoked in patch files
             by sending the "canvas" message to #N, which is bound
             to pd_camvasmaker. */
@@ -15,9 +15,9 @@
 #define LIST_NGETBYTE 100 /* bigger that this we use alloc, not alloca */
 
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < LIST_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : gettmpbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < LIST_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < LIST_NGETBYTE || (freetmpbytes((x), (n) * sizeof(t_atom)), 0)))
 
 t_class *clone_class;
 static t_class *clone_in_class, *clone_out_class;
@@ -59,6 +59,7 @@ typedef struct _clone
     int x_phase;
     int x_startvoice;   /* number of first voice, 0 by default */
     int x_suppressvoice; /* suppress voice number as $1 arg */
+    int x_parallel;     /* run copies' DSP on worker threads */
 } t_clone;
 
 int clone_match(t_pd *z, t_symbol *name, t_symbol *dir)
@@ -293,6 +294,43 @@ static void clone_loadbang(t_clone *x, t_floatarg f)
 void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
 t_signal *signal_newfromcontext(int borrowed);
 void signal_makereusable(t_signal *sig);
+struct _dspfork *dsp_fork(int nbranch, int nout, t_signal **outsigs);
+void dsp_forkbranch(struct _dspfork *f, t_signal **outsigs);
+void dsp_forkjoin(struct _dspfork *f);
+
+    /* parallel version: each copy is a branch of a "fork" (see d_ugen.c)
+    which runs them on the DSP worker threads and sums their outputs. */
+static void clone_dsp_parallel(t_clone *x, t_signal **sp, int nin, int nout)
+{
+    int i, j;
+    struct _dspfork *f;
+    t_signal **tempio = (t_signal **)alloca((nin + nout) * sizeof(*tempio)),
+        **outsigs = (t_signal **)getbytes(x->x_n * nout * sizeof(*outsigs));
+        /* as below, but hold one extra reference to the input signals until
+        all copies are added, so that no copy can reuse them for output
+        while others are still reading them. */
+    for (i = 0; i < nin; i++)
+    {
+        sp[i]->s_refcount += x->x_n;
+        tempio[i] = sp[i];
+    }
+    f = dsp_fork(x->x_n, nout, sp + nin);
+    for (j = 0; j < x->x_n; j++)
+    {
+        for (i = 0; i < nout; i++)
+            tempio[nin + i] = outsigs[j * nout + i] =
+                signal_newfromcontext(1);
+        canvas_dodsp(x->x_vec[j].c_gl, 0, tempio);
+        dsp_forkbranch(f, tempio + nin);
+    }
+    dsp_forkjoin(f);
+    for (i = 0; i < x->x_n * nout; i++)
+        signal_makereusable(outsigs[i]);
+    for (i = 0; i < nin; i++)
+        if (!--sp[i]->s_refcount)
+            signal_makereusable(sp[i]);
+    freebytes(outsigs, x->x_n * nout * sizeof(*outsigs));
+}
 
 static void clone_dsp(t_clone *x, t_signal **sp)
 {
@@ -319,6 +357,11 @@ static void clone_dsp(t_clone *x, t_signal **sp)
             return;
         }
     }
+    if (x->x_parallel)
+    {
+        clone_dsp_parallel(x, sp, nin, nout);
+        return;
+    }
     tempsigs = (t_signal **)alloca((nin + 2 * nout) * sizeof(*tempsigs));
     tempio = tempsigs + nout;
         /* load input signals into signal vector to send subpatches */
@@ -366,6 +409,7 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     x->x_outvec = 0;
     x->x_startvoice = 0;
     x->x_suppressvoice = 0;
+    x->x_parallel = 0;
     clone_voicetovis = -1;
     if (argc == 0)
     {
@@ -385,6 +429,8 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
         }
         else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-x"))
             x->x_suppressvoice = 1, argc--, argv++;
+        else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-p"))
+            x->x_parallel = 1, argc--, argv++;
         else goto usage;
     }
     if (argc >= 2 && (wantn = atom_getfloatarg(0, argc, argv)) >= 0
@@ -442,7 +488,7 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
         canvas_vis(x->x_vec[voicetovis].c_gl, 1);
     return (x);
 usage:
-    error("usage: clone [-s starting-number] <number> <name> [arguments]");
+    error("usage: clone [-s starting-number] [-x] [-p] <number> <name> [arguments]");
 fail:
     freebytes(x, sizeof(t_clone));
     canvas_resume_dsp(dspstate);
@@ -452,7 +498,8 @@ fail:
 void clone_setup(void)
 {
     clone_class = class_new(gensym("clone"), (t_newmethod)clone_new,
-        (t_method)clone_free, sizeof(t_clone), CLASS_NOINLET, A_GIMME, 0);
+        (t_method)clone_free, sizeof(t_clone),
+            CLASS_NOINLET | CLASS_PARALLEL, A_GIMME, 0);
     class_addmethod(clone_class, (t_method)clone_click, gensym("click"),
         A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, 0);
     class_addmethod(clone_class, (t_method)clone_loadbang, gensym("loadbang"),
@@ -357,26 +357,30 @@ static void messresponder_anything(t_messresponder *x,
 
 static void message_bang(t_message *x)
 {
-    binbuf_eval(x->m_text.te_binbuf, &x->m_messresponder.mr_pd, 0, 0);
+    binbuf_evalcached(x->m_text.te_binbuf, &x->m_messresponder.mr_pd,
+        0, 0);
 }
 
 static void message_float(t_message *x, t_float f)
 {
     t_atom at;
     SETFLOAT(&at, f);
-    binbuf_eval(x->m_text.te_binbuf, &x->m_messresponder.mr_pd, 1, &at);
+    binbuf_evalcached(x->m_text.te_binbuf, &x->m_messresponder.mr_pd,
+        1, &at);
 }
 
 static void message_symbol(t_message *x, t_symbol *s)
 {
     t_atom at;
     SETSYMBOL(&at, s);
-    binbuf_eval(x->m_text.te_binbuf, &x->m_messresponder.mr_pd, 1, &at);
+    binbuf_evalcached(x->m_text.te_binbuf, &x->m_messresponder.mr_pd,
+        1, &at);
 }
 
 static void message_list(t_message *x, t_symbol *s, int argc, t_atom *argv)
 {
-    binbuf_eval(x->m_text.te_binbuf, &x->m_messresponder.mr_pd, argc, argv);
+    binbuf_evalcached(x->m_text.te_binbuf, &x->m_messresponder.mr_pd,
+        argc, argv);
 }
 
 static void message_set(t_message *x, t_symbol *s, int argc, t_atom *argv)
@@ -5,6 +5,8 @@
 
 #include <stdlib.h>
 #include "m_pd.h"
+#include "m_imp.h"
+#include "m_symhash.h"
 #include "s_stuff.h"
 #include "g_canvas.h"
 #include <stdio.h>
@@ -23,22 +25,31 @@
 #define snprintf _snprintf
 #endif
 
+typedef struct _binbufplan t_binbufplan;
+
 struct _binbuf
 {
     int b_n;
     t_atom *b_vec;
+    t_binbufplan *b_plan;   /* cached plan for binbuf_evalcached(), or 0 */
+    int b_nevals;           /* number of evaluations since last change */
 };
 
+static void binbuf_unplan(t_binbuf *x);
+
 t_binbuf *binbuf_new(void)
 {
     t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
     x->b_n = 0;
     x->b_vec = t_getbytes(0);
+    x->b_plan = 0;
+    x->b_nevals = 0;
     return (x);
 }
 
 void binbuf_free(t_binbuf *x)
 {
+    binbuf_unplan(x);
     t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
     t_freebytes(x,  sizeof(*x));
 }
@@ -49,28 +60,45 @@ t_binbuf *binbuf_duplicate(const t_binbuf *y)
     x->b_n = y->b_n;
     x->b_vec = t_getbytes(x->b_n * sizeof(*x->b_vec));
     memcpy(x->b_vec, y->b_vec, x->b_n * sizeof(*x->b_vec));
+    x->b_plan = 0;
+    x->b_nevals = 0;
     return (x);
 }
 
 void binbuf_clear(t_binbuf *x)
 {
+    binbuf_unplan(x);
     x->b_vec = t_resizebytes(x->b_vec, x->b_n * sizeof(*x->b_vec), 0);
     x->b_n = 0;
 }
 
-    /* convert text to a binbuf */
+    /* powers of ten that are exact in double precision */
+static const double binbuf_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+    /* convert text to a binbuf.  This is done in one pass: each token is
+    hashed for the symbol table as it is scanned and looked up where it lies
+    in the text, and is only copied out if backslashes have to be removed.
+    A number whose digits fit in a double is multiplied or divided by an exact
+    power of ten, which gives the same correctly rounded result as atof()
+    (Clinger's fast path); longer ones are still handed to atof(). */
 void binbuf_text(t_binbuf *x, const char *text, size_t size)
 {
-    char buf[MAXPDSTRING+1], *bufp, *ebuf = buf+MAXPDSTRING;
+    char buf[MAXPDSTRING+1];
     const char *textp = text, *etext = text+size;
     t_atom *ap;
-    int nalloc = 16, natom = 0;
+    int nalloc, natom = 0;
     binbuf_clear(x);
+        /* start with room for an atom per eight characters, which is about
+        what patches have, but not more than a few thousand; if that's not
+        enough we double it */
+    nalloc = (size < 32768 ? (int)(size / 8) : 4096) + 16;
     if (!binbuf_resize(x, nalloc)) return;
     ap = x->b_vec;
     while (1)
     {
-        int type;
             /* skip leading space */
         while ((textp != etext) && (*textp == ' ' || *textp == '\n'
             || *textp == '\r' || *textp == '\t')) textp++;
@@ -80,12 +108,16 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
         else
         {
                 /* it's an atom other than a comma or semi */
+            const char *start = textp;
             char c;
             int floatstate = 0, slash = 0, lastslash = 0, dollar = 0;
-            bufp = buf;
+            int inplace = 1, length = 0, symlength = -1;
+            int negative = 0, scale = 0, exponent = 0, exponsign = 1, exact = 1;
+            unsigned int hash = SYMHASH_INIT;
+            uint64_t mantissa = 0;
             do
             {
-                c = *bufp = *textp++;
+                c = *textp++;
                 lastslash = slash;
                 slash = (c == '\\');
 
@@ -97,7 +129,7 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
                         expon = (c == 'e' || c == 'E');
                     if (floatstate == 0)    /* beginning */
                     {
-                        if (minus) floatstate = 1;
+                        if (minus) floatstate = 1, negative = 1;
                         else if (digit) floatstate = 2;
                         else if (dot) floatstate = 3;
                         else floatstate = -1;
@@ -135,6 +167,7 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
                         if (plusminus) floatstate = 7;
                         else if (digit) floatstate = 8;
                         else floatstate = -1;
+                        if (minus) exponsign = -1;
                     }
                     else if (floatstate == 7)   /* got plus or minus */
                     {
@@ -145,33 +178,80 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
                     {
                         if (!digit) floatstate = -1;
                     }
+                        /* collect the digits of the mantissa and exponent */
+                    if (digit && (floatstate == 2 || floatstate == 5))
+                    {
+                        if (mantissa < 100000000000000000ULL)
+                            mantissa = mantissa * 10 + (c - '0');
+                        else exact = 0;
+                        if (floatstate == 5)
+                            scale--;
+                    }
+                    else if (digit && floatstate == 8 && exponent < 10000)
+                        exponent = exponent * 10 + (c - '0');
                 }
                 if (!lastslash && c == '$' && (textp != etext &&
                     textp[0] >= '0' && textp[0] <= '9'))
                         dollar = 1;
-                if (!slash) bufp++;
-                else if (lastslash)
+                if (slash && !lastslash)
+                {
+                        /* a backslash to remove: the rest of the token has to
+                        be copied to buf */
+                    if (inplace)
+                    {
+                        memcpy(buf, start, length);
+                        inplace = 0;
+                    }
+                }
+                else
                 {
-                    bufp++;
                     slash = 0;
+                    if (!inplace)
+                        buf[length] = c;
+                        /* as with gensym(), a null ends the symbol's name */
+                    if (!c && symlength < 0)
+                        symlength = length;
+                    else if (symlength < 0)
+                        hash = SYMHASH_ADD(hash, c);
+                    length++;
                 }
             }
-            while (textp != etext && bufp != ebuf &&
+            while (textp != etext && length != MAXPDSTRING &&
                 (slash || (*textp != ' ' && *textp != '\n' && *textp != '\r'
                     && *textp != '\t' &&*textp != ',' && *textp != ';')));
-            *bufp = 0;
+            if (symlength < 0)
+                symlength = length;
 #if 0
-            post("binbuf_text: buf %s", buf);
+            post("binbuf_text: token %.*s", length, (inplace ? start : buf));
 #endif
             if (floatstate == 2 || floatstate == 4 || floatstate == 5 ||
                 floatstate == 8)
+            {
+                    /* numbers never contain backslashes, so are in place */
+                int e = scale + exponsign * exponent;
+                if (exact && mantissa <= (1ULL << 53) && e >= -22 && e <= 22)
+                {
+                    double d = (e < 0 ? mantissa / binbuf_pow10[-e] :
+                        mantissa * binbuf_pow10[e]);
+                    SETFLOAT(ap, (negative ? -d : d));
+                }
+                else
+                {
+                    memcpy(buf, start, length);
+                    buf[length] = 0;
                     SETFLOAT(ap, atof(buf));
+                }
+            }
                 /* LATER try to figure out how to mix "$" and "\$" correctly;
                 here, the backslashes were already stripped so we assume all
                 "$" chars are real dollars.  In fact, we only know at least one
                 was. */
             else if (dollar)
             {
+                char *bufp;
+                if (inplace)
+                    memcpy(buf, start, length);
+                buf[length] = 0;
                 if (buf[0] != '$')
                     dollar = 0;
                 for (bufp = buf+1; *bufp; bufp++)
@@ -181,7 +261,8 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
                     SETDOLLAR(ap, atoi(buf+1));
                 else SETDOLLSYM(ap, gensym(buf));
             }
-            else SETSYMBOL(ap, gensym(buf));
+            else SETSYMBOL(ap, gensym_hashed((inplace ? start : buf),
+                symlength, hash));
         }
         ap++;
         natom++;
@@ -201,7 +282,7 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
 void binbuf_gettext(const t_binbuf *x, char **bufp, int *lengthp)
 {
     char *buf = getbytes(0), *newbuf;
-    int length = 0;
+    int length = 0, size = 0;   /* size is what's allocated */
     char string[MAXPDSTRING];
     const t_atom *ap;
     int indx;
@@ -213,21 +294,20 @@ void binbuf_gettext(const t_binbuf *x, char **bufp, int *lengthp)
                 length && buf[length-1] == ' ') length--;
         atom_string(ap, string, MAXPDSTRING);
         newlength = length + (int)strlen(string) + 1;
-        if (!(newbuf = resizebytes(buf, length, newlength))) break;
+        if (!(newbuf = resizebytes(buf, size, newlength))) break;
         buf = newbuf;
+        size = newlength;
         strcpy(buf + length, string);
         length = newlength;
         if (ap->a_type == A_SEMI) buf[length-1] = '\n';
         else buf[length-1] = ' ';
     }
     if (length && buf[length-1] == ' ')
-    {
-        if ((newbuf = t_resizebytes(buf, length, length-1)))
-        {
-            buf = newbuf;
-            length--;
-        }
-    }
+        length--;
+        /* callers free the buffer as 'length' bytes long */
+    if (size != length && (newbuf = t_resizebytes(buf, size, length)))
+        buf = newbuf;
+    else length = size;
     *bufp = buf;
     *lengthp = length;
 }
@@ -460,7 +540,9 @@ t_atom *binbuf_getvec(const t_binbuf *x)
 
 int binbuf_resize(t_binbuf *x, int newsize)
 {
-    t_atom *new = t_resizebytes(x->b_vec,
+    t_atom *new;
+    binbuf_unplan(x);
+    new = t_resizebytes(x->b_vec,
         x->b_n * sizeof(*x->b_vec), newsize * sizeof(*x->b_vec));
     if (new)
         x->b_vec = new, x->b_n = newsize;
@@ -603,14 +685,482 @@ done:
 #endif
 
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < HUGEMSG ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : gettmpbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < HUGEMSG || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < HUGEMSG || (freetmpbytes((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) \
+    ((x) = (t_atom *)gettmpbytes((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (freetmpbytes((x), (n) * sizeof(t_atom)))
 #endif
 
+    /* send a message collected by binbuf_eval() to its target */
+static void binbuf_dispatch(t_pd *target, int nargs, t_atom *mstack)
+{
+    switch (mstack->a_type)
+    {
+    case A_SYMBOL:
+        typedmess(target, mstack->a_w.w_symbol, nargs-1, mstack+1);
+        break;
+    case A_FLOAT:
+        if (nargs == 1) pd_float(target, mstack->a_w.w_float);
+        else pd_list(target, 0, nargs, mstack);
+        break;
+    case A_POINTER:
+        if (nargs == 1) pd_pointer(target, mstack->a_w.w_gpointer);
+        else pd_list(target, 0, nargs, mstack);
+        break;
+    default:
+        bug("bad selector");
+        break;
+    }
+}
+
+/* Message boxes evaluate the same binbuf over and over, often with the
+same arguments, through binbuf_evalcached().  After the second evaluation
+since the binbuf last changed we make a "plan" for it if it contains dollsyms
+("$1-foo", "$0-bar"), which cost a string expansion and a symbol lookup each
+time.  The messages are split at commas and semicolons once and for all, and
+each dollsym is split into text and "$n" pieces, with a little cache
+remembering what it last expanded to and for which arguments.  Clearing or
+resizing the binbuf throws the plan away (see binbuf_unplan()); since the
+atoms can also be changed in place through binbuf_getvec(), the plan keeps its
+own copy of them and is only used while they still match.  Binbufs without
+dollsyms get no plan, since the ordinary path is already as quick. */
+
+#define PLAN_MAXREF 4       /* most "$n"s a dollsym can have to be split */
+
+typedef struct _dollsymcache
+{
+    t_symbol *c_sym;        /* the dollsym itself */
+    t_symbol *c_result;     /* last expansion, or 0 if none yet */
+    int c_nref;             /* number of "$n", or -1 if we didn't split it */
+    int c_ref[PLAN_MAXREF];     /* n for each "$n" */
+    int c_lit[PLAN_MAXREF+1];   /* onset of the text before each "$n"... */
+    int c_nlit[PLAN_MAXREF+1];  /* ... and its length */
+    t_atom c_arg[PLAN_MAXREF];  /* the arguments c_result was made from */
+} t_dollsymcache;
+
+#define PLAN_KEEP 0         /* message goes to the previous target */
+
+typedef struct _evalmsg
+{
+    int m_targettype;       /* PLAN_KEEP, A_SYMBOL, A_DOLLAR or A_DOLLSYM */
+    t_symbol *m_targetsym;  /* fixed target name for A_SYMBOL */
+    int m_target;           /* index of the target atom otherwise */
+    int m_onset;            /* first atom of the message */
+    int m_n;                /* number of atoms in the message */
+    int m_plain;            /* true if no atoms need substituting */
+    int m_cache;            /* first dollsym cache slot to use */
+} t_evalmsg;
+
+struct _binbufplan
+{
+    t_atom *p_vec;          /* private copy of the binbuf's atoms */
+    int p_natom;
+    t_evalmsg *p_msg;
+    int p_nmsg;
+    t_dollsymcache *p_cache;
+    int p_ncache;
+    int p_maxnargs;         /* longest message */
+    int p_busy;             /* number of evaluations in progress */
+    int p_stale;            /* binbuf changed while we were busy */
+};
+
+static int binbuf_useplans = 1;
+
+static void binbufplan_free(t_binbufplan *p)
+{
+    freebytes(p->p_vec, p->p_natom * sizeof(*p->p_vec));
+    freebytes(p->p_msg, p->p_nmsg * sizeof(*p->p_msg));
+    freebytes(p->p_cache, p->p_ncache * sizeof(*p->p_cache));
+    freebytes(p, sizeof(*p));
+}
+
+    /* forget the plan, if any.  If it is being executed (perhaps the message
+    box is setting its own contents) the executor frees it when done. */
+static void binbuf_unplan(t_binbuf *x)
+{
+    if (x->b_plan)
+    {
+        if (x->b_plan->p_busy)
+            x->b_plan->p_stale = 1;
+        else binbufplan_free(x->b_plan);
+        x->b_plan = 0;
+    }
+    x->b_nevals = 0;
+}
+
+    /* check that the binbuf still holds the atoms the plan was made from */
+static int binbuf_planmatches(const t_binbuf *x, const t_binbufplan *p)
+{
+    int i;
+    if (p->p_natom != x->b_n)
+        return (0);
+    for (i = 0; i < x->b_n; i++)
+    {
+        const t_atom *a1 = &x->b_vec[i], *a2 = &p->p_vec[i];
+        if (a1->a_type != a2->a_type)
+            return (0);
+        switch (a1->a_type)
+        {
+        case A_FLOAT:   /* compare the bits so that NaNs match */
+            if (memcmp(&a1->a_w.w_float, &a2->a_w.w_float, sizeof(t_float)))
+                return (0);
+            break;
+        case A_SYMBOL: case A_DOLLSYM:
+            if (a1->a_w.w_symbol != a2->a_w.w_symbol)
+                return (0);
+            break;
+        case A_DOLLAR:
+            if (a1->a_w.w_index != a2->a_w.w_index)
+                return (0);
+            break;
+        default:
+            break;
+        }
+    }
+    return (1);
+}
+
+    /* split a dollsym into text and "$n" the same way
+    binbuf_realizedollsym() does; a '$' without digits is just text */
+static void dollsymcache_init(t_dollsymcache *c, t_symbol *s)
+{
+    const char *name = s->s_name, *str = name;
+    c->c_sym = s;
+    c->c_result = 0;
+    c->c_nref = 0;
+    c->c_lit[0] = 0;
+    if (strlen(name) >= MAXPDSTRING/2)
+    {
+        c->c_nref = -1;
+        return;
+    }
+    while ((str = strchr(str, '$')))
+    {
+        const char *dollar = str;
+        int argno = 0, ndigits = 0;
+        for (str++; *str >= '0' && *str <= '9'; str++, ndigits++)
+            argno = (ndigits < 9 ? 10 * argno + (*str - '0') : argno);
+        if (!ndigits)
+            continue;
+        if (ndigits >= 9 || c->c_nref == PLAN_MAXREF)
+        {
+            c->c_nref = -1;
+            return;
+        }
+        c->c_nlit[c->c_nref] = (int)(dollar - name) - c->c_lit[c->c_nref];
+        c->c_ref[c->c_nref++] = argno;
+        c->c_lit[c->c_nref] = (int)(str - name);
+    }
+    c->c_nlit[c->c_nref] = (int)strlen(name) - c->c_lit[c->c_nref];
+}
+
+static int binbuf_sameatom(const t_atom *a, const t_atom *b)
+{
+    if (a->a_type != b->a_type)
+        return (0);
+    switch (a->a_type)
+    {
+    case A_FLOAT:
+        return (!memcmp(&a->a_w.w_float, &b->a_w.w_float, sizeof(t_float)));
+    case A_SYMBOL:
+        return (a->a_w.w_symbol == b->a_w.w_symbol);
+    case A_POINTER:
+        return (a->a_w.w_gpointer == b->a_w.w_gpointer);
+    default:
+        return (0);
+    }
+}
+
+    /* paste the pieces together, formatting arguments as
+    binbuf_expanddollsym() would.  Returns 0 for anything unusual, which
+    binbuf_realizedollsym() then deals with. */
+static t_symbol *dollsymcache_expand(t_dollsymcache *c, t_atom **args)
+{
+    char buf[MAXPDSTRING];
+    int i, len = 0;
+    for (i = 0; ; i++)
+    {
+        char numbuf[MAXPDSTRING/2];
+        const char *piece;
+        int npiece;
+        memcpy(buf + len, c->c_sym->s_name + c->c_lit[i], c->c_nlit[i]);
+        len += c->c_nlit[i];
+        if (i == c->c_nref)
+            break;
+        if (args[i]->a_type == A_SYMBOL)
+        {
+            piece = args[i]->a_w.w_symbol->s_name;
+            if ((npiece = (int)strlen(piece)) >= MAXPDSTRING/2-2)
+                return (0);
+        }
+        else if (args[i]->a_type == A_FLOAT)
+        {
+            t_float f = args[i]->a_w.w_float, zero = 0;
+                /* small integers are by far the most common.  (Compare
+                zero bitwise so that -0 still goes to sprintf() with fast
+                math.) */
+            if (f > -1000000 && f < 1000000 && f == (int)f && (f != 0 ||
+                !memcmp(&f, &zero, sizeof(f))))
+            {
+                int n = (int)f;
+                char *sp = numbuf + sizeof(numbuf);
+                unsigned int u = (n < 0 ? -n : n);
+                do *--sp = '0' + u % 10;
+                while (u /= 10);
+                if (n < 0)
+                    *--sp = '-';
+                piece = sp;
+                npiece = (int)(numbuf + sizeof(numbuf) - sp);
+            }
+            else
+            {
+                sprintf(numbuf, "%g", f);
+                piece = numbuf;
+                npiece = (int)strlen(numbuf);
+            }
+        }
+        else return (0);
+        if (len + npiece + c->c_nlit[i+1] >= MAXPDSTRING-1)
+            return (0);
+        memcpy(buf + len, piece, npiece);
+        len += npiece;
+    }
+    buf[len] = 0;
+    return (gensym(buf));
+}
+
+    /* binbuf_realizedollsym(s, argc, argv, 0) through the cache */
+static t_symbol *dollsymcache_get(t_dollsymcache *c, int argc,
+    const t_atom *argv)
+{
+    t_atom *args[PLAN_MAXREF], dollarzero;
+    int i, havedollarzero = 0;
+    if (c->c_nref < 0)
+        return (binbuf_realizedollsym(c->c_sym, argc, argv, 0));
+    for (i = 0; i < c->c_nref; i++)
+    {
+        if (c->c_ref[i] > argc)     /* out of range: let it complain */
+            return (binbuf_realizedollsym(c->c_sym, argc, argv, 0));
+        else if (c->c_ref[i])
+            args[i] = (t_atom *)&argv[c->c_ref[i]-1];
+        else
+        {
+            if (!havedollarzero)
+                SETFLOAT(&dollarzero, canvas_getdollarzero()),
+                    havedollarzero = 1;
+            args[i] = &dollarzero;
+        }
+    }
+    if (c->c_result)
+    {
+        for (i = 0; i < c->c_nref; i++)
+            if (!binbuf_sameatom(args[i], &c->c_arg[i]))
+                break;
+        if (i == c->c_nref)
+            return (c->c_result);
+    }
+    if (!(c->c_result = dollsymcache_expand(c, args)))
+        c->c_result = binbuf_realizedollsym(c->c_sym, argc, argv, 0);
+    for (i = 0; i < c->c_nref; i++)
+        c->c_arg[i] = *args[i];
+    return (c->c_result);
+}
+
+    /* split the binbuf into messages just as binbuf_eval() would with a
+    nonzero target.  Returns 0 if there's anything we don't handle. */
+static t_binbufplan *binbuf_makeplan(const t_binbuf *x)
+{
+    t_binbufplan *p;
+    t_evalmsg *m;
+    int i, nmsg = 1, ncache = 0, onset;
+    for (i = 0; i < x->b_n; i++)
+    {
+        switch (x->b_vec[i].a_type)
+        {
+        case A_SEMI: case A_COMMA: nmsg++; break;
+        case A_DOLLSYM: ncache++; break;
+        case A_FLOAT: case A_SYMBOL: case A_DOLLAR: break;
+        default: return (0);
+        }
+    }
+        /* without dollsyms the plan saves nothing worth having */
+    if (!ncache)
+        return (0);
+    p = (t_binbufplan *)getbytes(sizeof(*p));
+    p->p_natom = x->b_n;
+    p->p_vec = (t_atom *)getbytes(x->b_n * sizeof(*p->p_vec));
+    memcpy(p->p_vec, x->b_vec, x->b_n * sizeof(*p->p_vec));
+    p->p_msg = (t_evalmsg *)getbytes(nmsg * sizeof(*p->p_msg));
+    p->p_nmsg = nmsg;
+    p->p_cache = (t_dollsymcache *)getbytes(ncache * sizeof(*p->p_cache));
+    p->p_ncache = ncache;
+    p->p_maxnargs = 0;
+    p->p_busy = p->p_stale = 0;
+    nmsg = ncache = onset = 0;
+    m = p->p_msg;
+    m->m_targettype = PLAN_KEEP;
+    m->m_cache = 0;
+    while (1)
+    {
+        t_atom *at;
+        m->m_onset = onset;
+        m->m_plain = 1;
+        for (i = onset; i < p->p_natom && p->p_vec[i].a_type != A_SEMI &&
+            p->p_vec[i].a_type != A_COMMA; i++)
+        {
+            if (p->p_vec[i].a_type == A_DOLLSYM)
+                dollsymcache_init(&p->p_cache[ncache++],
+                    p->p_vec[i].a_w.w_symbol);
+            if (p->p_vec[i].a_type != A_FLOAT &&
+                p->p_vec[i].a_type != A_SYMBOL)
+                    m->m_plain = 0;
+        }
+        m->m_n = i - onset;
+        if (m->m_n > p->p_maxnargs)
+            p->p_maxnargs = m->m_n;
+            /* empty messages do nothing, unless their target can fail */
+        if (m->m_n || m->m_targettype != PLAN_KEEP)
+            m++, nmsg++;
+        if (i == p->p_natom)
+            break;
+        if (p->p_vec[i].a_type == A_COMMA)
+        {
+            m->m_targettype = PLAN_KEEP;
+            m->m_cache = ncache;
+            onset = i + 1;
+            continue;
+        }
+        while (i < p->p_natom && (p->p_vec[i].a_type == A_SEMI ||
+            p->p_vec[i].a_type == A_COMMA))
+                i++;
+        if (i == p->p_natom)
+            break;
+        at = &p->p_vec[i];
+        m->m_target = i;
+        m->m_cache = ncache;
+        if (at->a_type == A_DOLLAR)
+            m->m_targettype = A_DOLLAR;
+        else if (at->a_type == A_DOLLSYM)
+        {
+            m->m_targettype = A_DOLLSYM;
+            dollsymcache_init(&p->p_cache[ncache++], at->a_w.w_symbol);
+        }
+        else
+        {
+            m->m_targettype = A_SYMBOL;
+            m->m_targetsym = atom_getsymbol(at);
+        }
+        onset = i + 1;
+    }
+    p->p_msg = (t_evalmsg *)resizebytes(p->p_msg,
+        p->p_nmsg * sizeof(*p->p_msg), nmsg * sizeof(*p->p_msg));
+    p->p_nmsg = nmsg;
+    return (p);
+}
+
+static void binbuf_evalplan(t_binbufplan *p, t_pd *target, int argc,
+    const t_atom *argv)
+{
+    t_atom smallstack[SMALLMSG], *mstack;
+    t_pd *initial_target = target;
+    int i, j, maxnargs = p->p_maxnargs;
+    if (maxnargs <= SMALLMSG)
+        mstack = smallstack;
+    else ATOMS_ALLOCA(mstack, maxnargs);
+    p->p_busy++;
+    for (i = 0; i < p->p_nmsg; i++)
+    {
+        t_evalmsg *m = &p->p_msg[i];
+        t_dollsymcache *c = &p->p_cache[m->m_cache];
+        const t_atom *at = &p->p_vec[m->m_onset];
+        t_atom *msp = mstack;
+        if (m->m_targettype != PLAN_KEEP)
+        {
+            t_symbol *s;
+            const t_atom *tat = &p->p_vec[m->m_target];
+            if (m->m_targettype == A_SYMBOL)
+                s = m->m_targetsym;
+            else if (m->m_targettype == A_DOLLAR)
+            {
+                if (tat->a_w.w_index <= 0 || tat->a_w.w_index > argc)
+                {
+                    pd_error(initial_target,
+                        "$%d: not enough arguments supplied",
+                            tat->a_w.w_index);
+                    goto skip;
+                }
+                else if (argv[tat->a_w.w_index-1].a_type != A_SYMBOL)
+                {
+                    pd_error(initial_target,
+                        "$%d: symbol needed as message destination",
+                            tat->a_w.w_index);
+                    goto skip;
+                }
+                else s = argv[tat->a_w.w_index-1].a_w.w_symbol;
+            }
+            else if (!(s = dollsymcache_get(c++, argc, argv)))
+            {
+                pd_error(initial_target, "$%s: not enough arguments supplied",
+                    tat->a_w.w_symbol->s_name);
+                goto skip;
+            }
+            if (!(target = s->s_thing))
+            {
+                pd_error(initial_target, "%s: no such object ", s->s_name);
+                goto skip;
+            }
+        }
+        if (!m->m_n)
+            continue;
+        if (m->m_plain)
+            memcpy(mstack, at, m->m_n * sizeof(*mstack));
+        else for (j = 0; j < m->m_n; j++, at++, msp++)
+        {
+            t_symbol *s9;
+            switch (at->a_type)
+            {
+            case A_DOLLAR:
+                if (at->a_w.w_index > 0 && at->a_w.w_index <= argc)
+                    *msp = argv[at->a_w.w_index-1];
+                else if (at->a_w.w_index == 0)
+                    SETFLOAT(msp, canvas_getdollarzero());
+                else
+                {
+                    pd_error(target, "$%d: argument number out of range",
+                        at->a_w.w_index);
+                    SETFLOAT(msp, 0);
+                }
+                break;
+            case A_DOLLSYM:
+                if (!(s9 = dollsymcache_get(c++, argc, argv)))
+                {
+                    pd_error(target, "%s: argument number out of range",
+                        at->a_w.w_symbol->s_name);
+                    SETSYMBOL(msp, at->a_w.w_symbol);
+                }
+                else SETSYMBOL(msp, s9);
+                break;
+            default:
+                *msp = *at;
+                break;
+            }
+        }
+        binbuf_dispatch(target, m->m_n, mstack);
+        continue;
+    skip:
+            /* like binbuf_eval(), drop everything up to the next semicolon */
+        while (i + 1 < p->p_nmsg && p->p_msg[i+1].m_targettype == PLAN_KEEP)
+            i++;
+    }
+    if (!--p->p_busy && p->p_stale)
+        binbufplan_free(p);
+    if (maxnargs > SMALLMSG)
+        ATOMS_FREEA(mstack, maxnargs);
+}
+
 void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
 {
     t_atom smallstack[SMALLMSG], *mstack, *msp;
@@ -783,25 +1333,7 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
         }
     gotmess:
         if (nargs)
-        {
-            switch (mstack->a_type)
-            {
-            case A_SYMBOL:
-                typedmess(target, mstack->a_w.w_symbol, nargs-1, mstack+1);
-                break;
-            case A_FLOAT:
-                if (nargs == 1) pd_float(target, mstack->a_w.w_float);
-                else pd_list(target, 0, nargs, mstack);
-                break;
-            case A_POINTER:
-                if (nargs == 1) pd_pointer(target, mstack->a_w.w_gpointer);
-                else pd_list(target, 0, nargs, mstack);
-                break;
-            default:
-                bug("bad selector");
-                break;
-            }
-        }
+            binbuf_dispatch(target, nargs, mstack);
         msp = mstack;
         if (!ac) break;
         target = nexttarget;
@@ -813,6 +1345,26 @@ broken:
          ATOMS_FREEA(mstack, maxnargs);
 }
 
+    /* binbuf_eval() for message boxes, which evaluate the same binbuf
+    again and again: from the second time on, use a plan if there is one. */
+void binbuf_evalcached(t_binbuf *x, t_pd *target, int argc,
+    const t_atom *argv)
+{
+    if (x->b_plan && !binbuf_planmatches(x, x->b_plan))
+        binbuf_unplan(x);
+    if (target && target != &pd_objectmaker && binbuf_useplans)
+    {
+        if (!x->b_plan && x->b_nevals < 2 && ++x->b_nevals == 2)
+            x->b_plan = binbuf_makeplan(x);
+        if (x->b_plan)
+        {
+            binbuf_evalplan(x->b_plan, target, argc, argv);
+            return;
+        }
+    }
+    binbuf_eval(x, target, argc, argv);
+}
+
 int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crflag)
 {
     long length;
@@ -1529,3 +2081,379 @@ void binbuf_savetext(const t_binbuf *bfrom, t_binbuf *bto)
     binbuf_addsemi(bto);
 }
 
+
+#ifdef PD_BENCHMARKS
+
+    /* "pd binbuf-benchmark <mbytes>": time binbuf_text() on a patch file of
+    the given size (default 50 MB) made of typical lines, then on a million
+    short FUDI messages parsed one at a time as netreceive does. */
+void glob_binbufbenchmark(void *dummy, t_floatarg f)
+{
+    static const char *fudi[4] = {
+        "volume 0.75;\n", "note 60 100 250;\n", "set $1 foo-bar 1e-05;\n",
+        "list 1 2 3 4 5 6 7 8 9 10;\n"};
+    size_t size = (f > 0 ? f : 50) * 1000000, length = 0, fudilength = 0;
+    char *text = (char *)getbytes(size + MAXPDSTRING);
+    t_binbuf *b = binbuf_new();
+    double starttime, patchtime, fuditime;
+    int i, natom;
+    for (i = 0; length < size; i++)
+    {
+        switch (i % 5)
+        {
+        case 0: length += sprintf(text + length,
+            "#X obj %d %d osc~ %d;\n", i % 997, i % 577, i % 4000); break;
+        case 1: length += sprintf(text + length,
+            "#X msg %d %d \\; pd-sub%d vis 1 \\, \\$1 %g;\n", i % 997,
+                i % 577, i % 37, i * 0.001); break;
+        case 2: length += sprintf(text + length,
+            "#X floatatom %d %d 5 0 0 0 - - - 0;\n", i % 997, i % 577); break;
+        case 3: length += sprintf(text + length,
+            "#X text %d %d this is a comment about object %d;\n",
+                i % 997, i % 577, i); break;
+        default: length += sprintf(text + length,
+            "#X connect %d 0 %d 1;\n", i - 4, i - 3); break;
+        }
+    }
+    starttime = sys_getrealtime();
+    binbuf_text(b, text, length);
+    patchtime = sys_getrealtime() - starttime;
+    natom = binbuf_getnatom(b);
+    for (i = 0; i < 4; i++)
+        fudilength += strlen(fudi[i]);
+    starttime = sys_getrealtime();
+    for (i = 0; i < 1000000; i++)
+        binbuf_text(b, fudi[i & 3], strlen(fudi[i & 3]));
+    fuditime = sys_getrealtime() - starttime;
+    post("binbuf-benchmark: patch of %.1f MB, %d atoms: %.1f msec (%.0f MB/sec)",
+        length * 1e-6, natom, 1000 * patchtime,
+            (patchtime > 0 ? length * 1e-6 / patchtime : 0));
+    post("binbuf-benchmark: 1000000 FUDI messages, %.1f MB: %.1f msec "
+        "(%.0f messages/sec)", fudilength * 0.25, 1000 * fuditime,
+            (fuditime > 0 ? 1000000 / fuditime : 0));
+    binbuf_free(b);
+    freebytes(text, size + MAXPDSTRING);
+}
+
+    /* compare two binbufs atom by atom; symbols have to be the same
+    pointers and floats the same bits */
+static int binbuftest_compare(const t_binbuf *x, const t_binbuf *y)
+{
+    int i, nbad = 0;
+    if (x->b_n != y->b_n)
+        return (1);
+    for (i = 0; i < x->b_n; i++)
+    {
+        const t_atom *a = x->b_vec + i, *b = y->b_vec + i;
+        if (a->a_type != b->a_type)
+            nbad++;
+        else if (a->a_type == A_FLOAT)
+        {
+            if (memcmp(&a->a_w.w_float, &b->a_w.w_float, sizeof(t_float)))
+                nbad++;
+        }
+        else if (a->a_type == A_SYMBOL || a->a_type == A_DOLLSYM)
+        {
+            if (a->a_w.w_symbol != b->a_w.w_symbol)
+                nbad++;
+        }
+        else if (a->a_type == A_DOLLAR && a->a_w.w_index != b->a_w.w_index)
+            nbad++;
+    }
+    return (nbad);
+}
+
+    /* check binbuf_text() on a few hand-made messages, on numbers against
+    atof(), and on a patch too big for the first guess at its atom count,
+    which has to come back the same from binbuf_gettext(). */
+int binbuf_selftest(void)
+{
+    static const struct
+    {
+        const char *c_text, *c_types, *c_atoms;
+    } cases[] =
+    {
+        {"", "", ""},
+        {"  \n\t ", "", ""},
+        {"1 -2 .5 3. 1e3 -2.5e-2", "ffffff", "1 -2 0.5 3 1000 -0.025"},
+        {"foo 1x - -. . e3 1e 1e+", "ssssssss", "foo 1x - -. . e3 1e 1e+"},
+        {"a;b,c ;, d", "s;s,s;,s", "a ; b , c ; , d"},
+        {"$1 $12 $1-x x$2 \\$1 $", "$$SSss", "$1 $12 $1-x x$2 \\$1 $"},
+        {"a\\ b c\\;d \\,", "sss", "a\\ b c\\;d \\,"},
+        {"100000000000000000000 0.0000000000000000000000001", "ff",
+            "1e+20 1e-25"},
+    };
+    static const char *numbers[6] = {"%d", "%g", "%.9g", "%.17g", "%e",
+        "%.3f"};
+    t_binbuf *b = binbuf_new(), *b2 = binbuf_new();
+    char text[MAXPDSTRING], *buf, *buf2;
+    unsigned int seed = 1;
+    int i, j, nbad = 0, length, length2;
+    size_t size;
+    for (i = 0; i < (int)(sizeof(cases)/sizeof(*cases)); i++)
+    {
+        int nfail = 0;
+        binbuf_text(b, cases[i].c_text, strlen(cases[i].c_text));
+        if (b->b_n != (int)strlen(cases[i].c_types))
+            nfail = 1;
+        else for (j = 0, text[0] = 0; j < b->b_n; j++)
+        {
+            const t_atom *a = b->b_vec + j;
+            char c = cases[i].c_types[j];
+            if ((a->a_type == A_FLOAT) != (c == 'f') ||
+                (a->a_type == A_SYMBOL) != (c == 's') ||
+                (a->a_type == A_SEMI) != (c == ';') ||
+                (a->a_type == A_COMMA) != (c == ',') ||
+                (a->a_type == A_DOLLAR) != (c == '$') ||
+                (a->a_type == A_DOLLSYM) != (c == 'S'))
+                    nfail = 1;
+            if (j)
+                strcat(text, " ");
+            atom_string(a, text + strlen(text), MAXPDSTRING/2);
+        }
+        if (nfail || strcmp(text, cases[i].c_atoms))
+        {
+            pd_error(0, "binbuf self-test: \"%s\" came out as \"%s\"",
+                cases[i].c_text, text);
+            nbad++;
+        }
+    }
+        /* numbers in every format we write them in, some taking the quick
+        way and some too long or too big or small for it */
+    for (i = 0; i < 100000; i++)
+    {
+        double d;
+        seed = seed * 435898247 + 382842987;
+        d = (double)(seed >> 8) / (1 << ((seed >> 4) & 15));
+        seed = seed * 435898247 + 382842987;
+        if (seed & 0x80000000)
+            d = -d;
+        if (seed & 0x40000000)
+            d *= 1e-30;
+        else if (seed & 0x20000000)
+            d *= 1e25;
+        if (i % 6)
+            sprintf(text, numbers[i % 6], d);
+        else sprintf(text, numbers[0], (int)(seed >> 8) - 0x800000);
+        binbuf_text(b, text, strlen(text));
+        if (b->b_n != 1 || b->b_vec[0].a_type != A_FLOAT ||
+            b->b_vec[0].a_w.w_float != (t_float)atof(text))
+        {
+            if (nbad++ < 10)
+                pd_error(0, "binbuf self-test: %s read as %s", text,
+                    (b->b_n == 1 && b->b_vec[0].a_type == A_FLOAT ?
+                        "a different number" : "something else"));
+        }
+    }
+        /* a patch of about 200 KB with two characters an atom, so that the
+        atom vector has to grow a few times */
+    size = 200000;
+    buf = (char *)getbytes(size + MAXPDSTRING);
+    for (i = 0, length = 0; length < (int)size; i++)
+    {
+        if (i % 3)
+            length += sprintf(buf + length, "#X msg %d %d \\; pd-x%d \\$1 "
+                "%g \\, a\\ b $%d;\n", i % 997, i % 577, i, i * 0.125, i % 10);
+        else length += sprintf(buf + length, "%d %d %d %d %d %d %d %d, ",
+            i % 10, i % 9, i % 8, i % 7, i % 6, i % 5, i % 4, i % 3);
+    }
+    binbuf_text(b, buf, length);
+    binbuf_gettext(b, &buf2, &length2);
+    binbuf_text(b2, buf2, length2);
+    if (b->b_n < length / 4 || binbuftest_compare(b, b2))
+    {
+        pd_error(0, "binbuf self-test: patch of %d atoms changed "
+            "on a round trip", b->b_n);
+        nbad++;
+    }
+    freebytes(buf2, length2);
+    freebytes(buf, size + MAXPDSTRING);
+    binbuf_free(b);
+    binbuf_free(b2);
+    if (nbad)
+        pd_error(0, "binbuf self-test: %d errors", nbad);
+    return (nbad);
+}
+
+static t_class *evalbench_class;
+
+typedef struct _evalbench
+{
+    t_pd b_pd;
+    int b_count;
+    t_binbuf *b_record;     /* if nonzero, every message is added to it */
+} t_evalbench;
+
+static void evalbench_anything(t_evalbench *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    x->b_count++;
+    if (x->b_record)
+    {
+        binbuf_addv(x->b_record, "s", s);
+        binbuf_add(x->b_record, argc, argv);
+        binbuf_addsemi(x->b_record);
+    }
+}
+
+static t_evalbench *evalbench_new(void)
+{
+    t_evalbench *x;
+    if (!evalbench_class)
+    {
+        evalbench_class = class_new(gensym("evalbench"), 0, 0,
+            sizeof(t_evalbench), CLASS_PD, 0);
+        class_addanything(evalbench_class, evalbench_anything);
+    }
+    x = (t_evalbench *)pd_new(evalbench_class);
+    x->b_count = 0;
+    x->b_record = 0;
+    return (x);
+}
+
+    /* "pd message-benchmark": time binbuf_evalcached() on the contents of a
+    few typical message boxes, sent a million times each, with and without
+    the cached plans.  Boxes without dollsyms get no plan and so take the
+    same path both times. */
+void glob_messagebenchmark(void *dummy)
+{
+    static const char *boxes[5] = {
+        "1 2 3", "set $1 $2", "pitch $1-note $2",
+        "; $0-recv $1; evalbench-recv bang", "; evalbench-recv 1, 2, 3"};
+    t_evalbench *x;
+    t_symbol *recv = gensym("evalbench-recv"),
+        *recv0 = binbuf_realizedollsym(gensym("$0-recv"), 0, 0, 0);
+    t_binbuf *b = binbuf_new();
+    t_atom args[2];
+    int i, j, useplans = binbuf_useplans;
+    x = evalbench_new();
+    pd_bind(&x->b_pd, recv);
+    pd_bind(&x->b_pd, recv0);
+    for (i = 0; i < 5; i++)
+    {
+        double oldtime = 0, newtime = 0;
+        int planned = 0;
+        for (j = 0; j < 2; j++)
+        {
+            double starttime;
+            int k;
+            binbuf_useplans = j;
+            binbuf_clear(b);
+            binbuf_text(b, boxes[i], strlen(boxes[i]));
+            x->b_count = 0;
+            starttime = sys_getrealtime();
+            for (k = 0; k < 1000000; k++)
+            {
+                SETFLOAT(&args[0], k & 15);
+                SETFLOAT(&args[1], 64);
+                binbuf_evalcached(b, &x->b_pd, 2, args);
+            }
+            if (j)
+                newtime = sys_getrealtime() - starttime, planned = !!b->b_plan;
+            else oldtime = sys_getrealtime() - starttime;
+        }
+        post("message-benchmark: [%s(: %d messages each: "
+            "%.1f msec uncached, %.1f msec %s",
+                boxes[i], x->b_count / 1000000, 1000 * oldtime, 1000 * newtime,
+                (planned ? "cached" : "again (no plan without dollsyms)"));
+    }
+    binbuf_useplans = useplans;
+    pd_unbind(&x->b_pd, recv);
+    pd_unbind(&x->b_pd, recv0);
+    pd_free(&x->b_pd);
+    binbuf_free(b);
+}
+
+    /* evaluate a message box the way it's clicked on a few times, then
+    change its last atom in place as a caller of binbuf_getvec() might, and
+    click on it a few more times; everything sent is recorded. */
+static void evaltest_run(t_evalbench *x, const char *box, t_binbuf *args,
+    int useplans, int *planned)
+{
+    t_binbuf *b = binbuf_new();
+    int i;
+    binbuf_useplans = useplans;
+    binbuf_text(b, box, strlen(box));
+    for (i = 0; i < 6; i++)
+    {
+        if (i == 3)
+        {
+            *planned = !!b->b_plan;
+            SETSYMBOL(binbuf_getvec(b) + binbuf_getnatom(b) - 1,
+                gensym("changed"));
+        }
+        binbuf_evalcached(b, &x->b_pd, binbuf_getnatom(args),
+            binbuf_getvec(args));
+    }
+    binbuf_free(b);
+}
+
+    /* check that the cached plans send the same messages as binbuf_eval()
+    for boxes with dollsyms in arguments and destinations, commas, empty
+    messages and symbol and float arguments, and that a box changed in
+    place is seen as changed. */
+int message_selftest(void)
+{
+    static const struct
+    {
+        const char *c_box, *c_args;
+        int c_plan;     /* whether there should be a plan to check */
+    } cases[] =
+    {
+        {"1 2 3", "5", 0},
+        {"set $1 $2", "5 foo", 0},
+        {"pitch $1-note $2", "60 100", 1},
+        {"pitch $1-note $2", "c 1.5", 1},
+        {"$2-$1 $1$2 x-$1-$2 $ $-1 3", "a b", 1},
+        {"a $1-b, , c $2-d, e", "1 2", 1},
+        {"; evaltest-$1 foo $2-x; evaltest-recv $1-y, 4", "a 3", 1},
+        {"; evaltest-$1 foo $2-x; evaltest-recv $1-y, 4", "1 a", 1},
+        {"; $1 bar $2-z; ; evaltest-a 1", "evaltest-recv 7", 1},
+        {"x-$1; evaltest-recv list $2 $1-q", "2 evaltest-a", 1},
+    };
+    static const char *recvs[3] = {"evaltest-recv", "evaltest-a",
+        "evaltest-1"};
+    t_evalbench *x = evalbench_new();
+    t_binbuf *args = binbuf_new(), *oldrecord = binbuf_new(),
+        *newrecord = binbuf_new();
+    int i, nbad = 0, useplans = binbuf_useplans;
+    for (i = 0; i < 3; i++)
+        pd_bind(&x->b_pd, gensym(recvs[i]));
+    for (i = 0; i < (int)(sizeof(cases)/sizeof(*cases)); i++)
+    {
+        int planned, dummy;
+        binbuf_text(args, cases[i].c_args, strlen(cases[i].c_args));
+        binbuf_clear(oldrecord);
+        x->b_record = oldrecord;
+        evaltest_run(x, cases[i].c_box, args, 0, &dummy);
+        binbuf_clear(newrecord);
+        x->b_record = newrecord;
+        evaltest_run(x, cases[i].c_box, args, 1, &planned);
+        if (planned != cases[i].c_plan ||
+            binbuftest_compare(oldrecord, newrecord))
+        {
+            char *buf;
+            int length;
+            binbuf_gettext(newrecord, &buf, &length);
+            pd_error(0, "message self-test: [%s( with \"%s\": %s:\n%.*s",
+                cases[i].c_box, cases[i].c_args,
+                    (planned != cases[i].c_plan ? "wrong plan" :
+                        "cached messages differ"),
+                        length, buf);
+            freebytes(buf, length);
+            nbad++;
+        }
+    }
+    binbuf_useplans = useplans;
+    for (i = 0; i < 3; i++)
+        pd_unbind(&x->b_pd, gensym(recvs[i]));
+    pd_free(&x->b_pd);
+    binbuf_free(args);
+    binbuf_free(oldrecord);
+    binbuf_free(newrecord);
+    if (nbad)
+        pd_error(0, "message self-test: %d errors", nbad);
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
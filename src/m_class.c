@@ -5,6 +5,7 @@
 #define PD_CLASS_DEF
 #include "m_pd.h"
 #include "m_imp.h"
+#include "m_symhash.h"
 #include "s_stuff.h"
 #include "g_canvas.h"
 #include <stdlib.h>
@@ -44,6 +45,10 @@ t_pdinstance pd_maininstance;
 
 static t_symbol *dogensym(const char *s, t_symbol *oldsym,
     t_pdinstance *pdinstance);
+static t_symtab *symtab_new(void);
+#ifdef PDINSTANCE
+static void symtab_free(t_symtab *x);
+#endif
 void x_midi_newpdinstance( void);
 void x_midi_freepdinstance( void);
 void s_inter_newpdinstance( void);
@@ -60,23 +65,25 @@ void s_stuff_newpdinstance(void)
     STUFF->st_externlist = STUFF->st_searchpath =
         STUFF->st_staticpath = STUFF->st_helppath = STUFF->st_temppath = 0;
     STUFF->st_schedblocksize = STUFF->st_blocksize = DEFDACBLKSIZE;
+    STUFF->st_tmpbytes = getbytes(TMPBYTESIZE);
 }
 
 void s_stuff_freepdinstance(void)
 {
+    freebytes(STUFF->st_tmpbytes, TMPBYTESIZE);
+    freebytes(STUFF->st_clockheap,
+        STUFF->st_clockheapsize * sizeof(*STUFF->st_clockheap));
     freebytes(STUFF, sizeof(*STUFF));
 }
 
 static t_pdinstance *pdinstance_init(t_pdinstance *x)
 {
-    int i;
     x->pd_systime = 0;
     x->pd_clock_setlist = 0;
     x->pd_canvaslist = 0;
     x->pd_templatelist = 0;
     x->pd_symhash = getbytes(SYMTABHASHSIZE * sizeof(*x->pd_symhash));
-    for (i = 0; i < SYMTABHASHSIZE; i++)
-        x->pd_symhash[i] = 0;
+    x->pd_symtab = symtab_new();
 #ifdef PDINSTANCE
     dogensym("pointer",   &x->pd_s_pointer,  x);
     dogensym("float",     &x->pd_s_float,    x);
@@ -112,11 +119,85 @@ static t_pdinstance *pdinstance_init(t_pdinstance *x)
     return (x);
 }
 
-static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
-    int nmethod, t_gotfn fn, t_symbol *sel, t_atomtype *args,
-        t_pdinstance *pdinstance)
+/* Each class's method list has a hash table of indices into it, keyed by
+selector, so that pd_typedmess() and getfn() needn't search the list.  Its
+size depends only on the number of methods, so it's rebuilt whenever that
+crosses a power of two (or a method gets renamed), and otherwise methods
+are just added to it.  Slots hold the index plus one, zero if empty. */
+
+static int methodhash_size(int nmethod)
+{
+    int size = 8;
+    if (!nmethod)
+        return (0);
+    while (size < 2 * nmethod)
+        size *= 2;
+    return (size);
+}
+
+static void methodhash_insert(int *hash, int size, t_methodentry *mlist,
+    int index)
+{
+    int i;
+    if (!mlist[index].me_name)
+        return;
+    for (i = pd_ptrhash(mlist[index].me_name, size); hash[i];
+        i = (i + 1) & (size - 1))
+            ;
+    hash[i] = index + 1;
+}
+
+static void methodhash_rebuild(int **hashp, t_methodentry *mlist,
+    int oldnmethod, int nmethod)
+{
+    int size = methodhash_size(nmethod), i;
+    freebytes(*hashp, methodhash_size(oldnmethod) * sizeof(**hashp));
+    *hashp = (int *)getbytes(size * sizeof(**hashp));
+    for (i = 0; i < nmethod; i++)
+        methodhash_insert(*hashp, size, mlist, i);
+}
+
+static t_methodentry *methodhash_find(const int *hash, t_methodentry *mlist,
+    int nmethod, t_symbol *sel)
+{
+    int size = methodhash_size(nmethod), i, j;
+    if (!size)
+        return (0);
+    for (i = pd_ptrhash(sel, size); (j = hash[i]);
+        i = (i + 1) & (size - 1))
+            if (mlist[j-1].me_name == sel)
+                return (mlist + (j-1));
+    return (0);
+}
+
+    /* work out ahead of time whether a method only takes floats, in which
+    case pd_typedmess() can copy them without checking each argument's
+    wanted type. */
+static void class_addmethodinfo(t_class *c, t_atomtype *args)
 {
+    t_methodinfo *mi;
     int i;
+    c->c_methodinfo = (t_methodinfo *)t_resizebytes(c->c_methodinfo,
+        c->c_nmethod * sizeof(*c->c_methodinfo),
+        (c->c_nmethod + 1) * sizeof(*c->c_methodinfo));
+    mi = c->c_methodinfo + c->c_nmethod;
+    mi->mi_allfloat = 1;
+    mi->mi_nreq = 0;
+    for (i = 0; args[i]; i++)
+    {
+        if (args[i] == A_FLOAT)
+            mi->mi_nreq = i + 1;
+        else if (args[i] != A_DEFFLOAT)
+            mi->mi_allfloat = 0;
+    }
+    mi->mi_nfloat = i;
+}
+
+static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
+    int **methodhash, int nmethod, t_gotfn fn, t_symbol *sel,
+        t_atomtype *args, t_pdinstance *pdinstance)
+{
+    int i, renamed = 0;
     t_methodentry *m;
     for (i = 0; i < nmethod; i++)
         if (sel && (*methodlist)[i].me_name == sel)
@@ -125,6 +206,7 @@ static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
         snprintf(nbuf, 80, "%s_aliased", sel->s_name);
         nbuf[79] = 0;
         (*methodlist)[i].me_name = dogensym(nbuf, 0, pdinstance);
+        renamed = 1;
         if (c == pd_objectmaker)
             verbose(1, "warning: class '%s' overwritten; old one renamed '%s'",
                 sel->s_name, nbuf);
@@ -140,6 +222,10 @@ static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
     i = 0;
     while ((m->me_arg[i] = args[i]))
         i++;
+    if (renamed || methodhash_size(nmethod + 1) != methodhash_size(nmethod))
+        methodhash_rebuild(methodhash, *methodlist, nmethod, nmethod + 1);
+    else methodhash_insert(*methodhash, methodhash_size(nmethod + 1),
+        *methodlist, nmethod);
 }
 
 #ifdef PDINSTANCE
@@ -178,8 +264,13 @@ EXTERN t_pdinstance *pdinstance_new(void)
             pd_ninstances * sizeof(*c->c_methods),
             (pd_ninstances + 1) * sizeof(*c->c_methods));
         c->c_methods[pd_ninstances] = t_getbytes(0);
+        c->c_methodhash = (int **)t_resizebytes(c->c_methodhash,
+            pd_ninstances * sizeof(*c->c_methodhash),
+            (pd_ninstances + 1) * sizeof(*c->c_methodhash));
+        c->c_methodhash[pd_ninstances] = 0;
         for (i = 0; i < c->c_nmethod; i++)
-            class_addmethodtolist(c, &c->c_methods[pd_ninstances], i,
+            class_addmethodtolist(c, &c->c_methods[pd_ninstances],
+                &c->c_methodhash[pd_ninstances], i,
                 c->c_methods[0][i].me_fun,
                 dogensym(c->c_methods[0][i].me_name->s_name, 0, x),
                     c->c_methods[0][i].me_arg, x);
@@ -196,7 +287,6 @@ EXTERN t_pdinstance *pdinstance_new(void)
 
 EXTERN void pdinstance_free(t_pdinstance *x)
 {
-    t_symbol *s;
     t_canvas *canvas;
     int i, instanceno;
     t_class *c;
@@ -223,30 +313,15 @@ EXTERN void pdinstance_free(t_pdinstance *x)
         c->c_methods = (t_methodentry **)t_resizebytes(c->c_methods,
             pd_ninstances * sizeof(*c->c_methods),
             (pd_ninstances - 1) * sizeof(*c->c_methods));
+        freebytes(c->c_methodhash[instanceno],
+            methodhash_size(c->c_nmethod) * sizeof(**c->c_methodhash));
+        for (i = instanceno; i < pd_ninstances-1; i++)
+            c->c_methodhash[i] = c->c_methodhash[i+1];
+        c->c_methodhash = (int **)t_resizebytes(c->c_methodhash,
+            pd_ninstances * sizeof(*c->c_methodhash),
+            (pd_ninstances - 1) * sizeof(*c->c_methodhash));
     }
-    for (i =0; i < SYMTABHASHSIZE; i++)
-    {
-        while ((s = x->pd_symhash[i]))
-        {
-            x->pd_symhash[i] = s->s_next;
-            if(s != &x->pd_s_pointer &&
-               s != &x->pd_s_float &&
-               s != &x->pd_s_symbol &&
-               s != &x->pd_s_bang &&
-               s != &x->pd_s_list &&
-               s != &x->pd_s_anything &&
-               s != &x->pd_s_signal &&
-               s != &x->pd_s__N &&
-               s != &x->pd_s__X &&
-               s != &x->pd_s_x &&
-               s != &x->pd_s_y &&
-               s != &x->pd_s_)
-            {
-                freebytes((void *)s->s_name, strlen(s->s_name)+1);
-                freebytes(s, sizeof(*s));
-            }
-        }
-    }
+    symtab_free(x->pd_symtab);
     freebytes(x->pd_symhash, SYMTABHASHSIZE * sizeof (*x->pd_symhash));
     x_midi_freepdinstance();
     g_canvas_freepdinstance();
@@ -493,6 +568,8 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
     c->c_patchable = (typeflag == CLASS_PATCHABLE);
     c->c_gobj = (typeflag >= CLASS_GOBJ);
     c->c_drawcommand = 0;
+    c->c_parallel = ((flags & CLASS_PARALLEL) != 0);
+    c->c_dspgroup = c->c_dspwrites = 0;
     c->c_floatsignalin = 0;
     c->c_externdir = class_extern_dir;
     c->c_savefn = (typeflag == CLASS_PATCHABLE ? text_save : class_nosavefn);
@@ -502,11 +579,15 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
         pd_ninstances * sizeof(*c->c_methods));
     for (i = 0; i < pd_ninstances; i++)
         c->c_methods[i] = t_getbytes(0);
+    c->c_methodhash = (int **)t_getbytes(
+        pd_ninstances * sizeof(*c->c_methodhash));
     c->c_next = class_list;
     class_list = c;
 #else
     c->c_methods = t_getbytes(0);
+    c->c_methodhash = 0;
 #endif
+    c->c_methodinfo = t_getbytes(0);
 #if 0       /* enable this if you want to see a list of all classes */
     post("class: %s", c->c_name->s_name);
 #endif
@@ -536,11 +617,17 @@ void class_free(t_class *c)
         if(c->c_methods[i])
             freebytes(c->c_methods[i], c->c_nmethod * sizeof(*c->c_methods[i]));
         c->c_methods[i] = NULL;
+        freebytes(c->c_methodhash[i],
+            methodhash_size(c->c_nmethod) * sizeof(*c->c_methodhash[i]));
     }
     freebytes(c->c_methods, pd_ninstances * sizeof(*c->c_methods));
+    freebytes(c->c_methodhash, pd_ninstances * sizeof(*c->c_methodhash));
 #else
     freebytes(c->c_methods, c->c_nmethod * sizeof(*c->c_methods));
+    freebytes(c->c_methodhash,
+        methodhash_size(c->c_nmethod) * sizeof(*c->c_methodhash));
 #endif
+    freebytes(c->c_methodinfo, c->c_nmethod * sizeof(*c->c_methodinfo));
     freebytes(c, sizeof(*c));
 }
 
@@ -652,14 +739,15 @@ void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
 #ifdef PDINSTANCE
         for (i = 0; i < pd_ninstances; i++)
         {
-            class_addmethodtolist(c, &c->c_methods[i], c->c_nmethod,
-                (t_gotfn)fn, sel?dogensym(sel->s_name, 0, pd_instances[i]):0,
+            class_addmethodtolist(c, &c->c_methods[i], &c->c_methodhash[i],
+                c->c_nmethod, (t_gotfn)fn, sel?dogensym(sel->s_name, 0, pd_instances[i]):0,
                     argvec, pd_instances[i]);
         }
 #else
-        class_addmethodtolist(c, &c->c_methods, c->c_nmethod,
-            (t_gotfn)fn, sel, argvec, &pd_maininstance);
+        class_addmethodtolist(c, &c->c_methods, &c->c_methodhash,
+            c->c_nmethod, (t_gotfn)fn, sel, argvec, &pd_maininstance);
 #endif
+        class_addmethodinfo(c, argvec);
         c->c_nmethod++;
     }
     goto done;
@@ -749,6 +837,16 @@ void class_sethelpsymbol(t_class *c, t_symbol *s)
     c->c_helpname = s;
 }
 
+    /* declare which DSPGROUP_* state (see m_imp.h) a signal class's DSP
+    code touches, and whether it writes to it, for parallel DSP. */
+void class_setdspgroup(t_class *c, int group, int writes)
+{
+    if(!c)
+        return;
+    c->c_dspgroup = group;
+    c->c_dspwrites = (writes ? group : 0);
+}
+
 const t_parentwidgetbehavior *pd_getparentwidget(t_pd *x)
 {
     return ((*x)->c_pwb);
@@ -839,44 +937,266 @@ t_propertiesfn class_getpropertiesfn(const t_class *c)
 
 /* ---------------- the symbol table ------------------------ */
 
-static t_symbol *dogensym(const char *s, t_symbol *oldsym,
-    t_pdinstance *pdinstance)
+/* Symbols are found in an open-addressed hash table which stores each
+symbol's hash and length next to the pointer to it, so that a lookup only
+has to compare names when those match.  The table doubles in size when it's
+half full; since the hashes are kept, growing doesn't rehash the names.
+The symbols themselves, with their names right after them, are packed into
+large chunks of memory that are only freed with the Pd instance.
+
+Externs (and libpd) may walk all symbols through the instance's pd_symhash,
+an array of SYMTABHASHSIZE chains linked by s_next, so each new symbol is
+also put at the head of its chain there, as before; nothing else reads the
+chains. */
+
+typedef struct _symtabentry
 {
-    char *symname = 0;
-    t_symbol **symhashloc, *sym2;
-    unsigned int hash = 5381;
-    int length = 0;
-    const char *s2 = s;
-    while (*s2) /* djb2 hash algo */
+    t_symbol *e_sym;            /* zero if this slot is free */
+    unsigned int e_hash;
+    int e_length;               /* strlen() of the name */
+} t_symtabentry;
+
+typedef struct _symchunk
+{
+    struct _symchunk *c_next;
+    size_t c_size;              /* including this header */
+} t_symchunk;
+
+#define SYMCHUNKSIZE 16384      /* usual size of chunks of symbols */
+
+struct _symtab
+{
+    t_symtabentry *t_vec;       /* the hash table */
+    int t_size;                 /* its size, a power of two */
+    int t_shift;                /* 32 minus log2 of t_size */
+    int t_count;                /* number of symbols in it */
+    t_symchunk *t_chunks;       /* chunks holding symbols and names */
+    char *t_chunkfill;          /* free space in latest chunk */
+    size_t t_chunkleft;         /* and how much of it there is */
+};
+
+static t_symtab *symtab_new(void)
+{
+    t_symtab *x = (t_symtab *)getbytes(sizeof(*x));
+    x->t_size = SYMTABHASHSIZE;
+    for (x->t_shift = 32; (1 << (32 - x->t_shift)) < x->t_size; )
+        x->t_shift--;
+    x->t_vec = (t_symtabentry *)getbytes(x->t_size * sizeof(*x->t_vec));
+    x->t_count = 0;
+    x->t_chunks = 0;
+    x->t_chunkfill = 0;
+    x->t_chunkleft = 0;
+    return (x);
+}
+
+#ifdef PDINSTANCE
+static void symtab_free(t_symtab *x)
+{
+    t_symchunk *chunk;
+    while ((chunk = x->t_chunks))
     {
-        hash = ((hash << 5) + hash) + *s2;
-        length++;
-        s2++;
+        x->t_chunks = chunk->c_next;
+        freebytes(chunk, chunk->c_size);
     }
-    symhashloc = pdinstance->pd_symhash + (hash & (SYMTABHASHSIZE-1));
-    while ((sym2 = *symhashloc))
+    freebytes(x->t_vec, x->t_size * sizeof(*x->t_vec));
+    freebytes(x, sizeof(*x));
+}
+#endif
+
+    /* get space for a symbol and/or its name.  Requests bigger than a
+    quarter chunk get a chunk of their own so as not to waste the rest of
+    the current one. */
+static char *symtab_getbytes(t_symtab *x, size_t n)
+{
+    char *ret;
+    t_symchunk *chunk;
+    n = (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (n > x->t_chunkleft)
     {
-        if (!strcmp(sym2->s_name, s))
-            return(sym2);
-        symhashloc = &sym2->s_next;
+        size_t size = (n > SYMCHUNKSIZE/4 ?
+            n + sizeof(t_symchunk) : SYMCHUNKSIZE);
+        chunk = (t_symchunk *)getbytes(size);
+        chunk->c_next = x->t_chunks;
+        chunk->c_size = size;
+        x->t_chunks = chunk;
+        if (n > SYMCHUNKSIZE/4)
+            return ((char *)(chunk + 1));
+        x->t_chunkfill = (char *)(chunk + 1);
+        x->t_chunkleft = size - sizeof(t_symchunk);
     }
+    ret = x->t_chunkfill;
+    x->t_chunkfill += n;
+    x->t_chunkleft -= n;
+    return (ret);
+}
+
+    /* scatter the hash over the table (Fibonacci hashing): multiply it by
+    2^32 over the golden ratio and take the top bits of the product, which
+    depend on all of the hash's bits */
+#define symtab_slot(hash, shift) \
+    ((int)((unsigned int)((hash) * 2654435769U) >> (shift)))
+
+static void symtab_grow(t_symtab *x)
+{
+    int oldsize = x->t_size, newsize = 2 * oldsize, newshift = x->t_shift - 1,
+        i, j;
+    t_symtabentry *oldvec = x->t_vec, *newvec =
+        (t_symtabentry *)getbytes(newsize * sizeof(*newvec));
+    for (i = 0; i < oldsize; i++)
+    {
+        if (!oldvec[i].e_sym)
+            continue;
+        for (j = symtab_slot(oldvec[i].e_hash, newshift); newvec[j].e_sym;
+            j = (j + 1) & (newsize - 1))
+                ;
+        newvec[j] = oldvec[i];
+    }
+    freebytes(oldvec, oldsize * sizeof(*oldvec));
+    x->t_vec = newvec;
+    x->t_size = newsize;
+    x->t_shift = newshift;
+}
+
+    /* look up or make the symbol whose name is the "length" characters at
+    "s", with hash value "hash" (see SYMHASH_ADD); the name needn't be
+    null-terminated. */
+static t_symbol *dogensymn(const char *s, int length, unsigned int hash,
+    t_symbol *oldsym, t_pdinstance *pdinstance)
+{
+    t_symtab *x = pdinstance->pd_symtab;
+    t_symtabentry *e;
+    t_symbol *sym2, **symhashloc;
+    char *symname;
+    int i;
+    for (i = symtab_slot(hash, x->t_shift); (e = &x->t_vec[i])->e_sym;
+        i = (i + 1) & (x->t_size - 1))
+    {
+        if (e->e_hash == hash && e->e_length == length &&
+            !memcmp(e->e_sym->s_name, s, length))
+                return (e->e_sym);
+    }
+        /* not found: e is the free slot to put it in */
     if (oldsym)
+    {
         sym2 = oldsym;
-    else sym2 = (t_symbol *)t_getbytes(sizeof(*sym2));
-    symname = t_getbytes(length+1);
-    sym2->s_next = 0;
-    sym2->s_thing = 0;
-    strcpy(symname, s);
+        symname = symtab_getbytes(x, length + 1);
+    }
+    else
+    {
+        size_t symsize = (sizeof(*sym2) + sizeof(void *) - 1) &
+            ~(sizeof(void *) - 1);
+        sym2 = (t_symbol *)symtab_getbytes(x, symsize + length + 1);
+        symname = (char *)sym2 + symsize;
+    }
+    memcpy(symname, s, length);
+    symname[length] = 0;
     sym2->s_name = symname;
+    sym2->s_thing = 0;
+    symhashloc = pdinstance->pd_symhash + (hash & (SYMTABHASHSIZE-1));
+    sym2->s_next = *symhashloc;
     *symhashloc = sym2;
+    e->e_sym = sym2;
+    e->e_hash = hash;
+    e->e_length = length;
+    if (++x->t_count * 2 > x->t_size)
+        symtab_grow(x);
     return (sym2);
 }
 
+static t_symbol *dogensym(const char *s, t_symbol *oldsym,
+    t_pdinstance *pdinstance)
+{
+    unsigned int hash = SYMHASH_INIT;
+    int length = 0;
+    const char *s2 = s;
+    while (*s2) /* djb2 hash algo */
+    {
+        hash = SYMHASH_ADD(hash, *s2);
+        length++;
+        s2++;
+    }
+    return (dogensymn(s, length, hash, oldsym, pdinstance));
+}
+
 t_symbol *gensym(const char *s)
 {
     return(dogensym(s, 0, pd_this));
 }
 
+t_symbol *gensym_hashed(const char *s, int length, unsigned int hash)
+{
+    return(dogensymn(s, length, hash, 0, pd_this));
+}
+
+#ifdef PD_BENCHMARKS
+
+    /* "pd symbol-benchmark <n>": make n (default 100000) symbols with a
+    common "$0-" style prefix, then look each of them up ten more times.
+    The symbols stay in the table afterward, so running it again measures
+    lookups only. */
+void glob_symbolbenchmark(void *dummy, t_floatarg f)
+{
+    int n = (f >= 1 ? f : 100000), i, j;
+    char *names = (char *)getbytes(n * 32);
+    double starttime, maketime, looktime;
+    for (i = 0; i < n; i++)
+        sprintf(names + 32 * i, "1003-symbol-benchmark-%d", i);
+    starttime = sys_getrealtime();
+    for (i = 0; i < n; i++)
+        gensym(names + 32 * i);
+    maketime = sys_getrealtime();
+    for (j = 0; j < 10; j++)
+        for (i = 0; i < n; i++)
+            gensym(names + 32 * i);
+    looktime = sys_getrealtime();
+    post("symbol-benchmark: %d symbols: make %.1f msec, 10 lookups each "
+        "%.1f msec", n, 1000 * (maketime - starttime),
+            1000 * (looktime - maketime));
+    post("symbol-benchmark: %d symbols in table of %d",
+        pd_this->pd_symtab->t_count, pd_this->pd_symtab->t_size);
+    freebytes(names, n * 32);
+}
+
+    /* "pd self-test": make enough symbols for the table to grow, and check
+    that each name always gives the same symbol, also when gensym_hashed()
+    looks up an unterminated copy of it, and that every symbol is on just
+    one of the pd_symhash chains. */
+int symbol_selftest(void)
+{
+    int n = pd_this->pd_symtab->t_size, i, j, length, nchained = 0, nbad = 0;
+    t_symbol **syms = (t_symbol **)getbytes(n * sizeof(*syms)), *s;
+    char buf[MAXPDSTRING];
+    unsigned int hash;
+    for (i = 0; i < n; i++)
+    {
+        sprintf(buf, "1003-symbol-self-test-%d", i);
+        syms[i] = gensym(buf);
+        if (strcmp(syms[i]->s_name, buf))
+            nbad++;
+    }
+    for (i = 0; i < n; i++)
+    {
+        sprintf(buf, "1003-symbol-self-test-%d;", i);
+        length = (int)strlen(buf) - 1;
+        for (j = 0, hash = SYMHASH_INIT; j < length; j++)
+            hash = SYMHASH_ADD(hash, buf[j]);
+        if (gensym_hashed(buf, length, hash) != syms[i] ||
+            gensym(syms[i]->s_name) != syms[i])
+                nbad++;
+    }
+    for (i = 0; i < SYMTABHASHSIZE; i++)
+        for (s = pd_this->pd_symhash[i]; s; s = s->s_next)
+            nchained++;
+    if (nchained != pd_this->pd_symtab->t_count)
+        nbad++;
+    freebytes(syms, n * sizeof(*syms));
+    if (nbad)
+        pd_error(0, "symbol self-test: %d errors", nbad);
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 static t_symbol *addfileextent(t_symbol *s)
 {
     char namebuf[MAXPDSTRING];
@@ -956,6 +1276,7 @@ void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
     t_method *f;
     t_class *c = *x;
     t_methodentry *m, *mlist;
+    t_methodinfo *mi;
     t_atomtype *wp, wanttype;
     int i;
     t_int ai[MAXPDARG+1], *ap = ai;
@@ -1002,11 +1323,13 @@ void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
     }
 #ifdef PDINSTANCE
     mlist = c->c_methods[pd_this->pd_instanceno];
+    m = methodhash_find(c->c_methodhash[pd_this->pd_instanceno],
+        mlist, c->c_nmethod, s);
 #else
     mlist = c->c_methods;
+    m = methodhash_find(c->c_methodhash, mlist, c->c_nmethod, s);
 #endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s)
+    if (m)
     {
         wp = m->me_arg;
         if (*wp == A_GIMME)
@@ -1016,6 +1339,24 @@ void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
                     (*((t_newgimme)(m->me_fun)))(s, argc, argv);
             else (*((t_messgimme)(m->me_fun)))(x, s, argc, argv);
             return;
+        }
+            /* methods taking only floats (or nothing) don't need the
+            argument types looked at one by one */
+        mi = c->c_methodinfo + (m - mlist);
+        if (mi->mi_allfloat && x != &pd_objectmaker)
+        {
+            if (argc < mi->mi_nreq) goto badarg;
+            if (argc > mi->mi_nfloat) argc = mi->mi_nfloat;
+            for (i = 0; i < argc; i++)
+            {
+                if (argv[i].a_type != A_FLOAT) goto badarg;
+                ad[i] = argv[i].a_w.w_float;
+            }
+            for (; i < mi->mi_nfloat; i++)
+                ad[i] = 0;
+            (*(t_fun1)(m->me_fun))((t_int)x,
+                ad[0], ad[1], ad[2], ad[3], ad[4]);
+            return;
         }
         if (argc > MAXPDARG) argc = MAXPDARG;
         if (x != &pd_objectmaker) *(ap++) = (t_int)x, narg++;
@@ -1168,16 +1509,15 @@ void nullfn(void) {}
 t_gotfn getfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
+    t_methodentry *m;
 
 #ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
+    m = methodhash_find(c->c_methodhash[pd_this->pd_instanceno],
+        c->c_methods[pd_this->pd_instanceno], c->c_nmethod, s);
 #else
-    mlist = c->c_methods;
+    m = methodhash_find(c->c_methodhash, c->c_methods, c->c_nmethod, s);
 #endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
+    if (m) return(m->me_fun);
     pd_error(x, "%s: no method for message '%s'", c->c_name->s_name, s->s_name);
     return((t_gotfn)nullfn);
 }
@@ -1185,16 +1525,15 @@ t_gotfn getfn(const t_pd *x, t_symbol *s)
 t_gotfn zgetfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
+    t_methodentry *m;
 
 #ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
+    m = methodhash_find(c->c_methodhash[pd_this->pd_instanceno],
+        c->c_methods[pd_this->pd_instanceno], c->c_nmethod, s);
 #else
-    mlist = c->c_methods;
+    m = methodhash_find(c->c_methodhash, c->c_methods, c->c_nmethod, s);
 #endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
+    if (m) return(m->me_fun);
     return(0);
 }
 
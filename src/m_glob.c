@@ -18,6 +18,43 @@ over.  Some others are prototyped in m_imp.h as well. */
 void glob_menunew(void *dummy, t_symbol *name, t_symbol *dir);
 void glob_verifyquit(void *dummy, t_floatarg f);
 void glob_dsp(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_dspthreads(void *dummy, t_floatarg f);
+void glob_dspstats(void *dummy);
+void glob_memorystats(void *dummy);
+void glob_rtalloccheck(void *dummy, t_floatarg f);
+void glob_fftprecision(void *dummy, t_floatarg f);
+void glob_soundfilestats(void *dummy);
+void glob_guicoalesce(void *dummy, t_floatarg f);
+void glob_guistats(void *dummy);
+void glob_callbackstats(void *dummy, t_symbol *s);
+#ifdef PD_BENCHMARKS
+void glob_clockbenchmark(void *dummy, t_floatarg f);
+void glob_symbolbenchmark(void *dummy, t_floatarg f);
+void glob_binopbenchmark(void *dummy);
+void glob_oscbenchmark(void *dummy);
+void glob_fftbenchmark(void *dummy);
+void glob_soundfilebenchmark(void *dummy);
+void glob_exprbenchmark(void *dummy);
+void glob_binbufbenchmark(void *dummy, t_floatarg f);
+void glob_messagebenchmark(void *dummy);
+void glob_schedblockbenchmark(void *dummy, t_symbol *name, t_symbol *dir,
+    t_floatarg fsec);
+int clock_selftest(void);
+int symbol_selftest(void);
+int memory_selftest(void);
+int soundfile_selftest(void);
+int binop_selftest(void);
+int osc_selftest(void);
+int fft_selftest(void);
+int expr_selftest(void);
+int binbuf_selftest(void);
+int message_selftest(void);
+int schedblock_selftest(void);
+int dspthreads_selftest(void);
+int dspfork_selftest(void);
+int bindlist_selftest(void);
+int keyindex_selftest(void);
+#endif
 void glob_meters(void *dummy, t_floatarg f);
 void glob_key(void *dummy, t_symbol *s, int ac, t_atom *av);
 void glob_audiostatus(void *dummy);
@@ -127,6 +164,50 @@ void glob_zoom_open(t_pd *dummy, t_floatarg f)
     sys_zoom_open = (f != 0 ? 2 : 1);
 }
 
+#ifdef PD_BENCHMARKS
+    /* "pd self-test": run the regression checks that go with the
+    benchmarks.  Each reports its own errors; "make check" looks for the
+    "passed" line at the end. */
+static const struct _selftest
+{
+    const char *t_name;
+    int (*t_fn)(void);
+} glob_selftests[] =
+{
+    {"clock", clock_selftest},
+    {"symbol", symbol_selftest},
+    {"memory", memory_selftest},
+    {"soundfile", soundfile_selftest},
+    {"binop", binop_selftest},
+    {"osc", osc_selftest},
+    {"fft", fft_selftest},
+    {"expr", expr_selftest},
+    {"binbuf", binbuf_selftest},
+    {"message", message_selftest},
+    {"schedblock", schedblock_selftest},
+    {"dsp-threads", dspthreads_selftest},
+    {"clone", dspfork_selftest},
+    {"bindlist", bindlist_selftest},
+    {"keyindex", keyindex_selftest},
+};
+
+#define NSELFTEST (sizeof(glob_selftests)/sizeof(*glob_selftests))
+
+static void glob_selftest(void *dummy)
+{
+    unsigned int i, nfail = 0;
+    for (i = 0; i < NSELFTEST; i++)
+        if ((*glob_selftests[i].t_fn)())
+    {
+        pd_error(0, "self-test: %s failed", glob_selftests[i].t_name);
+        nfail++;
+    }
+    if (nfail)
+        post("self-test: %d of %d failed", nfail, (int)NSELFTEST);
+    else post("self-test: passed (%d tests)", (int)NSELFTEST);
+}
+#endif
+
 void glob_init(void)
 {
     maxclass = class_new(gensym("max"), 0, 0, sizeof(t_pd),
@@ -147,6 +228,48 @@ void glob_init(void)
         gensym("verifyquit"), A_DEFFLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_foo, gensym("foo"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_dsp, gensym("dsp"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspthreads,
+        gensym("dsp-threads"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspstats,
+        gensym("dsp-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memorystats,
+        gensym("memory-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_rtalloccheck,
+        gensym("rt-alloc-check"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_fftprecision,
+        gensym("fft-precision"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_soundfilestats,
+        gensym("soundfile-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_guicoalesce,
+        gensym("gui-coalesce"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_guistats,
+        gensym("gui-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_callbackstats,
+        gensym("callback-stats"), A_DEFSYM, 0);
+#ifdef PD_BENCHMARKS
+    class_addmethod(glob_pdobject, (t_method)glob_clockbenchmark,
+        gensym("clock-benchmark"), A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_symbolbenchmark,
+        gensym("symbol-benchmark"), A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_binopbenchmark,
+        gensym("binop-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_oscbenchmark,
+        gensym("osc-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_fftbenchmark,
+        gensym("fft-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_soundfilebenchmark,
+        gensym("soundfile-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_exprbenchmark,
+        gensym("expr-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_binbufbenchmark,
+        gensym("binbuf-benchmark"), A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_messagebenchmark,
+        gensym("message-benchmark"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_schedblockbenchmark,
+        gensym("schedblock-benchmark"), A_SYMBOL, A_SYMBOL, A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_selftest,
+        gensym("self-test"), 0);
+#endif
     class_addmethod(glob_pdobject, (t_method)glob_meters, gensym("meters"),
         A_FLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_key, gensym("key"), A_GIMME, 0);
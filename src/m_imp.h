@@ -19,6 +19,15 @@ typedef struct _methodentry
     t_atomtype me_arg[MAXPDARG+1];
 } t_methodentry;
 
+    /* what pd_typedmess() needs to know about a method's arguments, kept
+    apart from t_methodentry (one per method, shared by all instances) */
+typedef struct _methodinfo
+{
+    unsigned char mi_allfloat;  /* true if all args are (def)floats */
+    unsigned char mi_nfloat;    /* if so, how many */
+    unsigned char mi_nreq;      /* and how many must be supplied */
+} t_methodinfo;
+
 EXTERN_STRUCT _widgetbehavior;
 
 typedef void (*t_bangmethod)(t_pd *x);
@@ -58,14 +67,53 @@ struct _class
     char c_firstin;                 /* if patchable, true if draw first inlet */
     char c_drawcommand;             /* a drawing command for a template */
     t_classfreefn c_classfreefn;    /* function to call before freeing class */
+#ifdef PDINSTANCE
+    int **c_methodhash;             /* c_methods indices by selector */
+#else
+    int *c_methodhash;
+#endif
+    t_methodinfo *c_methodinfo;     /* argument summary for each method */
+    char c_parallel;                /* DSP may run on another thread */
+    int c_dspgroup;                 /* shared DSP state, see below */
+    int c_dspwrites;                /* subset of c_dspgroup written to */
 };
 
+    /* groups of signal objects sharing state outside themselves.  Parallel
+    DSP only has to serialize readers of a group if somebody writes to it. */
+#define DSPGROUP_DAC 1
+#define DSPGROUP_TAB 2
+#define DSPGROUP_DEL 4
+#define DSPGROUP_SEND 8
+#define DSPGROUP_THROW 16
+
+/* m_memory.c */
+void *gettmpbytes(size_t nbytes);
+void freetmpbytes(void *x, size_t nbytes);
+EXTERN void resettmpbytes(void);
+void memory_realtime(int onoff);
+
 /* m_pd.c */
 EXTERN void pd_init_systems(void);
 EXTERN void pd_term_systems(void);
 
+    /* hash a pointer to a slot in a table of "size" slots, a power of two.
+    We multiply by 2^64 over the golden ratio and take bits from the upper
+    half of the product, which depend on all the pointer's bits; the low
+    bits would only depend on the pointer's low bits, which alignment makes
+    alike. */
+static inline int pd_ptrhash(const void *p, int size)
+{
+    return ((int)(((uint64_t)(size_t)p * 0x9e3779b97f4a7c15ULL) >> 32) &
+        (size - 1));
+}
+
+/* m_binbuf.c */
+EXTERN void binbuf_evalcached(t_binbuf *x, t_pd *target, int argc,
+    const t_atom *argv);
+
 /* m_class.c */
 EXTERN void pd_emptylist(t_pd *x);
+EXTERN void class_setdspgroup(t_class *c, int group, int writes);
 
 /* m_obj.c */
 EXTERN int obj_noutlets(const t_object *x);
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "m_pd.h"
 #include "m_imp.h"
+#include "s_stuff.h"
 
 /* #define LOUD */
 #ifdef LOUD
@@ -17,11 +18,425 @@
 static int totalmem = 0;
 #endif
 
+/* define this to get every block straight from calloc(), for instance to
+let valgrind see individual blocks */
+/* #define NOMEMPOOL */
+
+/* Blocks up to MEMMAXSMALL bytes come from pools, one for each of a number
+of size classes, so that making and freeing small objects doesn't have to go
+through malloc().  Blocks have no header: the size class is taken from the
+slab the block lies in, which a map of slab addresses tells us, so the size
+passed to freebytes() or resizebytes() is only trusted for blocks that
+aren't in a slab.  Those are larger blocks, which come straight from
+calloc() and go back to free(), and anything else, such as blocks an
+extern got from malloc().  Pd has always asked for the size a block was
+got with; with DEBUGMEM defined, a size that doesn't match is reported.
+
+Pooled blocks are carved out of slabs of MEMSLABSIZE bytes, aligned to their
+size so that a block's slab can be found from its address.  Each thread has
+a cache of free blocks of each size, so pooled blocks are usually got and
+freed without locking (and separate Pd instances, running in separate
+threads, don't contend for memory.)  When a cache gets too full or runs
+empty it trades a batch of blocks with a shared, locked depot, which keeps
+them on their slabs; a slab whose blocks all come back to the depot is given
+back to the system unless it's the only free memory of its size.  Threads
+that exit give their whole cache back, and the cache itself is kept for a
+new thread to reuse.
+
+Each cache also counts how many blocks of each size class its thread has
+got minus how many it has freed; "pd memory-stats" adds these up. */
+
+#include <pthread.h>
+#ifdef _WIN32
+#include <malloc.h>     /* for _aligned_malloc() */
+#endif
+
+#define MEMNCLASS 20
+#define MEMMAXSMALL 1024
+#define MEMSLABSIZE 65536   /* bytes gotten at once to make pooled blocks */
+#define MEMSLABHEAD 64      /* room for the t_memslab at the start of each */
+#define MEMCACHEMAX 64      /* most free blocks a thread keeps per class */
+#define MEMBATCH 32         /* how many to trade with the depot at once */
+
+    /* 16 to 128 bytes in steps of 16, then four steps per doubling */
+static const size_t mem_classsize[MEMNCLASS] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+    320, 384, 448, 512, 640, 768, 896, 1024};
+
+typedef struct _memslab
+{
+    struct _memslab *ms_next;       /* slabs with free blocks in the depot */
+    struct _memslab *ms_prev;
+    void *ms_free;                  /* those free blocks */
+    int ms_nfree;
+    int ms_nblock;                  /* how many blocks the slab holds */
+    int ms_class;                   /* and their size class */
+} t_memslab;
+
+#define mem_slabof(block) \
+    ((t_memslab *)((size_t)(block) & ~(size_t)(MEMSLABSIZE - 1)))
+
+    /* a bit for each MEMSLABSIZE of address space that holds a slab, in
+    leaves of 2^MEMMAPLEAFBITS bits that are made as needed and never freed,
+    so that the map can be read without locking; it's changed under
+    mem_mutex.  This covers 48-bit addresses; slabs beyond aren't used. */
+#define MEMMAPLEAFBITS 20
+#define MEMMAPROOT 4096
+#define MEMMAPLEAFBYTES ((1 << MEMMAPLEAFBITS) / 8)
+static unsigned char *mem_map[MEMMAPROOT];
+
+typedef struct _memcache
+{
+    void *mc_free[MEMNCLASS];       /* free blocks, linked through first word */
+    int mc_nfree[MEMNCLASS];
+    long mc_nlive[MEMNCLASS];       /* blocks got minus blocks freed */
+    long mc_largebytes;             /* same in bytes for unpooled blocks */
+    int mc_inuse;                   /* zero if its thread has exited */
+    struct _memcache *mc_next;      /* list of all caches */
+} t_memcache;
+
+static pthread_once_t mem_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mem_key;
+static pthread_mutex_t mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+static t_memcache *mem_cachelist;
+static t_memslab *mem_depot[MEMNCLASS]; /* under mem_mutex */
+static int mem_ndepot[MEMNCLASS];       /* free blocks in the depot */
+static int mem_nslab;                   /* slabs gotten from the system */
+
+static void *mem_slaballoc(void)
+{
+#ifdef _WIN32
+    return (_aligned_malloc(MEMSLABSIZE, MEMSLABSIZE));
+#else
+    void *ret;
+    return (posix_memalign(&ret, MEMSLABSIZE, MEMSLABSIZE) ? 0 : ret);
+#endif
+}
+
+static void mem_slabfree(t_memslab *slab)
+{
+#ifdef _WIN32
+    _aligned_free(slab);
+#else
+    free(slab);
+#endif
+}
+
+    /* check whether a MEMSLABSIZE-aligned address is a slab of ours */
+static int mem_isslab(const t_memslab *slab)
+{
+    size_t n = (size_t)slab / MEMSLABSIZE, bit;
+    const unsigned char *leaf;
+    if ((n >> MEMMAPLEAFBITS) >= MEMMAPROOT ||
+        !(leaf = mem_map[n >> MEMMAPLEAFBITS]))
+            return (0);
+    bit = n & ((1 << MEMMAPLEAFBITS) - 1);
+    return ((leaf[bit >> 3] >> (bit & 7)) & 1);
+}
+
+    /* enter a slab in the map or take it out; call with mem_mutex held.
+    Returns 0 if the slab can't be entered. */
+static int mem_mapslab(const t_memslab *slab, int onoff)
+{
+    size_t n = (size_t)slab / MEMSLABSIZE, root = n >> MEMMAPLEAFBITS,
+        bit = n & ((1 << MEMMAPLEAFBITS) - 1);
+    if (root >= MEMMAPROOT)
+        return (0);
+    if (!mem_map[root] &&
+        !(onoff && (mem_map[root] = (unsigned char *)calloc(1,
+            MEMMAPLEAFBYTES))))
+                return (0);
+    if (onoff)
+        mem_map[root][bit >> 3] |= (1 << (bit & 7));
+    else mem_map[root][bit >> 3] &= ~(1 << (bit & 7));
+    return (1);
+}
+
+    /* the size class of a block from the slab it lies in, or MEMNCLASS if
+    it isn't in one */
+static int mem_classof(const void *block)
+{
+    t_memslab *slab = mem_slabof(block);
+    return (mem_isslab(slab) ? slab->ms_class : MEMNCLASS);
+}
+
+static void mem_unlinkslab(t_memslab *slab, int cl)
+{
+    if (slab->ms_prev)
+        slab->ms_prev->ms_next = slab->ms_next;
+    else mem_depot[cl] = slab->ms_next;
+    if (slab->ms_next)
+        slab->ms_next->ms_prev = slab->ms_prev;
+}
+
+    /* give a block back to its slab in the depot; call with mem_mutex held.
+    The slab, not the caller, says which size class the block is in. */
+static void mem_depotput(void *block)
+{
+    t_memslab *slab = mem_slabof(block);
+    int cl = slab->ms_class;
+    *(void **)block = slab->ms_free;
+    slab->ms_free = block;
+    if (!slab->ms_nfree++)
+    {
+        slab->ms_prev = 0;
+        if ((slab->ms_next = mem_depot[cl]))
+            slab->ms_next->ms_prev = slab;
+        mem_depot[cl] = slab;
+    }
+    mem_ndepot[cl]++;
+    if (slab->ms_nfree == slab->ms_nblock &&
+        mem_ndepot[cl] > slab->ms_nblock)
+    {
+        mem_unlinkslab(slab, cl);
+        mem_ndepot[cl] -= slab->ms_nblock;
+        mem_nslab--;
+        mem_mapslab(slab, 0);
+        mem_slabfree(slab);
+    }
+}
+
+    /* give n blocks from the front of a cache to the depot */
+static void mem_spill(t_memcache *x, int cl, int n)
+{
+    void *b;
+    pthread_mutex_lock(&mem_mutex);
+    while (n-- && (b = x->mc_free[cl]))
+    {
+        x->mc_free[cl] = *(void **)b;
+        x->mc_nfree[cl]--;
+        mem_depotput(b);
+    }
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+static void mem_exitthread(void *z)
+{
+    t_memcache *x = (t_memcache *)z;
+    int cl;
+    for (cl = 0; cl < MEMNCLASS; cl++)
+        mem_spill(x, cl, x->mc_nfree[cl]);
+    pthread_mutex_lock(&mem_mutex);
+    x->mc_inuse = 0;
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+static void mem_init(void)
+{
+    pthread_key_create(&mem_key, mem_exitthread);
+}
+
+static t_memcache *mem_getcache(void)
+{
+    t_memcache *x;
+    pthread_once(&mem_once, mem_init);
+    if ((x = (t_memcache *)pthread_getspecific(mem_key)))
+        return (x);
+    pthread_mutex_lock(&mem_mutex);
+    for (x = mem_cachelist; x; x = x->mc_next)
+        if (!x->mc_inuse)
+            break;
+    if (!x && (x = (t_memcache *)calloc(1, sizeof(*x))))
+    {
+        x->mc_next = mem_cachelist;
+        mem_cachelist = x;
+    }
+    if (x)
+        x->mc_inuse = 1;
+    pthread_mutex_unlock(&mem_mutex);
+    if (x)
+        pthread_setspecific(mem_key, x);
+    return (x);
+}
+
+static int mem_getclass(size_t nbytes)
+{
+#ifdef NOMEMPOOL
+    return (MEMNCLASS);
+#else
+    size_t n1 = nbytes - 1;
+    int b;
+    if (nbytes > MEMMAXSMALL)
+        return (MEMNCLASS);
+    if (nbytes <= 128)
+        return ((int)(n1 >> 4));
+    for (b = 7; (n1 >> (b+1)); b++)
+        ;
+    return (8 + 4 * (b - 7) + (int)((n1 - ((size_t)1 << b)) >> (b - 2)));
+#endif
+}
+
+    /* refill an empty cache from the depot, making a new slab if needed */
+static void mem_refill(t_memcache *x, int cl)
+{
+    size_t blocksize = mem_classsize[cl];
+    t_memslab *slab;
+    int i, n = 0;
+    pthread_mutex_lock(&mem_mutex);
+    if (!mem_depot[cl])
+    {
+        pthread_mutex_unlock(&mem_mutex);
+        if (!(slab = (t_memslab *)mem_slaballoc()))
+            return;
+        slab->ms_nblock = (int)((MEMSLABSIZE - MEMSLABHEAD) / blocksize);
+        slab->ms_nfree = slab->ms_nblock;
+        slab->ms_class = cl;
+        slab->ms_free = 0;
+        for (i = slab->ms_nblock; i--; )
+        {
+            void *b = (char *)slab + MEMSLABHEAD + i * blocksize;
+            *(void **)b = slab->ms_free;
+            slab->ms_free = b;
+        }
+        pthread_mutex_lock(&mem_mutex);
+        if (!mem_mapslab(slab, 1))
+        {
+            pthread_mutex_unlock(&mem_mutex);
+            mem_slabfree(slab);
+            return;
+        }
+        slab->ms_prev = 0;
+        if ((slab->ms_next = mem_depot[cl]))
+            slab->ms_next->ms_prev = slab;
+        mem_depot[cl] = slab;
+        mem_ndepot[cl] += slab->ms_nblock;
+        mem_nslab++;
+    }
+    while (n < MEMBATCH && (slab = mem_depot[cl]))
+    {
+        void *b = slab->ms_free;
+        slab->ms_free = *(void **)b;
+        *(void **)b = x->mc_free[cl];
+        x->mc_free[cl] = b;
+        n++;
+        if (!--slab->ms_nfree)
+            mem_unlinkslab(slab, cl);
+    }
+    mem_ndepot[cl] -= n;
+    pthread_mutex_unlock(&mem_mutex);
+    x->mc_nfree[cl] += n;
+}
+
+static void *mem_getblock(size_t nbytes, int zero)
+{
+    t_memcache *x;
+    int cl = mem_getclass(nbytes);
+    void *ret;
+    if (cl < MEMNCLASS && (x = mem_getcache()))
+    {
+        if (!x->mc_free[cl])
+            mem_refill(x, cl);
+        if ((ret = x->mc_free[cl]))
+        {
+            x->mc_free[cl] = *(void **)ret;
+            x->mc_nfree[cl]--;
+            x->mc_nlive[cl]++;
+            if (zero)
+                memset(ret, 0, nbytes);
+            return (ret);
+        }
+    }
+        /* larger blocks, and small ones if we couldn't make a slab */
+    if ((ret = (zero ? calloc(1, nbytes) : malloc(nbytes))) &&
+        (x = mem_getcache()))
+            x->mc_largebytes += nbytes;
+    return (ret);
+}
+
+#ifdef DEBUGMEM
+    /* report a caller whose size for a block isn't the one it was got with,
+    or whose block isn't where one of that size class would be */
+static void mem_checksize(const char *fn, const void *block, int cl,
+    size_t nbytes)
+{
+    t_memslab *slab = mem_slabof(block);
+    if (cl < MEMNCLASS ?
+        (mem_getclass(nbytes) != cl ||
+            ((char *)block - (char *)slab) < MEMSLABHEAD ||
+            ((char *)block - (char *)slab - MEMSLABHEAD) %
+                mem_classsize[cl]) :
+        mem_getclass(nbytes) < MEMNCLASS)
+            bug("%s: %ld bytes at %p, but the block is %s", fn,
+                (long)nbytes, block, (cl < MEMNCLASS ?
+                    "from a pool of another size" : "not from a pool"));
+}
+#endif
+
+static void mem_freeblock(void *block, size_t nbytes)
+{
+    t_memcache *x = mem_getcache();
+    int cl = mem_classof(block);
+    if (cl == MEMNCLASS)
+    {
+        if (x)
+            x->mc_largebytes -= nbytes;
+        free(block);
+    }
+    else if (x)
+    {
+        *(void **)block = x->mc_free[cl];
+        x->mc_free[cl] = block;
+        x->mc_nlive[cl]--;
+        if (++x->mc_nfree[cl] > MEMCACHEMAX)
+            mem_spill(x, cl, MEMBATCH);
+    }
+    else
+    {
+        pthread_mutex_lock(&mem_mutex);
+        mem_depotput(block);
+        pthread_mutex_unlock(&mem_mutex);
+    }
+}
+
+/* "pd rt-alloc-check 1" counts memory allocated by the thread running
+sched_audio_callbackfn() while it holds the Pd lock, and posts how much was
+allocated at most once a second. */
+
+static int mem_rtcheck;         /* true if checking */
+static int mem_inrt;            /* true while in the audio callback */
+static pthread_t mem_rtthread;  /* thread running the audio callback */
+static int mem_nrtalloc;        /* allocations since last report */
+static size_t mem_rtallocbytes; /* and how many bytes */
+static double mem_rtreporttime;
+
+#define mem_checkrt(nbytes) \
+    if (mem_inrt && pthread_equal(pthread_self(), mem_rtthread)) \
+        mem_nrtalloc++, mem_rtallocbytes += (nbytes)
+
+void memory_realtime(int onoff)
+{
+    if (onoff && mem_rtcheck)
+    {
+        mem_rtthread = pthread_self();
+        mem_inrt = 1;
+    }
+    else if (!onoff)
+    {
+        mem_inrt = 0;
+        if (mem_nrtalloc && sys_getrealtime() >= mem_rtreporttime + 1)
+        {
+            post("warning: %d allocations (%ld bytes) in audio callback",
+                mem_nrtalloc, (long)mem_rtallocbytes);
+            mem_nrtalloc = 0;
+            mem_rtallocbytes = 0;
+            mem_rtreporttime = sys_getrealtime();
+        }
+    }
+}
+
+void glob_rtalloccheck(void *dummy, t_floatarg f)
+{
+    mem_rtcheck = (f != 0);
+    mem_nrtalloc = 0;
+    mem_rtallocbytes = 0;
+}
+
 void *getbytes(size_t nbytes)
 {
     void *ret;
     if (nbytes < 1) nbytes = 1;
-    ret = (void *)calloc(nbytes, 1);
+    mem_checkrt(nbytes);
+    ret = mem_getblock(nbytes, 1);
 #ifdef LOUD
     fprintf(stderr, "new  %lx %d\n", (int)ret, nbytes);
 #endif /* LOUD */
@@ -50,9 +465,33 @@ void *copybytes(const void *src, size_t nbytes)
 void *resizebytes(void *old, size_t oldsize, size_t newsize)
 {
     void *ret;
+    int oldclass, newclass;
     if (newsize < 1) newsize = 1;
     if (oldsize < 1) oldsize = 1;
-    ret = (void *)realloc((char *)old, newsize);
+    if (!old)
+        return (getbytes(newsize));
+    mem_checkrt(newsize);
+    oldclass = mem_classof(old);
+    newclass = mem_getclass(newsize);
+#ifdef DEBUGMEM
+    mem_checksize("resizebytes", old, oldclass, oldsize);
+#endif
+        /* don't copy more than a pooled block holds, whatever we're told */
+    if (oldclass < MEMNCLASS && oldsize > mem_classsize[oldclass])
+        oldsize = mem_classsize[oldclass];
+    if (oldclass == newclass && oldclass < MEMNCLASS)
+        ret = old;  /* still the same size class */
+    else if (oldclass == MEMNCLASS && newclass == MEMNCLASS)
+    {
+        t_memcache *x = mem_getcache();
+        if ((ret = realloc(old, newsize)) && x)
+            x->mc_largebytes += (long)newsize - (long)oldsize;
+    }
+    else if ((ret = mem_getblock(newsize, 0)))
+    {
+        memcpy(ret, old, (oldsize < newsize ? oldsize : newsize));
+        mem_freeblock(old, oldsize);
+    }
     if (newsize > oldsize && ret)
         memset(((char *)ret) + oldsize, 0, newsize - oldsize);
 #ifdef LOUD
@@ -75,9 +514,155 @@ void freebytes(void *fatso, size_t nbytes)
 #endif /* LOUD */
 #ifdef DEBUGMEM
     totalmem -= nbytes;
+    if (fatso)
+        mem_checksize("freebytes", fatso, mem_classof(fatso), nbytes);
+#endif
+    if (fatso)
+        mem_freeblock(fatso, nbytes);
+}
+
+/* Scratch space for atom vectors too big for alloca(), as in binbuf_eval().
+Each Pd instance has TMPBYTESIZE bytes used as a stack: since these are
+always freed in the reverse order they were got, freeing the latest one
+makes its space available again.  In case something doesn't, the
+schedulers' outermost loops empty it anyway after each tick with
+resettmpbytes() (not sched_tick() itself, which may be called from inside a
+message that still holds some, as the schedblock benchmark does.)  If it's
+full we fall back on getbytes().  Unlike getbytes(), gettmpbytes() doesn't
+zero the memory. */
+
+void *gettmpbytes(size_t nbytes)
+{
+    size_t n = (nbytes + 15) & ~(size_t)15;
+    if (STUFF->st_tmpbytes && STUFF->st_tmpfill + n <= TMPBYTESIZE)
+    {
+        void *ret = STUFF->st_tmpbytes + STUFF->st_tmpfill;
+        STUFF->st_tmpfill += n;
+        return (ret);
+    }
+    else return (getbytes(nbytes));
+}
+
+void freetmpbytes(void *x, size_t nbytes)
+{
+    char *cp = (char *)x;
+    if (STUFF->st_tmpbytes && cp >= STUFF->st_tmpbytes &&
+        cp < STUFF->st_tmpbytes + TMPBYTESIZE)
+    {
+        if (cp + ((nbytes + 15) & ~(size_t)15) ==
+            STUFF->st_tmpbytes + STUFF->st_tmpfill)
+                STUFF->st_tmpfill = cp - STUFF->st_tmpbytes;
+    }
+    else freebytes(x, nbytes);
+}
+
+void resettmpbytes(void)
+{
+    STUFF->st_tmpfill = 0;
+}
+
+    /* "pd memory-stats": post live bytes in each size class */
+void glob_memorystats(void *dummy)
+{
+    long nlive[MEMNCLASS], largebytes = 0, total = 0;
+    int i, nfree[MEMNCLASS], ncache = 0, nslab;
+    t_memcache *x;
+    for (i = 0; i < MEMNCLASS; i++)
+        nlive[i] = nfree[i] = 0;
+    pthread_mutex_lock(&mem_mutex);
+    for (x = mem_cachelist; x; x = x->mc_next)
+    {
+        for (i = 0; i < MEMNCLASS; i++)
+            nlive[i] += x->mc_nlive[i], nfree[i] += x->mc_nfree[i];
+        largebytes += x->mc_largebytes;
+        ncache++;
+    }
+    for (i = 0; i < MEMNCLASS; i++)
+        nfree[i] += mem_ndepot[i];
+    nslab = mem_nslab;
+    pthread_mutex_unlock(&mem_mutex);
+    post("memory: %d thread caches, %d slabs of %d bytes", ncache, nslab,
+        MEMSLABSIZE);
+    for (i = 0; i < MEMNCLASS; i++)
+    {
+        if (!nlive[i] && !nfree[i])
+            continue;
+        post("memory: %4d bytes: %ld live (%ld bytes), %d free",
+            (int)mem_classsize[i], nlive[i],
+                nlive[i] * (long)mem_classsize[i], nfree[i]);
+        total += nlive[i] * (long)mem_classsize[i];
+    }
+    post("memory: larger blocks: %ld bytes", largebytes);
+    post("memory: total live: %ld bytes", total + largebytes);
+}
+
+#ifdef PD_BENCHMARKS
+    /* get and free lots of blocks of a few sizes, checking that they come
+    back zeroed and that the slabs they needed are given back afterward */
+int memory_selftest(void)
+{
+    static const size_t sizes[] = {1, 24, 100, 1000, 5000};
+    int n = 20000, i, j, nbad = 0, nslab;
+    char **vec = (char **)getbytes(n * sizeof(*vec));
+#ifndef DEBUGMEM
+    t_memcache *x;
+#endif
+    pthread_mutex_lock(&mem_mutex);
+    nslab = mem_nslab;
+    pthread_mutex_unlock(&mem_mutex);
+    for (j = 0; j < (int)(sizeof(sizes)/sizeof(*sizes)); j++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (!(vec[i] = (char *)getbytes(sizes[j])) ||
+                vec[i][0] || vec[i][sizes[j]-1])
+                    nbad++;
+            else memset(vec[i], 1, sizes[j]);
+        }
+        for (i = 0; i < n; i++)
+            if (vec[i])
+                freebytes(vec[i], sizes[j]);
+    }
+#ifndef DEBUGMEM   /* which would report these */
+        /* a wrong size or a block from malloc() mustn't get into a pool, and
+        resizebytes() mustn't copy more than the block holds */
+    if ((x = mem_getcache()))
+    {
+        int cl1 = mem_getclass(24), cl2 = mem_getclass(40),
+            cl3 = mem_getclass(500);
+        long live1 = x->mc_nlive[cl1], live2 = x->mc_nlive[cl2],
+            live3 = x->mc_nlive[cl3];
+        char *b1 = (char *)getbytes(24), *b2 = (char *)malloc(24);
+        if (b1)
+            freebytes(b1, 500);
+        if (b2)
+            freebytes(b2, 24);
+        if ((b1 = (char *)getbytes(24)))
+        {
+            memset(b1, 1, 24);
+            if ((b1 = (char *)resizebytes(b1, 2000, 40)))
+            {
+                if (mem_classof(b1) != cl2 || b1[23] != 1 || b1[39])
+                    nbad++;
+                freebytes(b1, 40);
+            }
+        }
+        if (x->mc_nlive[cl1] != live1 || x->mc_nlive[cl2] != live2 ||
+            x->mc_nlive[cl3] != live3)
+                nbad++;
+    }
 #endif
-    free(fatso);
+        /* allow one slab per class to be kept */
+    pthread_mutex_lock(&mem_mutex);
+    if (mem_nslab > nslab + MEMNCLASS)
+        nbad++;
+    pthread_mutex_unlock(&mem_mutex);
+    freebytes(vec, n * sizeof(*vec));
+    if (nbad)
+        pd_error(0, "memory self-test: %d errors", nbad);
+    return (nbad);
 }
+#endif /* PD_BENCHMARKS */
 
 #ifdef DEBUGMEM
 #include <stdio.h>
@@ -52,64 +52,222 @@ void gobj_save(t_gobj *x, t_binbuf *b)
 
 /* deal with several objects bound to the same symbol.  If more than one, we
 actually bind a collection object to the symbol, which forwards messages sent
-to the symbol. */
+to the symbol.
+
+The receivers are kept in an array in the order they were bound, and get
+messages in the opposite order (the last one bound gets it first).  To unbind
+one we just empty its slot, so that the others keep their places even if this
+happens while we're sending them a message.  The empty slots are squeezed out
+afterward, once there are as many of them as of full ones.  Long lists also
+have a hash table from receiver to slot so that we can find the one to unbind
+without looking through all of them. */
 
 static t_class *bindlist_class;
 
-typedef struct _bindelem
-{
-    t_pd *e_who;
-    struct _bindelem *e_next;
-} t_bindelem;
+#define BINDLIST_INITSIZE 4     /* slots in a new bindlist */
+#define BINDLIST_HASHMIN 16     /* make a hash table above this many slots */
 
 typedef struct _bindlist
 {
     t_pd b_pd;
-    t_bindelem *b_list;
+    t_symbol *b_sym;            /* the symbol we're bound to */
+    t_pd **b_vec;               /* receivers, zero where one was unbound */
+    int b_n;                    /* number of slots in use, full or empty */
+    int b_nfull;                /* number of them that are full */
+    int b_size;                 /* number of slots allocated */
+    int b_sending;              /* nonzero while sending to the receivers */
+    int *b_hash;                /* slot numbers of the receivers, or -1 */
+    int b_hashsize;             /* twice b_size (a power of 2) if hashed */
 } t_bindlist;
 
+static int bindlist_hashof(t_bindlist *x, t_pd *who)
+{
+    return (pd_ptrhash(who, x->b_hashsize));
+}
+
+static void bindlist_rehash(t_bindlist *x)
+{
+    int i;
+    if (x->b_size <= BINDLIST_HASHMIN)
+        return;
+    if (x->b_hashsize != 2 * x->b_size)
+    {
+        if (x->b_hash)
+            freebytes(x->b_hash, x->b_hashsize * sizeof(int));
+        x->b_hashsize = 2 * x->b_size;
+        x->b_hash = (int *)getbytes(x->b_hashsize * sizeof(int));
+    }
+    for (i = 0; i < x->b_hashsize; i++)
+        x->b_hash[i] = -1;
+    for (i = 0; i < x->b_n; i++)
+        if (x->b_vec[i])
+    {
+        int h = bindlist_hashof(x, x->b_vec[i]);
+        while (x->b_hash[h] >= 0)
+            h = (h + 1) & (x->b_hashsize - 1);
+        x->b_hash[h] = i;
+    }
+}
+
+static void bindlist_add(t_bindlist *x, t_pd *who)
+{
+    if (x->b_n == x->b_size)
+    {
+        x->b_vec = (t_pd **)resizebytes(x->b_vec, x->b_size * sizeof(t_pd *),
+            2 * x->b_size * sizeof(t_pd *));
+        x->b_size *= 2;
+        bindlist_rehash(x);
+    }
+    x->b_vec[x->b_n] = who;
+    if (x->b_hash)
+    {
+        int h = bindlist_hashof(x, who);
+        while (x->b_hash[h] >= 0)
+            h = (h + 1) & (x->b_hashsize - 1);
+        x->b_hash[h] = x->b_n;
+    }
+    x->b_n++;
+    x->b_nfull++;
+}
+
+    /* empty the slot of the last binding of "who" if any; return 1 if so */
+static int bindlist_remove(t_bindlist *x, t_pd *who)
+{
+    int slot = -1;
+    if (x->b_hash)
+    {
+            /* the same object may be bound more than once; find the hash
+            entry for the latest binding, then close up the gap behind it */
+        int mask = x->b_hashsize - 1, h, found = -1, i, j;
+        for (h = bindlist_hashof(x, who); x->b_hash[h] >= 0; h = (h + 1) & mask)
+            if (x->b_vec[x->b_hash[h]] == who && x->b_hash[h] > slot)
+                slot = x->b_hash[h], found = h;
+        if (found < 0)
+            return (0);
+        for (i = found, j = (i + 1) & mask; x->b_hash[j] >= 0;
+            j = (j + 1) & mask)
+        {
+            int home = bindlist_hashof(x, x->b_vec[x->b_hash[j]]);
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                x->b_hash[i] = x->b_hash[j];
+                i = j;
+            }
+        }
+        x->b_hash[i] = -1;
+    }
+    else
+    {
+        for (slot = x->b_n; slot--; )
+            if (x->b_vec[slot] == who)
+                break;
+        if (slot < 0)
+            return (0);
+    }
+    x->b_vec[slot] = 0;
+    x->b_nfull--;
+    return (1);
+}
+
+    /* called when not sending.  If there's only one receiver left bind it
+    directly to the symbol and get rid of the bindlist; otherwise squeeze out
+    the empty slots if there are enough of them. */
+static void bindlist_tidy(t_bindlist *x)
+{
+    int i, n;
+    if (x->b_nfull < 2)
+    {
+        t_pd *who = 0;
+        for (i = 0; i < x->b_n; i++)
+            if (x->b_vec[i])
+                who = x->b_vec[i];
+        x->b_sym->s_thing = who;
+        freebytes(x->b_vec, x->b_size * sizeof(t_pd *));
+        if (x->b_hash)
+            freebytes(x->b_hash, x->b_hashsize * sizeof(int));
+        pd_free(&x->b_pd);
+    }
+    else if (x->b_n - x->b_nfull >= x->b_nfull)
+    {
+        for (i = n = 0; i < x->b_n; i++)
+            if (x->b_vec[i])
+                x->b_vec[n++] = x->b_vec[i];
+        x->b_n = n;
+        if (x->b_hash)
+            bindlist_rehash(x);
+    }
+}
+
+    /* receivers may bind and unbind while we send them a message.  New ones
+    go past the ones we're going through and unbound ones leave their slots
+    empty, so we just go down from where the list ended when we started, and
+    tidy up when done. */
+static void bindlist_donesending(t_bindlist *x)
+{
+    if (!--x->b_sending && x->b_n > x->b_nfull)
+        bindlist_tidy(x);
+}
+
 static void bindlist_bang(t_bindlist *x)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_bang(e->e_who);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_bang(x->b_vec[i]);
+    bindlist_donesending(x);
 }
 
 static void bindlist_float(t_bindlist *x, t_float f)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_float(e->e_who, f);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_float(x->b_vec[i], f);
+    bindlist_donesending(x);
 }
 
 static void bindlist_symbol(t_bindlist *x, t_symbol *s)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_symbol(e->e_who, s);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_symbol(x->b_vec[i], s);
+    bindlist_donesending(x);
 }
 
 static void bindlist_pointer(t_bindlist *x, t_gpointer *gp)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_pointer(e->e_who, gp);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_pointer(x->b_vec[i], gp);
+    bindlist_donesending(x);
 }
 
 static void bindlist_list(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_list(e->e_who, s, argc, argv);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_list(x->b_vec[i], s, argc, argv);
+    bindlist_donesending(x);
 }
 
 static void bindlist_anything(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_typedmess(e->e_who, s, argc, argv);
+    int i;
+    x->b_sending++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_typedmess(x->b_vec[i], s, argc, argv);
+    bindlist_donesending(x);
 }
 
 void m_pd_setup(void)
@@ -128,26 +286,22 @@ void pd_bind(t_pd *x, t_symbol *s)
 {
     if (s->s_thing)
     {
+        t_bindlist *b;
         if (*s->s_thing == bindlist_class)
-        {
-            t_bindlist *b = (t_bindlist *)s->s_thing;
-            t_bindelem *e = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            e->e_next = b->b_list;
-            e->e_who = x;
-            b->b_list = e;
-        }
+            b = (t_bindlist *)s->s_thing;
         else
         {
-            t_bindlist *b = (t_bindlist *)pd_new(bindlist_class);
-            t_bindelem *e1 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            t_bindelem *e2 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            b->b_list = e1;
-            e1->e_who = x;
-            e1->e_next = e2;
-            e2->e_who = s->s_thing;
-            e2->e_next = 0;
+            b = (t_bindlist *)pd_new(bindlist_class);
+            b->b_sym = s;
+            b->b_size = BINDLIST_INITSIZE;
+            b->b_vec = (t_pd **)getbytes(b->b_size * sizeof(t_pd *));
+            b->b_n = b->b_nfull = b->b_sending = 0;
+            b->b_hash = 0;
+            b->b_hashsize = 0;
+            bindlist_add(b, s->s_thing);
             s->s_thing = &b->b_pd;
         }
+        bindlist_add(b, x);
     }
     else s->s_thing = x;
 }
@@ -159,28 +313,11 @@ void pd_unbind(t_pd *x, t_symbol *s)
     {
             /* bindlists always have at least two elements... if the number
             goes down to one, get rid of the bindlist and bind the symbol
-            straight to the remaining element. */
-
+            straight to the remaining element (after sending, if we're in
+            the middle of that). */
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        if ((e = b->b_list)->e_who == x)
-        {
-            b->b_list = e->e_next;
-            freebytes(e, sizeof(t_bindelem));
-        }
-        else for (e = b->b_list; (e2 = e->e_next); e = e2)
-            if (e2->e_who == x)
-        {
-            e->e_next = e2->e_next;
-            freebytes(e2, sizeof(t_bindelem));
-            break;
-        }
-        if (!b->b_list->e_next)
-        {
-            s->s_thing = b->b_list->e_who;
-            freebytes(b->b_list, sizeof(t_bindelem));
-            pd_free(&b->b_pd);
-        }
+        if (bindlist_remove(b, x) && !b->b_sending)
+            bindlist_tidy(b);
     }
     else pd_error(x, "%s: couldn't unbind", s->s_name);
 }
@@ -194,22 +331,209 @@ t_pd *pd_findbyclass(t_symbol *s, const t_class *c)
     if (*s->s_thing == bindlist_class)
     {
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        int warned = 0;
-        for (e = b->b_list; e; e = e->e_next)
-            if (*e->e_who == c)
+        int i, warned = 0;
+        for (i = b->b_n; i--; )
+            if (b->b_vec[i] && *b->b_vec[i] == c)
         {
             if (x && !warned)
             {
                 post("warning: %s: multiply defined", s->s_name);
                 warned = 1;
             }
-            x = e->e_who;
+            x = b->b_vec[i];
         }
     }
     return x;
 }
 
+#ifdef PD_BENCHMARKS
+
+    /* receivers for the bindlist self-test, which log their numbers when
+    they get a message and can unbind and bind others then */
+typedef struct _bindtest
+{
+    t_pd b_pd;
+    int b_id;
+    int b_unbind[3];        /* receivers to unbind on our first copy, or -1 */
+    int b_bind;             /* receiver to bind then, or -1 */
+} t_bindtest;
+
+#define BINDTEST_MAXN 100
+#define BINDTEST_NRECV (BINDTEST_MAXN + 1)
+#define BINDTEST_NSLOT (4 * BINDTEST_NRECV)
+
+static t_class *bindtest_class;
+static t_bindtest *bindtest_vec[BINDTEST_NRECV];
+static t_symbol *bindtest_sym;
+static int bindtest_log[BINDTEST_NSLOT], bindtest_nlog;
+
+static int bindtest_gotone(int *log, int nlog, int id)
+{
+    while (nlog--)
+        if (log[nlog] == id)
+            return (1);
+    return (0);
+}
+
+static void bindtest_float(t_bindtest *x, t_float f)
+{
+    int i, first = !bindtest_gotone(bindtest_log, bindtest_nlog, x->b_id);
+    bindtest_log[bindtest_nlog++] = x->b_id;
+    if (!first)
+        return;
+    for (i = 0; i < 3; i++)
+        if (x->b_unbind[i] >= 0)
+            pd_unbind(&bindtest_vec[x->b_unbind[i]]->b_pd, bindtest_sym);
+    if (x->b_bind >= 0)
+        pd_bind(&bindtest_vec[x->b_bind]->b_pd, bindtest_sym);
+}
+
+    /* the model of a bindlist: receiver numbers in the order they were bound,
+    with -1 where one was unbound.  Unbinding takes away the latest binding. */
+static void bindtest_modelunbind(int *slots, int nslots, int id)
+{
+    while (nslots--)
+        if (slots[nslots] == id)
+    {
+        slots[nslots] = -1;
+        return;
+    }
+}
+
+static void bindtest_bind(int *slots, int *nslots, int id)
+{
+    pd_bind(&bindtest_vec[id]->b_pd, bindtest_sym);
+    slots[(*nslots)++] = id;
+}
+
+static void bindtest_unbind(int *slots, int nslots, int id)
+{
+    pd_unbind(&bindtest_vec[id]->b_pd, bindtest_sym);
+    bindtest_modelunbind(slots, nslots, id);
+}
+
+    /* send a float to the symbol and check that the receivers got it in the
+    model's order, latest binding first, and that the symbol is bound the way
+    it should be afterward.  Receivers unbound while sending don't get the
+    message if we haven't reached them yet, and new ones don't get it. */
+static int bindtest_check(int n, const char *what, int *slots, int *nslots)
+{
+    int expect[BINDTEST_NSLOT], nexpect = 0, nfull = 0, last = -1, i, j,
+        bad = 0;
+    for (i = *nslots; i--; )
+        if (slots[i] >= 0)
+    {
+        t_bindtest *x = bindtest_vec[slots[i]];
+        int first = !bindtest_gotone(expect, nexpect, x->b_id);
+        expect[nexpect++] = x->b_id;
+        if (!first)
+            continue;
+        for (j = 0; j < 3; j++)
+            if (x->b_unbind[j] >= 0)
+                bindtest_modelunbind(slots, *nslots, x->b_unbind[j]);
+        if (x->b_bind >= 0)
+            slots[(*nslots)++] = x->b_bind;
+    }
+    bindtest_nlog = 0;
+    if (bindtest_sym->s_thing)
+        pd_float(bindtest_sym->s_thing, 1);
+    if (bindtest_nlog != nexpect ||
+        memcmp(bindtest_log, expect, nexpect * sizeof(int)))
+            bad = 1;
+    for (i = 0; i < *nslots; i++)
+        if (slots[i] >= 0)
+            nfull++, last = slots[i];
+    if (nfull == 0)
+        bad |= (bindtest_sym->s_thing != 0);
+    else if (nfull == 1)
+        bad |= (bindtest_sym->s_thing != &bindtest_vec[last]->b_pd);
+    else if (!bindtest_sym->s_thing || *bindtest_sym->s_thing != bindlist_class)
+        bad = 1;
+    else
+    {
+        t_bindlist *b = (t_bindlist *)bindtest_sym->s_thing;
+        bad |= (b->b_nfull != nfull || b->b_sending ||
+            (b->b_hash != 0) != (b->b_size > BINDLIST_HASHMIN));
+    }
+    if (bad)
+        pd_error(0, "bindlist self-test: %d receivers: %s: wrong order or "
+            "binding", n, what);
+    return (bad);
+}
+
+    /* "pd self-test": bind n receivers to a symbol, for n on either side of
+    where bindlists get a hash table, and check who gets messages in which
+    order as we bind some of them twice, unbind them (also while sending)
+    and bind new ones. */
+int bindlist_selftest(void)
+{
+    static const int sizes[] = {2, 3, BINDLIST_HASHMIN, BINDLIST_HASHMIN + 1,
+        BINDTEST_MAXN};
+    int slots[BINDTEST_NSLOT], nslots, k, i, j, n, nbad = 0;
+    if (!bindtest_class)
+    {
+        bindtest_class = class_new(gensym("bindtest"), 0, 0,
+            sizeof(t_bindtest), CLASS_PD, 0);
+        class_addfloat(bindtest_class, bindtest_float);
+    }
+    bindtest_sym = gensym("bindlist-self-test");
+    for (i = 0; i < BINDTEST_NRECV; i++)
+    {
+        bindtest_vec[i] = (t_bindtest *)pd_new(bindtest_class);
+        bindtest_vec[i]->b_id = i;
+        for (j = 0; j < 3; j++)
+            bindtest_vec[i]->b_unbind[j] = -1;
+        bindtest_vec[i]->b_bind = -1;
+    }
+    for (k = 0; k < (int)(sizeof(sizes)/sizeof(*sizes)); k++)
+    {
+        t_bindtest *x;
+        n = sizes[k];
+        nslots = 0;
+        for (i = 0; i < n; i++)
+            bindtest_bind(slots, &nslots, i);
+        nbad += bindtest_check(n, "bind", slots, &nslots);
+            /* bind two of them a second time and unbind one of those again */
+        bindtest_bind(slots, &nslots, 0);
+        bindtest_bind(slots, &nslots, n/2);
+        nbad += bindtest_check(n, "bind twice", slots, &nslots);
+        bindtest_unbind(slots, nslots, 0);
+        nbad += bindtest_check(n, "unbind one of two", slots, &nslots);
+            /* receiver n/2, bound twice, gets the message first; it unbinds
+            itself, one we haven't reached yet and one we have, and binds a
+            new one, which shouldn't get the message until the next time */
+        x = bindtest_vec[n/2];
+        x->b_unbind[0] = n/2;
+        x->b_unbind[1] = 0;
+        x->b_unbind[2] = n - 1;
+        x->b_bind = n;
+        nbad += bindtest_check(n, "unbind while sending", slots, &nslots);
+        x->b_unbind[0] = x->b_unbind[1] = x->b_unbind[2] = x->b_bind = -1;
+        nbad += bindtest_check(n, "after sending", slots, &nslots);
+            /* unbind the rest from the middle out */
+        for (i = 0; i < nslots; i++)
+        {
+            j = (nslots / 2 + (i & 1 ? -(i + 1) / 2 : i / 2) + nslots) % nslots;
+            if (slots[j] >= 0)
+            {
+                bindtest_unbind(slots, nslots, slots[j]);
+                nbad += bindtest_check(n, "unbind", slots, &nslots);
+            }
+        }
+        if (bindtest_sym->s_thing)
+        {
+            pd_error(0, "bindlist self-test: %d receivers: still bound", n);
+            bindtest_sym->s_thing = 0;
+            nbad++;
+        }
+    }
+    for (i = 0; i < BINDTEST_NRECV; i++)
+        pd_free(&bindtest_vec[i]->b_pd);
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* stack for maintaining bindings for the #X symbol during nestable loads.
 */
 
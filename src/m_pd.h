@@ -466,6 +466,7 @@ EXTERN const t_parentwidgetbehavior *pd_getparentwidget(t_pd *x);
 #define CLASS_GOBJ 2
 #define CLASS_PATCHABLE 3
 #define CLASS_NOINLET 8
+#define CLASS_PARALLEL 16      /* DSP only touches the object's own state */
 
 #define CLASS_TYPEMASK 3
 
@@ -816,6 +817,9 @@ EXTERN_STRUCT _instanceugen;
 EXTERN_STRUCT _instancestuff;
 #define t_instancestuff struct _instancestuff
 
+EXTERN_STRUCT _symtab;
+#define t_symtab struct _symtab
+
 #ifndef PDTHREADS
 #define PDTHREADS 1
 #endif
@@ -823,7 +827,7 @@ EXTERN_STRUCT _instancestuff;
 struct _pdinstance
 {
     double pd_systime;          /* global time in Pd ticks */
-    t_clock *pd_clock_setlist;  /* list of set clocks */
+    t_clock *pd_clock_setlist;  /* earliest set clock */
     t_canvas *pd_canvaslist;    /* list of all root canvases */
     struct _template *pd_templatelist;  /* list of all templates */
     int pd_instanceno;          /* ordinal number of this instance */
@@ -851,6 +855,7 @@ struct _pdinstance
 #if PDTHREADS
     int pd_islocked;
 #endif
+    t_symtab *pd_symtab;        /* table gensym() looks symbols up in */
 };
 #define t_pdinstance struct _pdinstance
 EXTERN t_pdinstance pd_maininstance;
@@ -7,6 +7,8 @@
 #include "m_pd.h"
 #include "m_imp.h"
 #include "s_stuff.h"
+#include <string.h>
+#include <math.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -22,6 +24,8 @@ static int sys_quit;
 
 int sys_usecsincelastsleep(void);
 int sys_sleepgrain;
+int sys_pollthread;         /* read input on the main thread in callback mode */
+int sys_pollthreadrunning;  /* ... and it's doing so now */
 
 typedef void (*t_clockmethod)(void *client);
 
@@ -30,7 +34,8 @@ struct _clock
     double c_settime;       /* in TIMEUNITS; <0 if unset */
     void *c_owner;
     t_clockmethod c_fn;
-    struct _clock *c_next;
+    double c_seq;           /* order in which set clocks were set */
+    int c_index;            /* position in clock heap if set */
     t_float c_unit;         /* >0 if in TIMEUNITS; <0 if in samples */
 };
 
@@ -44,24 +49,85 @@ t_clock *clock_new(void *owner, t_method fn)
     x->c_settime = -1;
     x->c_owner = owner;
     x->c_fn = (t_clockmethod)fn;
-    x->c_next = 0;
+    x->c_seq = 0;
+    x->c_index = -1;
     x->c_unit = TIMEUNITPERMSEC;
     return (x);
 }
 
+/* Set clocks are kept in a 4-ary heap ordered by time, so that setting and
+unsetting take time proportional to the log of the number of set clocks.
+Clocks set to the same time go off in the order they were set, which we
+get by comparing the number of the clock_set() call that set them. */
+
+#define CLOCKHEAPARITY 4
+
+#define clock_before(a, b) ((a)->c_settime < (b)->c_settime || \
+    ((a)->c_settime == (b)->c_settime && (a)->c_seq < (b)->c_seq))
+
+static void clock_heapput(t_clock *x, int i)
+{
+    STUFF->st_clockheap[i] = x;
+    x->c_index = i;
+}
+
+    /* move a clock toward the top of the heap until it's in order */
+static void clock_siftup(t_clock *x, int i)
+{
+    t_clock **heap = STUFF->st_clockheap;
+    while (i > 0)
+    {
+        int parent = (i - 1) / CLOCKHEAPARITY;
+        if (!clock_before(x, heap[parent]))
+            break;
+        clock_heapput(heap[parent], i);
+        i = parent;
+    }
+    clock_heapput(x, i);
+}
+
+    /* ... and toward the bottom */
+static void clock_siftdown(t_clock *x, int i)
+{
+    t_clock **heap = STUFF->st_clockheap;
+    int n = STUFF->st_nclock;
+    while (1)
+    {
+        int first = CLOCKHEAPARITY * i + 1, last = first + CLOCKHEAPARITY,
+            j, best;
+        if (first >= n)
+            break;
+        if (last > n)
+            last = n;
+        for (best = first, j = first + 1; j < last; j++)
+            if (clock_before(heap[j], heap[best]))
+                best = j;
+        if (!clock_before(heap[best], x))
+            break;
+        clock_heapput(heap[best], i);
+        i = best;
+    }
+    clock_heapput(x, i);
+}
+
 void clock_unset(t_clock *x)
 {
     if (x->c_settime >= 0)
     {
-        if (x == pd_this->pd_clock_setlist)
-            pd_this->pd_clock_setlist = x->c_next;
-        else
+        int i = x->c_index;
+        t_clock *last = STUFF->st_clockheap[--STUFF->st_nclock];
+        if (last != x)
         {
-            t_clock *x2 = pd_this->pd_clock_setlist;
-            while (x2->c_next != x) x2 = x2->c_next;
-            x2->c_next = x->c_next;
+                /* put the last clock in the hole and restore the order */
+            if (i > 0 && clock_before(last,
+                STUFF->st_clockheap[(i - 1) / CLOCKHEAPARITY]))
+                    clock_siftup(last, i);
+            else clock_siftdown(last, i);
         }
+        pd_this->pd_clock_setlist =
+            (STUFF->st_nclock ? STUFF->st_clockheap[0] : 0);
         x->c_settime = -1;
+        x->c_index = -1;
     }
 }
 
@@ -71,23 +137,18 @@ void clock_set(t_clock *x, double setticks)
     if (setticks < pd_this->pd_systime) setticks = pd_this->pd_systime;
     clock_unset(x);
     x->c_settime = setticks;
-    if (pd_this->pd_clock_setlist &&
-        pd_this->pd_clock_setlist->c_settime <= setticks)
+    x->c_seq = STUFF->st_clockseq++;
+    if (STUFF->st_nclock == STUFF->st_clockheapsize)
     {
-        t_clock *cbefore, *cafter;
-        for (cbefore = pd_this->pd_clock_setlist,
-            cafter = pd_this->pd_clock_setlist->c_next;
-                cbefore; cbefore = cafter, cafter = cbefore->c_next)
-        {
-            if (!cafter || cafter->c_settime > setticks)
-            {
-                cbefore->c_next = x;
-                x->c_next = cafter;
-                return;
-            }
-        }
+        int newsize = (STUFF->st_clockheapsize ?
+            2 * STUFF->st_clockheapsize : 64);
+        STUFF->st_clockheap = (t_clock **)resizebytes(STUFF->st_clockheap,
+            STUFF->st_clockheapsize * sizeof(t_clock *),
+                newsize * sizeof(t_clock *));
+        STUFF->st_clockheapsize = newsize;
     }
-    else x->c_next = pd_this->pd_clock_setlist, pd_this->pd_clock_setlist = x;
+    clock_siftup(x, STUFF->st_nclock++);
+    pd_this->pd_clock_setlist = STUFF->st_clockheap[0];
 }
 
     /* set the clock to call back after a delay in msec */
@@ -165,6 +226,124 @@ void clock_free(t_clock *x)
     freebytes(x, sizeof *x);
 }
 
+#ifdef PD_BENCHMARKS
+
+    /* "pd clock-benchmark <n>": set n clocks (default a million) to
+    pseudo-random times with plenty of ties, move half of them, then take
+    them off the heap in order as sched_tick() would, checking the order
+    as we go.  The clocks are never called back. */
+static void clock_benchmarkfn(void *dummy) {}
+
+void glob_clockbenchmark(void *dummy, t_floatarg f)
+{
+    int n = (f >= 1 ? f : 1000000), i, nbad = 0;
+    unsigned int seed = 1;
+    t_clock **vec = (t_clock **)getbytes(n * sizeof(*vec)), *c;
+    double prevtime = -1, prevseq = -1,
+        starttime, settime, resettime, unsettime;
+    if (STUFF->st_nclock)
+    {
+        pd_error(0, "clock-benchmark: can't run while clocks are set");
+        freebytes(vec, n * sizeof(*vec));
+        return;
+    }
+    for (i = 0; i < n; i++)
+        vec[i] = clock_new(0, (t_method)clock_benchmarkfn);
+    starttime = sys_getrealtime();
+    for (i = 0; i < n; i++)
+    {
+        seed = seed * 435898247 + 382842987;
+        clock_set(vec[i], pd_this->pd_systime + (seed >> 20));
+    }
+    settime = sys_getrealtime();
+    for (i = 0; i < n; i += 2)
+    {
+        seed = seed * 435898247 + 382842987;
+        clock_set(vec[i], pd_this->pd_systime + (seed >> 20));
+    }
+    resettime = sys_getrealtime();
+    while (pd_this->pd_clock_setlist)
+    {
+        c = pd_this->pd_clock_setlist;
+        if (c->c_settime < prevtime ||
+            (c->c_settime == prevtime && c->c_seq < prevseq))
+                nbad++;
+        prevtime = c->c_settime;
+        prevseq = c->c_seq;
+        clock_unset(c);
+    }
+    unsettime = sys_getrealtime();
+    post("clock-benchmark: %d clocks: set %.1f msec, reset %.1f msec, "
+        "expire %.1f msec", n, 1000 * (settime - starttime),
+            1000 * (resettime - settime), 1000 * (unsettime - resettime));
+    if (nbad)
+        pd_error(0, "clock-benchmark: %d clocks out of order", nbad);
+    for (i = 0; i < n; i++)
+        clock_free(vec[i]);
+    freebytes(vec, n * sizeof(*vec));
+}
+
+    /* check the heap's order and each clock's idea of where it is in it;
+    returns the number of clocks out of place */
+static int clock_checkheap(void)
+{
+    t_clock **heap = STUFF->st_clockheap;
+    int i, nbad = 0;
+    for (i = 0; i < STUFF->st_nclock; i++)
+        if (heap[i]->c_index != i || (i > 0 &&
+            clock_before(heap[i], heap[(i - 1) / CLOCKHEAPARITY])))
+                nbad++;
+    return (nbad);
+}
+
+    /* "pd self-test": set, reset and unset clocks at random, many of them
+    to the same times, checking the heap as we go.  If no other clocks are
+    set, also check that they come out in order of time and then of
+    setting. */
+int clock_selftest(void)
+{
+    int n = 5000, nclock = STUFF->st_nclock, i, nbad = 0;
+    unsigned int seed = 1;
+    t_clock **vec = (t_clock **)getbytes(n * sizeof(*vec)), *c;
+    double prevtime = -1, prevseq = -1;
+    for (i = 0; i < n; i++)
+        vec[i] = clock_new(0, (t_method)clock_benchmarkfn);
+    for (i = 0; i < 4 * n; i++)
+    {
+        seed = seed * 435898247 + 382842987;
+        c = vec[(seed >> 8) % n];
+        if ((seed >> 28) < 4)
+            clock_unset(c);
+        else clock_set(c, pd_this->pd_systime + (seed & 15));
+        if (!(i % 97))
+            nbad += clock_checkheap();
+    }
+    nbad += clock_checkheap();
+    if (!nclock)
+    {
+        while ((c = pd_this->pd_clock_setlist))
+        {
+            if (c->c_settime < prevtime ||
+                (c->c_settime == prevtime && c->c_seq < prevseq))
+                    nbad++;
+            prevtime = c->c_settime;
+            prevseq = c->c_seq;
+            clock_unset(c);
+        }
+    }
+    for (i = 0; i < n; i++)
+        clock_free(vec[i]);
+    if (STUFF->st_nclock != nclock)
+        nbad++;
+    nbad += clock_checkheap();
+    freebytes(vec, n * sizeof(*vec));
+    if (nbad)
+        pd_error(0, "clock self-test: %d errors", nbad);
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* the following routines maintain a real-execution-time histogram of the
 various phases of real-time execution. */
 
@@ -430,6 +609,228 @@ void sched_tick(void)
     sched_diddsp++;
 }
 
+#ifdef PD_BENCHMARKS
+
+void ugen_start(void);
+void ugen_done_chain(void);
+void ugen_stop(void);
+void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
+void canvas_loadbang(t_canvas *x);
+
+    /* compute "nticks" ticks of a patch by itself, optionally copying the
+    first two output channels to "record" (two vectors of nticks ticks, one
+    after the other), and return the time it took */
+static double schedbench_run(t_canvas *x, int nticks, t_sample *record)
+{
+    int size = STUFF->st_schedblocksize, i,
+        nout = (STUFF->st_outchannels ? STUFF->st_outchannels : 2) * size;
+    double starttime, elapsed;
+    ugen_start();
+    canvas_dodsp(x, 1, 0);
+    ugen_done_chain();
+    starttime = sys_getrealtime();
+    for (i = 0; i < nticks && !sys_quit; i++)
+    {
+        sched_tick();
+        if (record)
+        {
+            memcpy(record + i * size, STUFF->st_soundout,
+                size * sizeof(t_sample));
+            memcpy(record + (nticks + i) * size, STUFF->st_soundout + size,
+                size * sizeof(t_sample));
+        }
+            /* zero the output as sys_send_dacs() would */
+        memset(STUFF->st_soundout, 0, nout * sizeof(t_sample));
+    }
+    elapsed = sys_getrealtime() - starttime;
+    ugen_stop();
+    return (elapsed);
+}
+
+    /* "pd schedblock-benchmark <file> <dir> [sec]": for each scheduler
+    block size from DEFDACBLKSIZE to MAXSCHEDBLKSIZE, open a patch, run "sec"
+    seconds of it (default 10) as fast as we can, and report the time per
+    sample.  Only the patch we open is computed; DSP for any others is
+    suspended meanwhile.  Audio devices are opened for a fixed block size, so
+    this only runs with audio closed, e.g., with "-nosound". */
+void glob_schedblockbenchmark(void *dummy, t_symbol *name, t_symbol *dir,
+    t_floatarg fsec)
+{
+    double sec = (fsec > 0 ? fsec : 10);
+    int oldsize = STUFF->st_schedblocksize, dspstate, size;
+    if (audio_isopen())
+    {
+        pd_error(0, "schedblock-benchmark: can't run with audio open");
+        return;
+    }
+    dspstate = canvas_suspend_dsp();
+    for (size = DEFDACBLKSIZE; size <= MAXSCHEDBLKSIZE; size *= 2)
+    {
+        t_canvas *x;
+        int nticks;
+        double elapsed;
+        sys_setschedblocksize(size);
+        if (!STUFF->st_soundin)
+            sys_setchsr(STUFF->st_inchannels, STUFF->st_outchannels,
+                STUFF->st_dacsr);
+        if (!(x = (t_canvas *)glob_evalfile(0, name, dir)))
+        {
+            pd_error(0, "schedblock-benchmark: %s/%s: couldn't open",
+                dir->s_name, name->s_name);
+            break;
+        }
+        if ((nticks = sec * STUFF->st_dacsr / size) < 1)
+            nticks = 1;
+        elapsed = schedbench_run(x, nticks, 0);
+        pd_free((t_pd *)x);
+        if (sys_quit)
+            break;
+        elapsed /= (double)nticks * size;
+        post("schedblock-benchmark: block size %4d: %.2f nsec per sample "
+            "(%.1f%% of real time)", size, 1e9 * elapsed,
+                100 * elapsed * STUFF->st_dacsr);
+    }
+    sys_setschedblocksize(oldsize);
+    canvas_resume_dsp(dspstate);
+}
+
+    /* make a patch from text, the way glob_evalfile() does from a file; for
+    the self-tests of DSP objects */
+t_canvas *sched_newtestpatch(const char *text)
+{
+    t_binbuf *b = binbuf_new();
+    t_pd *x = 0, *boundx = s__X.s_thing, *boundn = s__N.s_thing;
+    binbuf_text(b, text, strlen(text));
+    glob_setfilename(0, gensym("self-test.pd"), gensym("."));
+    s__X.s_thing = 0;
+    s__N.s_thing = &pd_canvasmaker;
+    binbuf_eval(b, 0, 0, 0);
+    glob_setfilename(0, &s_, &s_);
+    while ((x != s__X.s_thing) && s__X.s_thing)
+    {
+        x = s__X.s_thing;
+        vmess(x, gensym("pop"), "i", 0);
+    }
+    s__X.s_thing = boundx;
+    s__N.s_thing = boundn;
+    binbuf_free(b);
+    if (x)
+        canvas_loadbang((t_canvas *)x);
+    return ((t_canvas *)x);
+}
+
+    /* make a patch from text and compute "nsamples" of it by itself at the
+    current scheduler block size (which should divide it), copying the
+    first two output channels to "record": the left one, then the right.
+    Returns 0 if that can't be done. */
+int sched_rendertestpatch(const char *text, int nsamples, t_sample *record)
+{
+    int nout = STUFF->st_outchannels, dspstate, ok = 0;
+    t_canvas *x;
+    if (audio_isopen())
+        return (0);
+    dspstate = canvas_suspend_dsp();
+        /* dac~ only writes to channels we have, and with "-nosound" there
+        are none */
+    sys_setchsr(STUFF->st_inchannels, (nout < 2 ? 2 : nout), STUFF->st_dacsr);
+    if ((x = sched_newtestpatch(text)))
+    {
+        schedbench_run(x, nsamples / STUFF->st_schedblocksize, record);
+        pd_free((t_pd *)x);
+        ok = 1;
+    }
+    sys_setchsr(STUFF->st_inchannels, nout, STUFF->st_dacsr);
+    canvas_resume_dsp(dspstate);
+    return (ok);
+}
+
+    /* vline~ schedules its segments in logical time, whose rounding
+    depends on where the ticks fall; a sample late would be off by 0.0045 */
+#define SCHEDTEST_MAXDIFF 1e-3
+
+    /* check that a patch puts out the same samples at every scheduler
+    block size as at DEFDACBLKSIZE.  The left channel has a filtered
+    oscillator, a subpatch reblocked to 32 and a delay line, and has to
+    agree exactly; the right one has a metro driving vline~, which has to
+    agree to within SCHEDTEST_MAXDIFF. */
+int schedblock_selftest(void)
+{
+    static const char *patch =
+        "#N canvas 0 0 450 300 12;\n"
+        "#X obj 10 10 osc~ 441;\n"
+        "#X obj 10 40 lop~ 500;\n"
+        "#N canvas 0 0 450 300 sub 0;\n"
+        "#X obj 10 10 inlet~;\n"
+        "#X obj 10 40 hip~ 100;\n"
+        "#X obj 10 70 outlet~;\n"
+        "#X obj 100 10 block~ 32;\n"
+        "#X obj 100 40 phasor~ 30;\n"
+        "#X connect 0 0 1 0;\n"
+        "#X connect 1 0 2 0;\n"
+        "#X connect 4 0 2 0;\n"
+        "#X restore 10 70 pd sub;\n"
+        "#X obj 10 100 delwrite~ \\$0-d 1000;\n"
+        "#X obj 10 130 delread~ \\$0-d 100;\n"
+        "#X obj 10 160 +~;\n"
+        "#X obj 10 190 dac~;\n"
+        "#X obj 200 10 loadbang;\n"
+        "#X obj 200 40 metro 7.3;\n"
+        "#X obj 200 70 f;\n"
+        "#X obj 240 70 + 1;\n"
+        "#X msg 200 100 \\$1 5;\n"
+        "#X obj 200 130 vline~;\n"
+        "#X connect 0 0 1 0;\n"
+        "#X connect 1 0 2 0;\n"
+        "#X connect 2 0 3 0;\n"
+        "#X connect 2 0 5 1;\n"
+        "#X connect 4 0 5 0;\n"
+        "#X connect 5 0 6 0;\n"
+        "#X connect 7 0 8 0;\n"
+        "#X connect 8 0 9 0;\n"
+        "#X connect 9 0 10 0;\n"
+        "#X connect 10 0 9 1;\n"
+        "#X connect 9 0 11 0;\n"
+        "#X connect 11 0 12 0;\n"
+        "#X connect 12 0 6 1;\n";
+    int oldsize = STUFF->st_schedblocksize, nsamples = 8 * MAXSCHEDBLKSIZE,
+        dspstate, size, i, nbad = 0;
+    t_sample *ref = (t_sample *)getbytes(2 * nsamples * sizeof(t_sample)),
+        *out = (t_sample *)getbytes(2 * nsamples * sizeof(t_sample));
+    if (audio_isopen())
+        return (0);
+    dspstate = canvas_suspend_dsp();
+    for (size = DEFDACBLKSIZE; size <= MAXSCHEDBLKSIZE; size *= 2)
+    {
+        int ndiff = 0;
+        sys_setschedblocksize(size);
+        if (!sched_rendertestpatch(patch, nsamples,
+            (size == DEFDACBLKSIZE ? ref : out)))
+        {
+            nbad++;
+            break;
+        }
+        if (size == DEFDACBLKSIZE)
+            continue;
+        for (i = 0; i < nsamples; i++)
+            if (out[i] != ref[i] ||
+                fabs(out[nsamples + i] - ref[nsamples + i]) > SCHEDTEST_MAXDIFF)
+                    ndiff++;
+        if (ndiff)
+        {
+            pd_error(0, "schedblock self-test: block size %d: %d of %d "
+                "samples differ", size, ndiff, nsamples);
+            nbad++;
+        }
+    }
+    sys_setschedblocksize(oldsize);
+    canvas_resume_dsp(dspstate);
+    freebytes(ref, 2 * nsamples * sizeof(t_sample));
+    freebytes(out, 2 * nsamples * sizeof(t_sample));
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /*
 Here is Pd's "main loop."  This routine dispatches clock timeouts and DSP
 "ticks" deterministically, and polls for input from MIDI and the GUI.  If
@@ -476,6 +877,7 @@ static void m_pollingscheduler(void)
         {
             double beforetick = pd_this->pd_systime;
             sched_tick();
+            resettmpbytes();
             sched_fastforward -= clock_gettimesince(beforetick);
         }
         if (sched_useaudio != SCHED_AUDIO_NONE)
@@ -527,7 +929,10 @@ static void m_pollingscheduler(void)
         sys_setmiditimediff(0, 1e-6 * sys_schedadvance);
         sys_addhist(1);
         if (timeforward != SENDDACS_NO)
+        {
             sched_tick();
+            resettmpbytes();
+        }
         if (timeforward == SENDDACS_YES)
             didsomething = 1;
 
@@ -549,9 +954,22 @@ static void m_pollingscheduler(void)
                 /* call externally installed idle function if any. */
             if (!sys_idlehook || !sys_idlehook())
             {
-                    /* if even that had nothing to do, sleep. */
+                    /* if even that had nothing to do, sleep.  Without
+                    audio we know when the next tick is due, so don't
+                    oversleep it; incoming messages wake us early anyway. */
                 if (timeforward != SENDDACS_SLEPT)
-                    sys_microsleep(sys_sleepgrain);
+                {
+                    int sleeptime = sys_sleepgrain;
+                    if (sched_useaudio == SCHED_AUDIO_NONE)
+                    {
+                        double untiltick = 1000. *
+                            clock_gettimesince(sched_referencelogicaltime) -
+                            1e6 * (sys_getrealtime() - sched_referencerealtime);
+                        if (untiltick < sleeptime)
+                            sleeptime = (untiltick > 0 ? untiltick : 0);
+                    }
+                    sys_microsleep(sleeptime);
+                }
             }
             sys_lock();
             sys_addhist(5);
@@ -561,12 +979,44 @@ static void m_pollingscheduler(void)
     sys_unlock();
 }
 
+    /* statistics for "pd callback-stats": how many audio callbacks took
+    longer than the block they compute lasts, so that the audio device
+    missed its deadline unless it had time to spare from earlier blocks,
+    how many found the Pd lock taken by another thread and waited for it,
+    and how many skipped their tick instead. */
+static int sched_ncallbacks, sched_nlate, sched_nlockwaits, sched_nskipped;
+static double sched_maxcallbacktime, sched_lockwaittime;
+
 void sched_audio_callbackfn(void)
 {
+    double starttime = sys_getrealtime(), elapsed;
+#if PDTHREADS
+    if (sys_trylock())
+    {
+            /* with the poll thread, nothing that should hold the lock
+            for long runs elsewhere, so rather than wait (and maybe miss
+            more than this block's deadline) we skip the tick: the audio
+            device gets the silence it was handed and the input is lost.
+            Otherwise the GUI may be in the middle of something and we
+            have to wait for it. */
+        if (sys_pollthreadrunning)
+        {
+            sched_ncallbacks++;
+            sched_nskipped++;
+            return;
+        }
+        sys_lock();
+        sched_nlockwaits++;
+        sched_lockwaittime += sys_getrealtime() - starttime;
+    }
+#else
     sys_lock();
+#endif
+    memory_realtime(1);
     sys_setmiditimediff(0, 1e-6 * sys_schedadvance);
     sys_addhist(1);
     sched_tick();
+    resettmpbytes();
     sys_addhist(2);
     sys_pollmidiqueue();
     sys_addhist(3);
@@ -574,30 +1024,81 @@ void sched_audio_callbackfn(void)
     sys_addhist(5);
     sched_pollformeters();
     sys_addhist(0);
+    memory_realtime(0);
+    elapsed = sys_getrealtime() - starttime;
+    sched_ncallbacks++;
+    if (elapsed > STUFF->st_schedblocksize / STUFF->st_dacsr)
+        sched_nlate++;
+    if (elapsed > sched_maxcallbacktime)
+        sched_maxcallbacktime = elapsed;
     sys_unlock();
 }
 
+    /* "pd callback-stats [reset]" */
+void glob_callbackstats(void *dummy, t_symbol *s)
+{
+    post("callback-stats: %d callbacks, %d late (over %.2f msec), "
+        "longest %.2f msec; %d waited %.2f msec for the lock, %d skipped "
+        "their tick; poll thread %s", sched_ncallbacks, sched_nlate,
+            1000. * STUFF->st_schedblocksize / STUFF->st_dacsr,
+                1000. * sched_maxcallbacktime, sched_nlockwaits,
+                    1000. * sched_lockwaittime, sched_nskipped,
+                        (sys_pollthreadrunning ? "on" : "off"));
+    if (s == gensym("reset"))
+    {
+        sched_ncallbacks = sched_nlate = sched_nlockwaits =
+            sched_nskipped = 0;
+        sched_maxcallbacktime = sched_lockwaittime = 0;
+    }
+}
+
 static void m_callbackscheduler(void)
 {
     sys_initmidiqueue();
+    if (sys_pollthread)
+    {
+        sys_lock();
+        sys_pollthreadrunning = 1;
+        sys_unlock();
+    }
     while (!sys_quit)
     {
         double timewas = pd_this->pd_systime;
+        if (sys_pollthreadrunning)
+        {
+                /* wait for input instead of sleeping, for about a second */
+            double waketime = sys_getrealtime() + 1;
+            int grain = (sys_sleepgrain >= 100 ? sys_sleepgrain : 1000);
+            while (!sys_quit && sys_getrealtime() < waketime)
+                sys_pollthread_wait(grain);
+        }
+        else
+        {
 #ifdef _WIN32
-        Sleep(1000);
+            Sleep(1000);
 #else
-        sleep(1);
+            sleep(1);
 #endif
+        }
         if (pd_this->pd_systime == timewas)
         {
             sys_lock();
             sys_pollgui();
             sched_tick();
+            resettmpbytes();
             sys_unlock();
         }
         if (sys_idlehook)
             sys_idlehook();
     }
+    if (sys_pollthreadrunning)
+    {
+            /* take care of whatever we handed over but nobody picked up */
+        sys_lock();
+        sys_pollgui();
+        sys_pollthreadrunning = 0;
+        sys_unlock();
+    }
 }
 
 int m_mainloop(void)
@@ -623,7 +1124,10 @@ int m_mainloop(void)
 int m_batchmain(void)
 {
     while (sys_quit != SYS_QUIT_QUIT)
+    {
         sched_tick();
+        resettmpbytes();
+    }
     return (0);
 }
 
@@ -0,0 +1,17 @@
+/* Copyright (c) 1997-1999 Miller Puckette.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* symbol name hashing, private to the symbol table (m_class.c) and the
+parser in binbuf_text() (m_binbuf.c). */
+
+#pragma once
+
+#include "m_pd.h"
+
+    /* symbol names are hashed with djb2, one char at a time; gensym_hashed()
+    takes a name that is "length" chars long, not necessarily terminated,
+    along with its hash, so that a parser can hash as it scans. */
+#define SYMHASH_INIT 5381
+#define SYMHASH_ADD(hash, c) (((hash) << 5) + (hash) + (c))
+t_symbol *gensym_hashed(const char *s, int length, unsigned int hash);
@@ -125,7 +125,7 @@ SRC = g_canvas.c g_graph.c g_text.c g_rtext.c g_array.c g_template.c g_io.c \
     d_soundfile_next.c d_soundfile_wave.c \
     x_arithmetic.c x_connective.c x_interface.c x_midi.c x_misc.c \
     x_time.c x_acoustics.c x_net.c x_text.c x_gui.c x_list.c x_array.c \
-    x_scalar.c  x_vexp.c x_vexp_if.c x_vexp_fun.c \
+    x_scalar.c  x_vexp.c x_vexp_if.c x_vexp_fun.c x_vexp_comp.c \
     $(SYSSRC)
 
 OBJ = $(SRC:.c=.o) 
@@ -190,31 +190,36 @@ static void audio_init(void)
 #endif
 }
 
+    /* block size the sound buffers were last allocated for */
+static int audio_soundblocksize;
+
     /* set channels and sample rate.  */
 
 void sys_setchsr(int chin, int chout, int sr)
 {
+    int blocksize = STUFF->st_schedblocksize;
     int inbytes = (chin ? chin : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample));
+                (blocksize*sizeof(t_sample));
     int outbytes = (chout ? chout : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample));
+                (blocksize*sizeof(t_sample));
 
     if (STUFF->st_soundin)
         freebytes(STUFF->st_soundin,
             (STUFF->st_inchannels? STUFF->st_inchannels : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample)));
+                (audio_soundblocksize*sizeof(t_sample)));
     if (STUFF->st_soundout)
         freebytes(STUFF->st_soundout,
             (STUFF->st_outchannels? STUFF->st_outchannels : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample)));
+                (audio_soundblocksize*sizeof(t_sample)));
+    audio_soundblocksize = blocksize;
     STUFF->st_inchannels = chin;
     STUFF->st_outchannels = chout;
     if (!audio_isfixedsr())
         STUFF->st_dacsr = sr;
 
     sys_advance_samples = (sys_schedadvance * STUFF->st_dacsr) / (1000000.);
-    if (sys_advance_samples < DEFDACBLKSIZE)
-        sys_advance_samples = DEFDACBLKSIZE;
+    if (sys_advance_samples < blocksize)
+        sys_advance_samples = blocksize;
 
     STUFF->st_soundin = (t_sample *)getbytes(inbytes);
     memset(STUFF->st_soundin, 0, inbytes);
@@ -228,6 +233,27 @@ void sys_setchsr(int chin, int chout, int sr)
     canvas_resume_dsp(canvas_suspend_dsp());
 }
 
+    /* set the number of sample frames the scheduler computes per tick.  It
+    is rounded down to a power of two between DEFDACBLKSIZE and
+    MAXSCHEDBLKSIZE.  Some objects, like send~ and throw~, size their
+    buffers from sys_getblksize() when they're created, so this is meant to
+    be set at startup (by "-schedblocksize"), before any patch is open.
+    Audio devices opened after this transfer blocks of this size. */
+void sys_setschedblocksize(int n)
+{
+    if (n < DEFDACBLKSIZE)
+        n = DEFDACBLKSIZE;
+    else if (n > MAXSCHEDBLKSIZE)
+        n = MAXSCHEDBLKSIZE;
+    n = 1 << ilog2(n);
+    if (n == STUFF->st_schedblocksize)
+        return;
+    STUFF->st_schedblocksize = n;
+    if (STUFF->st_soundin)
+        sys_setchsr(STUFF->st_inchannels, STUFF->st_outchannels,
+            STUFF->st_dacsr);
+}
+
 /* ----------------------- public routines ----------------------- */
 
     /* set audio device settings (after cleaning up the specified device and
@@ -263,8 +289,9 @@ void sys_set_audio_settings(int naudioindev, int *audioindev, int nchindev,
         rate = DEFAULTSRATE;
     if (advance < 0)
         advance = DEFAULTADVANCE;
-    if (blocksize != (1 << ilog2(blocksize)) || blocksize < DEFDACBLKSIZE)
-        blocksize = DEFDACBLKSIZE;
+    if (blocksize != (1 << ilog2(blocksize)) ||
+        blocksize < STUFF->st_schedblocksize)
+            blocksize = STUFF->st_schedblocksize;
      audio_init();
         /* Since the channel vector might be longer than the
         audio device vector, or vice versa, we fill the shorter one
@@ -473,7 +500,8 @@ void sys_reopen_audio(void)
 #ifdef USEAPI_PORTAUDIO
     if (sys_audioapi == API_PORTAUDIO)
     {
-        int blksize = (audio_blocksize ? audio_blocksize : 64);
+        int blksize = (audio_blocksize > STUFF->st_schedblocksize ?
+            audio_blocksize : STUFF->st_schedblocksize);
         int nbufs = sys_advance_samples / blksize;
         if (nbufs < 1) nbufs = 1;
         if (sys_verbose)
@@ -563,7 +591,7 @@ int sys_send_dacs(void)
     {
         int i, n;
         t_sample maxsamp;
-        for (i = 0, n = sys_inchannels * DEFDACBLKSIZE, maxsamp = sys_inmax;
+        for (i = 0, n = sys_inchannels * STUFF->st_schedblocksize, maxsamp = sys_inmax;
             i < n; i++)
         {
             t_sample f = STUFF->st_soundin[i];
@@ -571,7 +599,7 @@ int sys_send_dacs(void)
             else if (-f > maxsamp) maxsamp = -f;
         }
         sys_inmax = maxsamp;
-        for (i = 0, n = STUFF->st_outchannels * DEFDACBLKSIZE,
+        for (i = 0, n = STUFF->st_outchannels * STUFF->st_schedblocksize,
             maxsamp = sys_outmax; i < n; i++)
         {
             t_sample f = STUFF->st_soundout[i];
@@ -915,8 +943,8 @@ void sys_set_audio_settings_reopen(int naudioindev, int *audioindev, int nchinde
     if (callback < 0)
         callback = 0;
     if (newblocksize != (1<<ilog2(newblocksize)) ||
-        newblocksize < DEFDACBLKSIZE || newblocksize > 2048)
-            newblocksize = DEFDACBLKSIZE;
+        newblocksize < STUFF->st_schedblocksize || newblocksize > 2048)
+            newblocksize = STUFF->st_schedblocksize;
 
     if (!audio_callback_is_open && !callback)
         sys_close_audio();
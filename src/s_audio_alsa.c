@@ -204,7 +204,7 @@ static int alsaio_setup(t_alsa_dev *dev, int out, int *channels, int *rate,
     if (err < 0)
         return (-1);
         /* set up the buffer */
-    bufsizeforthis = DEFDACBLKSIZE * dev->a_sampwidth * *channels;
+    bufsizeforthis = STUFF->st_schedblocksize * dev->a_sampwidth * *channels;
     if (alsa_snd_buf)
     {
         if (alsa_snd_bufsize < bufsizeforthis)
@@ -446,7 +446,7 @@ int alsa_send_dacs(void)
 
     chansintogo = STUFF->st_inchannels;
     chansouttogo = STUFF->st_outchannels;
-    transfersize = DEFDACBLKSIZE;
+    transfersize = STUFF->st_schedblocksize;
 
     timelast = timenow;
     timenow = sys_getrealtime();
@@ -501,21 +501,21 @@ int alsa_send_dacs(void)
 
         if (alsa_outdev[iodev].a_sampwidth == 4)
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
+                for (j = i, k = transfersize, fp2 = fp1; k--;
                      j += thisdevchans, fp2++)
             {
                 t_sample s1 = *fp2 * INT32_MAX;
                 ((t_alsa_sample32 *)alsa_snd_buf)[j] = CLIP32(s1);
             }
             for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
+                for (j = i, k = transfersize; k--; j += thisdevchans)
                     ((t_alsa_sample32 *)alsa_snd_buf)[j] = 0;
         }
         else if (alsa_outdev[iodev].a_sampwidth == 3)
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
+                for (j = i, k = transfersize, fp2 = fp1; k--;
                      j += thisdevchans, fp2++)
             {
                 int s = *fp2 * 8388352.;
@@ -532,15 +532,15 @@ int alsa_send_dacs(void)
 #endif
             }
             for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
+                for (j = i, k = transfersize; k--; j += thisdevchans)
                     ((char *)(alsa_snd_buf))[3*j] =
                     ((char *)(alsa_snd_buf))[3*j+1] =
                     ((char *)(alsa_snd_buf))[3*j+2] = 0;
         }
         else        /* 16 bit samples */
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
+                for (j = ch, k = transfersize, fp2 = fp1; k--;
                      j += thisdevchans, fp2++)
             {
                 int s = *fp2 * 32767.;
@@ -551,7 +551,7 @@ int alsa_send_dacs(void)
                 ((t_alsa_sample16 *)alsa_snd_buf)[j] = s;
             }
             for (; i < thisdevchans; i++, ch++)
-                for (j = ch, k = DEFDACBLKSIZE; k--; j += thisdevchans)
+                for (j = ch, k = transfersize; k--; j += thisdevchans)
                     ((t_alsa_sample16 *)alsa_snd_buf)[j] = 0;
         }
         result = snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
@@ -582,7 +582,7 @@ int alsa_send_dacs(void)
         }
 
         /* zero out the output buffer */
-        memset(STUFF->st_soundout, 0, DEFDACBLKSIZE * sizeof(*STUFF->st_soundout) *
+        memset(STUFF->st_soundout, 0, transfersize * sizeof(*STUFF->st_soundout) *
                STUFF->st_outchannels);
         if (sys_getrealtime() - timenow > 0.002)
         {
@@ -628,9 +628,9 @@ int alsa_send_dacs(void)
         }
         if (alsa_indev[iodev].a_sampwidth == 4)
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
             {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+                for (j = ch, k = transfersize, fp2 = fp1; k--;
                      j += thisdevchans, fp2++)
                     *fp2 = (t_sample) ((t_alsa_sample32 *)alsa_snd_buf)[j]
                         * (1./ INT32_MAX);
@@ -639,9 +639,9 @@ int alsa_send_dacs(void)
         else if (alsa_indev[iodev].a_sampwidth == 3)
         {
 #if BYTE_ORDER == LITTLE_ENDIAN
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
             {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+                for (j = ch, k = transfersize, fp2 = fp1; k--;
                      j += thisdevchans, fp2++)
                     *fp2 = ((t_sample) (
                         (((unsigned char *)alsa_snd_buf)[3*j] << 8)
@@ -655,9 +655,9 @@ int alsa_send_dacs(void)
         }
         else
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
+            for (i = 0; i < chans; i++, ch++, fp1 += transfersize)
             {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
+                for (j = ch, k = transfersize, fp2 = fp1; k--;
                     j += thisdevchans, fp2++)
                         *fp2 = (t_sample) ((t_alsa_sample16 *)alsa_snd_buf)[j]
                             * 3.051850e-05;
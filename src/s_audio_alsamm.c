@@ -203,6 +203,8 @@ int alsamm_open_audio(int rate, int blocksize)
   snd_pcm_hw_params_alloca(&hw_params);
   snd_pcm_sw_params_alloca(&sw_params);
 
+  alsamm_transfersize = STUFF->st_schedblocksize;
+
   /* see add_devname */
   /* first have a look which cards we can get and
      set up device infos for them */
@@ -1029,7 +1031,7 @@ static int alsamm_stop()
 /* I see: (a guess as a documentation)
 
    all DAC data is in sys_soundout array with
-   DEFDACBLKSIZE (mostly 64) for each channels which
+   st_schedblocksize (mostly 64) for each channels which
    if we have more channels opened then dac-channels = sys_outchannels
    we have to zero (silence them), which should be done once.
 
@@ -47,10 +47,11 @@ static int pollprocess(jack_nframes_t nframes, void *arg)
 {
     int j;
     jack_default_audio_sample_t *out, *in;
+    int blocksize = STUFF->st_schedblocksize;
 
     pthread_mutex_lock(&jack_mutex);
     jack_out_max = nframes;
-    if (nframes >= DEFDACBLKSIZE && jack_filled >= nframes)
+    if (nframes >= blocksize && jack_filled >= nframes)
     {
         if (jack_filled != nframes)
             fprintf(stderr,"Partial read\n");
@@ -98,11 +99,11 @@ static int pollprocess(jack_nframes_t nframes, void *arg)
     }
     else
     {           /* PD could not keep up ! */
-        if (nframes < DEFDACBLKSIZE)
+        if (nframes < blocksize)
         {
             static int firsttime = 1;
             if(firsttime)
-                fprintf(stderr,"jack: nframes %d smaller than blocksize %d: NO SOUND!\n", nframes, DEFDACBLKSIZE);
+                fprintf(stderr,"jack: nframes %d smaller than blocksize %d: NO SOUND!\n", nframes, blocksize);
             firsttime = 0;
         }
         if (jack_started) jack_dio_error = 1;
@@ -124,39 +125,40 @@ static int callbackprocess(jack_nframes_t nframes, void *arg)
     int chan, j, k;
     unsigned int n;
     jack_default_audio_sample_t *out[MAX_JACK_PORTS], *in[MAX_JACK_PORTS], *jp;
+    int blocksize = STUFF->st_schedblocksize;
 
-    if (nframes % DEFDACBLKSIZE)
+    if (nframes % blocksize)
     {
         fprintf(stderr, "jack: nframes %d not a multiple of blocksize %d\n",
-            nframes, DEFDACBLKSIZE);
-        nframes -= (nframes % DEFDACBLKSIZE);
+            nframes, blocksize);
+        nframes -= (nframes % blocksize);
     }
     for (chan = 0; chan < STUFF->st_inchannels; chan++)
         in[chan] = jack_port_get_buffer(input_port[chan], nframes);
     for (chan = 0; chan < STUFF->st_outchannels; chan++)
         out[chan] = jack_port_get_buffer(output_port[chan], nframes);
-    for (n = 0; n < nframes; n += DEFDACBLKSIZE)
+    for (n = 0; n < nframes; n += blocksize)
     {
         t_sample *fp;
         for (chan = 0; chan < STUFF->st_inchannels; chan++)
             if (in[chan])
         {
-            for (fp = STUFF->st_soundin + chan*DEFDACBLKSIZE,
-                jp = in[chan] + n, j=0; j < DEFDACBLKSIZE; j++)
+            for (fp = STUFF->st_soundin + chan*blocksize,
+                jp = in[chan] + n, j=0; j < blocksize; j++)
                     *fp++ = *jp++;
         }
         for (chan = 0; chan < STUFF->st_outchannels; chan++)
         {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE,
-                j = 0; j < DEFDACBLKSIZE; j++)
+            for (fp = STUFF->st_soundout + chan*blocksize,
+                j = 0; j < blocksize; j++)
                     *fp++ = 0;
         }
         (*jack_callback)();
         for (chan = 0; chan < STUFF->st_outchannels; chan++)
             if (out[chan])
         {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE, jp = out[chan] + n,
-                j=0; j < DEFDACBLKSIZE; j++)
+            for (fp = STUFF->st_soundout + chan*blocksize, jp = out[chan] + n,
+                j=0; j < blocksize; j++)
                     *jp++ = *fp++;
         }
     }
@@ -514,6 +516,7 @@ int jack_send_dacs(void)
     int rtnval =  SENDDACS_YES;
     int timenow;
     int timeref = sys_getrealtime();
+    int blocksize = STUFF->st_schedblocksize;
     if (!jack_client) return SENDDACS_NO;
     if (!STUFF->st_inchannels && !STUFF->st_outchannels) return (SENDDACS_NO);
     if (jack_dio_error)
@@ -536,24 +539,24 @@ int jack_send_dacs(void)
     for (j = 0; j < STUFF->st_outchannels; j++)
     {
         memcpy(jack_outbuf + (j * BUF_JACK) + jack_filled, fp,
-            DEFDACBLKSIZE*sizeof(t_sample));
-        fp += DEFDACBLKSIZE;
+            blocksize*sizeof(t_sample));
+        fp += blocksize;
     }
     fp = STUFF->st_soundin;
     for (j = 0; j < STUFF->st_inchannels; j++)
     {
         memcpy(fp, jack_inbuf + (j * BUF_JACK) + jack_filled,
-            DEFDACBLKSIZE*sizeof(t_sample));
-        fp += DEFDACBLKSIZE;
+            blocksize*sizeof(t_sample));
+        fp += blocksize;
     }
-    jack_filled += DEFDACBLKSIZE;
+    jack_filled += blocksize;
     pthread_mutex_unlock(&jack_mutex);
 
     if ((timenow = sys_getrealtime()) - timeref > 0.002)
     {
         rtnval = SENDDACS_SLEPT;
     }
-    memset(STUFF->st_soundout, 0, DEFDACBLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
+    memset(STUFF->st_soundout, 0, blocksize*sizeof(t_sample)*STUFF->st_outchannels);
     return rtnval;
 }
 
@@ -43,9 +43,10 @@
 typedef int16_t t_oss_int16;
 typedef int32_t t_oss_int32;
 #define OSS_MAXSAMPLEWIDTH sizeof(t_oss_int32)
-#define OSS_BYTESPERCHAN(width) (DEFDACBLKSIZE * (width))
-#define OSS_XFERSAMPS(chans) (DEFDACBLKSIZE* (chans))
-#define OSS_XFERSIZE(chans, width) (DEFDACBLKSIZE * (chans) * (width))
+#define OSS_BYTESPERCHAN(width) (STUFF->st_schedblocksize * (width))
+#define OSS_XFERSAMPS(chans) (STUFF->st_schedblocksize* (chans))
+#define OSS_XFERSIZE(chans, width) \
+    (STUFF->st_schedblocksize * (chans) * (width))
 
 /* GLOBALS */
 static int linux_meters;        /* true if we're metering */
@@ -160,7 +161,7 @@ void oss_configure(t_oss_dev *dev, int srate, int dac, int skipblocksize,
         if (!linux_fragsize)
         {
             linux_fragsize = OSS_DEFFRAGSIZE;
-            while (linux_fragsize > DEFDACBLKSIZE
+            while (linux_fragsize > STUFF->st_schedblocksize
                 && linux_fragsize * 6 > sys_advance_samples)
                     linux_fragsize = linux_fragsize/2;
         }
@@ -264,7 +265,7 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
     int inchannels = 0, outchannels = 0;
     char devname[20];
     int n, i, fd, flags;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
+    char buf[OSS_MAXSAMPLEWIDTH * MAXSCHEDBLKSIZE * OSS_MAXCHPERDEV];
     int num_devs = 0;
     int wantmore=0;
     int spread = 0;
@@ -460,7 +461,7 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
             fprintf(stderr,("OSS: issuing first ADC 'read' ... "));
         read(linux_adcs[0].d_fd, buf,
             linux_adcs[0].d_bytespersamp *
-                linux_adcs[0].d_nchannels * DEFDACBLKSIZE);
+                linux_adcs[0].d_nchannels * STUFF->st_schedblocksize);
         if (sys_verbose)
             fprintf(stderr, "...done.\n");
     }
@@ -469,11 +470,11 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
     {
         int j;
         memset(buf, 0, linux_dacs[i].d_bytespersamp *
-                linux_dacs[i].d_nchannels * DEFDACBLKSIZE);
-        for (j = 0; j < sys_advance_samples/DEFDACBLKSIZE; j++)
+                linux_dacs[i].d_nchannels * STUFF->st_schedblocksize);
+        for (j = 0; j < sys_advance_samples/STUFF->st_schedblocksize; j++)
             write(linux_dacs[i].d_fd, buf,
                 linux_dacs[i].d_bytespersamp *
-                    linux_dacs[i].d_nchannels * DEFDACBLKSIZE);
+                    linux_dacs[i].d_nchannels * STUFF->st_schedblocksize);
     }
     sys_setalarm(0);
     STUFF->st_inchannels = inchannels;
@@ -545,7 +546,7 @@ in audio output and/or input. */
 static void oss_doresync(void)
 {
     int dev, zeroed = 0, wantsize;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
+    char buf[OSS_MAXSAMPLEWIDTH * MAXSCHEDBLKSIZE * OSS_MAXCHPERDEV];
     audio_buf_info ainfo;
 
         /* 1. if any input devices are ahead (have more than 1 buffer stored),
@@ -625,13 +626,14 @@ int oss_send_dacs(void)
     t_sample *fp1, *fp2;
     long fill;
     int i, j, dev, rtnval = SENDDACS_YES;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
+    char buf[OSS_MAXSAMPLEWIDTH * MAXSCHEDBLKSIZE * OSS_MAXCHPERDEV];
     t_oss_int16 *sp;
     t_oss_int32 *lp;
         /* the maximum number of samples we should have in the ADC buffer */
     int idle = 0;
     int thischan;
     double timeref, timenow;
+    int blocksize = STUFF->st_schedblocksize;
 
     if (!linux_nindevs && !linux_noutdevs)
         return (SENDDACS_NO);
@@ -719,11 +721,11 @@ int oss_send_dacs(void)
         {
             if (linux_dacs[dev].d_bytespersamp == 2)
             {
-                for (i = DEFDACBLKSIZE,  fp1 = STUFF->st_soundout +
-                    DEFDACBLKSIZE*thischan,
+                for (i = blocksize,  fp1 = STUFF->st_soundout +
+                    blocksize*thischan,
                     sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
                 {
-                    for (j=0, fp2 = fp1; j<nchannels; j++, fp2 += DEFDACBLKSIZE)
+                    for (j=0, fp2 = fp1; j<nchannels; j++, fp2 += blocksize)
                     {
                         int s = *fp2 * 32767.;
                         if (s > 32767) s = 32767;
@@ -745,7 +747,7 @@ int oss_send_dacs(void)
         thischan += nchannels;
     }
     memset(STUFF->st_soundout, 0,
-        STUFF->st_outchannels * (sizeof(t_sample) * DEFDACBLKSIZE));
+        STUFF->st_outchannels * (sizeof(t_sample) * blocksize));
 
         /* do input */
 
@@ -766,11 +768,11 @@ int oss_send_dacs(void)
 
         if (linux_adcs[dev].d_bytespersamp == 2)
         {
-            for (i = DEFDACBLKSIZE,fp1 = STUFF->st_soundin + thischan*DEFDACBLKSIZE,
+            for (i = blocksize,fp1 = STUFF->st_soundin + thischan*blocksize,
                 sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
             {
                 for (j=0;j<nchannels;j++)
-                    fp1[j*DEFDACBLKSIZE] = (t_sample)sp[j]*(t_sample)3.051850e-05;
+                    fp1[j*blocksize] = (t_sample)sp[j]*(t_sample)3.051850e-05;
             }
         }
         thischan += nchannels;
@@ -141,34 +141,35 @@ static int pa_lowlevel_callback(const void *inputBuffer,
     unsigned int n, j;
     float *fbuf, *fp2, *fp3;
     t_sample *soundiop;
-    if (nframes % DEFDACBLKSIZE)
+    unsigned int blocksize = STUFF->st_schedblocksize;
+    if (nframes % blocksize)
     {
         post("warning: audio nframes %ld not a multiple of blocksize %d",
-            nframes, (int)DEFDACBLKSIZE);
-        nframes -= (nframes % DEFDACBLKSIZE);
+            nframes, (int)blocksize);
+        nframes -= (nframes % blocksize);
     }
-    for (n = 0; n < nframes; n += DEFDACBLKSIZE)
+    for (n = 0; n < nframes; n += blocksize)
     {
         if (inputBuffer != NULL)
         {
             fbuf = ((float *)inputBuffer) + n*pa_inchans;
             soundiop = pa_soundin;
             for (i = 0, fp2 = fbuf; i < pa_inchans; i++, fp2++)
-                    for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
+                    for (j = 0, fp3 = fp2; j < blocksize;
                         j++, fp3 += pa_inchans)
                             *soundiop++ = (t_sample)*fp3;
         }
         else memset((void *)pa_soundin, 0,
-            DEFDACBLKSIZE * pa_inchans * sizeof(t_sample));
+            blocksize * pa_inchans * sizeof(t_sample));
         memset((void *)pa_soundout, 0,
-            DEFDACBLKSIZE * pa_outchans * sizeof(t_sample));
+            blocksize * pa_outchans * sizeof(t_sample));
         (*pa_callback)();
         if (outputBuffer != NULL)
         {
             fbuf = ((float *)outputBuffer) + n*pa_outchans;
             soundiop = pa_soundout;
             for (i = 0, fp2 = fbuf; i < pa_outchans; i++, fp2++)
-                for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
+                for (j = 0, fp3 = fp2; j < blocksize;
                     j++, fp3 += pa_outchans)
                         *fp3 = (float)*soundiop++;
         }
@@ -498,6 +499,7 @@ int pa_send_dacs(void)
     int rtnval =  SENDDACS_YES;
     int locked = 0;
     double timebefore;
+    int blocksize = STUFF->st_schedblocksize;
 #ifdef FAKEBLOCKING
 #ifdef THREADSIGNAL
     struct timespec ts;
@@ -522,7 +524,7 @@ int pa_send_dacs(void)
     if ((!STUFF->st_inchannels && !STUFF->st_outchannels) || !pa_stream)
         return (SENDDACS_NO);
     conversionbuf = (float *)alloca((STUFF->st_inchannels > STUFF->st_outchannels?
-        STUFF->st_inchannels:STUFF->st_outchannels) * DEFDACBLKSIZE * sizeof(float));
+        STUFF->st_inchannels:STUFF->st_outchannels) * blocksize * sizeof(float));
 
 #ifdef FAKEBLOCKING
     if (!STUFF->st_inchannels)    /* if no input channels sync on output */
@@ -531,7 +533,7 @@ int pa_send_dacs(void)
         pthread_mutex_lock(&pa_mutex);
 #endif
         while (sys_ringbuf_getwriteavailable(&pa_outring) <
-            (long)(STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(float)))
+            (long)(STUFF->st_outchannels * blocksize * sizeof(float)))
         {
             rtnval = SENDDACS_SLEPT;
 #ifdef THREADSIGNAL
@@ -561,11 +563,11 @@ int pa_send_dacs(void)
     {
         for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
             j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < blocksize;
                     k++, fp++, fp3 += STUFF->st_outchannels)
                         *fp3 = *fp;
         sys_ringbuf_write(&pa_outring, conversionbuf,
-            STUFF->st_outchannels*(DEFDACBLKSIZE*sizeof(float)), pa_outbuf);
+            STUFF->st_outchannels*(blocksize*sizeof(float)), pa_outbuf);
     }
     if (STUFF->st_inchannels)    /* if there is input sync on it */
     {
@@ -573,7 +575,7 @@ int pa_send_dacs(void)
         pthread_mutex_lock(&pa_mutex);
 #endif
         while (sys_ringbuf_getreadavailable(&pa_inring) <
-            (long)(STUFF->st_inchannels * DEFDACBLKSIZE * sizeof(float)))
+            (long)(STUFF->st_inchannels * blocksize * sizeof(float)))
         {
             rtnval = SENDDACS_SLEPT;
 #ifdef THREADSIGNAL
@@ -601,10 +603,10 @@ int pa_send_dacs(void)
     if (STUFF->st_inchannels && !locked)
     {
         sys_ringbuf_read(&pa_inring, conversionbuf,
-            STUFF->st_inchannels*(DEFDACBLKSIZE*sizeof(float)), pa_inbuf);
+            STUFF->st_inchannels*(blocksize*sizeof(float)), pa_inbuf);
         for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
             j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < blocksize;
                     k++, fp++, fp3 += STUFF->st_inchannels)
                         *fp = *fp3;
     }
@@ -616,28 +618,28 @@ int pa_send_dacs(void)
         if (!pa_started)
         {
             memset(conversionbuf, 0,
-                STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(float));
+                STUFF->st_outchannels * blocksize * sizeof(float));
             for (j = 0; j < pa_nbuffers-1; j++)
-                Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE);
+                Pa_WriteStream(pa_stream, conversionbuf, blocksize);
         }
         for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
             j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < blocksize;
                     k++, fp++, fp3 += STUFF->st_outchannels)
                         *fp3 = *fp;
-        if (Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
+        if (Pa_WriteStream(pa_stream, conversionbuf, blocksize) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
     }
 
     if (STUFF->st_inchannels)
     {
-        if (Pa_ReadStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
+        if (Pa_ReadStream(pa_stream, conversionbuf, blocksize) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
         for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
             j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < blocksize;
                     k++, fp++, fp3 += STUFF->st_inchannels)
                         *fp = *fp3;
     }
@@ -649,7 +651,7 @@ int pa_send_dacs(void)
     pa_started = 1;
 
     memset(STUFF->st_soundout, 0,
-        DEFDACBLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
+        blocksize*sizeof(t_sample)*STUFF->st_outchannels);
     if (locked)
     {
         PaError err = Pa_IsStreamActive(&pa_stream);
@@ -74,6 +74,26 @@ that didn't really belong anywhere. */
 
 #if PDTHREADS
 #include "pthread.h"
+#endif
+
+    /* how we wait for file descriptors: epoll on linux, poll() on other
+    Unixes (and on linux if we can't get an epoll instance), and select() on
+    Windows where sockets aren't small integers. */
+#if defined(__linux__)
+#define FDPOLL_EPOLL
+#include <sys/epoll.h>
+#include <stdint.h>
+#define FDPOLL_NEVENTS 64   /* max events we collect in one go */
+#define FDPOLL_NREADY 1024  /* ready fds the poll thread can hand over */
+    /* each epoll event carries its fd and which sys_addpollfn() call it
+    came from, so that we can tell a stale one from a reused fd number */
+#define FDPOLL_DATA(fd, gen) (((uint64_t)(gen) << 32) | (uint32_t)(fd))
+#define FDPOLL_FD(data) ((int)(uint32_t)(data))
+#define FDPOLL_GEN(data) ((unsigned int)((data) >> 32))
+#endif
+#if !defined(_WIN32)
+#define FDPOLL_POLL
+#include <poll.h>
 #endif
 
 typedef struct _fdpoll
@@ -98,6 +118,16 @@ struct _socketreceiver
     t_socketfromaddrfn sr_fromaddrfn; /* optional */
 };
 
+    /* a "coords" command for a canvas item that hasn't been sent yet */
+typedef struct _guicoords
+{
+    int gc_gen;         /* i_guigen when it was written */
+    int gc_onset;       /* where it starts in i_guibuf */
+    int gc_keylen;      /* length of the ".x%lx.c coords <tag>" part */
+} t_guicoords;
+
+#define GUI_NCOORDS 256     /* size of coords cache; a power of 2 */
+
 typedef struct _guiqueue
 {
     void *gq_client;
@@ -123,6 +153,28 @@ struct _instanceinter
     int i_waitingforping;
     int i_bytessincelastping;
     int i_fdschanged;   /* flag to break fdpoll loop if fd list changes */
+#ifdef FDPOLL_EPOLL
+    int i_epollfd;      /* epoll instance watching all the fds */
+    int *i_fdindex;     /* for each fd, its index in i_fdpoll or -1 */
+    unsigned int *i_fdgen;  /* for each fd, the FDPOLL_GEN it was added with */
+    unsigned int i_fdnextgen;
+    int i_fdindexsize;
+    uint64_t i_readyfds[FDPOLL_NREADY]; /* from the poll thread (-pollthread) */
+    int i_readyhead;
+    int i_readytail;
+#endif
+#ifdef FDPOLL_POLL
+    struct pollfd *i_pollfds;   /* copy of i_fdpoll for poll() */
+    int i_npollfds;
+#endif
+    int i_guicoalesce;  /* drop "coords" commands that are overridden */
+    int i_guigen;       /* incremented whenever unsent commands move */
+    int i_guidead;      /* bytes of blanked-out commands in the buffer */
+    t_guicoords i_guicoords[GUI_NCOORDS];
+    double i_guinbytes; /* statistics for "pd gui-stats" */
+    double i_guincommands;
+    double i_guincoalesced;
+    double i_guicoalescedbytes;
 
 #ifdef _WIN32
     LARGE_INTEGER i_inittime;
@@ -199,16 +251,37 @@ extern int sys_nosleep;
 ready - in that case, dispatch any resulting Pd messages and return.  Called
 with sys_lock() set.  We will temporarily release the lock if we actually
 sleep. */
-static int sys_domicrosleep(int microsec, int pollem)
+    /* wait with poll(), or select() on Windows */
+static int sys_pollfds(int microsec, int pollem)
 {
-    struct timeval timeout;
     int i, didsomething = 0;
-    t_fdpoll *fp;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
     if (pollem && INTER->i_nfdpoll)
     {
+#ifdef FDPOLL_POLL
+            /* the pollfd array is rebuilt whenever the fd list changes */
+        if (!INTER->i_pollfds)
+        {
+            INTER->i_pollfds = (struct pollfd *)getbytes(
+                INTER->i_nfdpoll * sizeof(struct pollfd));
+            INTER->i_npollfds = INTER->i_nfdpoll;
+            for (i = 0; i < INTER->i_nfdpoll; i++)
+            {
+                INTER->i_pollfds[i].fd = INTER->i_fdpoll[i].fdp_fd;
+                INTER->i_pollfds[i].events = POLLIN;
+            }
+        }
+        if (poll(INTER->i_pollfds, INTER->i_npollfds, 0) < 0)
+            perror("microsleep poll");
+        INTER->i_fdschanged = 0;
+        for (i = 0; i < INTER->i_nfdpoll &&
+            !INTER->i_fdschanged; i++)
+                if (INTER->i_pollfds[i].revents)
+#else
+        struct timeval timeout;
         fd_set readset, writeset, exceptset;
+        t_fdpoll *fp;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
         FD_ZERO(&writeset);
         FD_ZERO(&readset);
         FD_ZERO(&exceptset);
@@ -222,6 +295,7 @@ static int sys_domicrosleep(int microsec, int pollem)
         for (i = 0; i < INTER->i_nfdpoll &&
             !INTER->i_fdschanged; i++)
                 if (FD_ISSET(INTER->i_fdpoll[i].fdp_fd, &readset))
+#endif
         {
             (*INTER->i_fdpoll[i].fdp_fn)
                 (INTER->i_fdpoll[i].fdp_ptr,
@@ -244,6 +318,175 @@ static int sys_domicrosleep(int microsec, int pollem)
     return (0);
 }
 
+#ifdef FDPOLL_EPOLL
+    /* With epoll we wait for input and sleep in the same call, so incoming
+    messages wake us at once.  To get microsecond timeouts we select() on the
+    epoll descriptor, which becomes readable when any of the fds do; then we
+    collect the ready ones without waiting.  Each event carries its fd, which
+    we look up in i_fdindex, so the cost depends on the number of ready fds,
+    not on how many there are. */
+    /* With "-pollthread" the fds are added one-shot: once epoll has reported
+    one, it stays quiet until we re-arm it after running its handler.  That
+    way the poll thread (sys_pollthread_wait() below) can hand ready fds over
+    to us without either side touching what the other one owns. */
+static void sys_fdrearm(uint64_t data)
+{
+    int fd = FDPOLL_FD(data);
+    if (fd < INTER->i_fdindexsize && INTER->i_fdindex[fd] >= 0 &&
+        INTER->i_fdgen[fd] == FDPOLL_GEN(data))
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.u64 = data;
+        if (epoll_ctl(INTER->i_epollfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+            perror("epoll_ctl mod");
+    }
+}
+
+    /* run the handler for an fd epoll reported, unless it's gone since */
+static int sys_fdready(uint64_t data)
+{
+    int fd = FDPOLL_FD(data), index;
+    if (fd < INTER->i_fdindexsize && (index = INTER->i_fdindex[fd]) >= 0 &&
+        INTER->i_fdgen[fd] == FDPOLL_GEN(data))
+    {
+        (*INTER->i_fdpoll[index].fdp_fn)(INTER->i_fdpoll[index].fdp_ptr, fd);
+        if (sys_pollthread)
+            sys_fdrearm(data);
+        return (1);
+    }
+    return (0);
+}
+
+    /* run the handlers for the fds the poll thread found ready.  Only the
+    thread holding the Pd lock takes from the queue. */
+static int sys_pollreadyfds(void)
+{
+    int head = sys_loadindex(&INTER->i_readyhead),
+        tail = INTER->i_readytail, didsomething = 0;
+    while (tail != head)
+    {
+        uint64_t data = INTER->i_readyfds[tail];
+        tail = (tail + 1) & (FDPOLL_NREADY-1);
+        sys_storeindex(&INTER->i_readytail, tail);
+        didsomething |= sys_fdready(data);
+    }
+    return (didsomething);
+}
+
+static int sys_domicrosleep(int microsec, int pollem)
+{
+    struct epoll_event events[FDPOLL_NEVENTS];
+    int i, nevents, didsomething = 0;
+    if (INTER->i_epollfd < 0)
+        return (sys_pollfds(microsec, pollem));
+    if (sys_pollthreadrunning)
+    {
+            /* the poll thread does the waiting; we just pick up after it */
+        if (pollem)
+            didsomething = sys_pollreadyfds();
+        if (microsec && !didsomething)
+        {
+            sys_unlock();
+            usleep(microsec);
+            sys_lock();
+        }
+        return (didsomething);
+    }
+    if (pollem && INTER->i_nfdpoll)
+    {
+        if (microsec && INTER->i_epollfd < FD_SETSIZE)
+        {
+            struct timeval timeout;
+            fd_set readset;
+            FD_ZERO(&readset);
+            FD_SET(INTER->i_epollfd, &readset);
+            timeout.tv_sec = microsec / 1000000;
+            timeout.tv_usec = microsec % 1000000;
+            sys_unlock();
+            select(INTER->i_epollfd + 1, &readset, 0, 0, &timeout);
+            sys_lock();
+            nevents = epoll_wait(INTER->i_epollfd, events, FDPOLL_NEVENTS, 0);
+        }
+        else if (microsec)
+        {
+            sys_unlock();
+            nevents = epoll_wait(INTER->i_epollfd, events, FDPOLL_NEVENTS,
+                (microsec + 999) / 1000);
+            sys_lock();
+        }
+        else nevents = epoll_wait(INTER->i_epollfd, events,
+            FDPOLL_NEVENTS, 0);
+        if (nevents < 0 && errno != EINTR)
+            perror("microsleep epoll");
+        INTER->i_fdschanged = 0;
+        for (i = 0; i < nevents; i++)
+        {
+            if (!INTER->i_fdschanged)
+                didsomething |= sys_fdready(events[i].data.u64);
+                /* one-shot fds we didn't get to have to be re-armed */
+            else if (sys_pollthread)
+                sys_fdrearm(events[i].data.u64);
+        }
+        return (didsomething);
+    }
+    if (microsec)
+    {
+        sys_unlock();
+        usleep(microsec);
+        sys_lock();
+    }
+    return (0);
+}
+
+    /* "-pollthread": in callback mode the main thread sits here, without the
+    Pd lock, waiting for input.  The fds that become ready go into
+    i_readyfds, whose handlers the audio callback runs when it next polls
+    (it never has to wait for us, as it would if we parsed and sent messages
+    ourselves), and MIDI input goes into the MIDI input queue the same way.
+    Since each fd is one-shot, the queue can't hold more than FDPOLL_NREADY
+    of them unless there are that many fds; if it's full we just wait. */
+void sys_pollthread_wait(int microsec)
+{
+    struct epoll_event events[FDPOLL_NEVENTS];
+    int i, nevents = 0, head = INTER->i_readyhead, room = FDPOLL_NREADY - 1 -
+        ((head - sys_loadindex(&INTER->i_readytail)) & (FDPOLL_NREADY-1));
+    if (room > FDPOLL_NEVENTS)
+        room = FDPOLL_NEVENTS;
+    if (INTER->i_epollfd >= 0 && room > 0)
+        nevents = epoll_wait(INTER->i_epollfd, events, room,
+            (microsec + 999) / 1000);
+    else usleep(microsec);
+    if (nevents < 0 && errno != EINTR)
+        perror("poll thread epoll");
+    for (i = 0; i < nevents; i++)
+    {
+        INTER->i_readyfds[head] = events[i].data.u64;
+        head = (head + 1) & (FDPOLL_NREADY-1);
+    }
+    if (nevents > 0)
+        sys_storeindex(&INTER->i_readyhead, head);
+    sys_pollmidiin();
+}
+#else /* FDPOLL_EPOLL */
+static int sys_domicrosleep(int microsec, int pollem)
+{
+    return (sys_pollfds(microsec, pollem));
+}
+
+    /* without epoll there's no "-pollthread" (see s_main.c) */
+void sys_pollthread_wait(int microsec)
+{
+#ifdef _WIN32
+    Sleep(microsec/1000);
+#else
+    usleep(microsec);
+#endif
+    sys_pollmidiin();
+}
+#endif /* FDPOLL_EPOLL */
+
     /* sleep (but if any incoming or to-gui sending to do, do that instead.)
     Call with the PD unstance lock UNSET - we set it here. */
 void sys_microsleep(int microsec)
@@ -401,6 +644,28 @@ void sys_sockerror(const char *s)
     error("%s: %s (%d)", s, buf, err);
 }
 
+    /* keep the OS-level watch list in step with i_fdpoll */
+static void sys_fdpollchanged(void)
+{
+#ifdef FDPOLL_EPOLL
+    int i;
+    for (i = 0; i < INTER->i_fdindexsize; i++)
+        INTER->i_fdindex[i] = -1;
+    for (i = 0; i < INTER->i_nfdpoll; i++)
+        INTER->i_fdindex[INTER->i_fdpoll[i].fdp_fd] = i;
+#endif
+#ifdef FDPOLL_POLL
+    if (INTER->i_pollfds)
+    {
+        freebytes(INTER->i_pollfds,
+            INTER->i_npollfds * sizeof(struct pollfd));
+        INTER->i_pollfds = 0;
+        INTER->i_npollfds = 0;
+    }
+#endif
+    INTER->i_fdschanged = 1;
+}
+
 void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
 {
     int nfd, size;
@@ -417,7 +682,31 @@ void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
     INTER->i_nfdpoll = nfd + 1;
     if (fd >= INTER->i_maxfd)
         INTER->i_maxfd = fd + 1;
-    INTER->i_fdschanged = 1;
+#ifdef FDPOLL_EPOLL
+    if (fd >= INTER->i_fdindexsize)
+    {
+        int newsize = 2 * (fd + 1);
+        INTER->i_fdindex = (int *)resizebytes(INTER->i_fdindex,
+            INTER->i_fdindexsize * sizeof(int), newsize * sizeof(int));
+        INTER->i_fdgen = (unsigned int *)resizebytes(INTER->i_fdgen,
+            INTER->i_fdindexsize * sizeof(unsigned int),
+                newsize * sizeof(unsigned int));
+        INTER->i_fdindexsize = newsize;
+    }
+    INTER->i_fdgen[fd] = ++INTER->i_fdnextgen;
+    if (INTER->i_epollfd >= 0)
+    {
+            /* level-triggered, since the handlers only read once per call;
+            one-shot as well for the poll thread (see sys_fdrearm()) */
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | (sys_pollthread ? EPOLLONESHOT : 0);
+        ev.data.u64 = FDPOLL_DATA(fd, INTER->i_fdgen[fd]);
+        if (epoll_ctl(INTER->i_epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            perror("epoll_ctl add");
+    }
+#endif
+    sys_fdpollchanged();
 }
 
 void sys_rmpollfn(int fd)
@@ -426,6 +715,12 @@ void sys_rmpollfn(int fd)
     int i, size = nfd * sizeof(t_fdpoll);
     t_fdpoll *fp;
     INTER->i_fdschanged = 1;
+#ifdef FDPOLL_EPOLL
+    if (INTER->i_epollfd >= 0 &&
+        epoll_ctl(INTER->i_epollfd, EPOLL_CTL_DEL, fd, 0) < 0 &&
+            errno != EBADF && errno != ENOENT)
+                perror("epoll_ctl del");
+#endif
     for (i = nfd, fp = INTER->i_fdpoll; i--; fp++)
     {
         if (fp->fdp_fd == fd)
@@ -438,6 +733,7 @@ void sys_rmpollfn(int fd)
             INTER->i_fdpoll = (t_fdpoll *)t_resizebytes(
                 INTER->i_fdpoll, size, size - sizeof(t_fdpoll));
             INTER->i_nfdpoll = nfd - 1;
+            sys_fdpollchanged();
             return;
         }
     }
@@ -598,12 +894,7 @@ void socketreceiver_read(t_socketreceiver *x, int fd)
                 {
                     if (pd_this == &pd_maininstance)
                         sys_bail(1);
-                    else
-                    {
-                        sys_rmpollfn(fd);
-                        sys_closesocket(fd);
-                        sys_stopgui();
-                    }
+                    else sys_stopgui();  /* which closes fd */
                 }
                 else
                 {
@@ -723,6 +1014,8 @@ static void sys_trytogetmoreguibuf(int newsize)
             }
         }
         INTER->i_guihead = INTER->i_guitail = 0;
+        INTER->i_guidead = 0;
+        INTER->i_guigen++;
     }
     else
     {
@@ -736,6 +1029,92 @@ int sys_havegui(void)
     return (INTER->i_havegui);
 }
 
+/* Moving a slider or a VU meter, or dragging objects with connections,
+sends a "coords" command to the GUI each time.  When Pd is busy, several for
+the same canvas item may pile up in the buffer before it can be sent, and
+all but the last are pointless.  So we remember where recent "coords"
+commands are, and when another one for the same item arrives we blank out
+the old one: it's replaced by a \001 followed by spaces up to the newline.
+sys_flushtogui() squeezes blanked commands out before sending.  Only
+single-line commands of the form ".x%lx.c coords <tag> ..." are considered;
+nothing in Pd reads coordinates back from the GUI in between. */
+
+static void sys_coalescegui(int onset, int msglen)
+{
+    char *s = INTER->i_guibuf + onset, *word2, *tagend;
+    unsigned int hash = 5381;
+    int keylen, i;
+    t_guicoords *gc;
+    if (msglen < 12 || s[0] != '.' || s[1] != 'x' || s[msglen-1] != '\n' ||
+        memchr(s, '\n', msglen - 1) ||
+        !(word2 = memchr(s, ' ', msglen)) || strncmp(word2, " coords ", 8) ||
+        !(tagend = memchr(word2 + 8, ' ', msglen - (word2 + 8 - s))) ||
+        tagend == word2 + 8)
+            return;
+    keylen = (int)(tagend - s);
+    for (i = 0; i < keylen; i++)
+        hash = hash * 33 + (unsigned char)s[i];
+    gc = &INTER->i_guicoords[hash & (GUI_NCOORDS-1)];
+    if (gc->gc_gen == INTER->i_guigen && gc->gc_keylen == keylen &&
+        gc->gc_onset >= INTER->i_guitail &&
+        !memcmp(INTER->i_guibuf + gc->gc_onset, s, keylen))
+    {
+        char *old = INTER->i_guibuf + gc->gc_onset,
+            *nl = memchr(old, '\n', onset - gc->gc_onset);
+        if (nl)
+        {
+            old[0] = '\001';
+            memset(old + 1, ' ', nl - old - 1);
+            INTER->i_guidead += (int)(nl + 1 - old);
+            INTER->i_guincoalesced++;
+            INTER->i_guicoalescedbytes += (nl + 1 - old);
+        }
+    }
+    gc->gc_gen = INTER->i_guigen;
+    gc->gc_onset = onset;
+    gc->gc_keylen = keylen;
+}
+
+    /* remove the commands blanked out above from the unsent buffer */
+static void sys_squeezegui(void)
+{
+    char *buf = INTER->i_guibuf, *from = buf + INTER->i_guitail,
+        *to = from, *end = buf + INTER->i_guihead, *mark;
+    while ((mark = memchr(from, '\001', end - from)))
+    {
+        char *nl = mark + 1;
+        while (nl < end && *nl == ' ')
+            nl++;
+            /* a \001 that isn't ours is left alone */
+        if (nl == end || *nl != '\n')
+            nl = mark;
+        if (to != from)
+            memmove(to, from, mark - from);
+        to += mark - from;
+        from = nl + 1;
+        if (nl == mark)
+            *to++ = '\001';
+    }
+    if (to != from)
+        memmove(to, from, end - from);
+    INTER->i_guihead = (int)(to + (end - from) - buf);
+    INTER->i_guidead = 0;
+    INTER->i_guigen++;
+}
+
+    /* count the Tcl commands a sys_vgui() call finished, that is, its
+    newlines not escaped by a backslash.  A long command such as an array
+    plot takes many calls. */
+static int sys_countguicommands(const char *s, int n)
+{
+    const char *nl, *end = s + n;
+    int count = 0;
+    for (; (nl = memchr(s, '\n', end - s)); s = nl + 1)
+        if (nl == INTER->i_guibuf || nl[-1] != '\\')
+            count++;
+    return (count);
+}
+
 void sys_vgui(const char *fmt, ...)
 {
     int msglen, bytesleft, headwas, nwrote;
@@ -789,6 +1168,11 @@ void sys_vgui(const char *fmt, ...)
     }
     if (sys_debuglevel & DEBUG_MESSUP)
         fprintf(stderr, ">> %s", INTER->i_guibuf + INTER->i_guihead);
+    INTER->i_guinbytes += msglen;
+    INTER->i_guincommands += sys_countguicommands(
+        INTER->i_guibuf + INTER->i_guihead, msglen);
+    if (INTER->i_guicoalesce)
+        sys_coalescegui(INTER->i_guihead, msglen);
     INTER->i_guihead += msglen;
     INTER->i_bytessincelastping += msglen;
 }
@@ -800,8 +1184,10 @@ void sys_gui(const char *s)
 
 static int sys_flushtogui(void)
 {
-    int writesize = INTER->i_guihead - INTER->i_guitail,
-        nwrote = 0;
+    int writesize, nwrote = 0;
+    if (INTER->i_guidead)
+        sys_squeezegui();
+    writesize = INTER->i_guihead - INTER->i_guitail;
     if (writesize > 0)
         nwrote = (int)send(
             INTER->i_guisock,
@@ -820,9 +1206,10 @@ static int sys_flushtogui(void)
     }
     else if (!nwrote)
         return (0);
-    else if (nwrote >= INTER->i_guihead - INTER->i_guitail)
+    INTER->i_guigen++;
+    if (nwrote >= INTER->i_guihead - INTER->i_guitail)
         INTER->i_guihead = INTER->i_guitail = 0;
-    else if (nwrote)
+    else
     {
         INTER->i_guitail += nwrote;
         if (INTER->i_guitail > (INTER->i_guisize >> 2))
@@ -960,6 +1347,22 @@ int sys_pollgui(void)
     return (didsomething);
 }
 
+    /* "pd gui-coalesce <flag>": turn coalescing of "coords" commands on or
+    off; it's on unless the GUI or a user says otherwise. */
+void glob_guicoalesce(void *dummy, t_floatarg f)
+{
+    INTER->i_guicoalesce = (f != 0);
+}
+
+    /* "pd gui-stats": how much we've sent to the GUI */
+void glob_guistats(void *dummy)
+{
+    post("gui-stats: %.0f commands, %.0f bytes; "
+        "%.0f coords commands (%.0f bytes) coalesced",
+        INTER->i_guincommands, INTER->i_guinbytes,
+        INTER->i_guincoalesced, INTER->i_guicoalescedbytes);
+}
+
 void sys_init_fdpoll(void)
 {
     if (INTER->i_fdpoll)
@@ -967,6 +1370,15 @@ void sys_init_fdpoll(void)
     /* create an empty FD poll list */
     INTER->i_fdpoll = (t_fdpoll *)t_getbytes(0);
     INTER->i_nfdpoll = 0;
+#ifdef FDPOLL_EPOLL
+    INTER->i_fdindex = 0;
+    INTER->i_fdgen = 0;
+    INTER->i_fdnextgen = 0;
+    INTER->i_fdindexsize = 0;
+    INTER->i_readyhead = INTER->i_readytail = 0;
+    if ((INTER->i_epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        perror("epoll_create1");    /* we'll use poll() instead */
+#endif
     INTER->i_inbinbuf = binbuf_new();
 }
 
@@ -1510,8 +1922,8 @@ void glob_exit(void *dummy, t_float status)
     sys_close_midi();
     if (sys_havegui())
     {
-        sys_closesocket(INTER->i_guisock);
         sys_rmpollfn(INTER->i_guisock);
+        sys_closesocket(INTER->i_guisock);
     }
     exit((int)status);
 }
@@ -1566,8 +1978,8 @@ void sys_stopgui(void)
     sys_vgui("%s", "exit\n");
     if (INTER->i_guisock >= 0)
     {
-        sys_closesocket(INTER->i_guisock);
         sys_rmpollfn(INTER->i_guisock);
+        sys_closesocket(INTER->i_guisock);
         INTER->i_guisock = -1;
     }
     INTER->i_havegui = 0;
@@ -1586,6 +1998,10 @@ void s_inter_newpdinstance(void)
     INTER->i_freq = 0;
 #endif
     INTER->i_havegui = 0;
+    INTER->i_guicoalesce = 1;
+#ifdef FDPOLL_EPOLL
+    INTER->i_epollfd = -1;
+#endif
 }
 
 void s_inter_free(t_instanceinter *inter)
@@ -1597,6 +2013,26 @@ void s_inter_free(t_instanceinter *inter)
         t_freebytes(inter->i_fdpoll, inter->i_nfdpoll * sizeof(t_fdpoll));
         inter->i_fdpoll = 0;
         inter->i_nfdpoll = 0;
+#ifdef FDPOLL_EPOLL
+        if (inter->i_epollfd >= 0)
+            close(inter->i_epollfd);
+        inter->i_epollfd = -1;
+        if (inter->i_fdindex)
+        {
+            freebytes(inter->i_fdindex, inter->i_fdindexsize * sizeof(int));
+            freebytes(inter->i_fdgen,
+                inter->i_fdindexsize * sizeof(unsigned int));
+        }
+        inter->i_fdindex = 0;
+        inter->i_fdgen = 0;
+        inter->i_fdindexsize = 0;
+#endif
+#ifdef FDPOLL_POLL
+        if (inter->i_pollfds)
+            freebytes(inter->i_pollfds,
+                inter->i_npollfds * sizeof(struct pollfd));
+        inter->i_pollfds = 0;
+#endif
     }
     freebytes(inter, sizeof(*inter));
 }
@@ -421,12 +421,15 @@ static char *(usagemessage[]) = {
 "-channels ...    -- specify both input and output channels\n",
 "-audiobuf <n>    -- specify size of audio buffer in msec\n",
 "-blocksize <n>   -- specify audio I/O block size in sample frames\n",
+"-schedblocksize <n> -- sample frames per scheduler tick (64 to 2048)\n",
 "-sleepgrain <n>  -- specify number of milliseconds to sleep when idle\n",
 "-nodac           -- suppress audio output\n",
 "-noadc           -- suppress audio input\n",
 "-noaudio         -- suppress audio input and output (-nosound is synonym) \n",
 "-callback        -- use callbacks if possible\n",
 "-nocallback      -- use polling-mode (true by default)\n",
+"-pollthread      -- with callbacks, read input on another thread and skip\n"
+"                    ticks rather than wait for the Pd lock (linux)\n",
 "-listdev         -- list audio and MIDI devices\n",
 
 #ifdef USEAPI_OSS
@@ -724,11 +727,27 @@ int sys_argparse(int argc, char **argv)
             sys_main_callback = 0;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-pollthread"))
+        {
+#ifdef __linux__
+            sys_pollthread = 1;
+#else
+            fprintf(stderr, "-pollthread is only available on linux\n");
+#endif
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-blocksize"))
         {
             sys_main_blocksize = atoi(argv[1]);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(*argv, "-schedblocksize"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_setschedblocksize(atoi(argv[1]));
+            argc -= 2; argv += 2;
+        }
         else if (!strcmp(*argv, "-sleepgrain"))
         {
             if (argc < 2)
@@ -1378,7 +1397,7 @@ int sys_argparse(int argc, char **argv)
 
 int sys_getblksize(void)
 {
-    return (DEFDACBLKSIZE);
+    return (STUFF->st_schedblocksize);
 }
 
     /* stuff to do, once, after calling sys_argparse() -- which may itself
@@ -23,6 +23,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <signal.h>
+#if PDTHREADS
+#include <pthread.h>
+#endif
 
 /* channel voice messages */     /* dec, # */
 #define MIDI_NOTEOFF        0x80 /* 128, 2 */
@@ -70,6 +73,23 @@ int midi_outhead, midi_outtail;
 t_midiqelem midi_inqueue[MIDIQSIZE];
 int midi_inhead, midi_intail;
 static double sys_midiinittime;
+static int midi_inoverflowed;   /* set by the poll thread if queue was full */
+
+    /* with "-pollthread" the MIDI input devices are read by the poll thread
+    (sys_pollmidiin()); it and the code that opens and closes them
+    (glob_midi_setapi() and glob_midi_dialog()) take this lock.  In callback
+    mode messages are handled on the audio thread, so that's where those
+    two run and wait for the lock, but at most for one poll of the devices,
+    which is quick next to closing and reopening them.  Nothing else on the
+    audio thread takes it. */
+#if PDTHREADS
+static pthread_mutex_t midi_inmutex = PTHREAD_MUTEX_INITIALIZER;
+#define MIDI_LOCKINPUT pthread_mutex_lock(&midi_inmutex)
+#define MIDI_UNLOCKINPUT pthread_mutex_unlock(&midi_inmutex)
+#else
+#define MIDI_LOCKINPUT
+#define MIDI_UNLOCKINPUT
+#endif
 #define API_DEFAULTMIDI 0
 
 #if (defined USEAPI_ALSA) && (defined USEAPI_MIDIDUMMY)
@@ -421,7 +441,8 @@ static void sys_dispatchnextmidiin(void)
             }
         }
     }
-    midi_intail = (midi_intail + 1 == MIDIQSIZE ? 0 : midi_intail + 1);
+    sys_storeindex(&midi_intail,
+        (midi_intail + 1 == MIDIQSIZE ? 0 : midi_intail + 1));
 }
 
 void sys_pollmidiinqueue(void)
@@ -434,7 +455,7 @@ void sys_pollmidiinqueue(void)
     if (midi_inhead == midi_intail)
         db = 0;
 #endif
-    while (midi_inhead != midi_intail)
+    while (sys_loadindex(&midi_inhead) != midi_intail)
     {
 #ifdef TEST_DEJITTER
         if (!db)
@@ -464,7 +485,9 @@ void sys_pollmidiinqueue(void)
 
     /* this should be called from the system dependent MIDI code when a byte
     comes in, as a result of our calling sys_poll_midi.  We stick it on a
-    timetag queue and dispatch it at the appropriate logical time. */
+    timetag queue and dispatch it at the appropriate logical time.  If the
+    poll thread is reading MIDI we're called from there, and all we may do
+    is add to the queue. */
 void sys_midibytein(int portno, int byte)
 {
     static int warned = 0;
@@ -473,8 +496,13 @@ void sys_midibytein(int portno, int byte)
     if (newhead == MIDIQSIZE)
         newhead = 0;
             /* if FIFO is full flush an element to make room */
-    if (newhead == midi_intail)
+    if (newhead == sys_loadindex(&midi_intail))
     {
+        if (sys_pollthreadrunning)
+        {
+            midi_inoverflowed = 1;
+            return;
+        }
         if (!warned)
         {
             post("warning: MIDI timing FIFO overflowed");
@@ -486,8 +514,27 @@ void sys_midibytein(int portno, int byte)
     midi_inqueue[midi_inhead].q_onebyte = 1;
     midi_inqueue[midi_inhead].q_byte1 = byte;
     midi_inqueue[midi_inhead].q_time = sys_getmidiinrealtime();
-    midi_inhead = newhead;
-    sys_pollmidiinqueue();
+    sys_storeindex(&midi_inhead, newhead);
+    if (!sys_pollthreadrunning)
+        sys_pollmidiinqueue();
+}
+
+static void sys_pollmidibackend(void)
+{
+#ifdef USEAPI_ALSA
+      if (sys_midiapi == API_ALSA)
+        sys_alsa_poll_midi();
+      else
+#endif /* ALSA */
+    sys_poll_midi();    /* OS dependent poll for MIDI input */
+}
+
+    /* read MIDI input on the poll thread (see sys_pollthread_wait()) */
+void sys_pollmidiin(void)
+{
+    MIDI_LOCKINPUT;
+    sys_pollmidibackend();
+    MIDI_UNLOCKINPUT;
 }
 
 void sys_pollmidiqueue(void)
@@ -499,12 +546,13 @@ void sys_pollmidiqueue(void)
         post("delay %d", (int)(1000 * (newtime - lasttime)));
     lasttime = newtime;
 #endif
-#ifdef USEAPI_ALSA
-      if (sys_midiapi == API_ALSA)
-        sys_alsa_poll_midi();
-      else
-#endif /* ALSA */
-    sys_poll_midi();    /* OS dependent poll for MIDI input */
+    if (!sys_pollthreadrunning)
+        sys_pollmidibackend();
+    else if (midi_inoverflowed)
+    {
+        post("warning: MIDI input queue overflowed; bytes dropped");
+        midi_inoverflowed = 0;
+    }
     sys_pollmidioutqueue();
     sys_pollmidiinqueue();
 }
@@ -679,6 +727,7 @@ void glob_midi_setapi(void *dummy, t_floatarg f)
     int newapi = f;
     if (newapi != sys_midiapi)
     {
+        MIDI_LOCKINPUT;
 #ifdef USEAPI_ALSA
         if (sys_midiapi == API_ALSA)
             sys_alsa_close_midi();
@@ -687,6 +736,7 @@ void glob_midi_setapi(void *dummy, t_floatarg f)
               sys_close_midi();
         sys_midiapi = newapi;
         sys_reopen_midi();
+        MIDI_UNLOCKINPUT;
     }
 #ifdef USEAPI_ALSA
     midi_alsa_setndevs(midi_nmidiindev, midi_nmidioutdev);
@@ -825,6 +875,7 @@ void glob_midi_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv)
 #endif
     sys_save_midi_params(nindev, newmidiindev,
         noutdev, newmidioutdev);
+    MIDI_LOCKINPUT;
 #ifdef USEAPI_ALSA
     if (sys_midiapi == API_ALSA)
     {
@@ -837,6 +888,7 @@ void glob_midi_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv)
         sys_close_midi();
         sys_open_midi(nindev, newmidiindev, noutdev, newmidioutdev, 1);
     }
+    MIDI_UNLOCKINPUT;
 
 }
 
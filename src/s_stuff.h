@@ -59,7 +59,8 @@ EXTERN void sys_register_loader(loader_t loader);
 #define SENDDACS_YES 1
 #define SENDDACS_SLEPT 2
 
-#define DEFDACBLKSIZE 64
+#define DEFDACBLKSIZE 64        /* default scheduler block size */
+#define MAXSCHEDBLKSIZE 2048    /* largest one "-schedblocksize" allows */
 extern int sys_hipriority;      /* real-time flag, true if priority boosted */
 extern int sys_schedadvance;
 extern int sys_sleepgrain;
@@ -124,6 +125,7 @@ EXTERN void sys_putmidibyte(int portno, int a);
 EXTERN void sys_poll_midi(void);
 EXTERN void sys_setmiditimediff(double inbuftime, double outbuftime);
 EXTERN void sys_midibytein(int portno, int byte);
+EXTERN void sys_pollmidiin(void);   /* read MIDI input (poll thread) */
 
     /* implemented in the system dependent MIDI code (s_midi_pm.c, etc. ) */
 void midi_getdevs(char *indevlist, int *nindevs,
@@ -157,10 +159,24 @@ EXTERN void sys_log_error(int type);
 #define SCHED_AUDIO_POLL 1
 #define SCHED_AUDIO_CALLBACK 2
 void sched_set_using_audio(int flag);
+extern int sys_pollthread;          /* "-pollthread" flag */
+extern int sys_pollthreadrunning;   /* main thread is now reading input */
+
+    /* indices into a queue that one thread writes and another reads
+    without a lock: the writer fills in the entry and then stores the new
+    head, and the reader loads the head before looking at the entries. */
+#ifdef __GNUC__
+#define sys_loadindex(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define sys_storeindex(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define sys_loadindex(p) (*(volatile int *)(p))
+#define sys_storeindex(p, v) (*(volatile int *)(p) = (v))
+#endif
 
 /* s_inter.c */
 
 EXTERN void sys_microsleep(int microsec);
+EXTERN void sys_pollthread_wait(int microsec);
 EXTERN void sys_init_fdpoll(void);
 
 EXTERN void sys_bail(int exitcode);
@@ -379,6 +395,7 @@ EXTERN int sys_addhist(int phase);
 EXTERN void sched_tick(void);
 EXTERN void sys_pollmidiqueue(void);
 EXTERN void sys_setchsr(int chin, int chout, int sr);
+EXTERN void sys_setschedblocksize(int n);
 
 EXTERN void inmidi_realtimein(int portno, int cmd);
 EXTERN void inmidi_byte(int portno, int byte);
@@ -413,10 +430,19 @@ struct _instancestuff
     t_sample *st_soundout;
     t_sample *st_soundin;
     double st_time_per_dsp_tick;    /* obsolete - included for GEM?? */
+    struct _clock **st_clockheap;   /* set clocks, as a heap (m_sched.c) */
+    int st_nclock;                  /* number of set clocks */
+    int st_clockheapsize;           /* allocated size of clock heap */
+    double st_clockseq;             /* counts clock_set() calls */
+    char *st_tmpbytes;              /* scratch space for messages */
+    size_t st_tmpfill;              /* how much of it is in use */
+    struct _sfio *st_sfio;          /* disk slots for readsf~/writesf~ */
 };
 
 #define STUFF (pd_this->pd_stuff)
 
+#define TMPBYTESIZE (8192 * sizeof(t_atom)) /* size of st_tmpbytes */
+
 /* escape characters for tcl/tk
  * escapes special characters ("{}\") in the string 'src', which
  * has a maximum length of 'srclen' and might be 0-terminated,
@@ -5,6 +5,7 @@
 /* The "array" object. */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "g_canvas.h"
 #include <string.h>
 #include <stdio.h>
@@ -29,12 +30,13 @@
 #define TEXT_NGETBYTE 100 /* bigger that this we use alloc, not alloca */
 #if HAVE_ALLOCA
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < TEXT_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : gettmpbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < TEXT_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < TEXT_NGETBYTE || (freetmpbytes((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) \
+    ((x) = (t_atom *)gettmpbytes((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (freetmpbytes((x), (n) * sizeof(t_atom)))
 #endif
 
 /* -- "table" - classic "array define" object by Guenter Geiger --*/
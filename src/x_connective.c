@@ -5,6 +5,7 @@
 /* connective objects */
 
 #include "m_pd.h"
+#include "m_imp.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -349,6 +350,179 @@ static void receive_setup(void)
     class_addanything(receive_class, receive_anything);
 }
 
+/* ------------ looking up arguments of select and route ------------- */
+
+/* With more than a few arguments, select and route look symbols up in a hash
+table and floats in a sorted array, instead of comparing them against each
+argument in turn.  Either way we get the first argument that matches, as the
+linear search would.  A single argument can be changed from an inlet, but
+the index is only made for more than KEYINDEX_MIN of them, and the arguments
+are fixed then. */
+
+#define KEYINDEX_MIN 8
+
+typedef struct _keyentry
+{
+    t_word ke_w;
+    int ke_which;           /* argument number, or -1 for an empty slot */
+} t_keyentry;
+
+typedef struct _keyindex
+{
+    int k_n;                /* hash slots or sorted floats; 0 if no index */
+    int k_alloc;            /* entries allocated */
+    t_keyentry *k_vec;
+} t_keyindex;
+
+static int keyindex_hash(t_keyindex *k, t_symbol *s)
+{
+    return (pd_ptrhash(s, k->k_n));
+}
+
+    /* test for infinities and NaNs from the bits, since with -ffast-math
+    the compiler may assume there are none and fold "f == f" to 1.  They're
+    left out of the index, and looked for by linear search instead. */
+static int keyindex_isfinite(t_float f)
+{
+#if PD_FLOATSIZE == 32
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return ((bits & 0x7f800000) != 0x7f800000);
+#else
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return ((bits & 0x7ff0000000000000ULL) != 0x7ff0000000000000ULL);
+#endif
+}
+
+static int keyindex_isnan(t_float f)
+{
+#if PD_FLOATSIZE == 32
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return ((bits & 0x7fffffff) > 0x7f800000);
+#else
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return ((bits & 0x7fffffffffffffffULL) > 0x7ff0000000000000ULL);
+#endif
+}
+
+    /* "f1 == f2" for the linear search, so that it agrees with the index:
+    with -ffast-math a NaN may compare equal to anything */
+static int keyindex_floateq(t_float f1, t_float f2)
+{
+    if (keyindex_isfinite(f1) && keyindex_isfinite(f2))
+        return (f1 == f2);
+    return (!keyindex_isnan(f1) && !memcmp(&f1, &f2, sizeof(f1)));
+}
+
+static int keyindex_floatcmp(const void *p1, const void *p2)
+{
+    const t_keyentry *e1 = (const t_keyentry *)p1, *e2 = (const t_keyentry *)p2;
+    if (e1->ke_w.w_float < e2->ke_w.w_float)
+        return (-1);
+    else if (e1->ke_w.w_float > e2->ke_w.w_float)
+        return (1);
+    else return (e1->ke_which - e2->ke_which);
+}
+
+    /* make the index from the "n" arguments, which are at intervals of
+    "stride" bytes starting at "w" */
+static void keyindex_init(t_keyindex *k, t_atomtype type, int n,
+    t_word *w, size_t stride)
+{
+    int i;
+    k->k_n = k->k_alloc = 0;
+    k->k_vec = 0;
+    if (n <= KEYINDEX_MIN || (type != A_FLOAT && type != A_SYMBOL))
+        return;
+    if (type == A_SYMBOL)
+    {
+        for (k->k_n = 1; k->k_n < 2 * n; k->k_n *= 2)
+            ;
+        k->k_alloc = k->k_n;
+        k->k_vec = (t_keyentry *)getbytes(k->k_alloc * sizeof(t_keyentry));
+        for (i = 0; i < k->k_n; i++)
+            k->k_vec[i].ke_which = -1;
+        for (i = 0; i < n; i++, w = (t_word *)((char *)w + stride))
+        {
+            int h = keyindex_hash(k, w->w_symbol);
+                /* if it's already there the first one wins */
+            while (k->k_vec[h].ke_which >= 0 &&
+                k->k_vec[h].ke_w.w_symbol != w->w_symbol)
+                    h = (h + 1) & (k->k_n - 1);
+            if (k->k_vec[h].ke_which < 0)
+            {
+                k->k_vec[h].ke_w = *w;
+                k->k_vec[h].ke_which = i;
+            }
+        }
+    }
+    else
+    {
+        int nsorted;
+        k->k_alloc = n;
+        k->k_vec = (t_keyentry *)getbytes(k->k_alloc * sizeof(t_keyentry));
+        for (i = 0; i < n; i++, w = (t_word *)((char *)w + stride))
+            if (keyindex_isfinite(w->w_float))
+        {
+            k->k_vec[k->k_n].ke_w = *w;
+            k->k_vec[k->k_n++].ke_which = i;
+        }
+        qsort(k->k_vec, k->k_n, sizeof(t_keyentry), keyindex_floatcmp);
+            /* keep only the first argument with each value */
+        for (i = nsorted = 0; i < k->k_n; i++)
+            if (!nsorted || k->k_vec[i].ke_w.w_float !=
+                k->k_vec[nsorted-1].ke_w.w_float)
+                    k->k_vec[nsorted++] = k->k_vec[i];
+        k->k_n = nsorted;
+            /* an index with no entries would look like no index, so if
+            none were finite leave one that matches nothing */
+        if (!k->k_n)
+        {
+            k->k_vec[0].ke_w.w_float = 0;
+            k->k_vec[k->k_n++].ke_which = -1;
+        }
+    }
+}
+
+static void keyindex_free(t_keyindex *k)
+{
+    if (k->k_vec)
+        freebytes(k->k_vec, k->k_alloc * sizeof(t_keyentry));
+}
+
+    /* argument number of the first one equal to "s", or -1 */
+static int keyindex_findsymbol(t_keyindex *k, t_symbol *s)
+{
+    int h = keyindex_hash(k, s);
+    while (k->k_vec[h].ke_which >= 0)
+    {
+        if (k->k_vec[h].ke_w.w_symbol == s)
+            return (k->k_vec[h].ke_which);
+        h = (h + 1) & (k->k_n - 1);
+    }
+    return (-1);
+}
+
+    /* argument number of the first one equal to "f", which must be finite
+    (see keyindex_isfinite()), or -1 */
+static int keyindex_findfloat(t_keyindex *k, t_float f)
+{
+    int lo = 0, hi = k->k_n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (k->k_vec[mid].ke_w.w_float < f)
+            lo = mid + 1;
+        else if (k->k_vec[mid].ke_w.w_float > f)
+            hi = mid;
+        else return (k->k_vec[mid].ke_which);
+    }
+    return (-1);
+}
+
 /* -------------------------- select ------------------------------ */
 
 static t_class *sel1_class;
@@ -390,6 +564,7 @@ typedef struct _sel2
     t_int x_nelement;
     t_selectelement *x_vec;
     t_outlet *x_rejectout;
+    t_keyindex x_index;
 } t_sel2;
 
 static void sel2_float(t_sel2 *x, t_float f)
@@ -398,8 +573,16 @@ static void sel2_float(t_sel2 *x, t_float f)
     int nelement;
     if (x->x_type == A_FLOAT)
     {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_float == f)
+        if (x->x_index.k_n && keyindex_isfinite(f))
+        {
+            if ((nelement = keyindex_findfloat(&x->x_index, f)) >= 0)
+            {
+                outlet_bang(x->x_vec[nelement].e_outlet);
+                return;
+            }
+        }
+        else for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+            if (keyindex_floateq(e->e_w.w_float, f))
         {
             outlet_bang(e->e_outlet);
             return;
@@ -414,7 +597,15 @@ static void sel2_symbol(t_sel2 *x, t_symbol *s)
     int nelement;
     if (x->x_type == A_SYMBOL)
     {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (x->x_index.k_n)
+        {
+            if ((nelement = keyindex_findsymbol(&x->x_index, s)) >= 0)
+            {
+                outlet_bang(x->x_vec[nelement].e_outlet);
+                return;
+            }
+        }
+        else for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
             if (e->e_w.w_symbol == s)
         {
             outlet_bang(e->e_outlet);
@@ -427,6 +618,7 @@ static void sel2_symbol(t_sel2 *x, t_symbol *s)
 static void sel2_free(t_sel2 *x)
 {
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
+    keyindex_free(&x->x_index);
 }
 
 static void *select_new(t_symbol *s, int argc, t_atom *argv)
@@ -471,6 +663,8 @@ static void *select_new(t_symbol *s, int argc, t_atom *argv)
             else e->e_w.w_symbol = atom_getsymbolarg(n, argc, argv);
         }
         x->x_rejectout = outlet_new(&x->x_obj, &s_float);
+        keyindex_init(&x->x_index, x->x_type, argc, &x->x_vec->e_w,
+            sizeof(*x->x_vec));
         return (x);
     }
 
@@ -509,23 +703,46 @@ typedef struct _route
     int x_nelement;
     t_routeelement *x_vec;
     t_outlet *x_rejectout;
+    t_keyindex x_index;
 } t_route;
 
-static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
+    /* the first element matching a symbol or float, or 0 */
+static t_routeelement *route_findsymbol(t_route *x, t_symbol *s)
 {
     t_routeelement *e;
     int nelement;
-    if (x->x_type == A_SYMBOL)
+    if (x->x_index.k_n)
+        return ((nelement = keyindex_findsymbol(&x->x_index, s)) >= 0 ?
+            x->x_vec + nelement : 0);
+    for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (e->e_w.w_symbol == s)
+            return (e);
+    return (0);
+}
+
+static t_routeelement *route_findfloat(t_route *x, t_float f)
+{
+    t_routeelement *e;
+    int nelement;
+    if (x->x_index.k_n && keyindex_isfinite(f))
+        return ((nelement = keyindex_findfloat(&x->x_index, f)) >= 0 ?
+            x->x_vec + nelement : 0);
+    for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (keyindex_floateq(e->e_w.w_float, f))
+            return (e);
+    return (0);
+}
+
+static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
+{
+    t_routeelement *e;
+    if (x->x_type == A_SYMBOL && (e = route_findsymbol(x, sel)))
     {
-        for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_symbol == sel)
-        {
-            if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                    argc-1, argv+1);
-            else outlet_list(e->e_outlet, 0, argc, argv);
-            return;
-        }
+        if (argc > 0 && argv[0].a_type == A_SYMBOL)
+            outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                argc-1, argv+1);
+        else outlet_list(e->e_outlet, 0, argc, argv);
+        return;
     }
     outlet_anything(x->x_rejectout, sel, argc, argv);
 }
@@ -533,16 +750,12 @@ static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 {
     t_routeelement *e;
-    int nelement;
     if (x->x_type == A_FLOAT)
     {
-        t_float f;
         if (!argc) return;
         if (argv->a_type != A_FLOAT)
             goto rejected;
-        f = atom_getfloat(argv);
-        for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_float == f)
+        if ((e = route_findfloat(x, atom_getfloat(argv))))
         {
             if (argc > 1 && argv[1].a_type == A_SYMBOL)
                 outlet_anything(e->e_outlet, argv[1].a_w.w_symbol,
@@ -555,60 +768,45 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
     {
         if (argc > 1)       /* 2 or more args: treat as "list" */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = route_findsymbol(x, &s_list)))
             {
-                if (e->e_w.w_symbol == &s_list)
-                {
-                    if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                        outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                            argc-1, argv+1);
-                    else outlet_list(e->e_outlet, 0, argc, argv);
-                    return;
-                }
+                if (argc > 0 && argv[0].a_type == A_SYMBOL)
+                    outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                        argc-1, argv+1);
+                else outlet_list(e->e_outlet, 0, argc, argv);
+                return;
             }
         }
         else if (argc == 0)         /* no args: treat as "bang" */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = route_findsymbol(x, &s_bang)))
             {
-                if (e->e_w.w_symbol == &s_bang)
-                {
-                    outlet_bang(e->e_outlet);
-                    return;
-                }
+                outlet_bang(e->e_outlet);
+                return;
             }
         }
         else if (argv[0].a_type == A_FLOAT)    /* one float arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = route_findsymbol(x, &s_float)))
             {
-                if (e->e_w.w_symbol == &s_float)
-                {
-                    outlet_float(e->e_outlet, argv[0].a_w.w_float);
-                    return;
-                }
+                outlet_float(e->e_outlet, argv[0].a_w.w_float);
+                return;
             }
         }
         else if (argv[0].a_type == A_POINTER)    /* one pointer arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = route_findsymbol(x, &s_pointer)))
             {
-                if (e->e_w.w_symbol == &s_pointer)
-                {
-                    outlet_pointer(e->e_outlet, argv[0].a_w.w_gpointer);
-                    return;
-                }
+                outlet_pointer(e->e_outlet, argv[0].a_w.w_gpointer);
+                return;
             }
         }
         else                                     /* one symbol arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = route_findsymbol(x, &s_symbol)))
             {
-                if (e->e_w.w_symbol == &s_symbol)
-                {
-                    outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
-                    return;
-                }
+                outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
+                return;
             }
         }
     }
@@ -620,6 +818,7 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 static void route_free(t_route *x)
 {
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
+    keyindex_free(&x->x_index);
 }
 
 static void *route_new(t_symbol *s, int argc, t_atom *argv)
@@ -651,6 +850,8 @@ static void *route_new(t_symbol *s, int argc, t_atom *argv)
         else symbolinlet_new(&x->x_obj, &x->x_vec->e_w.w_symbol);
     }
     x->x_rejectout = outlet_new(&x->x_obj, &s_list);
+    keyindex_init(&x->x_index, x->x_type, argc, &x->x_vec->e_w,
+        sizeof(*x->x_vec));
     return (x);
 }
 
@@ -662,6 +863,135 @@ void route_setup(void)
     class_addanything(route_class, route_anything);
 }
 
+#ifdef PD_BENCHMARKS
+
+#define KEYTEST_NVALUE 12
+#define KEYTEST_MAXARG (5 * KEYINDEX_MIN)
+
+    /* float keys for the self-test: signed zeros, infinities and NaNs are
+    made from their bits, since with -ffast-math the compiler needn't keep
+    them apart from ordinary numbers */
+static t_float keytest_float(int which)
+{
+#if PD_FLOATSIZE == 32
+    static const uint32_t bits[5] = {0x80000000, 0x7f800000, 0xff800000,
+        0x7fc00000, 0xffc00001};
+    uint32_t b;
+#else
+    static const uint64_t bits[5] = {0x8000000000000000ULL,
+        0x7ff0000000000000ULL, 0xfff0000000000000ULL,
+        0x7ff8000000000000ULL, 0xfff8000000000001ULL};
+    uint64_t b;
+#endif
+    static const t_float plain[KEYTEST_NVALUE - 5] = {0, 1, -1, 2.5, 1e-30,
+        1e30, 3};
+    t_float f;
+    if (which < KEYTEST_NVALUE - 5)
+        return (plain[which]);
+    b = bits[which - (KEYTEST_NVALUE - 5)];
+    memcpy(&f, &b, sizeof(f));
+    return (f);
+}
+
+    /* the argument number a route finds for "a", or -1 */
+static int keytest_find(t_route *x, t_atom *a)
+{
+    t_routeelement *e = (x->x_type == A_FLOAT ?
+        route_findfloat(x, a->a_w.w_float) :
+            route_findsymbol(x, a->a_w.w_symbol));
+    return (e ? (int)(e - x->x_vec) : -1);
+}
+
+    /* make a route with "argc" arguments and check that each probe finds the
+    same argument with the index as by looking through all of them */
+static int keytest_route(int argc, t_atom *argv, int nprobe, t_atom *probes)
+{
+    t_route *x = (t_route *)route_new(0, argc, argv);
+    int nindex = x->x_index.k_n, i, which, nbad = 0;
+    if ((nindex != 0) != (argc > KEYINDEX_MIN))
+        nbad++;
+    for (i = 0; i < nprobe; i++)
+    {
+        x->x_index.k_n = nindex;
+        which = keytest_find(x, &probes[i]);
+        x->x_index.k_n = 0;
+        if (keytest_find(x, &probes[i]) != which)
+            nbad++;
+    }
+    x->x_index.k_n = nindex;
+    pd_free(&x->x_obj.ob_pd);
+    return (nbad);
+}
+
+    /* "pd self-test": check that route finds the same argument, the first
+    that matches, with the index as without.  The floats include both zeros,
+    which are equal, duplicates, and infinities and NaNs, which are kept out
+    of the index; NaNs match nothing.  Then try random lists of arguments on
+    both sides of KEYINDEX_MIN, including some of nothing but infinities and
+    NaNs, looking up every value. */
+int keyindex_selftest(void)
+{
+    static const char *names[KEYTEST_NVALUE] = {"a", "b", "c", "d", "e",
+        "list", "float", "symbol", "bang", "1", "-0", "a-b"};
+        /* arguments (as keytest_float() numbers) and the argument each of
+        them should find */
+    static const int fixed[][2] = {{1, 0}, {7, 1}, {6, 2}, {6, 2}, {10, -1},
+        {8, 5}, {0, 1}, {9, 7}, {11, -1}, {4, 9}, {8, 5}, {3, 11}};
+    t_atom argv[KEYTEST_MAXARG], probes[KEYTEST_NVALUE + KEYTEST_MAXARG];
+    unsigned int seed = 1;
+    int nfixed = sizeof(fixed)/sizeof(*fixed), argc, i, type, trial,
+        nbad = 0;
+    t_route *x;
+    for (i = 0; i < nfixed; i++)
+        SETFLOAT(&argv[i], keytest_float(fixed[i][0]));
+    x = (t_route *)route_new(0, nfixed, argv);
+    for (i = 0; i < 2 * nfixed; i++)
+    {
+        int nindex = x->x_index.k_n;
+        if (i >= nfixed)
+            x->x_index.k_n = 0;
+        if (keytest_find(x, &argv[i % nfixed]) != fixed[i % nfixed][1])
+            nbad++;
+        x->x_index.k_n = nindex;
+    }
+    SETFLOAT(&probes[0], 0.5);
+    if (keytest_find(x, &probes[0]) != -1)
+        nbad++;
+    pd_free(&x->x_obj.ob_pd);
+    for (type = 0; type < 2; type++)
+        for (argc = 1; argc <= KEYTEST_MAXARG; argc++)
+            for (trial = 0; trial < 20; trial++)
+    {
+        int nvalue = (trial == 19 ? 5 : KEYTEST_NVALUE),
+            first = (trial == 19 && !type ? KEYTEST_NVALUE - 5 : 0);
+        for (i = 0; i < argc; i++)
+        {
+            int which;
+            seed = seed * 435898247 + 382842987;
+            which = first + (int)((seed >> 8) % nvalue);
+            if (type)
+                SETSYMBOL(&argv[i], gensym(names[which]));
+            else SETFLOAT(&argv[i], keytest_float(which));
+        }
+        for (i = 0; i < KEYTEST_NVALUE; i++)
+        {
+            if (type)
+                SETSYMBOL(&probes[i], gensym(names[i]));
+            else SETFLOAT(&probes[i], keytest_float(i));
+        }
+        for (i = 0; i < argc; i++)
+            probes[KEYTEST_NVALUE + i] = argv[i];
+        if (!type)
+            SETFLOAT(&probes[0], 0.5);
+        nbad += keytest_route(argc, argv, KEYTEST_NVALUE + argc, probes);
+    }
+    if (nbad)
+        pd_error(0, "keyindex self-test: %d lookups differ", nbad);
+    return (nbad);
+}
+
+#endif /* PD_BENCHMARKS */
+
 /* -------------------------- pack ------------------------------ */
 
 static t_class *pack_class;
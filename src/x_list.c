@@ -3,6 +3,7 @@
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include <string.h>
 
 #ifdef _WIN32
@@ -61,12 +62,13 @@ typedef struct _alist
 
 #if HAVE_ALLOCA
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < LIST_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : gettmpbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < LIST_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < LIST_NGETBYTE || (freetmpbytes((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) \
+    ((x) = (t_atom *)gettmpbytes((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (freetmpbytes((x), (n) * sizeof(t_atom)))
 #endif
 
 static void atoms_copy(int argc, t_atom *from, t_atom *to)
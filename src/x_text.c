@@ -6,6 +6,7 @@
 moment it also defines "text" but it may later be better to split this off. */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "g_canvas.h"    /* just for glist_getfont, bother */
 #include <string.h>
 #include <stdio.h>
@@ -37,12 +38,13 @@ static t_class *text_define_class;
 #define TEXT_NGETBYTE 100 /* bigger that this we use alloc, not alloca */
 #if HAVE_ALLOCA
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < TEXT_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : gettmpbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < TEXT_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < TEXT_NGETBYTE || (freetmpbytes((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) \
+    ((x) = (t_atom *)gettmpbytes((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (freetmpbytes((x), (n) * sizeof(t_atom)))
 #endif
 
 /* --- common code for text define, textfile, and qlist for storing text -- */
@@ -60,6 +60,7 @@ void pd_error(void *object, char *fmt, ...);
 
 #define MAX_VARS        100
 #define MINODES         10 /* was 200 */
+#define MAX_ARGS        10 /* maximum number of function arguments */
 
 /* terminal defines */
 
@@ -185,6 +186,34 @@ struct ex_ex {
 #define EE_NOTABLE      0x08    /* NO TABLE */
 #define EE_NOVAR        0x10    /* NO VARIABLE */
 
+/*
+ * compiled expressions (see x_vexp_comp.c)
+ * the prefix stack of each expression is turned into a list of instructions
+ * that read and write numbered registers; scalar registers are struct ex_ex,
+ * vector registers (expr~ only) are signal vectors, number 0 being the output
+ */
+struct ex_instr {
+        int i_op;                       /* operation and operand kinds */
+        int i_dst;                      /* destination register */
+        int i_a, i_b, i_c;              /* operand registers */
+        struct ex_ex *i_node;           /* node for calls and $x#[]/$y#[] */
+};
+
+typedef struct ex_prog {
+        struct ex_instr *p_code;        /* the instructions */
+        int p_ncode;                    /* number of instructions */
+        int p_npre;                     /* fexpr~: # run once per block */
+        struct ex_ex *p_reg;            /* scalar registers */
+        int p_nreg;                     /* number of scalar registers */
+        int p_res;                      /* register holding the result */
+        t_float **p_vec;                /* vector registers */
+        int *p_vecin;                   /* inlet of each, -1 temporary, -2 out */
+        int p_nvec;                     /* number of vector registers */
+        int p_vsize;                    /* size of the temporary vectors */
+        int *p_args;                    /* argument registers of calls */
+        int p_nargs;                    /* size of p_args */
+} t_exprog;
+
 typedef struct expr {
 #ifdef PD
         t_object exp_ob;
@@ -204,6 +233,7 @@ typedef struct expr {
         long exp_proxy_id;
 #endif
         struct ex_ex *exp_stack[MAX_VARS];
+        t_exprog *exp_prog[MAX_VARS];   /* compiled exp_stack, if possible */
         struct ex_ex exp_var[MAX_VARS];
         struct ex_ex exp_res[MAX_VARS]; /* the evluation result */
         t_float *exp_p_var[MAX_VARS];
@@ -244,6 +274,16 @@ extern void ex_Avg(t_expr *expr, long int argc, struct ex_ex *argv,
 extern void ex_store(t_expr *expr, long int argc, struct ex_ex *argv,                                                                   struct ex_ex *optr);
 
 int value_getonly(t_symbol *s, t_float *f);
+extern void ex_sigidx(struct expr *expr, struct ex_ex *eptr,
+                        struct ex_ex *arg, struct ex_ex *optr, int idx);
+
+/* function prototypes for compiled expressions (x_vexp_comp.c) */
+extern t_exprog *ex_compile(t_expr *expr, struct ex_ex *eptr);
+extern void ex_progfree(t_exprog *prog);
+extern void ex_progdsp(t_expr *expr, t_exprog *prog);
+extern void ex_progrun(t_expr *expr, t_exprog *prog, int pre, int idx);
+extern void ex_compsetup(void);
+extern const char *ex_compisa(void);
 
 
 /* These pragmas are only used for MSVC, not MinGW or Cygwin <hans@at.or.at> */
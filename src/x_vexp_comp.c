@@ -0,0 +1,1155 @@
+/* Copyright (c) IRCAM.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* "expr" was written by Shahrokh Yadegari c. 1989. -msp */
+
+/*
+ * x_vexp_comp.c -- compile the prefix stack built by ex_parse() into a flat
+ *              list of instructions on numbered registers, and run them.
+ *
+ *      ex_eval() walks the prefix stack recursively every time, allocating
+ *      a temporary vector for each node of an expr~ and re-walking the
+ *      whole tree for every sample of an fexpr~.  The compiled form is made
+ *      once by expr_new(); it folds constant subexpressions, keeps its
+ *      temporary vectors from one block to the next, fuses a multiplication
+ *      with the addition that uses it, and for fexpr~ moves whatever does
+ *      not depend on the signals out of the per-sample loop.
+ *
+ *      Each instruction computes exactly what ex_eval() does for the same
+ *      node, including the int/float typing of scalars and the divide by
+ *      zero checks.  Expressions using tables, variables, stores or symbols
+ *      are not compiled and are still evaluated by ex_eval().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "x_vexp.h"
+
+extern struct ex_ex *ex_if(t_expr *expr, struct ex_ex *eptr,
+                                struct ex_ex *optr, struct ex_ex *argv, int idx);
+void ex_dzdetect(struct expr *expr);
+
+/*
+ * operators, in the order of the instruction codes
+ */
+#define EO_MUL          0
+#define EO_ADD          1
+#define EO_SUB          2
+#define EO_LT           3
+#define EO_LE           4
+#define EO_GT           5
+#define EO_GE           6
+#define EO_EQ           7
+#define EO_NE           8
+#define EO_SL           9       /* the following convert to int */
+#define EO_SR           10
+#define EO_AND          11
+#define EO_XOR          12
+#define EO_OR           13
+#define EO_LAND         14
+#define EO_LOR          15
+#define EO_MOD          16
+#define EO_DIV          17
+#define EO_NOT          18      /* unary operators */
+#define EO_NEG          19
+#define EO_UMINUS       20
+#define EO_N            21
+
+/*
+ * operand kinds of an operator
+ */
+#define EK_S            0       /* scalars of any type */
+#define EK_F            1       /* scalars known to be float */
+#define EK_VV           2       /* vector and vector (or vector, if unary) */
+#define EK_VS           3       /* vector and scalar */
+#define EK_SV           4       /* scalar and vector */
+#define EK_N            5
+
+#define EX_BIN(eo, ek)  ((eo) * EK_N + (ek))
+
+/*
+ * the other instructions
+ */
+#define EX_NOP          (EO_N * EK_N)
+#define EX_MOVE         (EX_NOP + 1)    /* dst = a */
+#define EX_LDI          (EX_NOP + 2)    /* dst = $i(a) */
+#define EX_LDF          (EX_NOP + 3)    /* dst = $f(a) */
+#define EX_LDX0         (EX_NOP + 4)    /* dst = $x(a)[0] */
+#define EX_LDY1         (EX_NOP + 5)    /* dst = $y(a)[-1] */
+#define EX_LDX          (EX_NOP + 6)    /* dst = $x(a)[b] */
+#define EX_LDY          (EX_NOP + 7)    /* dst = $y(a)[b] */
+#define EX_SIGIDX       (EX_NOP + 8)    /* dst = node[a] */
+#define EX_CALL         (EX_NOP + 9)    /* dst = node(args at a) */
+#define EX_JZ           (EX_NOP + 10)   /* if (!a) skip b instructions */
+#define EX_JMP          (EX_NOP + 11)   /* skip b instructions */
+#define EX_VMOVE        (EX_NOP + 12)   /* vector dst = vector a */
+#define EX_VSET         (EX_NOP + 13)   /* vector dst = scalar a */
+#define EX_SEL          (EX_NOP + 14)   /* dst = a ? b : c, 4 kinds */
+#define EX_MAD          (EX_NOP + 18)   /* dst = a * b + c, 4 kinds */
+
+/*
+ * for EX_CALL arguments and results, and during compilation,
+ * operands are scalar registers if >= 0 and vector registers if < 0
+ */
+#define EX_ISVEC(o)     ((o) < 0)
+#define EX_VREG(o)      (~(o))
+
+#define EX_VOUT         -2      /* p_vecin of the output vector */
+#define EX_VTMP         -1      /* p_vecin of a temporary vector */
+
+#define EX_FLT(r)       ((r)->ex_type == ET_INT ? (t_float)(r)->ex_int : \
+                                                                (r)->ex_flt)
+
+/*
+ * the value of the operators as in ex_eval(); the scalar versions detect
+ * division by zero themselves, the vector ones after the vector is checked
+ */
+#define DZC_PLAIN(ARG1,OPR,ARG2)        (ARG1 OPR ARG2)
+#define DZC_INT(ARG1,OPR,ARG2)          (((int)ARG1) OPR ((int)ARG2))
+#define DZC_MOD(ARG1,OPR,ARG2)          ((((int)ARG2)?(((int)ARG1) OPR \
+                                        ((int)ARG2)) : (ex_dzdetect(expr),0)))
+#define DZC_DIV(ARG1,OPR,ARG2)  (((ARG2)?(ARG1 OPR ARG2):(ex_dzdetect(expr),0)))
+#define DZC_VMOD(ARG1,OPR,ARG2)         ((((int)ARG2)?(((int)ARG1) OPR \
+                                                        ((int)ARG2)) : 0))
+#define DZC_VDIV(ARG1,OPR,ARG2)         (((ARG2)?(ARG1 OPR ARG2):0))
+
+/*
+ * ex_vzero -- report division by zero if any of the divisors is zero;
+ *             isint is set for the modulo, that converts them to int
+ */
+static void
+ex_vzero(t_expr *expr, t_float *fp, int n, int isint)
+{
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (isint ? !(int)fp[i] : !fp[i]) {
+                        ex_dzdetect(expr);
+                        return;
+                }
+}
+
+#define EX_BINCASES(eo, OPR, DZC, VDZC, ZCHK)                           \
+case EX_BIN(eo, EK_S):                                                  \
+        a = &reg[ip->i_a];                                              \
+        b = &reg[ip->i_b];                                              \
+        o = &reg[ip->i_dst];                                            \
+        if (a->ex_type == ET_INT) {                                     \
+                if (b->ex_type == ET_INT) {                             \
+                        o->ex_int = DZC(a->ex_int, OPR, b->ex_int);     \
+                        o->ex_type = ET_INT;                            \
+                } else {                                                \
+                        o->ex_flt = DZC(((t_float)a->ex_int), OPR,      \
+                                                        b->ex_flt);     \
+                        o->ex_type = ET_FLT;                            \
+                }                                                       \
+        } else {                                                        \
+                if (b->ex_type == ET_INT)                               \
+                        o->ex_flt = DZC(a->ex_flt, OPR, b->ex_int);     \
+                else                                                    \
+                        o->ex_flt = DZC(a->ex_flt, OPR, b->ex_flt);     \
+                o->ex_type = ET_FLT;                                    \
+        }                                                               \
+        break;                                                          \
+case EX_BIN(eo, EK_F):                                                  \
+        o = &reg[ip->i_dst];                                            \
+        o->ex_flt = DZC(reg[ip->i_a].ex_flt, OPR, reg[ip->i_b].ex_flt); \
+        o->ex_type = ET_FLT;                                            \
+        break;                                                          \
+case EX_BIN(eo, EK_VV):                                                 \
+        ap = vec[ip->i_a];                                              \
+        bp = vec[ip->i_b];                                              \
+        op = vec[ip->i_dst];                                            \
+        if (ZCHK)                                                       \
+                ex_vzero(expr, bp, n, ZCHK == 2);                       \
+        for (i = 0; i < n; i++)                                         \
+                op[i] = VDZC(ap[i], OPR, bp[i]);                        \
+        break;                                                          \
+case EX_BIN(eo, EK_VS):                                                 \
+        ap = vec[ip->i_a];                                              \
+        g = EX_FLT(&reg[ip->i_b]);                                      \
+        op = vec[ip->i_dst];                                            \
+        if (ZCHK)                                                       \
+                ex_vzero(expr, &g, 1, ZCHK == 2);                       \
+        for (i = 0; i < n; i++)                                         \
+                op[i] = VDZC(ap[i], OPR, g);                            \
+        break;                                                          \
+case EX_BIN(eo, EK_SV):                                                 \
+        f = EX_FLT(&reg[ip->i_a]);                                      \
+        bp = vec[ip->i_b];                                              \
+        op = vec[ip->i_dst];                                            \
+        if (ZCHK)                                                       \
+                ex_vzero(expr, bp, n, ZCHK == 2);                       \
+        for (i = 0; i < n; i++)                                         \
+                op[i] = VDZC(f, OPR, bp[i]);                            \
+        break;
+
+/*
+ * unary operators, TYPE is applied to float operands
+ */
+#define EX_UNCASES(eo, OPR, TYPE)                                       \
+case EX_BIN(eo, EK_S):                                                  \
+        a = &reg[ip->i_a];                                              \
+        o = &reg[ip->i_dst];                                            \
+        if (a->ex_type == ET_INT) {                                     \
+                o->ex_int = OPR a->ex_int;                              \
+                o->ex_type = ET_INT;                                    \
+        } else {                                                        \
+                o->ex_flt = OPR (TYPE a->ex_flt);                       \
+                o->ex_type = ET_FLT;                                    \
+        }                                                               \
+        break;                                                          \
+case EX_BIN(eo, EK_F):                                                  \
+        o = &reg[ip->i_dst];                                            \
+        o->ex_flt = OPR (TYPE reg[ip->i_a].ex_flt);                     \
+        o->ex_type = ET_FLT;                                            \
+        break;                                                          \
+case EX_BIN(eo, EK_VV):                                                 \
+        ap = vec[ip->i_a];                                              \
+        op = vec[ip->i_dst];                                            \
+        for (i = 0; i < n; i++)                                         \
+                op[i] = OPR (TYPE ap[i]);                               \
+        break;
+
+/*
+ * On x86 the interpreter is also compiled for AVX2, so that the loops over
+ * vectors use 8 floats at a time on the CPUs that have it.
+ */
+#if PD_FLOATSIZE == 32 && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define EX_AVX2
+#define EX_INLINE inline __attribute__((always_inline))
+#else
+#define EX_INLINE
+#endif
+
+/*
+ * ex_dorun -- run the instructions from ip up to end;
+ *             idx is the sample number processed for fexpr~
+ */
+static EX_INLINE void
+ex_dorun(t_expr *expr, t_exprog *prog, struct ex_instr *ip,
+                                                struct ex_instr *end, int idx)
+{
+        struct ex_ex *reg = prog->p_reg, *a, *b, *o;
+        struct ex_ex args[MAX_ARGS], res;
+        t_float **vec = prog->p_vec;
+        t_float *ap, *bp, *cp, *op, f, g;
+        t_ex_func *fn;
+        int n = expr->exp_vsize, i, j, *argp;
+
+        for (; ip < end; ip++) {
+                switch (ip->i_op) {
+                EX_BINCASES(EO_MUL, *, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_ADD, +, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_SUB, -, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_LT, <, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_LE, <=, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_GT, >, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_GE, >=, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_EQ, ==, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_NE, !=, DZC_PLAIN, DZC_PLAIN, 0)
+                EX_BINCASES(EO_SL, <<, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_SR, >>, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_AND, &, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_XOR, ^, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_OR, |, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_LAND, &&, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_LOR, ||, DZC_INT, DZC_INT, 0)
+                EX_BINCASES(EO_MOD, %, DZC_MOD, DZC_VMOD, 2)
+                EX_BINCASES(EO_DIV, /, DZC_DIV, DZC_VDIV, 1)
+                EX_UNCASES(EO_NOT, !, +)
+                EX_UNCASES(EO_NEG, ~, (long))
+                EX_UNCASES(EO_UMINUS, -, +)
+                case EX_NOP:
+                        break;
+                case EX_MOVE:
+                        reg[ip->i_dst] = reg[ip->i_a];
+                        break;
+                case EX_LDI:
+                        o = &reg[ip->i_dst];
+                        o->ex_int = expr->exp_var[ip->i_a].ex_int;
+                        o->ex_type = ET_INT;
+                        break;
+                case EX_LDF:
+                        o = &reg[ip->i_dst];
+                        o->ex_flt = expr->exp_var[ip->i_a].ex_flt;
+                        o->ex_type = ET_FLT;
+                        break;
+                case EX_LDX0:
+                        o = &reg[ip->i_dst];
+                        o->ex_flt = expr->exp_var[ip->i_a].ex_vec[idx];
+                        o->ex_type = ET_FLT;
+                        break;
+                case EX_LDY1:
+                        o = &reg[ip->i_dst];
+                        if (idx == 0)
+                                o->ex_flt =
+                                    expr->exp_p_res[ip->i_a][n - 1];
+                        else
+                                o->ex_flt =
+                                    expr->exp_tmpres[ip->i_a][idx - 1];
+                        o->ex_type = ET_FLT;
+                        break;
+                case EX_LDX:
+                case EX_LDY:
+                        /*
+                         * a constant index that is in range: the cases of
+                         * cal_sigidx() without interpolation
+                         */
+                        o = &reg[ip->i_dst];
+                        j = idx + ip->i_b;
+                        if (j >= 0)
+                                o->ex_flt = (ip->i_op == EX_LDX ?
+                                        expr->exp_var[ip->i_a].ex_vec :
+                                        expr->exp_tmpres[ip->i_a])[j];
+                        else if (j + n > 0)
+                                o->ex_flt = (ip->i_op == EX_LDX ?
+                                        expr->exp_p_var[ip->i_a] :
+                                        expr->exp_p_res[ip->i_a])[j + n];
+                        else {
+                                res.ex_type = ET_INT;
+                                res.ex_int = ip->i_b;
+                                ex_sigidx(expr, ip->i_node, &res, o, idx);
+                        }
+                        o->ex_type = ET_FLT;
+                        break;
+                case EX_SIGIDX:
+                        ex_sigidx(expr, ip->i_node, &reg[ip->i_a],
+                                                        &reg[ip->i_dst], idx);
+                        break;
+                case EX_CALL:
+                        fn = (t_ex_func *)ip->i_node->ex_ptr;
+                        argp = prog->p_args + ip->i_a;
+                        for (j = 0; j < fn->f_argc; j++) {
+                                if (EX_ISVEC(argp[j])) {
+                                        args[j].ex_type = ET_VEC;
+                                        args[j].ex_vec = vec[EX_VREG(argp[j])];
+                                } else
+                                        args[j] = reg[argp[j]];
+                        }
+                        if (EX_ISVEC(ip->i_dst)) {
+                                o = &res;
+                                o->ex_type = ET_VEC;
+                                o->ex_vec = vec[EX_VREG(ip->i_dst)];
+                        } else {
+                                o = &reg[ip->i_dst];
+                                o->ex_type = 0;
+                        }
+                        (*fn->f_func)(expr, fn->f_argc, args, o);
+                        break;
+                case EX_JZ:
+                        a = &reg[ip->i_a];
+                        if (a->ex_type == ET_INT ? !a->ex_int : !a->ex_flt)
+                                ip += ip->i_b - 1;
+                        break;
+                case EX_JMP:
+                        ip += ip->i_b - 1;
+                        break;
+                case EX_VMOVE:
+                        if (vec[ip->i_dst] != vec[ip->i_a])
+                                memcpy(vec[ip->i_dst], vec[ip->i_a],
+                                                        n * sizeof (t_float));
+                        break;
+                case EX_VSET:
+                        f = EX_FLT(&reg[ip->i_a]);
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = f;
+                        break;
+                /*
+                 * "if" with a vector condition
+                 */
+                case EX_SEL:
+                        ap = vec[ip->i_a];
+                        bp = vec[ip->i_b];
+                        cp = vec[ip->i_c];
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = (ap[i] ? bp[i] : cp[i]);
+                        break;
+                case EX_SEL + 1:
+                        ap = vec[ip->i_a];
+                        bp = vec[ip->i_b];
+                        g = EX_FLT(&reg[ip->i_c]);
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = (ap[i] ? bp[i] : g);
+                        break;
+                case EX_SEL + 2:
+                        ap = vec[ip->i_a];
+                        f = EX_FLT(&reg[ip->i_b]);
+                        cp = vec[ip->i_c];
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = (ap[i] ? f : cp[i]);
+                        break;
+                case EX_SEL + 3:
+                        ap = vec[ip->i_a];
+                        f = EX_FLT(&reg[ip->i_b]);
+                        g = EX_FLT(&reg[ip->i_c]);
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = (ap[i] ? f : g);
+                        break;
+                /*
+                 * a multiplication fused with the addition that follows;
+                 * the product is rounded to t_float before the addition
+                 * just as when the two are done one after the other
+                 */
+                case EX_MAD:
+                        ap = vec[ip->i_a];
+                        bp = vec[ip->i_b];
+                        cp = vec[ip->i_c];
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = ap[i] * bp[i] + cp[i];
+                        break;
+                case EX_MAD + 1:
+                        ap = vec[ip->i_a];
+                        bp = vec[ip->i_b];
+                        g = EX_FLT(&reg[ip->i_c]);
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = ap[i] * bp[i] + g;
+                        break;
+                case EX_MAD + 2:
+                        ap = vec[ip->i_a];
+                        f = EX_FLT(&reg[ip->i_b]);
+                        cp = vec[ip->i_c];
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = ap[i] * f + cp[i];
+                        break;
+                case EX_MAD + 3:
+                        ap = vec[ip->i_a];
+                        f = EX_FLT(&reg[ip->i_b]);
+                        g = EX_FLT(&reg[ip->i_c]);
+                        op = vec[ip->i_dst];
+                        for (i = 0; i < n; i++)
+                                op[i] = ap[i] * f + g;
+                        break;
+                default:
+                        post("expr: ex_run: bad instruction %d", ip->i_op);
+                        return;
+                }
+        }
+}
+
+static void
+ex_run_c(t_expr *expr, t_exprog *prog, struct ex_instr *ip,
+                                                struct ex_instr *end, int idx)
+{
+        ex_dorun(expr, prog, ip, end, idx);
+}
+
+#ifdef EX_AVX2
+static __attribute__((target("avx2"))) void
+ex_run_avx2(t_expr *expr, t_exprog *prog, struct ex_instr *ip,
+                                                struct ex_instr *end, int idx)
+{
+        ex_dorun(expr, prog, ip, end, idx);
+}
+#endif
+
+static void (*ex_run)(t_expr *expr, t_exprog *prog, struct ex_instr *ip,
+                                struct ex_instr *end, int idx) = ex_run_c;
+static const char *ex_isa = "C";
+
+/*
+ * ex_compsetup -- pick the interpreter for this CPU
+ */
+void
+ex_compsetup(void)
+{
+#ifdef EX_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                ex_run = ex_run_avx2;
+                ex_isa = "AVX2";
+        }
+#endif
+}
+
+const char *
+ex_compisa(void)
+{
+        return (ex_isa);
+}
+
+/*
+ * ex_progrun -- run a compiled expression; for fexpr~ "pre" runs the part
+ *               that is the same for all samples and is done once per block,
+ *               otherwise the rest of it is run (for expr and expr~, all)
+ */
+void
+ex_progrun(t_expr *expr, t_exprog *prog, int pre, int idx)
+{
+        if (pre)
+                (*ex_run)(expr, prog, prog->p_code,
+                                        prog->p_code + prog->p_npre, idx);
+        else
+                (*ex_run)(expr, prog, prog->p_code + prog->p_npre,
+                                        prog->p_code + prog->p_ncode, idx);
+}
+
+/* ------------------------- the compiler ----------------------------- */
+
+typedef struct ex_comp {
+        t_expr *c_expr;
+        t_exprog *c_prog;
+        int c_vector;                   /* expr~: vectors are allowed */
+        int c_filter;                   /* fexpr~: $x#[] and $y#[] are */
+        int c_maxcode, c_maxreg, c_maxvec, c_maxargs;   /* allocated sizes */
+        char *c_type;                   /* register type if known, or 0 */
+        char *c_const;                  /* register is a constant */
+        char *c_vary;                   /* register varies with the sample */
+        char *c_ivary;                  /* instruction varies with the sample */
+        int *c_free;                    /* temporary vectors not in use */
+        int c_nfree;
+        int c_inlet[MAX_VARS];          /* vector register of an inlet, or 0 */
+} t_excomp;
+
+/*
+ * ex_grow -- make room for n elements of size elsize in *bufp
+ *            holding *maxp; returns 0 if out of memory
+ */
+static int
+ex_grow(void *bufp, int *maxp, int n, size_t elsize)
+{
+        int newmax = (*maxp ? *maxp : 8);
+        void *newbuf;
+
+        if (n <= *maxp)
+                return (1);
+        while (newmax < n)
+                newmax *= 2;
+        if (!(newbuf = fts_realloc(*(void **)bufp, newmax * elsize)))
+                return (0);
+        memset((char *)newbuf + *maxp * elsize, 0, (newmax - *maxp) * elsize);
+        *(void **)bufp = newbuf;
+        *maxp = newmax;
+        return (1);
+}
+
+/*
+ * ex_newreg -- a new scalar register; returns -1 if out of memory
+ */
+static int
+ex_newreg(t_excomp *c, int type, int vary)
+{
+        t_exprog *p = c->c_prog;
+        int max = c->c_maxreg, n = p->p_nreg;
+
+        if (n >= c->c_maxreg) {
+                if (!ex_grow(&p->p_reg, &max, n + 1, sizeof (struct ex_ex)))
+                        return (-1);
+                max = c->c_maxreg;
+                if (!ex_grow(&c->c_const, &max, n + 1, 1))
+                        return (-1);
+                max = c->c_maxreg;
+                if (!ex_grow(&c->c_vary, &max, n + 1, 1) ||
+                    !ex_grow(&c->c_type, &c->c_maxreg, n + 1, 1))
+                        return (-1);
+        }
+        c->c_type[n] = type;
+        c->c_const[n] = 0;
+        c->c_vary[n] = vary;
+        return (p->p_nreg++);
+}
+
+/*
+ * ex_constreg -- a register holding the value of an ET_INT or ET_FLT node
+ */
+static int
+ex_constreg(t_excomp *c, struct ex_ex *val)
+{
+        int r;
+
+        if ((r = ex_newreg(c, val->ex_type, 0)) < 0)
+                return (-1);
+        c->c_prog->p_reg[r] = *val;
+        c->c_const[r] = 1;
+        return (r);
+}
+
+/*
+ * ex_emit -- add an instruction; returns its index or -1
+ */
+static int
+ex_emit(t_excomp *c, int op, int dst, int a, int b, int cc,
+                                        struct ex_ex *node, int vary)
+{
+        t_exprog *p = c->c_prog;
+        struct ex_instr *ip;
+        int max = c->c_maxcode, n = p->p_ncode;
+
+        if (!ex_grow(&p->p_code, &max, n + 1, sizeof (struct ex_instr)) ||
+            !ex_grow(&c->c_ivary, &c->c_maxcode, n + 1, 1))
+                return (-1);
+        ip = &p->p_code[n];
+        ip->i_op = op;
+        ip->i_dst = dst;
+        ip->i_a = a;
+        ip->i_b = b;
+        ip->i_c = cc;
+        ip->i_node = node;
+        c->c_ivary[n] = vary;
+        return (p->p_ncode++);
+}
+
+/*
+ * ex_newvec -- a vector register; vecin is an inlet number, EX_VOUT or
+ *              EX_VTMP for a temporary, that may reuse one no longer in use
+ */
+static int
+ex_newvec(t_excomp *c, int vecin)
+{
+        t_exprog *p = c->c_prog;
+        int max = c->c_maxvec;
+
+        if (vecin == EX_VTMP && c->c_nfree)
+                return (c->c_free[--c->c_nfree]);
+        if (!ex_grow(&p->p_vec, &max, p->p_nvec + 1, sizeof (t_float *)))
+                return (-1);
+        max = c->c_maxvec;
+        if (!ex_grow(&c->c_free, &max, p->p_nvec + 1, sizeof (int)) ||
+            !ex_grow(&p->p_vecin, &c->c_maxvec, p->p_nvec + 1, sizeof (int)))
+                return (-1);
+        p->p_vecin[p->p_nvec] = vecin;
+        return (p->p_nvec++);
+}
+
+/*
+ * ex_freevec -- the operand o has been used: if it is a temporary vector
+ *               it can be reused
+ */
+static void
+ex_freevec(t_excomp *c, int o)
+{
+        if (!EX_ISVEC(o) || c->c_prog->p_vecin[EX_VREG(o)] != EX_VTMP)
+                return;
+        c->c_free[c->c_nfree++] = EX_VREG(o);
+}
+
+/*
+ * ex_fold -- the last instruction only reads constants: run it now
+ *            and make its result a constant
+ */
+static void
+ex_fold(t_excomp *c)
+{
+        t_exprog *p = c->c_prog;
+        struct ex_instr *ip = &p->p_code[p->p_ncode - 1];
+
+        ex_run_c(c->c_expr, p, ip, ip + 1, 0);
+        c->c_const[ip->i_dst] = 1;
+        c->c_type[ip->i_dst] = p->p_reg[ip->i_dst].ex_type;
+        c->c_vary[ip->i_dst] = 0;
+        p->p_ncode--;
+}
+
+/*
+ * ex_opindex -- the EO_ number of an operator, or -1
+ */
+static int
+ex_opindex(long op)
+{
+        switch (op) {
+        case OP_MUL:    return (EO_MUL);
+        case OP_ADD:    return (EO_ADD);
+        case OP_SUB:    return (EO_SUB);
+        case OP_LT:     return (EO_LT);
+        case OP_LE:     return (EO_LE);
+        case OP_GT:     return (EO_GT);
+        case OP_GE:     return (EO_GE);
+        case OP_EQ:     return (EO_EQ);
+        case OP_NE:     return (EO_NE);
+        case OP_SL:     return (EO_SL);
+        case OP_SR:     return (EO_SR);
+        case OP_AND:    return (EO_AND);
+        case OP_XOR:    return (EO_XOR);
+        case OP_OR:     return (EO_OR);
+        case OP_LAND:   return (EO_LAND);
+        case OP_LOR:    return (EO_LOR);
+        case OP_MOD:    return (EO_MOD);
+        case OP_DIV:    return (EO_DIV);
+        case OP_NOT:    return (EO_NOT);
+        case OP_NEG:    return (EO_NEG);
+        case OP_UMINUS: return (EO_UMINUS);
+        default:        return (-1);
+        }
+}
+
+/*
+ * ex_tofloat -- an int constant used with a float, by an operator that
+ *               does not convert to int, can be made a float constant now
+ */
+static int
+ex_tofloat(t_excomp *c, int r, int other, int eo)
+{
+        struct ex_ex val;
+
+        if (eo >= EO_SL && eo <= EO_MOD)
+                return (r);
+        if (!c->c_const[r] || c->c_type[r] != ET_INT ||
+                                                c->c_type[other] != ET_FLT)
+                return (r);
+        val.ex_type = ET_FLT;
+        val.ex_flt = c->c_prog->p_reg[r].ex_int;
+        return (ex_constreg(c, &val));
+}
+
+/*
+ * ex_fusemul -- if the operand m of an addition is a vector product just
+ *               computed, turn that multiplication into a multiply-add
+ */
+static int
+ex_fusemul(t_excomp *c, int m, int y, int hint, int *res)
+{
+        t_exprog *p = c->c_prog;
+        struct ex_instr *ip;
+        int k, t, dst;
+
+        if (!EX_ISVEC(m) || !p->p_ncode ||
+            p->p_vecin[EX_VREG(m)] != EX_VTMP)
+                return (0);
+        ip = &p->p_code[p->p_ncode - 1];
+        if (ip->i_dst != EX_VREG(m) || (ip->i_op != EX_BIN(EO_MUL, EK_VV) &&
+            ip->i_op != EX_BIN(EO_MUL, EK_VS) &&
+            ip->i_op != EX_BIN(EO_MUL, EK_SV)))
+                return (0);
+        if (ip->i_op == EX_BIN(EO_MUL, EK_SV)) {
+                t = ip->i_a;
+                ip->i_a = ip->i_b;
+                ip->i_b = t;
+                ip->i_op = EX_BIN(EO_MUL, EK_VS);
+        }
+        k = (ip->i_op == EX_BIN(EO_MUL, EK_VS) ? 2 : 0) |
+                                                (EX_ISVEC(y) ? 0 : 1);
+        ex_freevec(c, m);
+        ex_freevec(c, y);
+        if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0)
+                return (0);
+        ip->i_op = EX_MAD + k;
+        ip->i_c = (EX_ISVEC(y) ? EX_VREG(y) : y);
+        ip->i_dst = dst;
+        *res = ~dst;
+        return (1);
+}
+
+/*
+ * ex_compbin -- compile a binary operator on the operands a and b
+ */
+static int
+ex_compbin(t_excomp *c, int eo, int a, int b, int hint, int *res)
+{
+        t_exprog *p = c->c_prog;
+        int ek, type, vary, dst;
+
+        if (!EX_ISVEC(a) && !EX_ISVEC(b)) {
+                if ((a = ex_tofloat(c, a, b, eo)) < 0 ||
+                    (b = ex_tofloat(c, b, a, eo)) < 0)
+                        return (0);
+                if (c->c_type[a] == ET_FLT && c->c_type[b] == ET_FLT)
+                        ek = EK_F, type = ET_FLT;
+                else if (c->c_type[a] == ET_INT && c->c_type[b] == ET_INT)
+                        ek = EK_S, type = ET_INT;
+                else if (c->c_type[a] == ET_FLT || c->c_type[b] == ET_FLT)
+                        ek = EK_S, type = ET_FLT;
+                else ek = EK_S, type = 0;
+                vary = (c->c_vary[a] || c->c_vary[b]);
+                if ((dst = ex_newreg(c, type, vary)) < 0 ||
+                    ex_emit(c, EX_BIN(eo, ek), dst, a, b, 0, 0, vary) < 0)
+                        return (0);
+                        /* leave the division by zero to be reported */
+                if (c->c_const[a] && c->c_const[b] &&
+                    !((eo == EO_DIV && !EX_FLT(&p->p_reg[b])) ||
+                      (eo == EO_MOD && !(int)EX_FLT(&p->p_reg[b]))))
+                        ex_fold(c);
+                *res = dst;
+                return (1);
+        }
+        if (eo == EO_ADD && (ex_fusemul(c, a, b, hint, res) ||
+                                        ex_fusemul(c, b, a, hint, res)))
+                return (1);
+        ek = (EX_ISVEC(a) ? (EX_ISVEC(b) ? EK_VV : EK_VS) : EK_SV);
+        ex_freevec(c, a);
+        ex_freevec(c, b);
+        if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0 ||
+            ex_emit(c, EX_BIN(eo, ek), dst, (EX_ISVEC(a) ? EX_VREG(a) : a),
+                        (EX_ISVEC(b) ? EX_VREG(b) : b), 0, 0, 1) < 0)
+                return (0);
+        *res = ~dst;
+        return (1);
+}
+
+/*
+ * ex_compun -- compile a unary operator on the operand a
+ */
+static int
+ex_compun(t_excomp *c, int eo, int a, int hint, int *res)
+{
+        int dst, type;
+
+        if (EX_ISVEC(a)) {
+                ex_freevec(c, a);
+                if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0 ||
+                    ex_emit(c, EX_BIN(eo, EK_VV), dst, EX_VREG(a),
+                                                        0, 0, 0, 1) < 0)
+                        return (0);
+                *res = ~dst;
+                return (1);
+        }
+        type = c->c_type[a];
+        if ((dst = ex_newreg(c, type, c->c_vary[a])) < 0 ||
+            ex_emit(c, EX_BIN(eo, (type == ET_FLT ? EK_F : EK_S)), dst, a,
+                                                0, 0, 0, c->c_vary[a]) < 0)
+                return (0);
+        if (c->c_const[a])
+                ex_fold(c);
+        *res = dst;
+        return (1);
+}
+
+static struct ex_ex *ex_comp(t_excomp *c, struct ex_ex *eptr, int *res,
+                                                                int hint);
+
+/*
+ * ex_compif -- compile "if"; with a scalar condition only one of the
+ *              two values is computed, as in ex_if()
+ */
+static struct ex_ex *
+ex_compif(t_excomp *c, struct ex_ex *eptr, int *res, int hint)
+{
+        t_exprog *p = c->c_prog;
+        int cond, l, r, start, jz, movel, jmp, mover, dst, i, vary;
+
+        if (!(eptr = ex_comp(c, eptr, &cond, -1)))
+                return (exNULL);
+        if (EX_ISVEC(cond)) {
+                if (!(eptr = ex_comp(c, eptr, &l, -1)) ||
+                    !(eptr = ex_comp(c, eptr, &r, -1)))
+                        return (exNULL);
+                ex_freevec(c, cond);
+                ex_freevec(c, l);
+                ex_freevec(c, r);
+                if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0 ||
+                    ex_emit(c, EX_SEL + (EX_ISVEC(l) ? 0 : 2) +
+                        (EX_ISVEC(r) ? 0 : 1), dst, EX_VREG(cond),
+                            (EX_ISVEC(l) ? EX_VREG(l) : l),
+                                (EX_ISVEC(r) ? EX_VREG(r) : r), 0, 1) < 0)
+                        return (exNULL);
+                *res = ~dst;
+                return (eptr);
+        }
+        /*
+         * the moves of the two values to the result are filled in once
+         * we know whether the result is a vector
+         */
+        start = p->p_ncode;
+        if ((jz = ex_emit(c, EX_JZ, 0, cond, 0, 0, 0, c->c_vary[cond])) < 0 ||
+            !(eptr = ex_comp(c, eptr, &l, -1)) ||
+            (movel = ex_emit(c, EX_NOP, 0, 0, 0, 0, 0, 0)) < 0 ||
+            (jmp = ex_emit(c, EX_JMP, 0, 0, 0, 0, 0, 0)) < 0 ||
+            !(eptr = ex_comp(c, eptr, &r, -1)) ||
+            (mover = ex_emit(c, EX_NOP, 0, 0, 0, 0, 0, 0)) < 0)
+                return (exNULL);
+        p->p_code[jz].i_b = jmp + 1 - jz;
+        p->p_code[jmp].i_b = mover + 1 - jmp;
+        if (EX_ISVEC(l) || EX_ISVEC(r)) {
+                ex_freevec(c, l);
+                ex_freevec(c, r);
+                if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0)
+                        return (exNULL);
+                p->p_code[movel].i_op = (EX_ISVEC(l) ? EX_VMOVE : EX_VSET);
+                p->p_code[movel].i_a = (EX_ISVEC(l) ? EX_VREG(l) : l);
+                p->p_code[movel].i_dst = dst;
+                p->p_code[mover].i_op = (EX_ISVEC(r) ? EX_VMOVE : EX_VSET);
+                p->p_code[mover].i_a = (EX_ISVEC(r) ? EX_VREG(r) : r);
+                p->p_code[mover].i_dst = dst;
+                *res = ~dst;
+                return (eptr);
+        }
+        if ((dst = ex_newreg(c, (c->c_type[l] == c->c_type[r] ?
+                                        c->c_type[l] : 0), 0)) < 0)
+                return (exNULL);
+        p->p_code[movel].i_op = p->p_code[mover].i_op = EX_MOVE;
+        p->p_code[movel].i_dst = p->p_code[mover].i_dst = dst;
+        p->p_code[movel].i_a = l;
+        p->p_code[mover].i_a = r;
+        /*
+         * for fexpr~ the whole "if" is computed once per block if none of
+         * it varies from sample to sample, otherwise all of it per sample
+         */
+        for (i = start, vary = c->c_vary[l] || c->c_vary[r]; i < p->p_ncode; i++)
+                vary |= c->c_ivary[i];
+        if (vary) {
+                for (i = start; i < p->p_ncode; i++) {
+                        c->c_ivary[i] = 1;
+                        if (!EX_ISVEC(p->p_code[i].i_dst) &&
+                            p->p_code[i].i_op != EX_JZ &&
+                            p->p_code[i].i_op != EX_JMP)
+                                c->c_vary[p->p_code[i].i_dst] = 1;
+                }
+        }
+        *res = dst;
+        return (eptr);
+}
+
+/*
+ * ex_compfunc -- compile a function call
+ */
+static struct ex_ex *
+ex_compfunc(t_excomp *c, struct ex_ex *eptr, int *res, int hint)
+{
+        t_exprog *p = c->c_prog;
+        t_ex_func *f = (t_ex_func *)eptr->ex_ptr;
+        struct ex_ex *node = eptr;
+        int args[MAX_ARGS], i, anyvec = 0, allconst = 1, vary, pure, dst, off;
+
+        if (!f || !f->f_name || f->f_argc > MAX_ARGS)
+                return (exNULL);
+        if (f->f_func == (void (*))ex_if)
+                return (ex_compif(c, eptr + 1, res, hint));
+        pure = strcmp(f->f_name, "random");
+        vary = !pure;
+        for (eptr++, i = 0; i < f->f_argc; i++) {
+                if (!(eptr = ex_comp(c, eptr, &args[i], -1)))
+                        return (exNULL);
+                if (EX_ISVEC(args[i]))
+                        anyvec = 1, allconst = 0;
+                else {
+                        allconst &= c->c_const[args[i]];
+                        vary |= c->c_vary[args[i]];
+                }
+        }
+        off = p->p_nargs;
+        if (!ex_grow(&p->p_args, &c->c_maxargs, off + f->f_argc, sizeof (int)))
+                return (exNULL);
+        memcpy(p->p_args + off, args, f->f_argc * sizeof (int));
+        p->p_nargs += f->f_argc;
+        if (anyvec) {
+                for (i = 0; i < f->f_argc; i++)
+                        ex_freevec(c, args[i]);
+                if ((dst = (hint >= 0 ? hint : ex_newvec(c, EX_VTMP))) < 0 ||
+                    ex_emit(c, EX_CALL, ~dst, off, 0, 0, node, 1) < 0)
+                        return (exNULL);
+                *res = ~dst;
+                return (eptr);
+        }
+        if ((dst = ex_newreg(c, 0, vary)) < 0 ||
+            ex_emit(c, EX_CALL, dst, off, 0, 0, node, vary) < 0)
+                return (exNULL);
+        if (allconst && pure)
+                ex_fold(c);
+        *res = dst;
+        return (eptr);
+}
+
+/*
+ * ex_comp -- compile the expression at eptr, returning the node after it
+ *            or exNULL if it can't be compiled; *res is set to the register
+ *            holding its value, and if it is a vector, the vector register
+ *            hint is used for it if not -1
+ */
+static struct ex_ex *
+ex_comp(t_excomp *c, struct ex_ex *eptr, int *res, int hint)
+{
+        t_exprog *p = c->c_prog;
+        int eo, a, b, k;
+        long v;
+
+        switch (eptr->ex_type) {
+        case ET_INT:
+        case ET_FLT:
+                if ((*res = ex_constreg(c, eptr)) < 0)
+                        return (exNULL);
+                return (eptr + 1);
+        case ET_II:
+        case ET_FI:
+                if (eptr->ex_int == -1)
+                        return (exNULL);
+                k = (eptr->ex_type == ET_II ? ET_INT : ET_FLT);
+                if ((*res = ex_newreg(c, k, 0)) < 0 ||
+                    ex_emit(c, (k == ET_INT ? EX_LDI : EX_LDF), *res,
+                                        (int)eptr->ex_int, 0, 0, 0, 0) < 0)
+                        return (exNULL);
+                return (eptr + 1);
+        case ET_VI:
+                if (!c->c_vector)
+                        return (exNULL);
+                k = (int)eptr->ex_int;
+                if (!c->c_inlet[k] &&
+                    (c->c_inlet[k] = ex_newvec(c, k)) < 0)
+                        return (exNULL);
+                *res = ~c->c_inlet[k];
+                return (eptr + 1);
+        case ET_XI0:
+        case ET_YOM1:
+                if (!c->c_filter || (eptr->ex_type == ET_YOM1 &&
+                    eptr->ex_int >= c->c_expr->exp_nexpr))
+                        return (exNULL);
+                if ((*res = ex_newreg(c, ET_FLT, 1)) < 0 ||
+                    ex_emit(c, (eptr->ex_type == ET_XI0 ? EX_LDX0 : EX_LDY1),
+                                *res, (int)eptr->ex_int, 0, 0, 0, 1) < 0)
+                        return (exNULL);
+                return (eptr + 1);
+        case ET_XI:
+        case ET_YO:
+                if (!c->c_filter)
+                        return (exNULL);
+                {
+                        struct ex_ex *node = eptr;
+
+                        if (!(eptr = ex_comp(c, eptr + 1, &a, -1)) ||
+                            EX_ISVEC(a) || (*res = ex_newreg(c, ET_FLT, 1)) < 0)
+                                return (exNULL);
+                        v = (c->c_const[a] && c->c_type[a] == ET_INT ?
+                                                p->p_reg[a].ex_int : 1);
+                        if (node->ex_type == ET_XI ? v <= 0 && v > -0x10000 :
+                            v < 0 && v > -0x10000 &&
+                            node->ex_int < c->c_expr->exp_nexpr)
+                                k = ex_emit(c, (node->ex_type == ET_XI ?
+                                        EX_LDX : EX_LDY), *res,
+                                            (int)node->ex_int, (int)v, 0,
+                                                node, 1);
+                        else k = ex_emit(c, EX_SIGIDX, *res, a, 0, 0, node, 1);
+                        return (k < 0 ? exNULL : eptr);
+                }
+        case ET_FUNC:
+                return (ex_compfunc(c, eptr, res, hint));
+        case ET_OP:
+                if ((eo = ex_opindex(eptr->ex_op)) < 0)
+                        return (exNULL);
+                if (!(eptr = ex_comp(c, eptr + 1, &a, -1)))
+                        return (exNULL);
+                if (eo >= EO_NOT)
+                        return (ex_compun(c, eo, a, hint, res) ?
+                                                        eptr : exNULL);
+                if (!(eptr = ex_comp(c, eptr, &b, -1)))
+                        return (exNULL);
+                return (ex_compbin(c, eo, a, b, hint, res) ? eptr : exNULL);
+        default:
+                /* tables, variables, symbols */
+                return (exNULL);
+        }
+}
+
+/*
+ * ex_hoist -- for fexpr~ move the instructions that don't vary from sample
+ *             to sample to the beginning, to be run once per block
+ */
+static int
+ex_hoist(t_excomp *c)
+{
+        t_exprog *p = c->c_prog;
+        struct ex_instr *code;
+        int i, n = 0;
+
+        if (!p->p_ncode)
+                return (1);
+        if (!(code = (struct ex_instr *)fts_malloc(p->p_ncode *
+                                                sizeof (struct ex_instr))))
+                return (0);
+        for (i = 0; i < p->p_ncode; i++)
+                if (!c->c_ivary[i])
+                        code[n++] = p->p_code[i];
+        p->p_npre = n;
+        for (i = 0; i < p->p_ncode; i++)
+                if (c->c_ivary[i])
+                        code[n++] = p->p_code[i];
+        memcpy(p->p_code, code, p->p_ncode * sizeof (struct ex_instr));
+        fts_free(code);
+        return (1);
+}
+
+/*
+ * ex_compile -- compile the expression whose prefix stack is at eptr;
+ *               returns 0 if it has to be evaluated by ex_eval() instead
+ */
+t_exprog *
+ex_compile(t_expr *expr, struct ex_ex *eptr)
+{
+        t_excomp c;
+        t_exprog *p;
+        int res, ok = 0;
+
+        if (!eptr || !(p = (t_exprog *)fts_calloc(1, sizeof (t_exprog))))
+                return (0);
+        memset(&c, 0, sizeof (c));
+        c.c_expr = expr;
+        c.c_prog = p;
+        c.c_vector = IS_EXPR_TILDE(expr);
+        c.c_filter = IS_FEXPR_TILDE(expr);
+        if (c.c_vector && ex_newvec(&c, EX_VOUT) < 0)
+                goto done;
+        if (!ex_comp(&c, eptr, &res, (c.c_vector ? 0 : -1)))
+                goto done;
+        if (c.c_vector) {
+                if (!EX_ISVEC(res)) {
+                        if (ex_emit(&c, EX_VSET, 0, res, 0, 0, 0, 1) < 0)
+                                goto done;
+                } else if (EX_VREG(res) != 0 &&
+                    ex_emit(&c, EX_VMOVE, 0, EX_VREG(res), 0, 0, 0, 1) < 0)
+                        goto done;
+        } else p->p_res = res;
+        if (c.c_filter && !ex_hoist(&c))
+                goto done;
+        ok = 1;
+done:
+        if (c.c_type) fts_free(c.c_type);
+        if (c.c_const) fts_free(c.c_const);
+        if (c.c_vary) fts_free(c.c_vary);
+        if (c.c_ivary) fts_free(c.c_ivary);
+        if (c.c_free) fts_free(c.c_free);
+        if (!ok) {
+                ex_progfree(p);
+                return (0);
+        }
+        return (p);
+}
+
+/*
+ * ex_progdsp -- called from expr_dsp(): point the vector registers at the
+ *               inlets and (re)allocate the temporary ones for the block
+ *               size; the output is set by the caller each time it is run
+ */
+void
+ex_progdsp(t_expr *expr, t_exprog *prog)
+{
+        int i;
+
+        for (i = 0; i < prog->p_nvec; i++) {
+                if (prog->p_vecin[i] >= 0)
+                        prog->p_vec[i] = expr->exp_var[prog->p_vecin[i]].ex_vec;
+                else if (prog->p_vecin[i] == EX_VTMP &&
+                    (!prog->p_vec[i] || prog->p_vsize != expr->exp_vsize)) {
+                        if (prog->p_vec[i])
+                                fts_free(prog->p_vec[i]);
+                        prog->p_vec[i] = (t_float *)
+                                fts_calloc(expr->exp_vsize, sizeof (t_float));
+                }
+        }
+        prog->p_vsize = expr->exp_vsize;
+}
+
+/*
+ * ex_progfree -- free a compiled expression
+ */
+void
+ex_progfree(t_exprog *prog)
+{
+        int i;
+
+        for (i = 0; i < prog->p_nvec; i++)
+                if (prog->p_vecin[i] == EX_VTMP && prog->p_vec[i])
+                        fts_free(prog->p_vec[i]);
+        if (prog->p_code) fts_free(prog->p_code);
+        if (prog->p_reg) fts_free(prog->p_reg);
+        if (prog->p_vec) fts_free(prog->p_vec);
+        if (prog->p_vecin) fts_free(prog->p_vecin);
+        if (prog->p_args) fts_free(prog->p_args);
+        fts_free(prog);
+}
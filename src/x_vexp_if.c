@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "x_vexp.h"
 
@@ -147,9 +148,12 @@ expr_ff(t_expr *x)
 #endif
                 y = x->exp_proxy;
         }
-        for (i = 0 ; i < x->exp_nexpr; i++)
+        for (i = 0 ; i < x->exp_nexpr; i++) {
                 if (x->exp_stack[i])
                         fts_free(x->exp_stack[i]);
+                if (x->exp_prog[i])
+                        ex_progfree(x->exp_prog[i]);
+        }
 /*
  * SDY free all the allocated buffers here for expr~ and fexpr~
  * check to see if there are others
@@ -200,7 +204,11 @@ expr_bang(t_expr *x)
                 return;
 
         for (i = x->exp_nexpr - 1; i > -1 ; i--) {
-                if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
+                if (x->exp_prog[i]) {
+                        ex_progrun(x, x->exp_prog[i], 0, 0);
+                        x->exp_res[i] =
+                                x->exp_prog[i]->p_reg[x->exp_prog[i]->p_res];
+                } else if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
                         /*fprintf(stderr,"expr_bang(error evaluation)\n"); */
                 /*  SDY now that we have multiple ones, on error we should
                  * continue
@@ -285,6 +293,7 @@ Nexpr_new(t_symbol *s, int ac, t_atom *av)
         x->exp_error = 0;
         for (i = 0; i < MAX_VARS; i++) {
                 x->exp_stack[i] = (struct ex_ex *)0;
+                x->exp_prog[i] = (t_exprog *)0;
                 x->exp_outlet[i] = (t_outlet *)0;
                 x->exp_res[i].ex_type = 0;
                 x->exp_res[i].ex_int = 0;
@@ -307,6 +316,8 @@ SDY the following coredumps why?
 */
                 return (0);
         }
+        for (i = 0; i < x->exp_nexpr; i++)
+                x->exp_prog[i] = ex_compile(x, x->exp_stack[i]);
 
         ninlet = 1;
         for (i = 0, eptr = x->exp_var; i < MAX_VARS ; i++, eptr++)
@@ -422,13 +433,22 @@ expr_perform(t_int *w)
                  * the data because, outputs could be the same buffer as
                  * inputs
                  */
-                if ( x->exp_nexpr == 1)
-                        ex_eval(x, x->exp_stack[0], &x->exp_res[0], 0);
-                else {
+                if ( x->exp_nexpr == 1) {
+                        if (x->exp_prog[0]) {
+                                x->exp_prog[0]->p_vec[0] =
+                                                x->exp_res[0].ex_vec;
+                                ex_progrun(x, x->exp_prog[0], 0, 0);
+                        } else
+                                ex_eval(x, x->exp_stack[0], &x->exp_res[0], 0);
+                } else {
                         res.ex_type = ET_VEC;
                         for (i = 0; i < x->exp_nexpr; i++) {
                                 res.ex_vec = x->exp_tmpres[i];
-                                ex_eval(x, x->exp_stack[i], &res, 0);
+                                if (x->exp_prog[i]) {
+                                        x->exp_prog[i]->p_vec[0] = res.ex_vec;
+                                        ex_progrun(x, x->exp_prog[i], 0, 0);
+                                } else
+                                        ex_eval(x, x->exp_stack[i], &res, 0);
                         }
                         n = x->exp_vsize * sizeof(t_float);
                         for (i = 0; i < x->exp_nexpr; i++)
@@ -447,10 +467,18 @@ expr_perform(t_int *w)
          * since the output buffer could be the same as one of the inputs
          * we need to keep the output in  a different buffer
          */
+        for (j = 0; j < x->exp_nexpr; j++)
+                if (x->exp_prog[j])
+                        ex_progrun(x, x->exp_prog[j], 1, 0);
         for (i = 0; i < x->exp_vsize; i++) for (j = 0; j < x->exp_nexpr; j++) {
-                res.ex_type = 0;
-                res.ex_int = 0;
-                ex_eval(x, x->exp_stack[j], &res, i);
+                if (x->exp_prog[j]) {
+                        ex_progrun(x, x->exp_prog[j], 0, i);
+                        res = x->exp_prog[j]->p_reg[x->exp_prog[j]->p_res];
+                } else {
+                        res.ex_type = 0;
+                        res.ex_int = 0;
+                        ex_eval(x, x->exp_stack[j], &res, i);
+                }
                 switch (res.ex_type) {
                 case ET_INT:
                         x->exp_tmpres[j][i] = (t_float) res.ex_int;
@@ -515,6 +543,10 @@ expr_dsp(t_expr *x, t_signal **sp)
                 abort();
         }
 
+        for (i = 0; i < x->exp_nexpr; i++)
+                if (x->exp_prog[i])
+                        ex_progdsp(x, x->exp_prog[i]);
+
         dsp_add(expr_perform, 1, (t_int *) x);
 
         /*
@@ -781,12 +813,267 @@ fexpr_tilde_clear(t_expr *x, t_symbol *s, int argc, t_atom *argv)
 
 #ifdef PD
 
+#ifdef PD_BENCHMARKS
+/*
+ * "pd expr-benchmark": time the compiled expressions against ex_eval()
+ * on some typical expr~, fexpr~ and expr objects and check they agree
+ */
+#define EXPRBENCH_N     64
+#define EXPRBENCH_REPS  20000
+
+static const char *exprbench_text[] = {
+        "expr~ $v1*$v2+$v3",
+        "expr~ sin($v1*6.28)*0.5+$f4",
+        "expr~ if($v1>0, $v1, -$v1*0.5)",
+        "expr~ ($v1-$v2)/($v1+$v2)",
+        "fexpr~ $x1*0.1+$y1*0.9",
+        "fexpr~ $x1-$x1[-1]+0.995*$y1",
+        "fexpr~ 0.2*$x1+0.3*$x1[-1]+0.2*$x1[-2]+0.5*$y1-0.2*$y1[-2]",
+        "fexpr~ if($x1>$y1, $x1, $y1*0.999)",
+        "fexpr~ $x1*$f2+$y1*(1-$f2)",
+        "expr $f1*2+$f2",
+        "expr sqrt($f1*$f1+$f2*$f2)",
+        "expr if($f1>$f2, $f1-$f2, $f2-$f1)",
+        "expr $i1%7+($i2<<2)",
+        0
+};
+
+/*
+ * exprbench_run -- run x once, for expr~ and fexpr~ one block
+ */
+static void
+exprbench_run(t_expr *x)
+{
+        t_int w[2];
+        int i;
+
+        if (IS_EXPR(x)) {
+                for (i = 0; i < x->exp_nexpr; i++)
+                        if (x->exp_prog[i]) {
+                                ex_progrun(x, x->exp_prog[i], 0, 0);
+                                x->exp_res[i] =
+                                    x->exp_prog[i]->p_reg[x->exp_prog[i]->p_res];
+                        } else
+                                ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0);
+        } else {
+                w[0] = 0;
+                w[1] = (t_int)x;
+                expr_perform(w);
+        }
+}
+
+/*
+ * exprbench_reset -- forget the past of an fexpr~, so that two runs agree
+ */
+static void
+exprbench_reset(t_expr *x)
+{
+        int i, n = x->exp_vsize * sizeof (t_float);
+
+        for (i = 0; i < x->exp_nexpr; i++) {
+                memset(x->exp_p_res[i], 0, n);
+                memset(x->exp_tmpres[i], 0, n);
+        }
+        for (i = 0; i < MAX_VARS; i++)
+                memset(x->exp_p_var[i], 0, n);
+}
+
+/*
+ * exprbench_new -- make the object for "text", with its inlets reading
+ *                  from "in" and, for expr~ and fexpr~, its first outlet
+ *                  writing to "out"
+ */
+static t_expr *
+exprbench_new(t_binbuf *b, const char *text, t_float in[3][EXPRBENCH_N],
+    t_float *out)
+{
+        t_expr *x;
+        int i, nin;
+
+        binbuf_text(b, text, strlen(text));
+        if (!(x = expr_new(atom_getsymbol(binbuf_getvec(b)),
+            binbuf_getnatom(b) - 1, binbuf_getvec(b) + 1)))
+                return (0);
+        x->exp_vsize = EXPRBENCH_N;
+        for (i = nin = 0; i < MAX_VARS; i++) {
+                switch (x->exp_var[i].ex_type) {
+                case ET_II:
+                        x->exp_var[i].ex_int = 3 + i;
+                        break;
+                case ET_FI:
+                        x->exp_var[i].ex_flt = 0.25 * (i + 1);
+                        break;
+                case ET_VI:
+                case ET_XI:
+                        x->exp_var[i].ex_vec = in[nin++ % 3];
+                        break;
+                default:
+                        if (!i)
+                                x->exp_var[i].ex_vec = in[nin++ % 3];
+                }
+        }
+        if (!IS_EXPR(x)) {
+                x->exp_res[0].ex_type = ET_VEC;
+                x->exp_res[0].ex_vec = out;
+        }
+        return (x);
+}
+
+/*
+ * exprbench_diff -- run two blocks with ex_eval() and two with the compiled
+ *                   programs "prog" (so that fexpr~ uses the past), and
+ *                   return the largest difference in the first outlet,
+ *                   relative to the value if that's more than one
+ */
+static double
+exprbench_diff(t_expr *x, t_exprog **prog, t_float out[2][EXPRBENCH_N])
+{
+        double maxdiff = 0, diff;
+        int i, j;
+
+        for (j = 0; j < 2; j++) {
+                exprbench_reset(x);
+                for (i = 0; i < x->exp_nexpr; i++)
+                        x->exp_prog[i] = (j ? prog[i] : 0);
+                if (!IS_EXPR(x))
+                        x->exp_res[0].ex_vec = out[j];
+                exprbench_run(x);
+                exprbench_run(x);
+                if (IS_EXPR(x))
+                        out[j][0] = (x->exp_res[0].ex_type == ET_INT ?
+                                (t_float)x->exp_res[0].ex_int :
+                                        x->exp_res[0].ex_flt);
+        }
+        for (i = 0; i < (IS_EXPR(x) ? 1 : EXPRBENCH_N); i++) {
+                diff = fabs(out[0][i] - out[1][i]);
+                if (fabs(out[0][i]) > 1)
+                        diff /= fabs(out[0][i]);
+                if (diff > maxdiff)
+                        maxdiff = diff;
+        }
+        return (maxdiff);
+}
+
+static void
+exprbench_input(t_float in[3][EXPRBENCH_N])
+{
+        int i;
+
+        for (i = 0; i < EXPRBENCH_N; i++) {
+                in[0][i] = sin(i * 0.3);
+                in[1][i] = ((i * 1103515245u + 12345) & 0xffff) / 32768. - 1;
+                in[2][i] = (t_float)i / EXPRBENCH_N;
+        }
+}
+
+/*
+ * more expressions for the self-test, to cover the other operators and
+ * the functions the compiler handles
+ */
+static const char *exprtest_text[] = {
+        "expr~ min($v1, $v2)+max($v2, $v3)*pow(abs($v3), 2)",
+        "expr~ fmod($v1*10, 3)+int($v2*5)-rint($v3*4)",
+        "expr~ ($v1>0)&&($v2<0.5)||!($v3>=0.25)",
+        "expr~ ($v1==$v2)+($v1!=$v3)-($v2<=$v3)",
+        "fexpr~ $x1[-1]*$f2-$y1[-1]*0.5",
+        "expr $f1/3+$i2/2-$i3%3",
+        "expr ($i1&6)|($i2^5)>>1",
+        "expr ~$i1+($i2<<3)-$f3*-1",
+        0
+};
+
+#define EXPRTEST_MAXDIFF 1e-5
+
+/*
+ * expr_selftest -- check that compiled expressions agree with ex_eval(),
+ *                  allowing for an ulp or so in vector division
+ */
+int
+expr_selftest(void)
+{
+        static t_float in[3][EXPRBENCH_N], out[2][EXPRBENCH_N];
+        static const char **texts[2] = {exprbench_text, exprtest_text};
+        t_exprog *prog[MAX_VARS];
+        t_binbuf *b = binbuf_new();
+        t_expr *x;
+        int i, j, k, nbad = 0;
+        double diff;
+
+        exprbench_input(in);
+        for (j = 0; j < 2; j++)
+                for (k = 0; texts[j][k]; k++) {
+                        if (!(x = exprbench_new(b, texts[j][k], in,
+                            out[0]))) {
+                                pd_error(0, "expr self-test: couldn't make %s",
+                                        texts[j][k]);
+                                nbad++;
+                                continue;
+                        }
+                        for (i = 0; i < x->exp_nexpr; i++)
+                                if ((prog[i] = x->exp_prog[i]))
+                                        ex_progdsp(x, prog[i]);
+                        if ((diff = exprbench_diff(x, prog, out)) >
+                            EXPRTEST_MAXDIFF) {
+                                pd_error(0, "expr self-test: %s: "
+                                        "compiled version differs by %g (%s)",
+                                        texts[j][k], diff, ex_compisa());
+                                nbad++;
+                        }
+                        pd_free(&x->exp_ob.ob_pd);
+                }
+        binbuf_free(b);
+        return (nbad);
+}
+
+void
+glob_exprbenchmark(void *dummy)
+{
+        static t_float in[3][EXPRBENCH_N], out[2][EXPRBENCH_N];
+        t_exprog *prog[MAX_VARS];
+        t_binbuf *b = binbuf_new();
+        t_expr *x;
+        int i, j, k, ncompiled;
+
+        exprbench_input(in);
+        post("expr-benchmark: speedup of compiled expressions (%s) over "
+                "ex_eval(), largest relative difference", ex_compisa());
+        for (k = 0; exprbench_text[k]; k++) {
+                double t1, t2, t3, maxdiff;
+
+                if (!(x = exprbench_new(b, exprbench_text[k], in, out[0])))
+                        continue;
+                for (i = ncompiled = 0; i < x->exp_nexpr; i++)
+                        if ((prog[i] = x->exp_prog[i])) {
+                                ex_progdsp(x, prog[i]);
+                                ncompiled++;
+                        }
+                t1 = sys_getrealtime();
+                for (j = 0; j < EXPRBENCH_REPS; j++)
+                        exprbench_run(x);
+                t2 = sys_getrealtime();
+                for (i = 0; i < x->exp_nexpr; i++)
+                        x->exp_prog[i] = 0;
+                for (j = 0; j < EXPRBENCH_REPS; j++)
+                        exprbench_run(x);
+                t3 = sys_getrealtime();
+                maxdiff = exprbench_diff(x, prog, out);
+                if (ncompiled)
+                        post("%-60s%8.2f%12g", exprbench_text[k],
+                                (t2 > t1 ? (t3 - t2) / (t2 - t1) : 0), maxdiff);
+                else post("%-60s not compiled", exprbench_text[k]);
+                pd_free(&x->exp_ob.ob_pd);
+        }
+        binbuf_free(b);
+}
+#endif /* PD_BENCHMARKS */
+
 void
 expr_setup(void)
 {
         /*
          * expr initialization
          */
+        ex_compsetup();
         expr_class = class_new(gensym("expr"), (t_newmethod)expr_new,
             (t_method)expr_ff, sizeof(t_expr), 0, A_GIMME, 0);
         class_addlist(expr_class, expr_list);